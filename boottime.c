@@ -18,40 +18,36 @@
 
 #include <libprom/prom.h>
 
+#include "expo.h"
 #include "boottime.h"
 
-static char *boot_time;		// node_boot_time_seconds 1.741802979e+09
+// node_boot_time_seconds 1741802979: -1 .. not yet read, -2 .. n/a
+static int64_t boot_time = -1;
 
 static void
-buildMetric(psb_t *sb, bool compact) {
+readBootTime(bool compact) {
 	kstat_ctl_t *kc;
 	kstat_t *ksp;
 	kid_t kid;
 	kstat_named_t *knp;
 
-	size_t sz;
 	char *buf;
 
-	sz = psb_len(sb);
-	if (!compact)
-		addPromInfo(SOLMEXM_BOOTTIME);
+	boot_time = -2;
 	while ((kc = kstat_open()) == NULL) {
 		if (errno == EAGAIN) {
 			(void) poll(NULL, 0, 200);
 		} else {
 			buf = strerror(errno);
 			PROM_WARN("Unable to access kstats: %s", buf)
-			break;
+			return;
 		}
 	}
-	if (kc == NULL) {
-		psb_truncate(sb, sz);
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
-	} else if ((ksp = kstat_lookup(kc, "unix", -1, "system_misc")) == NULL) {
+	if ((ksp = kstat_lookup(kc, "unix", -1, "system_misc")) == NULL) {
 #pragma GCC diagnostic pop
 		PROM_WARN("kstat unix:0:system_misc n/a", "")
-		psb_truncate(sb, sz);
 	} else {
 		while ((kid = kstat_read(kc, ksp, NULL)) == -1) {
 			if (errno == EAGAIN) {
@@ -62,13 +58,12 @@ buildMetric(psb_t *sb, bool compact) {
 				break;
 			}
 		}
-		if (kid == -1) {
-			psb_truncate(sb, sz);
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+		if (kid == -1) {
+			// already reported
 		} else if ((knp = kstat_data_lookup(ksp, "boot_time")) != NULL) {
 #pragma GCC diagnostic pop
-			char val[32];	// 16 is sufficient for the next ~80 years
 			uint64_t v = 0;
 			if (knp->data_type == KSTAT_DATA_UINT32) {
 				v = knp->value.ui32;
@@ -81,19 +76,12 @@ buildMetric(psb_t *sb, bool compact) {
 			} else {
 				PROM_WARN("Unexpected boot_time data_type %d", knp->data_type);
 			}
-			snprintf(val, sizeof(val), "%ld", v);
-			psb_add_str(sb, SOLMEXM_BOOTTIME_N " ");
-			psb_add_str(sb, val);
-			psb_add_char(sb, '\n');
+			boot_time = v;
 		} else if (!compact) {
 			PROM_WARN("kstat unix:0:system_misc:boot_time n/a", "");
-			psb_truncate(sb, sz);
 		}
 	}
-	if (kc != NULL)
-		kstat_close(kc);
-
-	boot_time = strdup(psb_str(sb) + sz);
+	kstat_close(kc);
 }
 
 void
@@ -104,10 +92,11 @@ collect_boottime(psb_t *sb, bool compact) {
 	if (free_sb)
 		sb = psb_new();
 
-	if (boot_time == NULL) {
-		buildMetric(sb, compact);
-	} else if (boot_time[0] != '\0') {
-		psb_add_str(sb, boot_time);
+	if (boot_time == -1)
+		readBootTime(compact);
+	if (boot_time >= 0) {
+		addExpoInfo(SOLMEXM_BOOTTIME);
+		expo_emit_int(sb, SOLMEXM_BOOTTIME_N, NULL, boot_time);
 	}
 
 	if (free_sb) {
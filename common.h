@@ -64,6 +64,20 @@ extern uint64_t tps;
 	psb_add_char(sb, '\n');\
 }
 
+/** Append the given label value to `b` escaping '\\', '"' and newlines. */
+static inline void
+addLabelValue(psb_t *b, const char *s) {
+	for (; *s != '\0'; s++) {
+		if (*s == '\n') {
+			psb_add_str(b, "\\n");
+			continue;
+		}
+		if (*s == '"' || *s == '\\')
+			psb_add_char(b, '\\');
+		psb_add_char(b, *s);
+	}
+}
+
 #define SOLMEXM_VERS_D "Software version information."
 #define SOLMEXM_VERS_T "gauge"
 #define SOLMEXM_VERS_N "solmex_version"
@@ -1364,6 +1378,285 @@ kstat cpu:0:vm | tail +3 | awk -v P='#define SOLMEX_VM_' -v NP='solmex_node_vm_'
 
 #define SOLMEX_FS_NAME_PREFIX "solmex_node_fs_"
 
+
+// kstat -c kmem_cache unix:0: selection
+#define SOLMEX_KMEM_NAME_PREFIX "solmex_node_kmem_"
+
+#define SOLMEX_KMEM_MEM_INUSE_D "Memory in use by the buffers of the cache (buf_inuse * buf_size)"
+#define SOLMEX_KMEM_MEM_INUSE_T "gauge"
+#define SOLMEX_KMEM_MEM_INUSE_N solmex_node_kmem_inuse_bytes
+
+#define SOLMEX_KMEM_BUF_SIZE_D "Size of a single buffer of the cache"
+#define SOLMEX_KMEM_BUF_SIZE_T "gauge"
+#define SOLMEX_KMEM_BUF_SIZE_N solmex_node_kmem_buf_size_bytes
+
+#define SOLMEX_KMEM_BUF_INUSE_D "Buffers currently allocated from the cache"
+#define SOLMEX_KMEM_BUF_INUSE_T "gauge"
+#define SOLMEX_KMEM_BUF_INUSE_N solmex_node_kmem_buf_inuse
+
+#define SOLMEX_KMEM_BUF_TOTAL_D "Buffers currently owned by the cache (in use + free)"
+#define SOLMEX_KMEM_BUF_TOTAL_T "gauge"
+#define SOLMEX_KMEM_BUF_TOTAL_N solmex_node_kmem_buf_total
+
+#define SOLMEX_KMEM_SLAB_CREATE_D "Slabs created by the cache"
+#define SOLMEX_KMEM_SLAB_CREATE_T "counter"
+#define SOLMEX_KMEM_SLAB_CREATE_N solmex_node_kmem_slab_create
+
+#define SOLMEX_KMEM_SLAB_DESTROY_D "Slabs destroyed by the cache"
+#define SOLMEX_KMEM_SLAB_DESTROY_T "counter"
+#define SOLMEX_KMEM_SLAB_DESTROY_N solmex_node_kmem_slab_destroy
+
+#define SOLMEX_KMEM_ALLOC_FAIL_D "Failed buffer allocations of the cache"
+#define SOLMEX_KMEM_ALLOC_FAIL_T "counter"
+#define SOLMEX_KMEM_ALLOC_FAIL_N solmex_node_kmem_alloc_fail
+
+#define SOLMEXM_KMEM_CACHES_D "Number of kmem caches found on the last full scan"
+#define SOLMEXM_KMEM_CACHES_T "gauge"
+#define SOLMEXM_KMEM_CACHES_N "solmex_node_kmem_caches"
+
+// nfs:0:{rfsproccnt_v*,rfsreqcnt_v*,nfs_server,nfs_client} and
+// unix:0:rpc_{cots,clts}_{server,client} selection
+#define SOLMEX_NFS_NAME_PREFIX "solmex_node_nfs_"
+#define SOLMEX_RPC_NAME_PREFIX "solmex_node_rpc_"
+
+#define SOLMEX_NFS_SERVER_OPS_D "Server side NFS operations processed by version and op (rfsproccnt_v*)"
+#define SOLMEX_NFS_SERVER_OPS_T "counter"
+#define SOLMEX_NFS_SERVER_OPS_N solmex_node_nfs_server_ops
+
+#define SOLMEX_NFS_CLIENT_OPS_D "Client side NFS operation requests sent by version and op (rfsreqcnt_v*)"
+#define SOLMEX_NFS_CLIENT_OPS_T "counter"
+#define SOLMEX_NFS_CLIENT_OPS_N solmex_node_nfs_client_ops
+
+// see  etc/kstat2solmex.sh -t nfs
+// (#) .. nfs_server #
+#define SOLMEX_NFS_SRV_BADCALLS_D "NFS calls rejected by the server"
+#define SOLMEX_NFS_SRV_BADCALLS_T "counter"
+#define SOLMEX_NFS_SRV_BADCALLS_N solmex_node_nfs_server_badcalls
+
+#define SOLMEX_NFS_SRV_CALLS_D "NFS calls received by the server"
+#define SOLMEX_NFS_SRV_CALLS_T "counter"
+#define SOLMEX_NFS_SRV_CALLS_N solmex_node_nfs_server_calls
+
+#define SOLMEX_NFS_SRV_REFERLINKS_D "NFSv4 referral symlinks found by the server"
+#define SOLMEX_NFS_SRV_REFERLINKS_T "counter"
+#define SOLMEX_NFS_SRV_REFERLINKS_N solmex_node_nfs_server_referlinks
+
+#define SOLMEX_NFS_SRV_REFERRALS_D "NFSv4 referrals sent by the server"
+#define SOLMEX_NFS_SRV_REFERRALS_T "counter"
+#define SOLMEX_NFS_SRV_REFERRALS_N solmex_node_nfs_server_referrals
+
+// (#) .. nfs_client #
+#define SOLMEX_NFS_CLNT_BADCALLS_D "NFS calls of the client which failed"
+#define SOLMEX_NFS_CLNT_BADCALLS_T "counter"
+#define SOLMEX_NFS_CLNT_BADCALLS_N solmex_node_nfs_client_badcalls
+
+#define SOLMEX_NFS_CLNT_CALLS_D "NFS calls sent by the client"
+#define SOLMEX_NFS_CLNT_CALLS_T "counter"
+#define SOLMEX_NFS_CLNT_CALLS_N solmex_node_nfs_client_calls
+
+#define SOLMEX_NFS_CLNT_CLGETS_D "RPC client handles obtained by the NFS client"
+#define SOLMEX_NFS_CLNT_CLGETS_T "counter"
+#define SOLMEX_NFS_CLNT_CLGETS_N solmex_node_nfs_client_clgets
+
+#define SOLMEX_NFS_CLNT_CLTOOMANY_D "Times the NFS client ran out of cached RPC client handles"
+#define SOLMEX_NFS_CLNT_CLTOOMANY_T "counter"
+#define SOLMEX_NFS_CLNT_CLTOOMANY_N solmex_node_nfs_client_cltoomany
+
+// (#) .. rpc_{cots,clts}_server #
+#define SOLMEX_RPC_SRV_BADCALLS_D "RPC calls rejected by transport"
+#define SOLMEX_RPC_SRV_BADCALLS_T "counter"
+#define SOLMEX_RPC_SRV_BADCALLS_N solmex_node_rpc_server_badcalls
+
+#define SOLMEX_RPC_SRV_BADLEN_D "RPC requests too short by transport"
+#define SOLMEX_RPC_SRV_BADLEN_T "counter"
+#define SOLMEX_RPC_SRV_BADLEN_N solmex_node_rpc_server_badlen
+
+#define SOLMEX_RPC_SRV_CALLS_D "RPC calls received by transport"
+#define SOLMEX_RPC_SRV_CALLS_T "counter"
+#define SOLMEX_RPC_SRV_CALLS_N solmex_node_rpc_server_calls
+
+#define SOLMEX_RPC_SRV_DUPCHECKS_D "RPC requests checked against the duplicate request cache by transport"
+#define SOLMEX_RPC_SRV_DUPCHECKS_T "counter"
+#define SOLMEX_RPC_SRV_DUPCHECKS_N solmex_node_rpc_server_dupchecks
+
+#define SOLMEX_RPC_SRV_DUPREQS_D "Duplicate RPC requests found by transport"
+#define SOLMEX_RPC_SRV_DUPREQS_T "counter"
+#define SOLMEX_RPC_SRV_DUPREQS_N solmex_node_rpc_server_dupreqs
+
+#define SOLMEX_RPC_SRV_NULLRECV_D "Times no RPC request was available when expected by transport"
+#define SOLMEX_RPC_SRV_NULLRECV_T "counter"
+#define SOLMEX_RPC_SRV_NULLRECV_N solmex_node_rpc_server_nullrecv
+
+#define SOLMEX_RPC_SRV_XDRCALL_D "RPC requests which could not be decoded by transport"
+#define SOLMEX_RPC_SRV_XDRCALL_T "counter"
+#define SOLMEX_RPC_SRV_XDRCALL_N solmex_node_rpc_server_xdrcall
+
+// (#) .. rpc_{cots,clts}_client #
+#define SOLMEX_RPC_CLNT_BADCALLS_D "RPC calls which failed by transport"
+#define SOLMEX_RPC_CLNT_BADCALLS_T "counter"
+#define SOLMEX_RPC_CLNT_BADCALLS_N solmex_node_rpc_client_badcalls
+
+#define SOLMEX_RPC_CLNT_BADVERFS_D "RPC replies with an invalid verifier by transport"
+#define SOLMEX_RPC_CLNT_BADVERFS_T "counter"
+#define SOLMEX_RPC_CLNT_BADVERFS_N solmex_node_rpc_client_badverfs
+
+#define SOLMEX_RPC_CLNT_BADXIDS_D "RPC replies not matching any outstanding call by transport"
+#define SOLMEX_RPC_CLNT_BADXIDS_T "counter"
+#define SOLMEX_RPC_CLNT_BADXIDS_N solmex_node_rpc_client_badxids
+
+#define SOLMEX_RPC_CLNT_CALLS_D "RPC calls sent by transport"
+#define SOLMEX_RPC_CLNT_CALLS_T "counter"
+#define SOLMEX_RPC_CLNT_CALLS_N solmex_node_rpc_client_calls
+
+#define SOLMEX_RPC_CLNT_CANTCONN_D "Failed RPC connection attempts by transport"
+#define SOLMEX_RPC_CLNT_CANTCONN_T "counter"
+#define SOLMEX_RPC_CLNT_CANTCONN_N solmex_node_rpc_client_cantconn
+
+#define SOLMEX_RPC_CLNT_CANTSEND_D "Failed RPC send attempts by transport"
+#define SOLMEX_RPC_CLNT_CANTSEND_T "counter"
+#define SOLMEX_RPC_CLNT_CANTSEND_N solmex_node_rpc_client_cantsend
+
+#define SOLMEX_RPC_CLNT_INTERRUPTS_D "RPC calls interrupted by a signal by transport"
+#define SOLMEX_RPC_CLNT_INTERRUPTS_T "counter"
+#define SOLMEX_RPC_CLNT_INTERRUPTS_N solmex_node_rpc_client_interrupts
+
+#define SOLMEX_RPC_CLNT_NEWCREDS_D "RPC calls needing refreshed credentials by transport"
+#define SOLMEX_RPC_CLNT_NEWCREDS_T "counter"
+#define SOLMEX_RPC_CLNT_NEWCREDS_N solmex_node_rpc_client_newcreds
+
+#define SOLMEX_RPC_CLNT_NOMEM_D "RPC calls failed due to memory shortage by transport"
+#define SOLMEX_RPC_CLNT_NOMEM_T "counter"
+#define SOLMEX_RPC_CLNT_NOMEM_N solmex_node_rpc_client_nomem
+
+#define SOLMEX_RPC_CLNT_RETRANS_D "RPC calls retransmitted by transport"
+#define SOLMEX_RPC_CLNT_RETRANS_T "counter"
+#define SOLMEX_RPC_CLNT_RETRANS_N solmex_node_rpc_client_retrans
+
+#define SOLMEX_RPC_CLNT_TIMEOUTS_D "RPC calls timed out waiting for a reply by transport"
+#define SOLMEX_RPC_CLNT_TIMEOUTS_T "counter"
+#define SOLMEX_RPC_CLNT_TIMEOUTS_N solmex_node_rpc_client_timeouts
+
+#define SOLMEX_RPC_CLNT_TIMERS_D "RPC calls whose computed retransmit timeout was at least the min. timeout by transport"
+#define SOLMEX_RPC_CLNT_TIMERS_T "counter"
+#define SOLMEX_RPC_CLNT_TIMERS_N solmex_node_rpc_client_timers
+
+// mac_{rx,tx}_{ring,hwlane,swlane}N
+#define SOLMEX_RING_BYTES_D "Bytes transferred by the ring resp. lane of the NIC"
+#define SOLMEX_RING_BYTES_T "counter"
+#define SOLMEX_RING_BYTES_N solmex_node_net_ring_bytes
+
+#define SOLMEX_RING_PKTS_D "Packets transferred by the ring resp. lane of the NIC"
+#define SOLMEX_RING_PKTS_T "counter"
+#define SOLMEX_RING_PKTS_N solmex_node_net_ring_pkts
+
+#define SOLMEX_RING_DROPS_D "Packets dropped by the software lane of the NIC"
+#define SOLMEX_RING_DROPS_T "counter"
+#define SOLMEX_RING_DROPS_N solmex_node_net_ring_drops_pkts
+
+#define SOLMEX_RING_COUNT_D "Number of rings resp. lanes of the NIC"
+#define SOLMEX_RING_COUNT_T "gauge"
+#define SOLMEX_RING_COUNT_N solmex_node_net_rings
+
+// statvfs(2) of mnttab entries
+#define SOLMEX_FSU_NAME_PREFIX "solmex_node_filesystem_"
+
+#define SOLMEX_FSU_SIZE_D "Filesystem size in bytes (f_blocks * f_frsize)"
+#define SOLMEX_FSU_SIZE_T "gauge"
+#define SOLMEX_FSU_SIZE_N solmex_node_filesystem_size_bytes
+
+#define SOLMEX_FSU_FREE_D "Free filesystem space in bytes (f_bfree * f_frsize)"
+#define SOLMEX_FSU_FREE_T "gauge"
+#define SOLMEX_FSU_FREE_N solmex_node_filesystem_free_bytes
+
+#define SOLMEX_FSU_AVAIL_D "Filesystem space available to non-root users in bytes (f_bavail * f_frsize)"
+#define SOLMEX_FSU_AVAIL_T "gauge"
+#define SOLMEX_FSU_AVAIL_N solmex_node_filesystem_avail_bytes
+
+#define SOLMEX_FSU_FILES_D "Total number of file nodes (inodes)"
+#define SOLMEX_FSU_FILES_T "gauge"
+#define SOLMEX_FSU_FILES_N solmex_node_filesystem_files
+
+#define SOLMEX_FSU_FILES_FREE_D "Free file nodes (inodes)"
+#define SOLMEX_FSU_FILES_FREE_T "gauge"
+#define SOLMEX_FSU_FILES_FREE_N solmex_node_filesystem_files_free
+
+#define SOLMEX_FSU_STALE_D "1 if statvfs() did not answer in time and the last known values got emitted, 0 otherwise"
+#define SOLMEX_FSU_STALE_T "gauge"
+#define SOLMEX_FSU_STALE_N solmex_node_filesystem_stale
+
+// /proc/<pid>/{psinfo,usage}
+#define SOLMEXM_PROCS_D "Processes by zone and state (O .. on CPU, R .. runnable, S .. sleeping, T .. stopped, W .. waiting for CPU caps, Z .. zombie, I .. idle/being created)"
+#define SOLMEXM_PROCS_T "gauge"
+#define SOLMEXM_PROCS_N "solmex_node_procs"
+
+#define SOLMEXM_PROCS_PROJECT_D "Processes by zone and project ID"
+#define SOLMEXM_PROCS_PROJECT_T "gauge"
+#define SOLMEXM_PROCS_PROJECT_N "solmex_node_procs_project"
+
+#define SOLMEXM_PROC_TOP_CPU_D "CPU utilization (usr + sys) of the top-N processes since the last scrape, 1 == one CPU strand fully used"
+#define SOLMEXM_PROC_TOP_CPU_T "gauge"
+#define SOLMEXM_PROC_TOP_CPU_N "solmex_node_proc_top_cpu"
+
+#define SOLMEXM_PROC_TOP_RSS_D "Resident set size of the top-N processes in bytes"
+#define SOLMEXM_PROC_TOP_RSS_T "gauge"
+#define SOLMEXM_PROC_TOP_RSS_N "solmex_node_proc_top_rss_bytes"
+
+// /dev/arp mib2 TCP connection tables
+#define SOLMEXM_TCP_CONNS_D "IPv4 and IPv6 TCP endpoints by state and local port as of the last scan"
+#define SOLMEXM_TCP_CONNS_T "gauge"
+#define SOLMEXM_TCP_CONNS_N "solmex_node_tcp_conns"
+
+// background high resolution sampler of selected kstat fields
+#define SOLMEXM_HIRES_MIN_D "Min. value of the kstat field sampled since the last scrape"
+#define SOLMEXM_HIRES_MIN_T "gauge"
+#define SOLMEXM_HIRES_MIN_N "solmex_node_hires_min"
+
+#define SOLMEXM_HIRES_MAX_D "Max. value of the kstat field sampled since the last scrape"
+#define SOLMEXM_HIRES_MAX_T "gauge"
+#define SOLMEXM_HIRES_MAX_N "solmex_node_hires_max"
+
+#define SOLMEXM_HIRES_AVG_D "Average value of the kstat field sampled since the last scrape"
+#define SOLMEXM_HIRES_AVG_T "gauge"
+#define SOLMEXM_HIRES_AVG_N "solmex_node_hires_avg"
+
+#define SOLMEXM_HIRES_LAST_D "Last value of the kstat field sampled"
+#define SOLMEXM_HIRES_LAST_T "gauge"
+#define SOLMEXM_HIRES_LAST_N "solmex_node_hires_last"
+
+#define SOLMEXM_HIRES_SAMPLES_D "Number of samples of the kstat field taken since the last scrape"
+#define SOLMEXM_HIRES_SAMPLES_T "gauge"
+#define SOLMEXM_HIRES_SAMPLES_N "solmex_node_hires_samples"
+
+// *.prom files merged from the textfile directory
+#define SOLMEXM_TEXTFILE_ERROR_D "1 if the textfile could not be read, is invalid or contains metrics of another textfile, 0 otherwise"
+#define SOLMEXM_TEXTFILE_ERROR_T "gauge"
+#define SOLMEXM_TEXTFILE_ERROR_N "solmex_node_textfile_error"
+
+#define SOLMEXM_TEXTFILE_AGE_D "Seconds since the last modification of the textfile"
+#define SOLMEXM_TEXTFILE_AGE_T "gauge"
+#define SOLMEXM_TEXTFILE_AGE_N "solmex_node_textfile_age_seconds"
+
+// commands run by the exec plugin collector
+#define SOLMEXM_EXEC_DURATION_D "Runtime of the last run of the command in seconds"
+#define SOLMEXM_EXEC_DURATION_T "gauge"
+#define SOLMEXM_EXEC_DURATION_N "solmex_node_exec_duration_seconds"
+
+#define SOLMEXM_EXEC_STATUS_D "Exit status of the last run of the command, 128 + signal number if killed, -1 if not run yet or not startable"
+#define SOLMEXM_EXEC_STATUS_T "gauge"
+#define SOLMEXM_EXEC_STATUS_N "solmex_node_exec_exit_status"
+
+#define SOLMEXM_EXEC_ERROR_D "1 if the last run of the command failed, timed out or produced invalid output, or if its metrics are provided by a textfile or a preceding command, 0 otherwise"
+#define SOLMEXM_EXEC_ERROR_T "gauge"
+#define SOLMEXM_EXEC_ERROR_N "solmex_node_exec_error"
+
+#define SOLMEXM_EXEC_AGE_D "Seconds since the emitted output of the command has been produced, since solmex start if there is none yet"
+#define SOLMEXM_EXEC_AGE_T "gauge"
+#define SOLMEXM_EXEC_AGE_N "solmex_node_exec_age_seconds"
+
+#define SOLMEXM_PLUGIN_DURATION_D "Time spent in the collector of the plugin during this scrape in seconds"
+#define SOLMEXM_PLUGIN_DURATION_T "gauge"
+#define SOLMEXM_PLUGIN_DURATION_N "solmex_node_plugin_duration_seconds"
+
 /*
 #define SOLMEXM_XXX_D "short description."
 #define SOLMEXM_XXX_T "gauge"
@@ -11,11 +11,13 @@
 #include <kstat.h>
 #include <sys/loadavg.h>
 #include <rpcsvc/rstat.h>
+#include <errno.h>
 
 #include <libprom/prom.h>
 
 #include "cpu_speed.h"
 #include "ks_util.h"
+#include "expo.h"
 
 // usr/src/cmd/powertop/common/cpufreq.c
 // usr/src/cmd/cpc/common/cpustat.c
@@ -36,96 +38,82 @@ static ks_info_t kstat[KS_IDX_MAX] = {
 };
 #pragma GCC diagnostic pop
 
+#define LABEL_MAX 128	// {cpu="N",package="N",core="N",lid="N"}
+
 void
 collect_cpu_speed(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
 	bool include_max)
 {
 	kstat_t *ksp;
 	kstat_named_t *knp;
-	char buf[32];
-	size_t sb_pos, len;
-	uint64_t freq, freqmax;
-	static psb_t *sbmax = NULL;
-	bool found;
+	char *lbl;
+	int len;
+	int64_t freq;
+	static char *labels = NULL;		// LABEL_MAX bytes per strand
+	static int64_t *freqmax = NULL;
+	static int max_n = 0;
 
 	PROM_DEBUG("collect_cpu_speed ...", "");
 
-	uint8_t n = update_instance(kc, &kstat[KS_SPEED]);
+	int n = update_instance(kc, &kstat[KS_SPEED]);
 	if (n < 1)
 		return;
 
+	if (n > max_n) {
+		char *l = realloc(labels, n * LABEL_MAX);
+		int64_t *f = realloc(freqmax, n * sizeof(int64_t));
+		if (l != NULL)
+			labels = l;
+		if (f != NULL)
+			freqmax = f;
+		if (l == NULL || f == NULL) {
+			PROM_WARN("Memory problem in cpu_speed: %s", strerror(errno));
+			return;
+		}
+		max_n = n;
+	}
+
 	bool free_sb = sb == NULL;
 	if (free_sb)
 		sb = psb_new();
 
-	if (include_max) {
-		if (sbmax == NULL) {
-			sbmax = psb_new();
-		} else {
-			psb_truncate(sbmax, 0);
-		}
-	}
-
-	if (!compact) {
-		if (include_max) {
-			psb_t *sbtmp = sb;
-			sb = sbmax;
-			addPromInfo(SOLMEXM_CPUSPEEDMAX);
-			sb = sbtmp;
-		}
-		addPromInfo(SOLMEXM_CPUSPEED);
-	}
+	addExpoInfo(SOLMEXM_CPUSPEED);
 	for (int i = 0; i < n; i++) {
-		freq = freqmax = -1;
-		psb_add_str(sb, SOLMEXM_CPUSPEED_N "{");
-		sb_pos = psb_len(sb);
-		sprintf(buf, "cpu=\"%d\",", i);
-		psb_add_str(sb, buf);
-		found = false;
+		freq = freqmax[i] = -1;
+		lbl = labels + i * LABEL_MAX;
+		len = sprintf(lbl, "{cpu=\"%d\"", i);
 		if ((ksp = ks_read(kc, kstat[KS_SPEED].ksp[i], now, NULL)) != NULL) {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
-			if ((knp = kstat_data_lookup(ksp, "chip_id")) != NULL) {
-				sprintf(buf, "package=\"%ld\",", knp->value.i64);
-				psb_add_str(sb, buf);
-				found = true;
-			}
-			if ((knp = kstat_data_lookup(ksp, "core_id")) != NULL) {
-				sprintf(buf, "core=\"%ld\",", knp->value.i64);
-				psb_add_str(sb, buf);
-				found = true;
-			}
-			if ((knp = kstat_data_lookup(ksp, "clog_id")) != NULL) {
-				sprintf(buf, "lid=\"%d\",", knp->value.i32);
-				psb_add_str(sb, buf);
-				found = true;
-			}
+			if ((knp = kstat_data_lookup(ksp, "chip_id")) != NULL)
+				len += sprintf(lbl + len, ",package=\"%ld\"", knp->value.i64);
+			if ((knp = kstat_data_lookup(ksp, "core_id")) != NULL)
+				len += sprintf(lbl + len, ",core=\"%ld\"", knp->value.i64);
+			if ((knp = kstat_data_lookup(ksp, "clog_id")) != NULL)
+				len += sprintf(lbl + len, ",lid=\"%d\"", knp->value.i32);
 			if ((knp = kstat_data_lookup(ksp, "current_clock_Hz")) != NULL) {
 				freq = knp->value.ui64;
 			}
 			if (include_max && (knp = kstat_data_lookup(ksp, "supported_frequencies_Hz")) != NULL) {
 				char *s = KSTAT_NAMED_STR_PTR(knp);
 				char *t;
-				freqmax = (t = strrchr(s, ':')) == NULL ? atol(s) : atol(t+1);
-				found = true;
+				freqmax[i] = (t = strrchr(s, ':')) == NULL ? atol(s) : atol(t+1);
 			}
 #pragma GCC diagnostic pop
 		}
-		len = psb_len(sb);
-		if (found)
-			psb_truncate(sb, len -1);
-		if (include_max) {
-			psb_add_str(sbmax, SOLMEXM_CPUSPEEDMAX_N "{");
-			psb_add_str(sbmax, psb_str(sb) + sb_pos);
-			sprintf(buf, "} %ld\n", freqmax);
-			psb_add_str(sbmax, buf);
-		}
-		sprintf(buf, "} %ld\n", freq);
-		psb_add_str(sb, buf);
+		lbl[len++] = '}';
+		lbl[len] = '\0';
+		ks_emit_times(ksp);
+		expo_emit_int(sb, SOLMEXM_CPUSPEED_N, lbl, freq);
 	}
 
-	if (include_max)
-		psb_add_str(sb, psb_str(sbmax));
+	if (include_max) {
+		addExpoInfo(SOLMEXM_CPUSPEEDMAX);
+		ks_emit_times(NULL);	// constant
+		for (int i = 0; i < n; i++)
+			expo_emit_int(sb, SOLMEXM_CPUSPEEDMAX_N, labels + i * LABEL_MAX,
+				freqmax[i]);
+	}
 
 	if (free_sb) {
 		fprintf(stdout, "\n%s", psb_str(sb));
@@ -44,9 +44,11 @@ typedef enum cpu_sys_quantity {
  * 		Otherwise the sum over all CPU strands alias threads gets emitted,
  *		only.
  * @param stype	The quantity of metrics to emit.
+ * @param agg	Bitmask of additional topology aggregation levels (see
+ * 	parse_cpu_agg()), which get summed up in the same pass over all strands.
  */
 void collect_cpusys(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
-	bool mp, cpu_sys_quantity_t stype);
+	bool mp, cpu_sys_quantity_t stype, uint8_t agg);
 
 #ifdef __cplusplus
 }
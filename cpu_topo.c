@@ -0,0 +1,277 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <kstat.h>
+#include <sys/pset.h>
+#include <sys/lgrp_user.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libprom/prom.h>
+
+#include "ks_util.h"
+#include "cpu_topo.h"
+
+// see also:
+// illumos-gate/usr/src/cmd/psrinfo/psrinfo.c
+// illumos-gate/usr/src/cmd/lgrpinfo/lgrpinfo.pl
+
+typedef enum ks_info_idx {
+	KS_IDX_CPU_INFO = 0,
+	KS_IDX_MAX,			// last entry by contract
+} ks_info_idx_t;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+static ks_info_t kstat[KS_IDX_MAX] = {
+	{ "cpu_info", -1, NULL, -1, 0, NULL },
+};
+#pragma GCC diagnostic pop
+
+typedef struct grp_key {
+	cpu_agg_level_t level;
+	int64_t id;
+	int64_t id2;		// the chip ID of a core, 0 otherwise
+} grp_key_t;
+
+static struct {
+	kid_t kid;			// kstat chain ID of the last build
+	uint8_t levels;		// levels of the last build
+	hrtime_t built;		// time of the last build
+	cpu_topo_t t;
+	grp_key_t *key;		// [group] -> its key
+	uint16_t sz;		// capacity of key and t.label
+} topo = { -1, CPUAGG_NONE, 0, { 0, 0, NULL, NULL }, NULL, 0 };
+
+uint8_t
+parse_cpu_agg(const char *s) {
+	char buf[_POSIX_ARG_MAX], *t, *e;
+	uint8_t levels = CPUAGG_NONE;
+
+	if (s == NULL)
+		return levels;
+	if (strlen(s) >= sizeof(buf)) {
+		fprintf(stderr, "cpu aggregation string to parse is too long.\n");
+		return CPUAGG_FAIL;
+	}
+	strcpy(buf, s);
+	for (t = buf; *t != '\0'; t = e) {
+		if ((e = strchr(t, ',')) != NULL)
+			*e++ = '\0';
+		else
+			e = t + strlen(t);
+		if (strcmp(t, "none") == 0) {
+			levels = CPUAGG_NONE;
+		} else if (strcmp(t, "strand") == 0 || strcmp(t, "cpu") == 0) {
+			levels |= CPUAGG_STRAND;
+		} else if (strcmp(t, "core") == 0) {
+			levels |= CPUAGG_CORE;
+		} else if (strcmp(t, "socket") == 0 || strcmp(t, "chip") == 0) {
+			levels |= CPUAGG_SOCKET;
+		} else if (strcmp(t, "pset") == 0) {
+			levels |= CPUAGG_PSET;
+		} else if (strcmp(t, "lgroup") == 0 || strcmp(t, "lgrp") == 0) {
+			levels |= CPUAGG_LGRP;
+		} else if (*t != '\0') {
+			fprintf(stderr, "Unknown cpu aggregation level '%s'.\n", t);
+			return CPUAGG_FAIL;
+		}
+	}
+	return levels;
+}
+
+static void
+resetGroups(void) {
+	uint16_t g;
+
+	for (g = 0; g < topo.t.ngrp; g++)
+		free(topo.t.label[g]);
+	topo.t.ngrp = 0;
+}
+
+// Return the index of the group with the given key. Created on demand.
+static int16_t
+getGroup(cpu_agg_level_t level, int64_t id, int64_t id2) {
+	char buf[64];
+	uint16_t g;
+
+	for (g = 0; g < topo.t.ngrp; g++) {
+		if (topo.key[g].level == level && topo.key[g].id == id
+			&& topo.key[g].id2 == id2)
+		{
+			return g;
+		}
+	}
+	if (g == INT16_MAX)
+		return -1;
+	if (g == topo.sz) {
+		uint16_t sz = topo.sz + 64;
+		grp_key_t *k = realloc(topo.key, sz * sizeof(grp_key_t));
+		char **l;
+		if (k == NULL)
+			return -1;
+		topo.key = k;
+		if ((l = realloc(topo.t.label, sz * sizeof(char *))) == NULL)
+			return -1;
+		topo.t.label = l;
+		topo.sz = sz;
+	}
+	switch (level) {
+		case CPUAGG_LVL_CORE:
+			sprintf(buf, "{socket=\"%ld\",core=\"%ld\"}", id2, id);
+			break;
+		case CPUAGG_LVL_SOCKET:
+			sprintf(buf, "{socket=\"%ld\"}", id);
+			break;
+		case CPUAGG_LVL_PSET:
+			if (id == PS_NONE)
+				strcpy(buf, "{pset=\"default\"}");
+			else
+				sprintf(buf, "{pset=\"%ld\"}", id);
+			break;
+		default:
+			sprintf(buf, "{lgroup=\"%ld\"}", id);
+	}
+	if ((topo.t.label[g] = strdup(buf)) == NULL)
+		return -1;
+	topo.key[g].level = level;
+	topo.key[g].id = id;
+	topo.key[g].id2 = id2;
+	topo.t.ngrp++;
+	return g;
+}
+
+#define GRP(cid, level)	topo.t.grp[(cid) * CPUAGG_LVL_MAX + (level)]
+
+// Assign the CPUs of the given lgroup and all its descendants.
+static void
+walkLgrp(lgrp_cookie_t c, lgrp_id_t lgrp, processorid_t *cpus, int depth) {
+	int i, n;
+	int16_t g;
+	lgrp_id_t *children;
+
+	if (depth > 16)
+		return;
+	n = lgrp_cpus(c, lgrp, cpus, topo.t.ncpu, LGRP_CONTENT_DIRECT);
+	for (i = 0; i < n && i < topo.t.ncpu; i++) {
+		if (cpus[i] < 0 || cpus[i] >= topo.t.ncpu)
+			continue;
+		if ((g = getGroup(CPUAGG_LVL_LGRP, lgrp, 0)) >= 0)
+			GRP(cpus[i], CPUAGG_LVL_LGRP) = g;
+	}
+	if ((n = lgrp_children(c, lgrp, NULL, 0)) <= 0)
+		return;
+	if ((children = malloc(n * sizeof(lgrp_id_t))) == NULL)
+		return;
+	n = lgrp_children(c, lgrp, children, n);
+	for (i = 0; i < n; i++)
+		walkLgrp(c, children[i], cpus, depth + 1);
+	free(children);
+}
+
+static bool
+buildTopo(kstat_ctl_t *kc, hrtime_t now, uint8_t levels) {
+	kstat_t *ksp;
+	kstat_named_t *knp;
+	int16_t *grp;
+	int i, n, ncpu = 0;
+	int64_t chip, core;
+	psetid_t pset;
+
+	resetGroups();
+	topo.t.ncpu = 0;
+	// one cpu_info instance per strand - 512+ on big SPARC boxes
+	if ((n = update_instance(kc, &kstat[KS_IDX_CPU_INFO])) < 1)
+		return false;
+	for (i = 0; i < n; i++)
+		if (kstat[KS_IDX_CPU_INFO].ksp[i]->ks_instance >= ncpu)
+			ncpu = kstat[KS_IDX_CPU_INFO].ksp[i]->ks_instance + 1;
+	if (ncpu > system_cpu_max + 1)
+		ncpu = system_cpu_max + 1;
+	grp = realloc(topo.t.grp, ncpu * CPUAGG_LVL_MAX * sizeof(int16_t));
+	if (grp == NULL) {
+		PROM_WARN("Unable to allocate cpu topology: %s", strerror(errno));
+		return false;
+	}
+	topo.t.grp = grp;
+	topo.t.ncpu = ncpu;
+	memset(grp, 0xff, ncpu * CPUAGG_LVL_MAX * sizeof(int16_t));
+
+	for (i = 0; i < n; i++) {
+		int cid = kstat[KS_IDX_CPU_INFO].ksp[i]->ks_instance;
+		if (cid < 0 || cid >= ncpu)
+			continue;
+		if (levels & CPUAGG_PSET) {
+			if (pset_assign(PS_QUERY, cid, &pset) != 0)
+				pset = PS_NONE;
+			GRP(cid, CPUAGG_LVL_PSET) = getGroup(CPUAGG_LVL_PSET, pset, 0);
+		}
+		if ((levels & (CPUAGG_CORE | CPUAGG_SOCKET)) == 0)
+			continue;
+		ksp = ks_read(kc, kstat[KS_IDX_CPU_INFO].ksp[i], now, NULL);
+		if (ksp == NULL)
+			continue;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+		if ((knp = kstat_data_lookup(ksp, "chip_id")) == NULL)
+			continue;
+		chip = knp->value.i64;
+		if (levels & CPUAGG_SOCKET)
+			GRP(cid, CPUAGG_LVL_SOCKET) = getGroup(CPUAGG_LVL_SOCKET, chip, 0);
+		if ((levels & CPUAGG_CORE)
+			&& (knp = kstat_data_lookup(ksp, "core_id")) != NULL)
+		{
+			core = knp->value.i64;
+			GRP(cid, CPUAGG_LVL_CORE) = getGroup(CPUAGG_LVL_CORE, core, chip);
+		}
+#pragma GCC diagnostic pop
+	}
+
+	if (levels & CPUAGG_LGRP) {
+		lgrp_cookie_t c = lgrp_init(LGRP_VIEW_OS);
+		processorid_t *cpus;
+
+		if (c == LGRP_COOKIE_NONE) {
+			PROM_WARN("Unable to get lgroup hierarchy: %s", strerror(errno));
+		} else {
+			if ((cpus = malloc(ncpu * sizeof(processorid_t))) != NULL) {
+				walkLgrp(c, lgrp_root(c), cpus, 0);
+				free(cpus);
+			}
+			lgrp_fini(c);
+		}
+	}
+	return true;
+}
+
+#undef GRP
+
+const cpu_topo_t *
+cpu_topo_get(kstat_ctl_t *kc, hrtime_t now, uint8_t levels) {
+	levels &= ~CPUAGG_STRAND;
+	if (levels == CPUAGG_NONE)
+		return NULL;
+
+	if (kc->kc_chain_id != topo.kid || levels != topo.levels
+		|| ((levels & CPUAGG_PSET)
+			&& now - topo.built > CPUTOPO_PSET_TTL * NANOSEC))
+	{
+		PROM_DEBUG("Rebuilding cpu topology ...", "");
+		topo.kid = kc->kc_chain_id;
+		topo.levels = levels;
+		topo.built = now;
+		if (!buildTopo(kc, now, levels))
+			topo.t.ncpu = 0;
+	}
+	return topo.t.ngrp == 0 ? NULL : &topo.t;
+}
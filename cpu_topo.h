@@ -0,0 +1,81 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file cpu_topo.h
+ * CPU topology (core, socket, processor set, lgroup) of all strands used to
+ * aggregate per-strand stats.
+ */
+
+#ifndef SOLMEX_CPU_TOPO_H
+#define SOLMEX_CPU_TOPO_H
+
+#include <kstat.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Aggregation levels. Strands are handled by the collectors themselves. */
+typedef enum cpu_agg_level {
+	CPUAGG_LVL_CORE = 0,
+	CPUAGG_LVL_SOCKET,
+	CPUAGG_LVL_PSET,
+	CPUAGG_LVL_LGRP,
+	CPUAGG_LVL_MAX		// last entry by contract
+} cpu_agg_level_t;
+
+/** Bitmask of aggregation levels as returned by parse_cpu_agg(). */
+#define CPUAGG_NONE		0
+#define CPUAGG_CORE		(1 << CPUAGG_LVL_CORE)
+#define CPUAGG_SOCKET	(1 << CPUAGG_LVL_SOCKET)
+#define CPUAGG_PSET		(1 << CPUAGG_LVL_PSET)
+#define CPUAGG_LGRP		(1 << CPUAGG_LVL_LGRP)
+#define CPUAGG_STRAND	(1 << CPUAGG_LVL_MAX)
+#define CPUAGG_FAIL		0xFF
+
+/** Max. number of seconds processor set membership gets cached. */
+#define CPUTOPO_PSET_TTL 10
+
+typedef struct cpu_topo {
+	uint16_t ncpu;		/**< max. CPU ID + 1 covered by `grp` */
+	uint16_t ngrp;		/**< number of groups over all levels */
+	int16_t *grp;		/**< [cpuid * CPUAGG_LVL_MAX + level] -> group or -1 */
+	char **label;		/**< [group] -> label set, e.g. `{socket="0"}` */
+} cpu_topo_t;
+
+/**
+ * @brief Parse the given comma separated list of aggregation levels
+ * 	(`strand`, `core`, `socket`, `pset`, `lgroup`).
+ * @param s	The string to parse.
+ * @return The related bitmask, `CPUAGG_FAIL` on error.
+ */
+uint8_t parse_cpu_agg(const char *s);
+
+/**
+ * @brief Get the topology for the given aggregation levels. It gets rebuilt
+ * 	if the kstat chain or the levels have been changed, processor set
+ * 	membership additionally every `CPUTOPO_PSET_TTL` seconds.
+ * @param kc	The kstat chain to use.
+ * @param now	The current time as delivered by gethrtime().
+ * @param levels	Bitmask of the aggregation levels wanted.
+ * @return `NULL` if no groups are wanted or on error, the topology otherwise.
+ * 	It is valid until the next call.
+ */
+const cpu_topo_t *cpu_topo_get(kstat_ctl_t *kc, hrtime_t now, uint8_t levels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_CPU_TOPO_H
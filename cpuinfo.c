@@ -22,6 +22,7 @@
 #include "cpuinfo.h"
 #include "ks_util.h"
 #include "dmi.h"
+#include "expo.h"
 
 // see also:
 // illumos-gate/usr/src/cmd/psrinfo/psrinfo.c
@@ -233,7 +234,7 @@ addCpuInfo(psb_t *sb, size_t sz, kstat_t *ksp, uint chip_id) {
 	}
 
 	psb_truncate(sb, sz);
-	psb_add_str(sb, SOLMEXM_CPUINFO_N "{package=\"");
+	psb_add_str(sb, "{package=\"");
 	sprintf(buf, "%u", chip_id);
 	psb_add_str(sb, buf);
 	psb_add_str(sb, "\",");
@@ -307,8 +308,7 @@ addCpuInfo(psb_t *sb, size_t sz, kstat_t *ksp, uint chip_id) {
 	}
 	n = psb_len(sb);
 	psb_truncate(sb, n - 1);
-	psb_add_str(sb, "} 1");
-	psb_add_char(sb,'\n');
+	psb_add_char(sb, '}');
 
 	chip_info[chip_count++] = strdup(psb_str(sb) + sz);
 	ADD_CHIP(chip_id);
@@ -388,11 +388,10 @@ collect_cpuinfo(psb_t *sb, bool compact) {
 	if (!initialized)
 		buildInfoMetric(sb);
 
-	if (!compact)
-		addPromInfo(SOLMEXM_CPUINFO);
+	addExpoInfo(SOLMEXM_CPUINFO);
 	for (n = 0; n < chip_count; n++) {
 		if (chip_info[n] != NULL)
-			psb_add_str(sb, chip_info[n]);
+			expo_emit(sb, SOLMEXM_CPUINFO_N, chip_info[n], "1", 1);
 	}
 
 	if (free_sb) {
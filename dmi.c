@@ -17,6 +17,7 @@
 
 #include <libprom/prom.h>
 
+#include "expo.h"
 #include "dmi.h"
 
 // for Linux comparision see
@@ -332,69 +333,63 @@ copyChassisInfo(smbios_hdl_t *shp, int id) {
 	hasType[3] = n != 0;
 }
 
-static char *metric;
+static char *labels;		// NULL if /dev/smbios is n/a
 
 static void
-buildMetric(psb_t *sb, bool compact) {
+buildLabels(void) {
 	smbios_hdl_t *shp;
 	uint c;
 	int n;
-	size_t sz;
+	psb_t *sb;
 
-	sz = psb_len(sb);
-	if (!compact)
-		addPromInfo(SOLMEXM_DMI);
+	initialized = true;
 	if ((shp = smbios_open(NULL, SMB_VERSION, 0, &n)) == NULL) {
 		PROM_WARN("Unable to open /dev/smbios.", "");
-		if (!compact) {
-			psb_add_str(sb, "# /dev/smbios n/a");
-			psb_add_char(sb, '\n');
-		}
-	} else {
-		c = 0;
-		copyBiosInfo(shp);
-		copyProductInfo(shp);
-		n = copyBaseboardInfo(shp);
-		copyChassisInfo(shp, n);
-		smbios_iter(shp, recordCpu, NULL);
-
-		psb_add_str(sb, SOLMEXM_DMI_N "{");
-		n = ARRAY_SIZE(dmi);
-		if (n > DMI_INFO_SZ)
-			n = DMI_INFO_SZ;
-		n--;
-		for (; n >= 0; n--) {
-			if (dmi[n] == NULL)
-				continue;
-			psb_add_str(sb, DMI_ATTR[n]);
-			psb_add_str(sb, "=\"");
-			psb_add_str(sb, dmi[n]);
-			psb_add_str(sb, "\",");
-			// for now we do not need the attrs anymore, so save some bytes
-			free(dmi[n]);
-			dmi[n] = NULL;
-			c++;
-		}
-		if (c > 0) {
-			n = psb_len(sb);
-			psb_truncate(sb, n - 1);	// remove the trailing comma
-		}
-		psb_add_str(sb, "} 1");
-		psb_add_char(sb, '\n');
+		return;
+	}
+	if ((sb = psb_new()) == NULL) {
 		smbios_close(shp);
+		return;
 	}
-	metric = strdup(psb_str(sb) + sz);
-	initialized = true;
+	c = 0;
+	copyBiosInfo(shp);
+	copyProductInfo(shp);
+	n = copyBaseboardInfo(shp);
+	copyChassisInfo(shp, n);
+	smbios_iter(shp, recordCpu, NULL);
+
+	psb_add_char(sb, '{');
+	n = ARRAY_SIZE(dmi);
+	if (n > DMI_INFO_SZ)
+		n = DMI_INFO_SZ;
+	n--;
+	for (; n >= 0; n--) {
+		if (dmi[n] == NULL)
+			continue;
+		psb_add_str(sb, DMI_ATTR[n]);
+		psb_add_str(sb, "=\"");
+		psb_add_str(sb, dmi[n]);
+		psb_add_str(sb, "\",");
+		// for now we do not need the attrs anymore, so save some bytes
+		free(dmi[n]);
+		dmi[n] = NULL;
+		c++;
+	}
+	if (c > 0) {
+		n = psb_len(sb);
+		psb_truncate(sb, n - 1);	// remove the trailing comma
+	}
+	psb_add_char(sb, '}');
+	smbios_close(shp);
+	labels = psb_dump(sb);
+	psb_destroy(sb);
 }
 
 int64_t
 get_cache_size(uint16_t cpuNum) {
-	if (!initialized) {
-		psb_t *sb = psb_new();
-		// if dmi collector is disabled, it got not called yet
-		collect_dmi(sb, true);
-		psb_destroy(sb);
-	}
+	// if dmi collector is disabled, it got not called yet
+	if (!initialized)
+		buildLabels();
 	if (cpuNum >= cpu_count)
 		return -1;
 
@@ -404,12 +399,9 @@ get_cache_size(uint16_t cpuNum) {
 
 int64_t
 get_turbo_speed(uint16_t cpuNum) {
-	if (initialized) {
-		psb_t *sb = psb_new();
-		// if dmi collector is disabled, it got not called yet
-		collect_dmi(sb, true);
-		psb_destroy(sb);
-	}
+	// if dmi collector is disabled, it got not called yet
+	if (!initialized)
+		buildLabels();
 	if (cpuNum >= cpu_count)
 		return -1;
 
@@ -425,15 +417,19 @@ collect_dmi(psb_t *sb, bool compact) {
 	if (free_sb)
 		sb = psb_new();
 
-	if (initialized) {
-		psb_add_str(sb, metric);
-	} else {
-		buildMetric(sb, compact);
+	if (!initialized)
+		buildLabels();
+	addExpoInfo(SOLMEXM_DMI);
+	if (labels != NULL) {
+		expo_emit(sb, SOLMEXM_DMI_N, labels, "1", 1);
+	} else if (!compact && expo_target == NULL) {
+		psb_add_str(sb, "# /dev/smbios n/a");
+		psb_add_char(sb, '\n');
 	}
 
 	if (free_sb) {
 		fprintf(stdout, "\n%s", psb_str(sb));
 		psb_destroy(sb);
 	}
-	PROM_DEBUG("Final DMI info size: %d", strlen(metric));
+	PROM_DEBUG("collect_dmi done", "");
 }
@@ -0,0 +1,247 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/*
+ * Benchmark of collect_vmstat() and collect_cpusys() on a synthetic kstat
+ * chain with up to 1024 strands (cpu:N:vm, cpu:N:sys and cpu_info:N:*), to
+ * check, that the time per scrape scales linearly with the number of strands.
+ * The kstat_*() functions used by solmex get replaced by the fixture below,
+ * so no libkstat is needed and the results do not depend on the box it runs
+ * on. Build and run it via:
+ *
+ *	make cpustat-bench && ./cpustat-bench [-a] [-r rounds] [strands ...]
+ *
+ *	-a	aggregate by core and socket as well (-A core,socket)
+ *	-r	number of scrapes to measure per strand count (default: 1000)
+ *
+ * Default strand counts are 64, 128, 256, 512 and 1024.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libprom/prom.h>
+
+#include "ks_util.h"
+#include "expo.h"
+#include "cpu_topo.h"
+#include "vmstat.h"
+#include "cpu_sys.h"
+
+#define STRANDS_MAX 1024
+#define NAMED_MAX 128		// capacity of the named stats of a kstat
+#define STRANDS_PER_CORE 8
+#define STRANDS_PER_SOCKET 128
+
+// usually set up by main.c
+uint16_t system_cpu_max = STRANDS_MAX - 1;
+uint8_t page_shift = 12;
+
+// 3 kstats per strand: cpu:N:vm, cpu:N:sys, cpu_info:N:cpu_infoN
+static kstat_t ks[STRANDS_MAX * 3];
+static kstat_named_t *named;
+static kstat_ctl_t kc;
+static hrtime_t fake_now;
+
+static void
+buildChain(int n) {
+	kstat_named_t *kn;
+	kstat_t *k;
+	int i, j;
+
+	memset(ks, 0, sizeof(ks));
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < 3; j++) {
+			k = &ks[i * 3 + j];
+			strcpy(k->ks_module, j == 2 ? "cpu_info" : "cpu");
+			k->ks_instance = i;
+			if (j == 2)
+				snprintf(k->ks_name, KSTAT_STRLEN, "cpu_info%d", i);
+			else
+				strcpy(k->ks_name, j == 0 ? "vm" : "sys");
+			k->ks_type = KSTAT_TYPE_NAMED;
+			k->ks_data = named + (i * 3 + j) * NAMED_MAX;
+			k->ks_ndata = 0;
+			k->ks_next = (i * 3 + j + 1 < n * 3) ? &ks[i * 3 + j + 1] : NULL;
+		}
+		kn = KSTAT_NAMED_PTR(k);
+		strcpy(kn[0].name, "chip_id");
+		kn[0].data_type = KSTAT_DATA_INT64;
+		kn[0].value.i64 = i / STRANDS_PER_SOCKET;
+		strcpy(kn[1].name, "core_id");
+		kn[1].data_type = KSTAT_DATA_INT64;
+		kn[1].value.i64 = i / STRANDS_PER_CORE;
+		k->ks_ndata = 2;
+	}
+	kc.kc_chain = ks;
+	kc.kc_chain_id++;	// let update_instance() and cpu_topo_get() rebuild
+}
+
+kstat_ctl_t *
+kstat_open(void) {
+	return &kc;
+}
+
+kid_t
+kstat_chain_update(kstat_ctl_t *kcp) {
+	(void) kcp;
+	return 0;
+}
+
+int
+kstat_close(kstat_ctl_t *kcp) {
+	(void) kcp;
+	return 0;
+}
+
+kstat_t *
+kstat_lookup(kstat_ctl_t *kcp, char *module, int instance, char *name) {
+	kstat_t *k;
+
+	for (k = kcp->kc_chain; k != NULL; k = k->ks_next) {
+		if ((module == NULL || strcmp(module, k->ks_module) == 0)
+			&& (instance < 0 || instance == k->ks_instance)
+			&& (name == NULL || strcmp(name, k->ks_name) == 0))
+		{
+			return k;
+		}
+	}
+	errno = ENOENT;
+	return NULL;
+}
+
+// cpu:N:* kstats provide any counter asked for, so the fixture does not need
+// to know the names the collectors use.
+void *
+kstat_data_lookup(kstat_t *k, char *name) {
+	kstat_named_t *kn = KSTAT_NAMED_PTR(k);
+	uint_t i;
+
+	for (i = 0; i < k->ks_ndata; i++)
+		if (strcmp(kn[i].name, name) == 0)
+			return &kn[i];
+	if (strcmp(k->ks_module, "cpu") != 0 || i == NAMED_MAX)
+		return NULL;
+	snprintf(kn[i].name, KSTAT_STRLEN, "%s", name);
+	kn[i].data_type = KSTAT_DATA_UINT64;
+	kn[i].value.ui64 = (uint64_t) k->ks_instance * 1000 + i;
+	k->ks_ndata++;
+	return &kn[i];
+}
+
+// like the kernel: copy out a new snapshot of all counters
+kid_t
+kstat_read(kstat_ctl_t *kcp, kstat_t *k, void *buf) {
+	kstat_named_t *kn = KSTAT_NAMED_PTR(k);
+	uint_t i;
+
+	(void) buf;
+	if (strcmp(k->ks_module, "cpu") == 0)
+		for (i = 0; i < k->ks_ndata; i++)
+			kn[i].value.ui64 += k->ks_instance % 7 + 1;
+	k->ks_snaptime = fake_now;
+	return kcp->kc_chain_id;
+}
+
+static double
+measure(int rounds, uint8_t agg, bool vm, size_t *len) {
+	psb_t *sb = psb_new();
+	hrtime_t t, total = 0;
+	int r;
+
+	for (r = -1; r < rounds; r++) {
+		psb_truncate(sb, 0);
+		// always a new snapshot: ks_read() skips reads within 1s
+		fake_now += 10LL * NANOSEC;
+		t = gethrtime();
+		expo_spans_reset();		// like collect() in main.c
+		if (vm)
+			collect_vmstat(sb, false, &kc, fake_now, true, VMSTAT_ALL, agg);
+		else
+			collect_cpusys(sb, false, &kc, fake_now, true, CPUSYS_EXTENDED,
+				agg);
+		expo_emit_times(0, 0);
+		if (r >= 0)		// the 1st one warms up caches and allocations
+			total += gethrtime() - t;
+	}
+	*len = psb_len(sb);
+	psb_destroy(sb);
+	return (double) total / rounds;
+}
+
+int
+main(int argc, char **argv) {
+	static const int def[] = { 64, 128, 256, 512, 1024 };
+	uint8_t agg = CPUAGG_NONE;
+	int c, i, n, count, rounds = 1000;
+	const int *strands = def;
+	int *list = NULL;
+	double ns;
+	size_t len;
+
+	while ((c = getopt(argc, argv, "ar:")) != -1) {
+		switch (c) {
+			case 'a':
+				agg = CPUAGG_CORE | CPUAGG_SOCKET;
+				break;
+			case 'r':
+				if ((rounds = atoi(optarg)) < 1) {
+					fprintf(stderr, "Invalid number of rounds '%s'.\n", optarg);
+					return 1;
+				}
+				break;
+			default:
+				fprintf(stderr,
+					"Usage: %s [-a] [-r rounds] [strands ...]\n", argv[0]);
+				return 1;
+		}
+	}
+	count = ARRAY_SIZE(def);
+	if (optind < argc) {
+		count = argc - optind;
+		if ((list = malloc(count * sizeof(int))) == NULL) {
+			perror("cpustat-bench");
+			return 1;
+		}
+		for (i = 0; i < count; i++) {
+			list[i] = atoi(argv[optind + i]);
+			if (list[i] < 1 || list[i] > STRANDS_MAX) {
+				fprintf(stderr, "Strands must be 1..%d.\n", STRANDS_MAX);
+				return 1;
+			}
+		}
+		strands = list;
+	}
+	if ((named = calloc(STRANDS_MAX * 3 * NAMED_MAX, sizeof(kstat_named_t)))
+		== NULL)
+	{
+		perror("cpustat-bench");
+		return 1;
+	}
+
+	printf("%-8s %7s %12s %10s %10s\n", "stats", "strands", "us/scrape",
+		"ns/strand", "bytes");
+	for (i = 0; i < count; i++) {
+		n = strands[i];
+		buildChain(n);
+		ns = measure(rounds, agg, true, &len);
+		printf("%-8s %7d %12.1f %10.1f %10zu\n", "cpu::vm", n, ns / 1000,
+			ns / n, len);
+		ns = measure(rounds, agg, false, &len);
+		printf("%-8s %7d %12.1f %10.1f %10zu\n", "cpu::sys", n, ns / 1000,
+			ns / n, len);
+	}
+	free(named);
+	free(list);
+	return 0;
+}
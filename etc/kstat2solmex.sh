@@ -172,6 +172,49 @@ function doMib2 {
 	done
 }
 
+function doNfs {
+	integer IGNORE=1
+	typeset -u PREFIX='SOLMEX_' IPREFIX PFX
+	typeset -l MPREFIX='solmex_node' SUBMOD=
+	typeset A B C D E METRIC
+	typeset -A SNAMEnfs_srv SNAMEnfs_clnt SNAMErpc_srv SNAMErpc_clnt
+	typeset -A MNAME=( [nfs_srv]='nfs_server' [nfs_clnt]='nfs_client' \
+		[rpc_srv]='rpc_server' [rpc_clnt]='rpc_client' )
+	while read A B C D E; do
+		if [[ $A == 'module:' ]]; then
+			read -A E
+			SUBMOD= IGNORE=1
+			(( D == 0 )) || continue
+			case "$B:${E[1]}" in
+				nfs:nfs_server) SUBMOD='nfs_srv' ;;
+				nfs:nfs_client) SUBMOD='nfs_clnt' ;;
+				# cots and clts share one table, transport becomes a label
+				unix:rpc_cots_server|unix:rpc_clts_server) SUBMOD='rpc_srv' ;;
+				unix:rpc_cots_client|unix:rpc_clts_client) SUBMOD='rpc_clnt' ;;
+			esac
+			[[ -z ${SUBMOD} ]] && continue
+			typeset -n SNAME="SNAME${SUBMOD}"
+			(( VERB )) && print -u2 -f "======= %s =======\n" "$B:${E[1]}"
+			IGNORE=0
+			continue
+		fi
+		(( IGNORE )) && continue
+		[[ -z $A ]] && IGNORE=1 && continue
+		[[ $A == 'crtime' || $A == 'snaptime' ]] && continue
+		METRIC="$A"
+		[[ -n ${SNAME[${METRIC}]} ]] && continue
+		SNAME["${METRIC}"]="$A"
+		(( VERB )) && print -u2 -f "%16s\t%s\n" "${METRIC}" "$A"
+	done<"$1"
+	for A in nfs_srv nfs_clnt rpc_srv rpc_clnt ; do
+		typeset -n SNAME="SNAME$A"
+		(( ${#SNAME[@]} == 0 )) && continue
+		PFX="${PREFIX}$A"
+		IPREFIX="${A}_IDX"
+		printIdx SNAME "${PFX}" "${MPREFIX}_${MNAME[$A]}" "${IPREFIX}" $A 1
+	done
+}
+
 function printAll {
 	typeset -n A=$1
 	typeset -u U
@@ -197,7 +240,7 @@ function printIdx {
 	typeset -n A=$1
 	typeset -u U
 	typeset PREFIX="$2" MPREFIX="$3" IPREFIX="$4" T=${PREFIX%%_*}
-	typeset SFX="$5"
+	typeset SFX="$5" TYPES="$6"
 	integer I=0
 	[[ -n ${SFX} && ${SFX:0:1} != '_' ]] && SFX="_${SFX}"
 	typeset -l ITYPE="${IPREFIX}"
@@ -205,7 +248,8 @@ function printIdx {
 		S="/* solmex metric names */\nstatic const char *snames${SFX}[] = {\n" \
 		M="/* kstat names */\nstatic const char *knames${SFX}[] = {\n" \
 		D="/* metric HELP text */\nstatic const char *sdesc${SFX}[] = {\n" \
-		E="/* index into snames/knames/sdesc */\ntypedef enum ${ITYPE} {\n"
+		E="/* index into snames/knames/sdesc */\ntypedef enum ${ITYPE} {\n" \
+		Y="/* metric TYPE */\nstatic const char *stypes${SFX}[] = {\n"
 
 	S+='#define STRINGIFY(x) #x\n#define _S(x) STRINGIFY(x)\n'
 	(( PLEN++ ))
@@ -216,16 +260,20 @@ function printIdx {
 		S+="\t_S(${PREFIX}_${U}_N),"
 		M+="\t\"${A[$N]}\","
 		D+="\t${PREFIX}_${U}_D,"
+		Y+="\t${PREFIX}_${U}_T,"
 		H+="#define ${PREFIX}_${U}_D \"\"\n"
 		H+="#define ${PREFIX}_${U}_T \"counter\"\n"
 		H+="#define ${PREFIX}_${U}_N ${MPREFIX}_${N%64}\n\n"
 		(( I++ ))
-		(( I == 3 )) && E+='\n' && S+='\n' && D+='\n' && M+='\n' && I=0	
+		(( I == 3 )) && E+='\n' && S+='\n' && D+='\n' && M+='\n' && \
+			Y+='\n' && I=0
 	done
 	E+="\t${IPREFIX}_MAX\n} ${ITYPE}_t;\n\n"
 	S+='\tNULL\n};\n'
 	D+='\tNULL\n};\n'
 	M+='\tNULL\n};\n'
+	Y+='\tNULL\n};\n'
+	(( TYPES )) && D+="\n$Y"
 	print "$H\n\n$E$M\n$S\n$D"
 }
 
@@ -233,6 +281,7 @@ function doMain {
 	[[ -z $1 || ! -s $1 ]] && { showUsage; return 1; }
 	[[ ${TARGET} == 'net' ]] && doNet "$1"
 	[[ ${TARGET} == 'mib' ]] && doMib2 "$1"
+	[[ ${TARGET} == 'nfs' ]] && doNfs "$1"
 }
 
 unset VERB TARGET; integer VERB=0
@@ -245,7 +294,7 @@ USAGE="[-?${VERSION}"' ]
 [F:functions?Print a list of all functions available.]
 [T:trace]:[functionList?A comma separated list of functions of this script to trace (convinience for troubleshooting).] 
 [+?]
-[t:target]:[name?Generate for the \aname\ad metrics class. Currently supported: \bnet\b, \bzfs\b.]
+[t:target]:[name?Generate for the \aname\ad metrics class. Currently supported: \bnet\b, \bmib\b, \bnfs\b.]
 [v:verbose?Print kstat data names to metric name mapping as discovered on stderr.]
 \n\n
 \akstat_output\a
@@ -0,0 +1,187 @@
+#!/usr/bin/python3
+
+# Minimal Prometheus remote write receiver to check the requests solmex sends
+# via -x http://... on the loopback interface. It verifies the HTTP headers,
+# the snappy block format and the protobuf WriteRequest of each request, prints
+# a summary to stdout and answers with 204 if fine, with 400 otherwise.
+#
+# Usage: rwcheck.py [-6] [-n count] [port]
+#	-6	listen on ::1 instead of 127.0.0.1
+#	-n	exit after count requests, with 1 if any of them was invalid
+# e.g.:
+#	./rwcheck.py -n 2 9201 &
+#	solmex -f -p 0 -y /dev/null -x 'http://127.0.0.1:9201/api/v1/write@5'
+
+import getopt
+import http.server
+import socket
+import struct
+import sys
+
+# https://github.com/google/snappy/blob/main/format_description.txt
+def varint(b, i):
+	v = s = 0
+	while True:
+		if i >= len(b):
+			raise ValueError('truncated varint')
+		c = b[i]
+		i += 1
+		v |= (c & 0x7F) << s
+		if c < 0x80:
+			return v, i
+		s += 7
+		if s > 63:
+			raise ValueError('varint too long')
+
+def unsnappy(b):
+	n, i = varint(b, 0)
+	out = bytearray()
+	while i < len(b):
+		tag = b[i]
+		i += 1
+		t = tag & 3
+		if t == 0:
+			# literal, length - 1 in the tag or in the next 1..4 bytes
+			l = tag >> 2
+			if l >= 60:
+				k = l - 59
+				l = int.from_bytes(b[i:i + k], 'little')
+				i += k
+			l += 1
+			if i + l > len(b):
+				raise ValueError('literal exceeds the input at %d' % i)
+			out += b[i:i + l]
+			i += l
+			continue
+		if t == 1:
+			l = ((tag >> 2) & 7) + 4
+			off = ((tag >> 5) << 8) | b[i]
+			i += 1
+		elif t == 2:
+			l = (tag >> 2) + 1
+			off = int.from_bytes(b[i:i + 2], 'little')
+			i += 2
+		else:
+			l = (tag >> 2) + 1
+			off = int.from_bytes(b[i:i + 4], 'little')
+			i += 4
+		if off == 0 or off > len(out):
+			raise ValueError('invalid copy offset %d at %d' % (off, i))
+		for _ in range(l):	# may overlap
+			out.append(out[-off])
+	if len(out) != n:
+		raise ValueError('length %d != preamble %d' % (len(out), n))
+	return bytes(out)
+
+# returns a list of (field, wire type, value)
+def fields(b):
+	i = 0
+	res = []
+	while i < len(b):
+		key, i = varint(b, i)
+		f, wt = key >> 3, key & 7
+		if wt == 0:
+			v, i = varint(b, i)
+		elif wt == 1:
+			v = b[i:i + 8]
+			i += 8
+		elif wt == 2:
+			l, i = varint(b, i)
+			v = b[i:i + l]
+			i += l
+		elif wt == 5:
+			v = b[i:i + 4]
+			i += 4
+		else:
+			raise ValueError('unsupported wire type %d' % wt)
+		if i > len(b):
+			raise ValueError('field %d exceeds its message' % f)
+		res.append((f, wt, v))
+	return res
+
+# WriteRequest: 1 timeseries
+# TimeSeries: 1 labels {1 name, 2 value}, 2 samples {1 value, 2 timestamp}
+def check_request(b):
+	series = samples = 0
+	names = set()
+	for f, wt, ts in fields(b):
+		if f != 1 or wt != 2:
+			raise ValueError('unexpected WriteRequest field %d' % f)
+		labels = []
+		for g, wt, v in fields(ts):
+			if g == 1 and wt == 2:
+				l = dict((h, x.decode('utf-8')) for h, _, x in fields(v))
+				if 1 not in l:
+					raise ValueError('label without name')
+				labels.append((l[1], l.get(2, '')))
+			elif g == 2 and wt == 2:
+				s = dict((h, x) for h, _, x in fields(v))
+				if 2 not in s:
+					raise ValueError('sample without timestamp')
+				struct.unpack('<d', s.get(1, b'\0' * 8))
+				samples += 1
+			else:
+				raise ValueError('unexpected TimeSeries field %d' % g)
+		ln = [x[0] for x in labels]
+		if ln != sorted(ln) or len(set(ln)) != len(ln):
+			raise ValueError('labels not sorted or not unique: %s' % ln)
+		if '__name__' not in ln:
+			raise ValueError('series without __name__: %s' % labels)
+		names.add(dict(labels)['__name__'])
+		series += 1
+	if series == 0:
+		raise ValueError('empty WriteRequest')
+	return series, samples, len(names)
+
+class Handler(http.server.BaseHTTPRequestHandler):
+	protocol_version = 'HTTP/1.1'
+
+	def do_POST(self):
+		h = self.headers
+		try:
+			if h.get('Content-Encoding') != 'snappy':
+				raise ValueError('Content-Encoding is not snappy')
+			if h.get('Content-Type') != 'application/x-protobuf':
+				raise ValueError('Content-Type is not application/x-protobuf')
+			if h.get('X-Prometheus-Remote-Write-Version') is None:
+				raise ValueError('X-Prometheus-Remote-Write-Version missing')
+			host = h.get('Host', '')
+			if host.count(':') > 1 and not host.startswith('['):
+				raise ValueError('IPv6 Host not bracketed: ' + host)
+			body = self.rfile.read(int(h.get('Content-Length', '0')))
+			raw = unsnappy(body)
+			series, samples, names = check_request(raw)
+			print('OK %s: %d bytes, %d uncompressed, %d series, %d samples, '
+				'%d metric names' % (host, len(body), len(raw), series, samples,
+				names), flush=True)
+			self.server.ok += 1
+			code = 204
+		except (ValueError, UnicodeDecodeError, struct.error) as e:
+			print('FAIL: %s' % e, flush=True)
+			self.server.failed += 1
+			code = 400
+		self.send_response(code)
+		self.send_header('Content-Length', '0')
+		self.send_header('Connection', 'close')
+		self.end_headers()
+
+	def log_message(self, fmt, *args):
+		pass
+
+class Server6(http.server.HTTPServer):
+	address_family = socket.AF_INET6
+
+def main():
+	opts, args = getopt.getopt(sys.argv[1:], '6n:')
+	opts = dict(opts)
+	port = int(args[0]) if args else 9201
+	cls = Server6 if '-6' in opts else http.server.HTTPServer
+	srv = cls(('::1' if '-6' in opts else '127.0.0.1', port), Handler)
+	srv.ok = srv.failed = 0
+	n = int(opts.get('-n', '0'))
+	while n == 0 or srv.ok + srv.failed < n:
+		srv.handle_request()
+	sys.exit(1 if srv.failed else 0)
+
+if __name__ == '__main__':
+	main()
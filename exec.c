@@ -0,0 +1,507 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libprom/prom.h>
+
+#include "exec.h"
+#include "textfile.h"
+
+extern char **environ;
+
+typedef enum exec_state {
+	EXEC_IDLE = 0,
+	EXEC_RUNNING,		// reading its output
+	EXEC_REAPING,		// output closed or killed, waiting for its exit
+} exec_state_t;
+
+typedef struct exec_plugin {
+	char name[EXEC_NAME_MAX + 1];
+	char *cmd;
+	uint32_t interval;		// in seconds
+	uint32_t timeout;		// in seconds
+	// runner thread only
+	exec_state_t state;
+	pid_t pid;
+	int fd;
+	hrtime_t start;
+	hrtime_t next;			// when to start the next run
+	bool ran;				// CLI mode: already run
+	bool killed;			// timed out, result already recorded
+	char *buf;
+	size_t len;
+	size_t sz;
+	bool overflow;
+	// shared, protected by exec_cfg_t.lock
+	char *out;				// output of the last successful run, or NULL
+	tf_names_t names;		// metric family names of out
+	time_t good;			// when out has been produced
+	double duration;		// of the last run in seconds
+	int status;				// exit status of the last run, -1 .. n/a
+	bool error;
+	// scraping thread only
+	bool conflict;			// out has been dropped: metric provided by others
+} exec_plugin_t;
+
+typedef struct exec_cfg {
+	exec_plugin_t *p;
+	uint32_t n;
+	pthread_mutex_t lock;
+	bool started;
+	time_t start;
+} exec_cfg_t;
+
+#define NANOSEC_D 1000000000.0
+
+void *
+parse_exec_opts(const char *s, void *config, int *valid) {
+	exec_cfg_t *cfg = (exec_cfg_t *) config;
+	exec_plugin_t *p, *x;
+	const char *cmd, *t;
+	unsigned int n, m;
+	size_t len;
+
+	*valid = 0;
+	if (s == NULL)
+		return cfg;
+	if (strcmp(s, "none") == 0 || strcmp(s, "n") == 0 || strcmp(s, "0") == 0) {
+		*valid = 1;
+		return NULL;
+	}
+	if ((cmd = strchr(s, '=')) == NULL || cmd[1] == '\0') {
+		fprintf(stderr, "Missing command in '%s'.\n", s);
+		return cfg;
+	}
+	for (t = s; t < cmd && (isalnum((unsigned char) *t) || *t == '_'
+		|| *t == '-' || *t == '.'); t++)
+		;
+	len = t - s;
+	if (len == 0 || len > EXEC_NAME_MAX || (t < cmd && *t != '@')) {
+		fprintf(stderr, "Invalid plugin name in '%s' (max. %d of "
+			"[A-Za-z0-9_.-]).\n", s, EXEC_NAME_MAX);
+		return cfg;
+	}
+	n = EXEC_INTERVAL_DEFAULT;
+	m = EXEC_TIMEOUT_DEFAULT;
+	if (t < cmd) {
+		int k = sscanf(t + 1, "%u,%u", &n, &m);
+		if (k < 1 || n < 1 || n > 86400 || (k == 2 && (m < 1 || m > 3600))) {
+			fprintf(stderr, "Invalid interval or timeout in '%s' "
+				"(1..86400, 1..3600).\n", s);
+			return cfg;
+		}
+	}
+	if (cfg == NULL) {
+		if ((cfg = calloc(1, sizeof(exec_cfg_t))) == NULL) {
+			perror("exec");
+			return NULL;
+		}
+		pthread_mutex_init(&(cfg->lock), NULL);
+	}
+	for (n = 0; n < cfg->n; n++) {
+		if (strlen(cfg->p[n].name) == len && strncmp(cfg->p[n].name, s, len)
+			== 0)
+		{
+			fprintf(stderr, "Duplicate plugin name in '%s'.\n", s);
+			return cfg;
+		}
+	}
+	if ((x = realloc(cfg->p, (cfg->n + 1) * sizeof(exec_plugin_t))) == NULL) {
+		perror("exec");
+		return cfg;
+	}
+	cfg->p = x;
+	p = &(cfg->p[cfg->n]);
+	memset(p, 0, sizeof(exec_plugin_t));
+	if ((p->cmd = strdup(cmd + 1)) == NULL) {
+		perror("exec");
+		return cfg;
+	}
+	memcpy(p->name, s, len);
+	p->interval = n;
+	p->timeout = m;
+	p->fd = -1;
+	p->status = -1;
+	cfg->n++;
+	*valid = 1;
+	return cfg;
+}
+
+static bool
+spawn(exec_plugin_t *p) {
+	posix_spawn_file_actions_t fa;
+	posix_spawnattr_t attr;
+	sigset_t sset;
+	static char sh[] = "sh", dc[] = "-c";
+	char *argv[] = { sh, dc, p->cmd, NULL };
+	int pfd[2], res;
+
+	p->start = gethrtime();
+	if (pipe(pfd) == -1) {
+		PROM_WARN("%s: unable to create pipe: %s", p->name, strerror(errno));
+		return false;
+	}
+	(void) fcntl(pfd[0], F_SETFD, FD_CLOEXEC);
+	(void) fcntl(pfd[1], F_SETFD, FD_CLOEXEC);
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&fa, pfd[1], 1);
+	posix_spawn_file_actions_addopen(&fa, 2, "/dev/null", O_WRONLY, 0);
+	posix_spawnattr_init(&attr);
+	// own process group to be able to kill the whole pipeline; SIGPIPE
+	// might be ignored by us, but the command should get the default
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP
+		| POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+	posix_spawnattr_setpgroup(&attr, 0);
+	sigemptyset(&sset);
+	posix_spawnattr_setsigmask(&attr, &sset);
+	sigaddset(&sset, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &sset);
+	res = posix_spawn(&(p->pid), "/bin/sh", &fa, &attr, argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+	posix_spawnattr_destroy(&attr);
+	(void) close(pfd[1]);
+	if (res != 0) {
+		PROM_WARN("%s: unable to run '%s': %s", p->name, p->cmd,
+			strerror(res));
+		(void) close(pfd[0]);
+		return false;
+	}
+	(void) fcntl(pfd[0], F_SETFL, fcntl(pfd[0], F_GETFL) | O_NONBLOCK);
+	p->fd = pfd[0];
+	p->len = 0;
+	p->overflow = false;
+	p->state = EXEC_RUNNING;
+	PROM_DEBUG("%s: started pid %d", p->name, (int) p->pid);
+	return true;
+}
+
+// Read all available output. Returns true on EOF.
+static bool
+readOutput(exec_plugin_t *p) {
+	char *x;
+	ssize_t n;
+
+	while (1) {
+		if (p->len + 4096 + 1 > p->sz) {
+			size_t sz = p->sz == 0 ? 8192 : p->sz << 1;
+			if (sz > EXEC_OUTPUT_MAX + 4096 + 1 || (x = realloc(p->buf, sz))
+				== NULL)
+			{
+				p->overflow = true;
+				return true;
+			}
+			p->buf = x;
+			p->sz = sz;
+		}
+		if ((n = read(p->fd, p->buf + p->len, 4096)) > 0) {
+			p->len += n;
+			if (p->len > EXEC_OUTPUT_MAX) {
+				p->overflow = true;
+				return true;
+			}
+			continue;
+		}
+		if (n == -1 && errno == EINTR)
+			continue;
+		return n == 0 || errno != EAGAIN;
+	}
+}
+
+// Record the result of a run.
+static void
+finish(exec_cfg_t *cfg, exec_plugin_t *p, int status, bool timedout) {
+	const char *msg = NULL;
+	char *out = NULL;
+	tf_names_t names = { NULL, 0, 0, 0 };
+	size_t line = 0;
+	int res;
+
+	if (p->fd != -1) {
+		(void) close(p->fd);
+		p->fd = -1;
+	}
+	p->state = EXEC_IDLE;
+	// -1 .. not started, or killed and not reaped yet
+	if (status == -1)
+		res = timedout ? 128 + SIGKILL : -1;
+	else
+		res = WIFEXITED(status) ? WEXITSTATUS(status)
+			: (WIFSIGNALED(status) ? 128 + WTERMSIG(status) : -1);
+	if (timedout) {
+		msg = "timed out";
+	} else if (p->overflow) {
+		msg = "too much output";
+	} else if (res != 0) {
+		msg = "failed";
+	} else if ((msg = tf_validate(p->buf == NULL ? "" : p->buf, p->len,
+		&names, &line)) == NULL)
+	{
+		if ((out = malloc(p->len + 2)) == NULL) {
+			msg = strerror(errno);
+		} else {
+			memcpy(out, p->buf == NULL ? "" : p->buf, p->len);
+			if (p->len > 0 && out[p->len - 1] != '\n')
+				out[p->len++] = '\n';
+			out[p->len] = '\0';
+		}
+	}
+	if (msg != NULL)
+		PROM_WARN("%s: %s (status %d, line %lu) - output ignored.", p->name,
+			msg, res, (unsigned long) line);
+	// do not keep large buffers around
+	if (p->sz > 65536) {
+		free(p->buf);
+		p->buf = NULL;
+		p->sz = 0;
+	}
+	pthread_mutex_lock(&(cfg->lock));
+	p->duration = (gethrtime() - p->start) / NANOSEC_D;
+	p->status = res;
+	p->error = msg != NULL;
+	if (out != NULL) {
+		free(p->out);
+		free(p->names.b);
+		p->out = out;
+		p->names = names;
+		p->good = time(NULL);
+	} else {
+		free(names.b);
+	}
+	pthread_mutex_unlock(&(cfg->lock));
+}
+
+// Whether a metric family of p's output is already provided by a textfile or
+// a plugin emitted before.
+static bool
+conflicts(exec_cfg_t *cfg, uint32_t k) {
+	exec_plugin_t *p = &(cfg->p[k]), *o;
+	const char *name, *owner = NULL;
+	uint32_t i;
+
+	name = tf_conflict(&(p->names), &owner);
+	for (i = 0; name == NULL && i < k; i++) {
+		o = &(cfg->p[i]);
+		if (o->out != NULL && !o->conflict
+			&& (name = tf_names_common(&(p->names), &(o->names))) != NULL)
+		{
+			owner = o->name;
+		}
+	}
+	if (name == NULL) {
+		p->conflict = false;
+		return false;
+	}
+	// once per conflict, not on every scrape
+	if (!p->conflict)
+		PROM_WARN("%s: metric '%s' already provided by '%s' - output ignored.",
+			p->name, name, owner);
+	p->conflict = true;
+	return true;
+}
+
+// Run the commands on their schedule. If once is set, run each command once
+// and return when all are done.
+static void
+runAll(exec_cfg_t *cfg, bool once) {
+	struct pollfd pfd[EXEC_PARALLEL_MAX];
+	exec_plugin_t *pp[EXEC_PARALLEL_MAX];
+	exec_plugin_t *p;
+	hrtime_t now, wait;
+	uint32_t i, running, done;
+	int k, n, status;
+
+	while (1) {
+		now = gethrtime();
+		running = done = 0;
+		// killed ones may hang in the kernel forever, so they count as done
+		for (i = 0; i < cfg->n; i++) {
+			if (cfg->p[i].state != EXEC_IDLE && !cfg->p[i].killed)
+				running++;
+			else if (cfg->p[i].ran)
+				done++;
+		}
+		if (once && done == cfg->n)
+			return;
+		wait = NANOSEC;
+		for (i = 0; i < cfg->n; i++) {
+			p = &(cfg->p[i]);
+			if (p->state != EXEC_IDLE || (once && p->ran))
+				continue;
+			if (now < p->next) {
+				if (p->next - now < wait)
+					wait = p->next - now;
+				continue;
+			}
+			if (running == EXEC_PARALLEL_MAX)
+				continue;
+			// keep the schedule, but do not try to catch up
+			p->next = (p->next == 0 || now - p->next > p->interval * NANOSEC)
+				? now + p->interval * NANOSEC
+				: p->next + p->interval * NANOSEC;
+			p->ran = true;
+			if (spawn(p))
+				running++;
+			else
+				finish(cfg, p, -1, false);
+		}
+		n = 0;
+		for (i = 0; i < cfg->n; i++) {
+			p = &(cfg->p[i]);
+			if (p->state == EXEC_IDLE)
+				continue;
+			if (!p->killed && p->start + p->timeout * NANOSEC - now < wait)
+				wait = p->start + p->timeout * NANOSEC - now;
+			if (p->state == EXEC_REAPING) {
+				if (wait > NANOSEC / 10)
+					wait = NANOSEC / 10;
+			} else {
+				pfd[n].fd = p->fd;
+				pfd[n].events = POLLIN;
+				pp[n++] = p;
+			}
+		}
+		if (wait < 0)
+			wait = 0;
+		if ((k = poll(pfd, n, wait / 1000000 + 1)) == -1 && errno != EINTR) {
+			PROM_WARN("poll failed: %s", strerror(errno));
+			(void) sleep(1);
+		}
+		for (k = 0; k < n; k++) {
+			if (pfd[k].revents != 0 && readOutput(pp[k])) {
+				(void) close(pp[k]->fd);
+				pp[k]->fd = -1;
+				pp[k]->state = EXEC_REAPING;
+			}
+		}
+		now = gethrtime();
+		for (i = 0; i < cfg->n; i++) {
+			p = &(cfg->p[i]);
+			if (p->state == EXEC_IDLE)
+				continue;
+			if (p->state == EXEC_REAPING
+				&& waitpid(p->pid, &status, WNOHANG) == p->pid)
+			{
+				if (p->killed) {
+					p->killed = false;
+					p->state = EXEC_IDLE;
+				} else {
+					finish(cfg, p, status, false);
+				}
+			} else if (!p->killed && now - p->start > p->timeout * NANOSEC) {
+				// A command hanging in an uninterruptible wait (e.g. on a
+				// dead NFS server) must not block the others: record the
+				// timeout now and reap it later.
+				(void) kill(-(p->pid), SIGKILL);
+				finish(cfg, p, -1, true);
+				p->killed = true;
+				p->state = EXEC_REAPING;
+			}
+		}
+	}
+}
+
+static void *
+exec_runner(void *arg) {
+	runAll((exec_cfg_t *) arg, false);
+	return NULL;
+}
+
+static bool
+startRunner(exec_cfg_t *cfg) {
+	pthread_attr_t attr;
+	pthread_t tid;
+	int res;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	res = pthread_create(&tid, &attr, exec_runner, cfg);
+	pthread_attr_destroy(&attr);
+	if (res != 0) {
+		PROM_WARN("Unable to create exec thread: %s", strerror(res));
+		return false;
+	}
+	return true;
+}
+
+#define EMIT(metric, fmt, expr) \
+	addExpoInfo(metric); \
+	for (i = 0; i < cfg->n; i++) { \
+		p = &(cfg->p[i]); \
+		sprintf(lbl, "{plugin=\"%s\"}", p->name); \
+		sprintf(buf, fmt, expr); \
+		expo_emit(sb, metric ## _N, lbl, buf, (double) (expr)); \
+	}
+
+void
+collect_exec(psb_t *sb, bool compact, void *config) {
+	exec_cfg_t *cfg = (exec_cfg_t *) config;
+	exec_plugin_t *p;
+	time_t now;
+	uint32_t i;
+	char buf[64], lbl[EXEC_NAME_MAX + 16];
+
+	if (cfg == NULL || cfg->n == 0)
+		return;
+
+	PROM_DEBUG("collect_exec ...", "");
+	if (!cfg->started) {
+		cfg->start = time(NULL);
+		if (sb == NULL)
+			runAll(cfg, true);
+		else
+			cfg->started = startRunner(cfg);
+	}
+
+	bool free_sb = sb == NULL;
+	if (free_sb)
+		sb = psb_new();
+
+	now = time(NULL);
+	pthread_mutex_lock(&(cfg->lock));
+	for (i = 0; i < cfg->n; i++) {
+		if (cfg->p[i].out == NULL || conflicts(cfg, i)
+			|| cfg->p[i].out[0] == '\0')
+		{
+			continue;
+		}
+		if (expo_target == NULL)
+			psb_add_char(sb, '\n');
+		expo_emit_text(sb, cfg->p[i].out);
+	}
+	EMIT(SOLMEXM_EXEC_DURATION, "%.6f", p->duration)
+	EMIT(SOLMEXM_EXEC_STATUS, "%d", p->status)
+	EMIT(SOLMEXM_EXEC_ERROR, "%d", p->error || p->conflict ? 1 : 0)
+	EMIT(SOLMEXM_EXEC_AGE, "%ld",
+		(long) (now - (p->good == 0 ? cfg->start : p->good)))
+	pthread_mutex_unlock(&(cfg->lock));
+
+	if (free_sb) {
+		fprintf(stdout, "\n%s", psb_str(sb));
+		psb_destroy(sb);
+	}
+	PROM_DEBUG("collect_exec done", "");
+}
+
+#undef EMIT
@@ -0,0 +1,68 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file exec.h
+ * Run external commands asynchronously and merge their cached output.
+ */
+#ifndef SOLMEX_EXEC_H
+#define SOLMEX_EXEC_H
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default interval in seconds between two runs of a command. */
+#define EXEC_INTERVAL_DEFAULT 60
+/** Default max. runtime of a command in seconds. */
+#define EXEC_TIMEOUT_DEFAULT 10
+/** Max. number of commands running at the same time. */
+#define EXEC_PARALLEL_MAX 4
+/** Max. size of the output of a command. */
+#define EXEC_OUTPUT_MAX (1024 * 1024)
+/** Max. length of a plugin name. */
+#define EXEC_NAME_MAX 32
+
+/**
+ * @brief Parse the given exec plugin option string of the form
+ * 	`name[@secs[,timeout]]=command` and add it to the given config.
+ * 	`command` gets run via `/bin/sh -c` every `secs` seconds and gets killed
+ * 	if it is still running after `timeout` seconds.
+ * @param s	The string to parse.
+ * @param cfg	The config returned by a previous call, `NULL` on the 1st.
+ * @param valid Gets set to @code 1 if the given string could be parsed
+ * 	successfully, to @code 0 otherwise.
+ * @return A reference to the config to be used in the collect_exec() call.
+ * 	`NULL` if disabled, or the given config on error.
+ */
+void *parse_exec_opts(const char *s, void *cfg, int *valid);
+
+/**
+ * @brief Emit the output of the last successful run of each configured
+ * 	command, and its duration, exit status, error state and age. Commands get
+ * 	run by a background thread, which gets started on the first call.
+ * 	Only output, which passes tf_validate(), gets cached. Output containing
+ * 	a metric family already provided by a textfile (see tf_conflict()) or a
+ * 	preceding command gets dropped. When called in CLI mode (`sb == NULL`),
+ * 	all commands get run once in the foreground instead.
+ * @param sb	where to add the stats.
+ * @param compact	whether to add HELP and TYPE comments
+ * @param cfg	The reference returned by parse_exec_opts().
+ */
+void collect_exec(psb_t *sb, bool compact, void *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_EXEC_H
@@ -0,0 +1,854 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libprom/prom.h>
+
+#include "expo.h"
+
+// see also https://prometheus.io/docs/instrumenting/exposition_formats/
+
+void
+expo_buf_add(expo_buf_t *b, const void *data, size_t len) {
+	if (b->err || len == 0)
+		return;
+	if (b->len + len > b->sz) {
+		size_t sz = b->sz == 0 ? 4096 : b->sz;
+		uint8_t *n;
+		while (sz < b->len + len)
+			sz <<= 1;
+		if ((n = realloc(b->b, sz)) == NULL) {
+			PROM_WARN("Unable to allocate output buffer: %s", strerror(errno));
+			b->err = true;
+			return;
+		}
+		b->b = n;
+		b->sz = sz;
+	}
+	memcpy(b->b + b->len, data, len);
+	b->len += len;
+}
+
+void
+expo_buf_reset(expo_buf_t *b) {
+	free(b->b);
+	b->b = NULL;
+	b->len = b->sz = 0;
+	b->err = false;
+}
+
+size_t
+expo_unescape(char *dst, const char *src, size_t len) {
+	size_t i, k = 0;
+
+	for (i = 0; i < len; i++) {
+		if (src[i] == '\\' && i + 1 < len) {
+			i++;
+			dst[k++] = src[i] == 'n' ? '\n' : src[i];
+		} else {
+			dst[k++] = src[i];
+		}
+	}
+	return k;
+}
+
+int
+expo_labels(const expo_sample_t *s, expo_label_t *l) {
+	const char *p = s->labels, *end = s->labels + s->llen, *v;
+	int n = 0;
+
+	while (p < end && n < EXPO_LABELS_MAX) {
+		while (p < end && (*p == ',' || *p == ' '))
+			p++;
+		if (p == end)
+			break;
+		l[n].name = p;
+		while (p < end && *p != '=')
+			p++;
+		l[n].nlen = p - l[n].name;
+		if (p + 1 >= end || p[1] != '"')
+			break;
+		v = p += 2;
+		while (p < end && *p != '"')
+			p += (*p == '\\') ? 2 : 1;
+		if (p >= end)
+			break;
+		l[n].value = v;
+		l[n].vlen = p - v;
+		n++;
+		p++;
+	}
+	return n;
+}
+
+static bool
+sameName(const char *a, size_t alen, const char *b, size_t blen) {
+	return alen == blen && strncmp(a, b, alen) == 0;
+}
+
+// Whether name is the family name + one of the summary/histogram suffixes.
+static bool
+isChild(const expo_family_t *f, const char *name, size_t nlen) {
+	const char *sfx;
+	size_t slen;
+
+	if ((f->type != EXPO_SUMMARY && f->type != EXPO_HISTOGRAM)
+		|| nlen <= f->nlen || strncmp(name, f->name, f->nlen) != 0)
+	{
+		return false;
+	}
+	sfx = name + f->nlen;
+	slen = nlen - f->nlen;
+	return sameName(sfx, slen, "_sum", 4) || sameName(sfx, slen, "_count", 6)
+		|| (f->type == EXPO_HISTOGRAM && sameName(sfx, slen, "_bucket", 7));
+}
+
+static int32_t
+addFamily(expo_set_t *set, const char *name, size_t nlen) {
+	expo_family_t *f;
+
+	if (set->nfam == set->szfam) {
+		uint32_t sz = set->szfam == 0 ? 256 : set->szfam << 1;
+		if ((f = realloc(set->fam, sz * sizeof(expo_family_t))) == NULL)
+			return -1;
+		set->fam = f;
+		set->szfam = sz;
+	}
+	f = &(set->fam[set->nfam]);
+	memset(f, 0, sizeof(expo_family_t));
+	f->name = name;
+	f->nlen = nlen;
+	f->type = EXPO_UNTYPED;
+	f->first = f->last = UINT32_MAX;
+	return set->nfam++;
+}
+
+static int32_t
+getFamily(expo_set_t *set, const char *name, size_t nlen, bool sample) {
+	int32_t i;
+
+	for (i = set->nfam - 1; i >= 0; i--)
+		if (sameName(set->fam[i].name, set->fam[i].nlen, name, nlen))
+			return i;
+	if (sample)
+		for (i = set->nfam - 1; i >= 0; i--)
+			if (isChild(&(set->fam[i]), name, nlen))
+				return i;
+	return addFamily(set, name, nlen);
+}
+
+// Append a new sample to the given family. Only name, labels and value need
+// to be set by the caller.
+static expo_sample_t *
+appendSample(expo_set_t *set, int32_t i) {
+	expo_sample_t *x;
+	expo_family_t *f;
+
+	if (set->nsample == set->szsample) {
+		uint32_t sz = set->szsample == 0 ? 1024 : set->szsample << 1;
+		if ((x = realloc(set->sample, sz * sizeof(expo_sample_t))) == NULL)
+			return NULL;
+		set->sample = x;
+		set->szsample = sz;
+	}
+	x = &(set->sample[set->nsample]);
+	memset(x, 0, sizeof(expo_sample_t));
+	x->next = UINT32_MAX;
+	f = &(set->fam[i]);
+	if (f->first == UINT32_MAX)
+		f->first = set->nsample;
+	else
+		set->sample[f->last].next = set->nsample;
+	f->last = set->nsample++;
+	return x;
+}
+
+static expo_type_t
+parseType(const char *s, size_t len) {
+	if (sameName(s, len, "counter", 7))
+		return EXPO_COUNTER;
+	if (sameName(s, len, "gauge", 5))
+		return EXPO_GAUGE;
+	if (sameName(s, len, "summary", 7))
+		return EXPO_SUMMARY;
+	if (sameName(s, len, "histogram", 9))
+		return EXPO_HISTOGRAM;
+	return EXPO_UNTYPED;
+}
+
+// "# HELP name text" or "# TYPE name type"
+static int32_t
+parseComment(expo_set_t *set, const char *s, const char *eol) {
+	const char *name, *t;
+	bool help;
+	int32_t i;
+
+	if (eol - s < 8 || s[1] != ' ')
+		return -2;
+	if (strncmp(s + 2, "HELP ", 5) == 0)
+		help = true;
+	else if (strncmp(s + 2, "TYPE ", 5) == 0)
+		help = false;
+	else
+		return -2;
+	for (name = t = s + 7; t < eol && *t != ' '; t++)
+		;
+	if (t == name || t - name > UINT16_MAX)
+		return -2;
+	if ((i = getFamily(set, name, t - name, false)) < 0)
+		return -1;
+	if (t < eol)
+		t++;
+	if (help) {
+		set->fam[i].help = t;
+		set->fam[i].hlen = (eol - t) > UINT16_MAX ? UINT16_MAX : eol - t;
+	} else {
+		set->fam[i].type = parseType(t, eol - t);
+	}
+	return i;
+}
+
+static int
+parseSample(expo_set_t *set, const char *s, const char *eol, int32_t *cur) {
+	expo_sample_t *x;
+	const char *p, *l = NULL;
+	char *e;
+	size_t nlen, llen = 0;
+	int32_t i;
+	double v;
+
+	for (p = s; p < eol && *p != '{' && *p != ' ' && *p != '\t'; p++)
+		;
+	nlen = p - s;
+	if (nlen == 0 || nlen > UINT16_MAX)
+		return 0;
+	if (p < eol && *p == '{') {
+		bool inq = false;
+		for (l = ++p; p < eol && (inq || *p != '}'); p++) {
+			if (*p == '\\')
+				p++;
+			else if (*p == '"')
+				inq = !inq;
+		}
+		if (p >= eol || p - l > UINT16_MAX)
+			return 0;
+		llen = p - l;
+		p++;
+	}
+	while (p < eol && (*p == ' ' || *p == '\t'))
+		p++;
+	if (p == eol)
+		return 0;
+	v = strtod(p, &e);
+	if (e == p || e - p > UINT16_MAX)
+		return 0;
+
+	if (*cur >= 0 && (sameName(set->fam[*cur].name, set->fam[*cur].nlen, s, nlen)
+		|| isChild(&(set->fam[*cur]), s, nlen)))
+	{
+		i = *cur;
+	} else if ((i = getFamily(set, s, nlen, true)) < 0) {
+		return 1;
+	}
+	*cur = i;
+
+	if ((x = appendSample(set, i)) == NULL)
+		return 1;
+	x->name = s;
+	x->nlen = nlen;
+	x->labels = l;
+	x->llen = llen;
+	x->value = v;
+	x->val = p;
+	x->vlen = e - p;
+	for (p = e; p < eol && (*p == ' ' || *p == '\t'); p++)
+		;
+	if (p < eol)
+		x->ts = strtoll(p, NULL, 10);
+	return 0;
+}
+
+int
+expo_parse_into(expo_set_t *set, const char *s, size_t len) {
+	const char *end = s + len, *eol;
+	int32_t cur = -1, i;
+
+	for (; s < end; s = eol + 1) {
+		if ((eol = memchr(s, '\n', end - s)) == NULL)
+			eol = end;
+		if (eol == s)
+			continue;
+		if (*s == '#') {
+			if ((i = parseComment(set, s, eol)) == -1)
+				goto fail;
+			if (i >= 0)
+				cur = i;
+		} else if (parseSample(set, s, eol, &cur) != 0) {
+			goto fail;
+		}
+	}
+	return 0;
+
+fail:
+	PROM_WARN("Unable to allocate metric set: %s", strerror(errno));
+	return 1;
+}
+
+expo_set_t *
+expo_new(void) {
+	expo_set_t *set;
+
+	if ((set = calloc(1, sizeof(expo_set_t))) == NULL) {
+		PROM_WARN("Unable to allocate metric set: %s", strerror(errno));
+		return NULL;
+	}
+	set->cur = -1;
+	return set;
+}
+
+expo_set_t *
+expo_parse(const char *s, size_t len) {
+	expo_set_t *set;
+
+	if ((set = expo_new()) == NULL)
+		return NULL;
+	if (expo_parse_into(set, s, len) != 0) {
+		expo_free(set);
+		return NULL;
+	}
+	return set;
+}
+
+// Strings of values added directly. Chunks never move, so the samples and
+// families may point into them.
+typedef struct expo_chunk {
+	struct expo_chunk *next;
+	size_t len;
+	size_t sz;
+	char b[];
+} expo_chunk_t;
+
+#define EXPO_CHUNK_SZ	(64 * 1024 - sizeof(expo_chunk_t))
+
+static const char *
+copyStr(expo_set_t *set, const char *s, size_t len) {
+	expo_chunk_t *c = set->arena;
+	char *d;
+
+	if (c == NULL || c->sz - c->len < len) {
+		size_t sz = len > EXPO_CHUNK_SZ ? len : EXPO_CHUNK_SZ;
+		if ((c = malloc(sizeof(expo_chunk_t) + sz)) == NULL) {
+			PROM_WARN("Unable to allocate metric set: %s", strerror(errno));
+			return NULL;
+		}
+		c->len = 0;
+		c->sz = sz;
+		c->next = set->arena;
+		set->arena = c;
+	}
+	d = c->b + c->len;
+	memcpy(d, s, len);
+	c->len += len;
+	return d;
+}
+
+int32_t
+expo_add_family(expo_set_t *set, const char *name, const char *help,
+	expo_type_t type)
+{
+	size_t nlen = strlen(name), hlen;
+	const char *n;
+	int32_t i;
+
+	if (nlen == 0 || nlen > UINT16_MAX)
+		return -1;
+	for (i = set->nfam - 1; i >= 0; i--)
+		if (sameName(set->fam[i].name, set->fam[i].nlen, name, nlen))
+			break;
+	if (i < 0) {
+		if ((n = copyStr(set, name, nlen)) == NULL
+			|| (i = addFamily(set, n, nlen)) < 0)
+		{
+			return -1;
+		}
+	}
+	if (help != NULL && set->fam[i].help == NULL) {
+		hlen = strlen(help);
+		if (hlen > UINT16_MAX)
+			hlen = UINT16_MAX;
+		if ((set->fam[i].help = copyStr(set, help, hlen)) != NULL)
+			set->fam[i].hlen = hlen;
+	}
+	set->fam[i].type = type;
+	set->cur = i;
+	return i;
+}
+
+int
+expo_add_sample(expo_set_t *set, const char *name, const char *labels,
+	const char *val, double value)
+{
+	size_t nlen = strlen(name), llen = 0;
+	expo_sample_t *x;
+	const char *n, *l = NULL, *v;
+	int32_t i = set->cur;
+
+	if (nlen == 0 || nlen > UINT16_MAX)
+		return 1;
+	if (labels != NULL && *labels == '{') {
+		llen = strlen(labels);
+		if (llen < 2 || labels[llen - 1] != '}' || llen - 2 > UINT16_MAX)
+			return 1;
+		llen -= 2;
+		if (llen > 0 && (l = copyStr(set, labels + 1, llen)) == NULL)
+			return 1;
+	}
+	if (i >= 0 && (sameName(set->fam[i].name, set->fam[i].nlen, name, nlen)
+		|| isChild(&(set->fam[i]), name, nlen)))
+	{
+		n = (set->fam[i].nlen == nlen) ? set->fam[i].name : NULL;
+	} else {
+		n = NULL;
+		i = -1;
+	}
+	if (n == NULL && (n = copyStr(set, name, nlen)) == NULL)
+		return 1;
+	if (i < 0 && (i = getFamily(set, n, nlen, true)) < 0)
+		return 1;
+	set->cur = i;
+	if ((v = copyStr(set, val, strlen(val))) == NULL
+		|| (x = appendSample(set, i)) == NULL)
+	{
+		return 1;
+	}
+	x->name = n;
+	x->nlen = nlen;
+	x->labels = l;
+	x->llen = llen;
+	x->val = v;
+	x->vlen = strlen(val);
+	x->value = value;
+	x->copy = true;
+	return 0;
+}
+
+void
+expo_free(expo_set_t *set) {
+	expo_chunk_t *c;
+
+	if (set == NULL)
+		return;
+	while ((c = set->arena) != NULL) {
+		set->arena = c->next;
+		free(c);
+	}
+	free(set->fam);
+	free(set->sample);
+	free(set);
+}
+
+expo_set_t *expo_target = NULL;
+
+// the kstat times expo_emit() attaches to samples, see expo_emit_times()
+static struct {
+	hrtime_t snap;
+	hrtime_t crtime;
+} stamp = { 0, 0 };
+
+static void addSpan(size_t start, size_t end, hrtime_t snap, hrtime_t crtime);
+
+void
+expo_emit_times(hrtime_t snap, hrtime_t crtime) {
+	stamp.snap = snap;
+	stamp.crtime = snap == 0 ? 0 : crtime;
+}
+
+void
+expo_emit_info(psb_t *sb, bool compact, const char *name, const char *type,
+	const char *help)
+{
+	if (expo_target != NULL) {
+		(void) expo_add_family(expo_target, name, help,
+			parseType(type, strlen(type)));
+		return;
+	}
+	if (compact)
+		return;
+	psb_add_str(sb, "\n# HELP ");
+	psb_add_str(sb, name);
+	psb_add_char(sb, ' ');
+	psb_add_str(sb, help);
+	psb_add_str(sb, "\n# TYPE ");
+	psb_add_str(sb, name);
+	psb_add_char(sb, ' ');
+	psb_add_str(sb, type);
+	psb_add_char(sb, '\n');
+}
+
+void
+expo_emit(psb_t *sb, const char *name, const char *labels, const char *val,
+	double v)
+{
+	expo_sample_t *x;
+	size_t start;
+
+	if (expo_target != NULL) {
+		if (expo_add_sample(expo_target, name, labels, val, v) == 0
+			&& stamp.snap != 0)
+		{
+			x = &(expo_target->sample[expo_target->nsample - 1]);
+			x->snap = stamp.snap;
+			x->crtime = stamp.crtime;
+		}
+		return;
+	}
+	start = psb_len(sb);
+	psb_add_str(sb, name);
+	if (labels != NULL)
+		psb_add_str(sb, labels);
+	psb_add_char(sb, ' ');
+	psb_add_str(sb, val);
+	psb_add_char(sb, '\n');
+	if (stamp.snap != 0)
+		addSpan(start, psb_len(sb), stamp.snap, stamp.crtime);
+}
+
+void
+expo_emit_uint(psb_t *sb, const char *name, const char *labels, uint64_t v) {
+	char buf[24];
+
+	sprintf(buf, "%lu", v);
+	expo_emit(sb, name, labels, buf, (double) v);
+}
+
+void
+expo_emit_int(psb_t *sb, const char *name, const char *labels, int64_t v) {
+	char buf[24];
+
+	sprintf(buf, "%ld", v);
+	expo_emit(sb, name, labels, buf, (double) v);
+}
+
+void
+expo_emit_double(psb_t *sb, const char *name, const char *labels, double v) {
+	char buf[32];
+
+	if (isnan(v))
+		strcpy(buf, "NaN");
+	else if (isinf(v))
+		strcpy(buf, v > 0 ? "+Inf" : "-Inf");
+	else
+		sprintf(buf, "%.17g", v);
+	expo_emit(sb, name, labels, buf, v);
+}
+
+void
+expo_emit_text(psb_t *sb, const char *text) {
+	expo_set_t *set = expo_target;
+	size_t len = strlen(text);
+	const char *s;
+	uint32_t i;
+
+	if (set == NULL) {
+		psb_add_str(sb, text);
+		return;
+	}
+	// the text might be a cache, which gets rebuilt or freed before the set
+	if (len == 0 || (s = copyStr(set, text, len)) == NULL)
+		return;
+	i = set->nsample;
+	if (expo_parse_into(set, s, len) != 0)
+		return;
+	// no offsets into the scrape buffer
+	for (; i < set->nsample; i++)
+		set->sample[i].copy = true;
+}
+
+typedef struct expo_span {
+	size_t start;
+	size_t end;
+	hrtime_t snap;
+	hrtime_t crtime;
+} expo_span_t;
+
+// not thread-safe: the http server handles one request at a time
+static struct {
+	expo_span_t *s;
+	uint32_t n;
+	uint32_t sz;
+	hrtime_t offset;	// wall clock - hrtime in ns
+} spans = { NULL, 0, 0, 0 };
+
+void
+expo_spans_reset(void) {
+	struct timespec ts;
+
+	spans.n = 0;
+	stamp.snap = stamp.crtime = 0;
+	if (clock_gettime(CLOCK_REALTIME, &ts) == 0)
+		spans.offset = (hrtime_t) ts.tv_sec * NANOSEC + ts.tv_nsec
+			- gethrtime();
+}
+
+#define HR2MS(t)	(((t) + spans.offset) / 1000000)
+
+static void
+addSpan(size_t start, size_t end, hrtime_t snap, hrtime_t crtime) {
+	expo_span_t *x;
+
+	if (spans.n > 0) {
+		x = &(spans.s[spans.n - 1]);
+		if (x->end == start && x->snap == snap && x->crtime == crtime) {
+			x->end = end;
+			return;
+		}
+	}
+	if (spans.n == spans.sz) {
+		uint32_t sz = spans.sz == 0 ? 32 : spans.sz << 1;
+		if ((x = realloc(spans.s, sz * sizeof(expo_span_t))) == NULL)
+			return;
+		spans.s = x;
+		spans.sz = sz;
+	}
+	x = &(spans.s[spans.n++]);
+	x->start = start;
+	x->end = end;
+	x->snap = snap;
+	x->crtime = crtime;
+}
+
+void
+expo_span_add(size_t start, size_t end, uint32_t first, hrtime_t snap,
+	hrtime_t crtime)
+{
+	expo_span_t *tail;
+	uint32_t i, k, n;
+	size_t pos;
+
+	if (snap == 0)
+		return;
+	for (i = first; expo_target != NULL && i < expo_target->nsample; i++) {
+		if (expo_target->sample[i].snap == 0) {
+			expo_target->sample[i].snap = snap;
+			expo_target->sample[i].crtime = crtime;
+		}
+	}
+	if (start >= end)
+		return;
+	// fill the gaps between the spans recorded via expo_emit() since start
+	for (k = spans.n; k > 0 && spans.s[k - 1].start >= start; k--)
+		;
+	if ((n = spans.n - k) == 0) {
+		addSpan(start, end, snap, crtime);
+		return;
+	}
+	if ((tail = malloc(n * sizeof(expo_span_t))) == NULL)
+		return;
+	memcpy(tail, spans.s + k, n * sizeof(expo_span_t));
+	spans.n = k;
+	for (i = 0, pos = start; i < n; pos = tail[i].end, i++) {
+		if (tail[i].start > pos)
+			addSpan(pos, tail[i].start, snap, crtime);
+		addSpan(tail[i].start, tail[i].end, tail[i].snap, tail[i].crtime);
+	}
+	if (pos < end)
+		addSpan(pos, end, snap, crtime);
+	free(tail);
+}
+
+hrtime_t
+expo_span_snap(size_t off) {
+	uint32_t lo = 0, hi = spans.n, m;
+
+	// spans get added in buffer order and do not overlap
+	while (lo < hi) {
+		m = (lo + hi) / 2;
+		if (spans.s[m].end <= off)
+			lo = m + 1;
+		else
+			hi = m;
+	}
+	return (lo < spans.n && off >= spans.s[lo].start) ? spans.s[lo].snap : 0;
+}
+
+void
+expo_apply_spans(expo_set_t *set, const char *text, size_t len) {
+	expo_sample_t *s;
+	uint32_t i, k = 0;
+	size_t off;
+
+	for (i = 0; i < set->nsample; i++) {
+		s = &(set->sample[i]);
+		if (s->copy) {
+			if (s->snap != 0) {
+				s->ts = HR2MS(s->snap);
+				s->created = s->crtime == 0 ? 0 : HR2MS(s->crtime);
+			}
+			continue;
+		}
+		// text samples are in text order
+		off = s->name - text;
+		if (off >= len)
+			continue;
+		while (k < spans.n && spans.s[k].end <= off)
+			k++;
+		if (k == spans.n || off < spans.s[k].start)
+			continue;
+		s->ts = HR2MS(spans.s[k].snap);
+		s->created = spans.s[k].crtime == 0 ? 0 : HR2MS(spans.s[k].crtime);
+	}
+}
+
+#undef HR2MS
+
+// Parse the q-value of the given media range parameters, 1 if n/a.
+static double
+qValue(const char *s, const char *end) {
+	const char *q;
+
+	for (q = s; q != NULL && q < end; q = memchr(q, ';', end - q)) {
+		q++;
+		while (q < end && *q == ' ')
+			q++;
+		if (end - q > 2 && q[0] == 'q' && q[1] == '=')
+			return strtod(q + 2, NULL);
+	}
+	return 1;
+}
+
+static bool
+contains(const char *s, const char *end, const char *what) {
+	size_t len = strlen(what);
+
+	for (; end - s >= (ptrdiff_t) len; s++)
+		if (strncmp(s, what, len) == 0)
+			return true;
+	return false;
+}
+
+static const expo_encoder_t encoders[EXPO_FMT_MAX] = {
+	[EXPO_FMT_TEXT] = { "prometheus",
+		"text/plain; version=0.0.4; charset=utf-8", NULL, false, false },
+	[EXPO_FMT_PROTOBUF] = { "protobuf", EXPO_PROTOBUF_CT,
+		expo_encode_protobuf, false, true },
+	[EXPO_FMT_OPENMETRICS] = { "openmetrics", EXPO_OPENMETRICS_CT,
+		expo_encode_openmetrics, true, true },
+	[EXPO_FMT_INFLUX] = { "influx", "text/plain; charset=utf-8",
+		expo_encode_influx, true, true },
+	[EXPO_FMT_GRAPHITE] = { "graphite", "text/plain; charset=utf-8",
+		expo_encode_graphite, true, true },
+	[EXPO_FMT_JSON] = { "json", "application/json",
+		expo_encode_json, true, true },
+};
+
+const expo_encoder_t *
+expo_encoder(expo_format_t fmt) {
+	return ((unsigned int) fmt < EXPO_FMT_MAX) ? &(encoders[fmt]) : NULL;
+}
+
+bool
+expo_format_parse(const char *name, expo_format_t *fmt) {
+	int i;
+
+	if (name == NULL)
+		return false;
+	for (i = 0; i < EXPO_FMT_MAX; i++) {
+		if (strcmp(name, encoders[i].name) == 0) {
+			*fmt = (expo_format_t) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+expo_format_t
+expo_negotiate(const char *accept, bool openmetrics) {
+	const char *s, *end;
+	expo_format_t best = EXPO_FMT_TEXT, fmt;
+	double bestq = -1, q;
+
+	if (accept == NULL)
+		return EXPO_FMT_TEXT;
+	for (s = accept; *s != '\0'; s = (*end == ',') ? end + 1 : end) {
+		if ((end = strchr(s, ',')) == NULL)
+			end = s + strlen(s);
+		while (s < end && *s == ' ')
+			s++;
+		if (strncmp(s, "application/openmetrics-text", 28) == 0) {
+			if (!openmetrics)
+				continue;
+			fmt = EXPO_FMT_OPENMETRICS;
+		} else if (contains(s, end, "application/vnd.google.protobuf")
+			&& contains(s, end, "proto=io.prometheus.client.MetricFamily")
+			&& contains(s, end, "encoding=delimited"))
+		{
+			fmt = EXPO_FMT_PROTOBUF;
+		} else if (strncmp(s, "application/json", 16) == 0) {
+			fmt = EXPO_FMT_JSON;
+		} else if (strncmp(s, "text/plain", 10) == 0
+			|| strncmp(s, "*/*", 3) == 0)
+		{
+			fmt = EXPO_FMT_TEXT;
+		} else {
+			continue;
+		}
+		// RFC 9110: q=0 means not acceptable
+		if ((q = qValue(s, end)) <= 0)
+			continue;
+		if (q > bestq) {
+			bestq = q;
+			best = fmt;
+		}
+	}
+	return best;
+}
+
+int
+expo_convert(expo_format_t fmt, expo_set_t *set, char **body, size_t *len,
+	const char **ctype)
+{
+	const expo_encoder_t *enc = expo_encoder(fmt);
+	expo_set_t *x = set;
+	expo_buf_t out = { NULL, 0, 0, false };
+	struct timespec ts;
+	int res;
+
+	if (enc == NULL || enc->encode == NULL)
+		return 1;
+	if (x == NULL && (x = expo_parse(*body, *len)) == NULL)
+		return 1;
+	if (enc->timestamps)
+		expo_apply_spans(x, *body, *len);
+	(void) clock_gettime(CLOCK_REALTIME, &ts);
+	// pull: the scraper adds the instance label
+	res = enc->encode(&out, x,
+		(int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000, NULL);
+	if (x != set)
+		expo_free(x);
+	if (res != 0) {
+		expo_buf_reset(&out);
+		return 1;
+	}
+	*ctype = enc->ctype;
+	free(*body);
+	// MHD_create_response_from_buffer() does not like NULL for empty bodies
+	if (out.b == NULL && (out.b = malloc(1)) == NULL)
+		return 1;
+	*body = (char *) out.b;
+	*len = out.len;
+	return 0;
+}
@@ -0,0 +1,463 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file expo.h
+ * Exposition layer: an indexed view of the metrics of a scrape and the
+ * encoders, which render it in formats other than the Prometheus text format.
+ */
+#ifndef SOLMEX_EXPO_H
+#define SOLMEX_EXPO_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Max. number of labels per sample. */
+#define EXPO_LABELS_MAX 32
+
+/** The output formats supported. */
+typedef enum expo_format {
+	EXPO_FMT_TEXT = 0,		/**< Prometheus text format 0.0.4 (as collected) */
+	EXPO_FMT_PROTOBUF,		/**< length-delimited MetricFamily messages */
+	EXPO_FMT_OPENMETRICS,	/**< OpenMetrics 1.0 text incl. kstat crtimes */
+	EXPO_FMT_INFLUX,		/**< InfluxDB line protocol */
+	EXPO_FMT_GRAPHITE,		/**< Graphite plaintext protocol with tags */
+	EXPO_FMT_JSON,			/**< JSON array of metric families */
+	EXPO_FMT_MAX
+} expo_format_t;
+
+/** The metric types as used by the Prometheus protobuf format. */
+typedef enum expo_type {
+	EXPO_COUNTER = 0,
+	EXPO_GAUGE = 1,
+	EXPO_SUMMARY = 2,
+	EXPO_UNTYPED = 3,
+	EXPO_HISTOGRAM = 4,
+} expo_type_t;
+
+/**
+ * A single sample. All strings are not `\0` terminated and point either into
+ * the scraped text or - if added via expo_add_sample() - into the set.
+ */
+typedef struct expo_sample {
+	const char *name;
+	const char *labels;		/**< text between the braces, still escaped */
+	const char *val;		/**< the value as found in the text */
+	uint16_t nlen;
+	uint16_t llen;
+	uint16_t vlen;
+	bool copy;				/**< added via expo_add_sample() */
+	uint32_t next;			/**< index of the next sample of the family */
+	double value;
+	int64_t ts;				/**< timestamp in ms, 0 if n/a */
+	int64_t created;		/**< creation time in ms, 0 if n/a */
+	hrtime_t snap;			/**< ks_snaptime of a copy, 0 if n/a */
+	hrtime_t crtime;		/**< ks_crtime of a copy, 0 if n/a */
+} expo_sample_t;
+
+typedef struct expo_family {
+	const char *name;
+	const char *help;		/**< still escaped, NULL if n/a */
+	uint16_t nlen;
+	uint16_t hlen;
+	expo_type_t type;
+	uint32_t first;			/**< index of the 1st sample, UINT32_MAX if none */
+	uint32_t last;
+} expo_family_t;
+
+typedef struct expo_set {
+	expo_family_t *fam;
+	expo_sample_t *sample;
+	uint32_t nfam;
+	uint32_t nsample;
+	uint32_t szfam;
+	uint32_t szsample;
+	int32_t cur;			/**< family of the last expo_add_sample() */
+	struct expo_chunk *arena;	/**< strings of expo_add_*() */
+} expo_set_t;
+
+typedef struct expo_label {
+	const char *name;
+	const char *value;		/**< still escaped */
+	uint16_t nlen;
+	uint16_t vlen;
+} expo_label_t;
+
+/** A growable byte buffer for binary output. */
+typedef struct expo_buf {
+	uint8_t *b;
+	size_t len;
+	size_t sz;
+	bool err;				/**< set if an allocation failed */
+} expo_buf_t;
+
+/**
+ * @brief Render the given set in a certain format and append it to `out`.
+ * @param out	The buffer to append to.
+ * @param set	The metrics to render.
+ * @param now	The timestamp in ms to use for samples without a kstat time.
+ * 	Formats, which have optional timestamps, ignore it.
+ * @param instance	The value of the `instance` label to add to each sample,
+ * 	`NULL` if none should be added. Ignored by Prometheus formats.
+ * @return `0` on success, `1` on error.
+ */
+typedef int (*expo_encode_fn)(expo_buf_t *out, const expo_set_t *set,
+	int64_t now, const char *instance);
+
+/** An output encoder. */
+typedef struct expo_encoder {
+	const char *name;		/**< as used in `?format=name` */
+	const char *ctype;		/**< the content type of its output */
+	expo_encode_fn encode;	/**< NULL for the text format (no conversion) */
+	bool timestamps;		/**< whether kstat times should be applied */
+	bool values;			/**< whether it renders from collector values, i.e.
+								 collectors should fill expo_target */
+} expo_encoder_t;
+
+/**
+ * @brief Get the encoder for the given format.
+ * @return `NULL` if the format is unknown.
+ */
+const expo_encoder_t *expo_encoder(expo_format_t fmt);
+
+/**
+ * @brief Lookup the format with the given encoder name.
+ * @param name	The name to lookup, e.g. `json`.
+ * @param fmt	Where to store the format found.
+ * @return `true` if found, `false` otherwise.
+ */
+bool expo_format_parse(const char *name, expo_format_t *fmt);
+
+/**
+ * @brief Pick the best output format for the given HTTP Accept header value
+ * 	wrt. the q-values of the media ranges. Ranges with `q=0` are not
+ * 	acceptable and get skipped.
+ * @param accept	The value of the Accept header, might be `NULL`.
+ * @param openmetrics	Whether application/openmetrics-text may be picked.
+ * 	If `false`, OpenMetrics gets used on explicit request (?format=) only.
+ * @return The format to use, EXPO_FMT_TEXT if no other format matches.
+ */
+expo_format_t expo_negotiate(const char *accept, bool openmetrics);
+
+/**
+ * @brief Render the given metrics in the given format. On success the text
+ * 	gets freed and replaced by the result.
+ * @param fmt	The format to convert to.
+ * @param set	The metrics to render. `NULL` to index the given text. Otherwise
+ * 	the text gets ignored (see expo_target). The set does not get freed.
+ * @param body	The malloc()ed text to convert.
+ * @param len	The length of the text in bytes.
+ * @param ctype	Where to store the content type of the result.
+ * @return `0` on success, `1` if the text has been left unchanged.
+ */
+int expo_convert(expo_format_t fmt, expo_set_t *set, char **body, size_t *len,
+	const char **ctype);
+
+/**
+ * @brief Forget all recorded kstat spans and take the current offset between
+ * 	gethrtime() and the wall clock to convert kstat times. Should be called
+ * 	at the start of each scrape.
+ */
+void expo_spans_reset(void);
+
+/**
+ * @brief Record the kstat times of the metrics written into the scrape
+ * 	buffer or added to expo_target by a single collector call. Samples
+ * 	already stamped via expo_emit_times() keep their times, only the rest
+ * 	gets the given ones.
+ * @param start	Offset of the first byte written by the collector.
+ * @param end	Offset of the byte after the last one written by the collector.
+ * @param first	Index of the first sample added to expo_target by the
+ * 	collector. Ignored if expo_target is `NULL`.
+ * @param snap	The most recent ks_snaptime of the kstats read, 0 if n/a.
+ * @param crtime	The ks_crtime of the kstat read, 0 if n/a or more than one
+ * 	kstat has been read.
+ */
+void expo_span_add(size_t start, size_t end, uint32_t first, hrtime_t snap,
+	hrtime_t crtime);
+
+/**
+ * @brief Get the kstat snaptime recorded for the given offset of the current
+ * 	scrape buffer.
+ * @param off	Offset of the metric within the scrape buffer.
+ * @return The ks_snaptime as delivered by gethrtime(), 0 if n/a.
+ */
+hrtime_t expo_span_snap(size_t off);
+
+/**
+ * @brief Attach the kstat times recorded via expo_span_add() during the
+ * 	last scrape to the related samples of the given set.
+ * @param set	The set to update.
+ * @param text	The text the set has been made from.
+ * @param len	The length of the text in bytes.
+ */
+void expo_apply_spans(expo_set_t *set, const char *text, size_t len);
+
+/**
+ * @brief Collect the values of all metrics.
+ * @param set	Where to store the set of collected metrics (timestamps already
+ * 	applied), might be set to `NULL` on error. In this case the returned
+ * 	text contains the metrics in the Prometheus text format.
+ * @param len	Where to store the length of the returned text.
+ * @return `NULL` on error, the malloc()ed text otherwise.
+ */
+typedef char *(*expo_scrape_fn)(expo_set_t **set, size_t *len);
+
+/**
+ * @brief Collect all metrics and render them in the given format.
+ * @param fmt	The format to use. If it cannot be rendered, the Prometheus
+ * 	text format gets used.
+ * @param len	Where to store the length of the returned data.
+ * @return `NULL` on error, the malloc()ed data otherwise.
+ */
+typedef char *(*expo_render_fn)(expo_format_t fmt, size_t *len);
+
+/**
+ * @brief Index the given metrics in the Prometheus text format. The text
+ * 	must not be changed or freed as long as the returned set is in use.
+ * 	Samples without a HELP or TYPE comment get an untyped family of their own.
+ * @param s		The text to index.
+ * @param len	The length of the text in bytes.
+ * @return `NULL` on error, the indexed set otherwise.
+ */
+expo_set_t *expo_parse(const char *s, size_t len);
+
+/**
+ * @brief Like expo_parse(), but add the samples of the given text to the
+ * 	given set. Samples of a family already in the set get appended to it.
+ * @return `0` on success, `1` on error.
+ */
+int expo_parse_into(expo_set_t *set, const char *s, size_t len);
+
+/**
+ * @brief Create an empty set to be filled via expo_add_family() and
+ * 	expo_add_sample() and/or expo_parse_into().
+ * @return `NULL` on error, the new set otherwise.
+ */
+expo_set_t *expo_new(void);
+
+/**
+ * @brief Add a metric family to the given set. If the set has already a
+ * 	family with this name, it gets returned instead. All strings get copied.
+ * @param name	The name of the family.
+ * @param help	The HELP text (escaped as in the text format), might be `NULL`.
+ * @param type	The type of the family.
+ * @return `-1` on error, the index of the family otherwise.
+ */
+int32_t expo_add_family(expo_set_t *set, const char *name, const char *help,
+	expo_type_t type);
+
+/**
+ * @brief Add a sample to the given set. It gets appended to the family with
+ * 	the same name (or the summary/histogram it belongs to), an untyped
+ * 	family gets created if there is none. All strings get copied.
+ * @param name	The name of the metric.
+ * @param labels	The labels incl. the braces (escaped as in the text
+ * 	format), `NULL` or `""` if none.
+ * @param val	The value as it would appear in the text format.
+ * @param value	The value.
+ * @return `0` on success, `1` on error.
+ */
+int expo_add_sample(expo_set_t *set, const char *name, const char *labels,
+	const char *val, double value);
+
+/**
+ * If not `NULL`, the expo_emit_*() functions add the metrics to this set
+ * instead of writing them in the text format into the given buffer. It gets
+ * set for the duration of a scrape, if the requested format gets rendered
+ * from collector values (see expo_encoder_t.values). Not thread-safe.
+ */
+extern expo_set_t *expo_target;
+
+/**
+ * @brief Emit the HELP and TYPE of a metric family: add it to expo_target if
+ * 	set, append the comments to `sb` otherwise unless `compact` is set.
+ */
+void expo_emit_info(psb_t *sb, bool compact, const char *name,
+	const char *type, const char *help);
+
+/** expo_emit_info() for the SOLMEXM_* metric `metric`, like addPromInfo(). */
+#define addExpoInfo(metric) \
+	expo_emit_info(sb, compact, metric ## _N, metric ## _T, metric ## _D)
+
+/**
+ * @brief Emit a sample: add it to expo_target if set, append
+ * 	`name{labels} value` to `sb` otherwise.
+ * @param labels	The labels incl. the braces, `NULL` if none.
+ */
+void expo_emit_uint(psb_t *sb, const char *name, const char *labels,
+	uint64_t v);
+
+/** @brief Same as expo_emit_uint(), but for a signed value. */
+void expo_emit_int(psb_t *sb, const char *name, const char *labels,
+	int64_t v);
+
+/** @brief Same as expo_emit_uint(), but for a floating point value. */
+void expo_emit_double(psb_t *sb, const char *name, const char *labels,
+	double v);
+
+/**
+ * @brief Same as expo_emit_uint(), but the value is already formatted as it
+ * 	should appear in the text format.
+ * @param val	The value as text.
+ * @param v	The value.
+ */
+void expo_emit(psb_t *sb, const char *name, const char *labels,
+	const char *val, double v);
+
+/**
+ * @brief Let the expo_emit_*() functions stamp all samples emitted after this
+ * 	call with the given kstat times, so that they do not get the times of
+ * 	the whole collector call (see expo_span_add()). Gets reset by
+ * 	expo_spans_reset().
+ * @param snap	The ks_snaptime of the kstat the following samples are made
+ * 	of, 0 to stop stamping.
+ * @param crtime	The ks_crtime of this kstat.
+ */
+void expo_emit_times(hrtime_t snap, hrtime_t crtime);
+
+/**
+ * @brief Emit metrics already available in the Prometheus text format, e.g.
+ * 	cached output or the output of other applications: parse them into
+ * 	expo_target if set, append them to `sb` otherwise. The text gets copied,
+ * 	so it may be changed or freed afterwards.
+ * @param text	The `\0` terminated metrics.
+ */
+void expo_emit_text(psb_t *sb, const char *text);
+
+/**
+ * @brief Free all resources allocated for the given set.
+ */
+void expo_free(expo_set_t *set);
+
+/**
+ * @brief Split the labels of the given sample into the given array.
+ * @return The number of labels stored in `l`.
+ */
+int expo_labels(const expo_sample_t *s, expo_label_t *l);
+
+/**
+ * @brief Copy the given escaped label value or HELP text to `dst` and resolve
+ * 	its escape sequences. `dst` needs room for at least `len` bytes.
+ * @return The number of bytes stored in `dst`.
+ */
+size_t expo_unescape(char *dst, const char *src, size_t len);
+
+/** @brief Append `len` bytes of `data` to the given buffer. */
+void expo_buf_add(expo_buf_t *b, const void *data, size_t len);
+
+/** @brief Free the data of the given buffer and reset it. */
+void expo_buf_reset(expo_buf_t *b);
+
+/**
+ * @brief Append the given set as length-delimited `io.prometheus.client.
+ * 	MetricFamily` protobuf messages to the given buffer.
+ * @return `0` on success, `1` on error.
+ */
+int expo_encode_protobuf(expo_buf_t *out, const expo_set_t *set, int64_t now,
+	const char *instance);
+
+/**
+ * @brief Append the given set in the OpenMetrics 1.0 text format incl. the
+ * 	`# EOF` terminator to the given buffer. Counter families get exposed
+ * 	without the `_total` suffix, their samples with it plus a `*_created`
+ * 	sample if the kstat crtime is known. Samples get the kstat snaptime as
+ * 	timestamp if known, unless expo_om_timestamps is `false`.
+ * @return `0` on success, `1` on error.
+ */
+int expo_encode_openmetrics(expo_buf_t *out, const expo_set_t *set,
+	int64_t now, const char *instance);
+
+/**
+ * Whether expo_encode_openmetrics() should add the kstat snaptimes as sample
+ * timestamps. Default: `true`.
+ */
+extern bool expo_om_timestamps;
+
+/**
+ * @brief Append the given set in the InfluxDB line protocol to the given
+ * 	buffer: the metric name becomes the measurement, labels become tags and
+ * 	the value gets stored in the field `value`. Timestamps are in ns. Samples
+ * 	with a NaN or Inf value get skipped.
+ * @return `0` on success, `1` on error.
+ */
+int expo_encode_influx(expo_buf_t *out, const expo_set_t *set, int64_t now,
+	const char *instance);
+
+/**
+ * @brief Append the given set in the Graphite plaintext protocol using
+ * 	tags (`name;tag=value;... value seconds`) to the given buffer. Samples
+ * 	with a NaN or Inf value get skipped.
+ * @return `0` on success, `1` on error.
+ */
+int expo_encode_graphite(expo_buf_t *out, const expo_set_t *set, int64_t now,
+	const char *instance);
+
+/**
+ * @brief Append the given set as a JSON array of metric families to the
+ * 	given buffer. NaN and Inf values get emitted as `null`.
+ * @return `0` on success, `1` on error.
+ */
+int expo_encode_json(expo_buf_t *out, const expo_set_t *set, int64_t now,
+	const char *instance);
+
+/** The content type of expo_encode_openmetrics() output. */
+#define EXPO_OPENMETRICS_CT \
+	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/** The content type of expo_encode_protobuf() output. */
+#define EXPO_PROTOBUF_CT "application/vnd.google.protobuf; " \
+	"proto=io.prometheus.client.MetricFamily; encoding=delimited"
+
+/** Max. length of a delta token incl. the terminating `\0`. */
+#define EXPO_DELTA_TOKEN_LEN 48
+/** Number of delta scrapes a token stays valid. */
+#define EXPO_DELTA_KEEP 64
+
+/**
+ * @brief Reduce the given metrics in the Prometheus text format to the
+ * 	samples, which appeared or changed their value since the delta scrape
+ * 	identified by the given token, and record the current state as a new
+ * 	generation. The result starts with `# TOKEN token full|delta`, and lists
+ * 	each series the client knows but which is gone now as `# REMOVED
+ * 	name{labels}`. If the token is unknown or expired, all samples get
+ * 	returned. On success the text gets freed and replaced by the result.
+ * 	Not thread-safe.
+ * @param since	The token of the client, might be `NULL`.
+ * @param body	The malloc()ed text to reduce.
+ * @param len	The length of the text in bytes.
+ * @param token	Where to store the new token. Needs room for
+ * 	EXPO_DELTA_TOKEN_LEN bytes.
+ * @param full	Where to store, whether all samples got returned.
+ * @return `0` on success, `1` if the text has been left unchanged.
+ */
+int expo_delta(const char *since, char **body, size_t *len, char *token,
+	bool *full);
+
+/* Protobuf wire format primitives (see expo_pb.c). */
+void pb_varint(expo_buf_t *b, uint64_t v);
+void pb_tag(expo_buf_t *b, uint32_t field, uint8_t wtype);
+void pb_bytes(expo_buf_t *b, uint32_t field, const void *data, size_t len);
+void pb_double(expo_buf_t *b, uint32_t field, double v);
+void pb_uint64(expo_buf_t *b, uint32_t field, uint64_t v);
+void pb_msg(expo_buf_t *b, uint32_t field, const expo_buf_t *msg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_EXPO_H
@@ -0,0 +1,283 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libprom/prom.h>
+
+#include "expo.h"
+
+// Change tracking for the /metrics/delta endpoint. Each delta scrape is a new
+// generation. Per series (name + labels) we remember the value, the
+// generation it changed last and the generation it has been seen last, so
+// that any client token of the last EXPO_DELTA_KEEP generations can be served
+// from a single table.
+
+#define ADD_STR(b, s)	expo_buf_add(b, s, strlen(s))
+
+typedef struct delta_entry {
+	char *key;			// name{labels}
+	double value;
+	uint64_t changed;	// generation of the last change or re-appearance
+	uint64_t seen;		// generation the series has been seen last
+	int next;			// next entry in the hash chain, -1 .. end
+} delta_entry_t;
+
+typedef struct delta_state {
+	delta_entry_t *entry;
+	int len;
+	int sz;
+	int *hash;
+	uint32_t hsz;		// always a power of 2
+	uint64_t gen;		// current generation
+	unsigned long epoch;	// tokens of other epochs are unknown
+} delta_state_t;
+
+static delta_state_t state = { .entry = NULL, .hash = NULL };
+
+static uint32_t
+keyHash(const char *s, size_t len) {
+	uint32_t h = 2166136261U;	// FNV-1a
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char) s[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static bool
+rehash(delta_state_t *ds) {
+	uint32_t h, sz = ds->hsz == 0 ? 1024 : ds->hsz;
+	int i, *n;
+
+	while (sz < (uint32_t) ds->sz * 2)
+		sz <<= 1;
+	if (sz != ds->hsz) {
+		if ((n = realloc(ds->hash, sz * sizeof(int))) == NULL)
+			return false;
+		ds->hash = n;
+		ds->hsz = sz;
+	}
+	memset(ds->hash, 0xff, ds->hsz * sizeof(int));
+	for (i = 0; i < ds->len; i++) {
+		h = keyHash(ds->entry[i].key, strlen(ds->entry[i].key))
+			& (ds->hsz - 1);
+		ds->entry[i].next = ds->hash[h];
+		ds->hash[h] = i;
+	}
+	return true;
+}
+
+// Build name{labels} of the given sample in b.
+static void
+sampleKey(expo_buf_t *b, const expo_sample_t *s) {
+	b->len = 0;
+	expo_buf_add(b, s->name, s->nlen);
+	if (s->llen > 0) {
+		expo_buf_add(b, "{", 1);
+		expo_buf_add(b, s->labels, s->llen);
+		expo_buf_add(b, "}", 1);
+	}
+	expo_buf_add(b, "", 1);
+}
+
+static delta_entry_t *
+lookup(delta_state_t *ds, const char *key, size_t len) {
+	delta_entry_t *e;
+	uint32_t h = keyHash(key, len);
+	int i;
+
+	if (ds->hsz == 0 && !rehash(ds))
+		return NULL;
+	for (i = ds->hash[h & (ds->hsz - 1)]; i >= 0; i = ds->entry[i].next) {
+		if (strcmp(ds->entry[i].key, key) == 0)
+			return &(ds->entry[i]);
+	}
+	if (ds->len == ds->sz) {
+		int sz = ds->sz == 0 ? 1024 : ds->sz << 1;
+		if ((e = realloc(ds->entry, sz * sizeof(delta_entry_t))) == NULL)
+			return NULL;
+		ds->entry = e;
+		ds->sz = sz;
+		if (!rehash(ds))
+			return NULL;
+	}
+	e = &(ds->entry[ds->len]);
+	if ((e->key = strdup(key)) == NULL)
+		return NULL;
+	e->seen = 0;
+	e->changed = ds->gen;
+	h &= ds->hsz - 1;
+	e->next = ds->hash[h];
+	ds->hash[h] = ds->len++;
+	return e;
+}
+
+// Drop all series, which vanished before the oldest valid token.
+static void
+purge(delta_state_t *ds) {
+	int i, k;
+
+	if (ds->gen <= EXPO_DELTA_KEEP)
+		return;
+	for (i = k = 0; i < ds->len; i++) {
+		if (ds->entry[i].seen < ds->gen - EXPO_DELTA_KEEP) {
+			free(ds->entry[i].key);
+			continue;
+		}
+		if (i != k)
+			ds->entry[k] = ds->entry[i];
+		k++;
+	}
+	if (k != ds->len) {
+		ds->len = k;
+		(void) rehash(ds);
+	}
+}
+
+// Return the generation of the given token, 0 if unknown or expired.
+static uint64_t
+tokenGen(const delta_state_t *ds, const char *token) {
+	unsigned long epoch;
+	unsigned long long gen;
+	int n = 0;
+
+	if (token == NULL || sscanf(token, "%lx-%llu%n", &epoch, &gen, &n) != 2
+		|| token[n] != '\0' || epoch != ds->epoch || gen > ds->gen
+		|| gen + EXPO_DELTA_KEEP < ds->gen)
+	{
+		return 0;
+	}
+	return gen;
+}
+
+static void
+addSample(expo_buf_t *out, const expo_family_t *f, const expo_sample_t *s,
+	bool *hdr)
+{
+	static const char *types[] = {
+		"counter", "gauge", "summary", "untyped", "histogram"
+	};
+
+	if (!*hdr) {
+		if (f->help != NULL) {
+			ADD_STR(out, "# HELP ");
+			expo_buf_add(out, f->name, f->nlen);
+			expo_buf_add(out, " ", 1);
+			expo_buf_add(out, f->help, f->hlen);
+			expo_buf_add(out, "\n", 1);
+		}
+		ADD_STR(out, "# TYPE ");
+		expo_buf_add(out, f->name, f->nlen);
+		expo_buf_add(out, " ", 1);
+		ADD_STR(out, types[f->type]);
+		expo_buf_add(out, "\n", 1);
+		*hdr = true;
+	}
+	expo_buf_add(out, s->name, s->nlen);
+	if (s->llen > 0) {
+		expo_buf_add(out, "{", 1);
+		expo_buf_add(out, s->labels, s->llen);
+		expo_buf_add(out, "}", 1);
+	}
+	expo_buf_add(out, " ", 1);
+	expo_buf_add(out, s->val, s->vlen);
+	expo_buf_add(out, "\n", 1);
+}
+
+int
+expo_delta(const char *since, char **body, size_t *len, char *token,
+	bool *full)
+{
+	delta_state_t *ds = &state;
+	expo_set_t *set;
+	expo_buf_t out = { NULL, 0, 0, false }, key = { NULL, 0, 0, false };
+	const expo_family_t *f;
+	const expo_sample_t *s;
+	delta_entry_t *e;
+	uint64_t from;
+	uint32_t i, k;
+	int j;
+	bool hdr;
+
+	if ((set = expo_parse(*body, *len)) == NULL)
+		return 1;
+	if (ds->epoch == 0)
+		ds->epoch = ((unsigned long) time(NULL) << 16) ^ getpid();
+	ds->gen++;
+	from = tokenGen(ds, since);
+	*full = from == 0;
+	snprintf(token, EXPO_DELTA_TOKEN_LEN, "%lx-%llu", ds->epoch,
+		(unsigned long long) ds->gen);
+	ADD_STR(&out, "# TOKEN ");
+	ADD_STR(&out, token);
+	ADD_STR(&out, *full ? " full\n" : " delta\n");
+	for (i = 0; i < set->nfam; i++) {
+		f = &(set->fam[i]);
+		hdr = false;
+		for (k = f->first; k != UINT32_MAX; k = s->next) {
+			s = &(set->sample[k]);
+			sampleKey(&key, s);
+			if (key.err || (e = lookup(ds, (char *) key.b, key.len - 1))
+				== NULL)
+			{
+				PROM_WARN("Unable to allocate delta state: %s",
+					strerror(errno));
+				goto fail;
+			}
+			// bitwise, so that NaN == NaN
+			if (e->changed == ds->gen || e->seen != ds->gen - 1
+				|| memcmp(&(e->value), &(s->value), sizeof(double)) != 0)
+			{
+				e->changed = ds->gen;
+				e->value = s->value;
+			}
+			e->seen = ds->gen;
+			if (*full || e->changed > from)
+				addSample(&out, f, s, &hdr);
+		}
+	}
+	// series the client knows, which are gone now
+	for (j = 0; !*full && j < ds->len; j++) {
+		e = &(ds->entry[j]);
+		if (e->seen < ds->gen && e->seen >= from) {
+			ADD_STR(&out, "# REMOVED ");
+			ADD_STR(&out, e->key);
+			expo_buf_add(&out, "\n", 1);
+		}
+	}
+	purge(ds);
+	expo_free(set);
+	expo_buf_reset(&key);
+	if (out.err) {
+		expo_buf_reset(&out);
+		return 1;
+	}
+	free(*body);
+	*body = (char *) out.b;
+	*len = out.len;
+	return 0;
+
+fail:
+	// this generation is incomplete: force a full response next time
+	ds->epoch++;
+	expo_free(set);
+	expo_buf_reset(&key);
+	expo_buf_reset(&out);
+	return 1;
+}
@@ -0,0 +1,268 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libprom/prom.h>
+
+#include "expo.h"
+
+// InfluxDB line protocol, Graphite plaintext (tagged) and JSON encoders.
+// https://docs.influxdata.com/influxdb/v2/reference/syntax/line-protocol/
+// https://graphite.readthedocs.io/en/latest/tags.html
+
+#define ADD_STR(b, s)	expo_buf_add(b, s, strlen(s))
+
+// max. size of an unescaped HELP text or label value
+#define FMT_SCRATCH_SZ	(UINT16_MAX + 1)
+
+// Append s and put a backslash in front of each char in esc.
+static void
+addEscaped(expo_buf_t *b, const char *s, size_t len, const char *esc) {
+	size_t i, k;
+
+	for (i = k = 0; i < len; i++) {
+		if (strchr(esc, s[i]) != NULL) {
+			expo_buf_add(b, s + k, i - k);
+			expo_buf_add(b, "\\", 1);
+			k = i;
+		}
+	}
+	expo_buf_add(b, s + k, len - k);
+}
+
+// Append s and replace each char in bad by an underscore.
+static void
+addSanitized(expo_buf_t *b, const char *s, size_t len, const char *bad) {
+	size_t i, k;
+
+	for (i = k = 0; i < len; i++) {
+		if (strchr(bad, s[i]) != NULL || s[i] == '\n') {
+			expo_buf_add(b, s + k, i - k);
+			expo_buf_add(b, "_", 1);
+			k = i + 1;
+		}
+	}
+	expo_buf_add(b, s + k, len - k);
+}
+
+// Finite values only. Always rendered from the parsed value, so that e.g.
+// "0x1p3", "+1" or "010" do not leak into formats, which do not accept
+// them. Callers skip NaN and +/-Inf or write them as null.
+static void
+addNumber(expo_buf_t *b, const expo_sample_t *s) {
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%.17g", s->value);
+	ADD_STR(b, buf);
+}
+
+int
+expo_encode_influx(expo_buf_t *out, const expo_set_t *set, int64_t now,
+	const char *instance)
+{
+	expo_label_t l[EXPO_LABELS_MAX];
+	const expo_sample_t *s;
+	char *scratch, buf[32];
+	uint32_t i;
+	int j, n;
+	size_t len;
+
+	if ((scratch = malloc(FMT_SCRATCH_SZ)) == NULL) {
+		PROM_WARN("Unable to allocate influx buffer: %s", strerror(errno));
+		return 1;
+	}
+	for (i = 0; i < set->nsample; i++) {
+		s = &(set->sample[i]);
+		// no way to express NaN or Inf
+		if (!isfinite(s->value))
+			continue;
+		addEscaped(out, s->name, s->nlen, ", ");
+		n = expo_labels(s, l);
+		for (j = 0; j < n; j++) {
+			// empty tag values are not allowed
+			if ((len = expo_unescape(scratch, l[j].value, l[j].vlen)) == 0)
+				continue;
+			expo_buf_add(out, ",", 1);
+			addEscaped(out, l[j].name, l[j].nlen, ",= ");
+			expo_buf_add(out, "=", 1);
+			addEscaped(out, scratch, len, ",= ");
+		}
+		if (instance != NULL && *instance != '\0') {
+			ADD_STR(out, ",instance=");
+			addEscaped(out, instance, strlen(instance), ",= ");
+		}
+		ADD_STR(out, " value=");
+		addNumber(out, s);
+		snprintf(buf, sizeof(buf), " %lld000000\n",
+			(long long) (s->ts != 0 ? s->ts : now));
+		ADD_STR(out, buf);
+	}
+	free(scratch);
+	return out->err ? 1 : 0;
+}
+
+int
+expo_encode_graphite(expo_buf_t *out, const expo_set_t *set, int64_t now,
+	const char *instance)
+{
+	expo_label_t l[EXPO_LABELS_MAX];
+	const expo_sample_t *s;
+	char *scratch, buf[32];
+	uint32_t i;
+	int j, n;
+	size_t len;
+
+	if ((scratch = malloc(FMT_SCRATCH_SZ)) == NULL) {
+		PROM_WARN("Unable to allocate graphite buffer: %s", strerror(errno));
+		return 1;
+	}
+	for (i = 0; i < set->nsample; i++) {
+		s = &(set->sample[i]);
+		if (!isfinite(s->value))
+			continue;
+		// name;tag=value;... value timestamp
+		expo_buf_add(out, s->name, s->nlen);
+		n = expo_labels(s, l);
+		for (j = 0; j < n; j++) {
+			if ((len = expo_unescape(scratch, l[j].value, l[j].vlen)) == 0)
+				continue;
+			expo_buf_add(out, ";", 1);
+			expo_buf_add(out, l[j].name, l[j].nlen);
+			expo_buf_add(out, "=", 1);
+			addSanitized(out, scratch, len, ";~ ");
+		}
+		if (instance != NULL && *instance != '\0') {
+			ADD_STR(out, ";instance=");
+			addSanitized(out, instance, strlen(instance), ";~ ");
+		}
+		expo_buf_add(out, " ", 1);
+		addNumber(out, s);
+		snprintf(buf, sizeof(buf), " %lld\n",
+			(long long) ((s->ts != 0 ? s->ts : now) / 1000));
+		ADD_STR(out, buf);
+	}
+	free(scratch);
+	return out->err ? 1 : 0;
+}
+
+static void
+addJsonString(expo_buf_t *b, const char *s, size_t len) {
+	char buf[8];
+	size_t i, k;
+
+	expo_buf_add(b, "\"", 1);
+	for (i = k = 0; i < len; i++) {
+		unsigned char c = s[i];
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		expo_buf_add(b, s + k, i - k);
+		k = i + 1;
+		if (c == '"' || c == '\\') {
+			buf[0] = '\\';
+			buf[1] = c;
+			expo_buf_add(b, buf, 2);
+		} else if (c == '\n') {
+			expo_buf_add(b, "\\n", 2);
+		} else {
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			expo_buf_add(b, buf, 6);
+		}
+	}
+	expo_buf_add(b, s + k, len - k);
+	expo_buf_add(b, "\"", 1);
+}
+
+// [{"name":"...","type":"...","help":"...","samples":[{"labels":{...},
+// "value":1,"ts":ms},...]},...]
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+int
+expo_encode_json(expo_buf_t *out, const expo_set_t *set, int64_t now,
+	const char *instance)
+{
+#pragma GCC diagnostic pop
+	static const char *types[] = {
+		"counter", "gauge", "summary", "untyped", "histogram"
+	};
+	expo_label_t l[EXPO_LABELS_MAX];
+	const expo_family_t *f;
+	const expo_sample_t *s;
+	char *scratch, buf[32];
+	uint32_t i, k;
+	int j, n;
+	bool first = true;
+
+	if ((scratch = malloc(FMT_SCRATCH_SZ)) == NULL) {
+		PROM_WARN("Unable to allocate json buffer: %s", strerror(errno));
+		return 1;
+	}
+	expo_buf_add(out, "[", 1);
+	for (i = 0; i < set->nfam; i++) {
+		f = &(set->fam[i]);
+		if (f->first == UINT32_MAX)
+			continue;
+		ADD_STR(out, first ? "{\"name\":" : ",\n{\"name\":");
+		first = false;
+		addJsonString(out, f->name, f->nlen);
+		ADD_STR(out, ",\"type\":\"");
+		ADD_STR(out, types[f->type]);
+		expo_buf_add(out, "\"", 1);
+		if (f->help != NULL) {
+			ADD_STR(out, ",\"help\":");
+			addJsonString(out, scratch,
+				expo_unescape(scratch, f->help, f->hlen));
+		}
+		ADD_STR(out, ",\"samples\":[");
+		for (k = f->first; k != UINT32_MAX; k = s->next) {
+			s = &(set->sample[k]);
+			ADD_STR(out, k == f->first ? "{" : ",{");
+			if (s->nlen != f->nlen) {
+				// summary and histogram children
+				ADD_STR(out, "\"name\":");
+				addJsonString(out, s->name, s->nlen);
+				expo_buf_add(out, ",", 1);
+			}
+			ADD_STR(out, "\"labels\":{");
+			n = expo_labels(s, l);
+			for (j = 0; j < n; j++) {
+				if (j > 0)
+					expo_buf_add(out, ",", 1);
+				addJsonString(out, l[j].name, l[j].nlen);
+				expo_buf_add(out, ":", 1);
+				addJsonString(out, scratch,
+					expo_unescape(scratch, l[j].value, l[j].vlen));
+			}
+			if (instance != NULL && *instance != '\0') {
+				ADD_STR(out, n > 0 ? ",\"instance\":" : "\"instance\":");
+				addJsonString(out, instance, strlen(instance));
+			}
+			ADD_STR(out, "},\"value\":");
+			// JSON knows no NaN and Inf
+			if (isfinite(s->value))
+				addNumber(out, s);
+			else
+				ADD_STR(out, "null");
+			if (s->ts != 0) {
+				snprintf(buf, sizeof(buf), ",\"ts\":%lld", (long long) s->ts);
+				ADD_STR(out, buf);
+			}
+			expo_buf_add(out, "}", 1);
+		}
+		ADD_STR(out, "]}");
+	}
+	ADD_STR(out, "]\n");
+	free(scratch);
+	return out->err ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "expo.h"
+
+// https://github.com/prometheus/OpenMetrics/blob/main/specification/OpenMetrics.md
+
+#define ADD_STR(b, s)	expo_buf_add(b, s, strlen(s))
+
+bool expo_om_timestamps = true;
+
+static bool
+isTotal(const char *name, size_t len) {
+	return len > 6 && strncmp(name + len - 6, "_total", 6) == 0;
+}
+
+// text format HELP escapes \\ and \n only, OpenMetrics also needs \"
+static void
+addHelp(expo_buf_t *b, const char *s, size_t len) {
+	size_t i, k;
+
+	for (i = k = 0; i < len; i++) {
+		if (s[i] == '\\') {
+			i++;
+		} else if (s[i] == '"') {
+			expo_buf_add(b, s + k, i - k);
+			expo_buf_add(b, "\\", 1);
+			k = i;
+		}
+	}
+	expo_buf_add(b, s + k, len - k);
+}
+
+static void
+addValue(expo_buf_t *b, const expo_sample_t *s) {
+	char buf[32];
+
+	if (isnan(s->value)) {
+		ADD_STR(b, "NaN");
+	} else if (isinf(s->value)) {
+		ADD_STR(b, s->value < 0 ? "-Inf" : "+Inf");
+	} else {
+		snprintf(buf, sizeof(buf), "%.17g", s->value);
+		ADD_STR(b, buf);
+	}
+}
+
+// ms since the epoch as seconds
+static void
+addSeconds(expo_buf_t *b, int64_t ms) {
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), " %lld.%03d", (long long) (ms / 1000),
+		(int) (ms % 1000));
+	ADD_STR(b, buf);
+}
+
+static void
+addLabels(expo_buf_t *b, const expo_sample_t *s) {
+	if (s->llen > 0) {
+		expo_buf_add(b, "{", 1);
+		expo_buf_add(b, s->labels, s->llen);
+		expo_buf_add(b, "}", 1);
+	}
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+int
+expo_encode_openmetrics(expo_buf_t *out, const expo_set_t *set, int64_t now,
+	const char *instance)
+{
+#pragma GCC diagnostic pop
+	static const char *types[] = {
+		"counter", "gauge", "summary", "unknown", "histogram"
+	};
+	const expo_family_t *f;
+	const expo_sample_t *s;
+	uint32_t i, k;
+	size_t nlen;
+	bool counter, total;
+
+	// Samples carry the kstat snaptime unless disabled: Prometheus does not
+	// mark series with timestamps as stale, when they vanish.
+	for (i = 0; i < set->nfam; i++) {
+		f = &(set->fam[i]);
+		if (f->first == UINT32_MAX)
+			continue;
+		// the family of a counter has no _total suffix, its samples need one
+		counter = f->type == EXPO_COUNTER;
+		total = counter && isTotal(f->name, f->nlen);
+		nlen = total ? f->nlen - 6 : f->nlen;
+		ADD_STR(out, "# TYPE ");
+		expo_buf_add(out, f->name, nlen);
+		expo_buf_add(out, " ", 1);
+		ADD_STR(out, types[f->type]);
+		expo_buf_add(out, "\n", 1);
+		if (f->help != NULL && f->hlen > 0) {
+			ADD_STR(out, "# HELP ");
+			expo_buf_add(out, f->name, nlen);
+			expo_buf_add(out, " ", 1);
+			addHelp(out, f->help, f->hlen);
+			expo_buf_add(out, "\n", 1);
+		}
+		for (k = f->first; k != UINT32_MAX; k = s->next) {
+			s = &(set->sample[k]);
+			expo_buf_add(out, s->name, s->nlen);
+			if (counter && !total)
+				ADD_STR(out, "_total");
+			addLabels(out, s);
+			expo_buf_add(out, " ", 1);
+			addValue(out, s);
+			if (expo_om_timestamps && s->ts != 0)
+				addSeconds(out, s->ts);
+			expo_buf_add(out, "\n", 1);
+			if (!counter || s->created == 0)
+				continue;
+			// family name + _created
+			expo_buf_add(out, f->name, nlen);
+			ADD_STR(out, "_created");
+			addLabels(out, s);
+			addSeconds(out, s->created);
+			expo_buf_add(out, "\n", 1);
+		}
+	}
+	ADD_STR(out, "# EOF\n");
+	return out->err ? 1 : 0;
+}
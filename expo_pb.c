@@ -0,0 +1,296 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libprom/prom.h>
+
+#include "expo.h"
+
+// A minimal protobuf encoder - just enough for the Prometheus client model:
+// https://github.com/prometheus/client_model/blob/master/io/prometheus/client/metrics.proto
+// https://protobuf.dev/programming-guides/encoding/
+
+#define PB_VARINT	0
+#define PB_I64		1
+#define PB_LEN		2
+
+// max. size of an unescaped HELP text or label value
+#define PB_SCRATCH_SZ	(UINT16_MAX + 1)
+
+void
+pb_varint(expo_buf_t *b, uint64_t v) {
+	uint8_t buf[10];
+	int n = 0;
+
+	while (v >= 0x80) {
+		buf[n++] = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	buf[n++] = v;
+	expo_buf_add(b, buf, n);
+}
+
+void
+pb_tag(expo_buf_t *b, uint32_t field, uint8_t wtype) {
+	pb_varint(b, (field << 3) | wtype);
+}
+
+void
+pb_bytes(expo_buf_t *b, uint32_t field, const void *data, size_t len) {
+	pb_tag(b, field, PB_LEN);
+	pb_varint(b, len);
+	expo_buf_add(b, data, len);
+}
+
+void
+pb_double(expo_buf_t *b, uint32_t field, double v) {
+	uint8_t buf[8];
+	uint64_t u;
+	int i;
+
+	// always little endian on the wire, also on SPARC
+	memcpy(&u, &v, sizeof(u));
+	for (i = 0; i < 8; i++, u >>= 8)
+		buf[i] = u & 0xFF;
+	pb_tag(b, field, PB_I64);
+	expo_buf_add(b, buf, 8);
+}
+
+void
+pb_uint64(expo_buf_t *b, uint32_t field, uint64_t v) {
+	pb_tag(b, field, PB_VARINT);
+	pb_varint(b, v);
+}
+
+void
+pb_msg(expo_buf_t *b, uint32_t field, const expo_buf_t *msg) {
+	pb_bytes(b, field, msg->b, msg->len);
+}
+
+typedef struct pb_group {
+	char *key;			// labels w/o le and quantile
+	uint32_t sample;	// the sample to take the labels from
+	uint64_t count;
+	double sum;
+	expo_buf_t sub;		// encoded buckets or quantiles
+} pb_group_t;
+
+typedef struct pb_ctx {
+	expo_buf_t fam;
+	expo_buf_t metric;
+	expo_buf_t tmp;
+	expo_buf_t lbl;
+	char *scratch;
+	pb_group_t *grp;
+	uint32_t ngrp;
+	uint32_t szgrp;
+} pb_ctx_t;
+
+static bool
+isSpecial(const expo_label_t *l) {
+	return (l->nlen == 2 && strncmp(l->name, "le", 2) == 0)
+		|| (l->nlen == 8 && strncmp(l->name, "quantile", 8) == 0);
+}
+
+// LabelPair: 1 name, 2 value
+static void
+addLabels(pb_ctx_t *c, const expo_sample_t *s, bool skipSpecial) {
+	expo_label_t l[EXPO_LABELS_MAX];
+	int i, n = expo_labels(s, l);
+	size_t len;
+
+	for (i = 0; i < n; i++) {
+		if (skipSpecial && isSpecial(&(l[i])))
+			continue;
+		c->lbl.len = 0;
+		pb_bytes(&(c->lbl), 1, l[i].name, l[i].nlen);
+		len = expo_unescape(c->scratch, l[i].value, l[i].vlen);
+		pb_bytes(&(c->lbl), 2, c->scratch, len);
+		pb_msg(&(c->metric), 1, &(c->lbl));
+	}
+}
+
+static const char *
+specialValue(const expo_sample_t *s, const char *name, size_t nlen) {
+	expo_label_t l[EXPO_LABELS_MAX];
+	int i, n = expo_labels(s, l);
+
+	for (i = 0; i < n; i++)
+		if (l[i].nlen == nlen && strncmp(l[i].name, name, nlen) == 0)
+			return l[i].value;
+	return NULL;
+}
+
+static pb_group_t *
+getGroup(pb_ctx_t *c, const expo_sample_t *s, uint32_t idx) {
+	expo_label_t l[EXPO_LABELS_MAX];
+	int i, n = expo_labels(s, l);
+	size_t len = 0;
+	uint32_t g;
+	pb_group_t *x;
+
+	for (i = 0; i < n; i++) {
+		if (isSpecial(&(l[i])))
+			continue;
+		memcpy(c->scratch + len, l[i].name, l[i].nlen + l[i].vlen + 2);
+		len += l[i].nlen + l[i].vlen + 2;
+		c->scratch[len++] = ',';
+	}
+	c->scratch[len] = '\0';
+	for (g = 0; g < c->ngrp; g++)
+		if (strcmp(c->grp[g].key, c->scratch) == 0)
+			return &(c->grp[g]);
+	if (c->ngrp == c->szgrp) {
+		uint32_t sz = c->szgrp + 16;
+		if ((x = realloc(c->grp, sz * sizeof(pb_group_t))) == NULL)
+			return NULL;
+		c->grp = x;
+		c->szgrp = sz;
+	}
+	x = &(c->grp[c->ngrp]);
+	memset(x, 0, sizeof(pb_group_t));
+	if ((x->key = strdup(c->scratch)) == NULL)
+		return NULL;
+	x->sample = idx;
+	c->ngrp++;
+	return x;
+}
+
+static void
+resetGroups(pb_ctx_t *c) {
+	uint32_t g;
+
+	for (g = 0; g < c->ngrp; g++) {
+		free(c->grp[g].key);
+		expo_buf_reset(&(c->grp[g].sub));
+	}
+	c->ngrp = 0;
+}
+
+// Summary: 1 sample_count, 2 sample_sum, 3 quantile {1 quantile, 2 value}
+// Histogram: 1 sample_count, 2 sample_sum, 3 bucket {1 cumulative_count,
+// 2 upper_bound}
+static int
+addGrouped(pb_ctx_t *c, const expo_set_t *set, const expo_family_t *f) {
+	const expo_sample_t *s;
+	const char *sfx, *v;
+	pb_group_t *g;
+	uint32_t i;
+
+	for (i = f->first; i != UINT32_MAX; i = s->next) {
+		s = &(set->sample[i]);
+		if ((g = getGroup(c, s, i)) == NULL)
+			return 1;
+		sfx = s->name + f->nlen;
+		if (s->nlen - f->nlen == 4 && strncmp(sfx, "_sum", 4) == 0) {
+			g->sum = s->value;
+		} else if (s->nlen - f->nlen == 6 && strncmp(sfx, "_count", 6) == 0) {
+			g->count = (uint64_t) s->value;
+		} else {
+			bool bucket = f->type == EXPO_HISTOGRAM;
+			if ((v = specialValue(s, bucket ? "le" : "quantile",
+				bucket ? 2 : 8)) == NULL)
+			{
+				continue;
+			}
+			c->tmp.len = 0;
+			if (bucket) {
+				pb_uint64(&(c->tmp), 1, (uint64_t) s->value);
+				pb_double(&(c->tmp), 2, strtod(v, NULL));
+			} else {
+				pb_double(&(c->tmp), 1, strtod(v, NULL));
+				pb_double(&(c->tmp), 2, s->value);
+			}
+			pb_msg(&(g->sub), 3, &(c->tmp));
+		}
+	}
+	for (i = 0; i < c->ngrp; i++) {
+		g = &(c->grp[i]);
+		c->metric.len = 0;
+		addLabels(c, &(set->sample[g->sample]), true);
+		c->tmp.len = 0;
+		pb_uint64(&(c->tmp), 1, g->count);
+		pb_double(&(c->tmp), 2, g->sum);
+		expo_buf_add(&(c->tmp), g->sub.b, g->sub.len);
+		pb_msg(&(c->metric), f->type == EXPO_HISTOGRAM ? 7 : 4, &(c->tmp));
+		pb_msg(&(c->fam), 4, &(c->metric));
+	}
+	resetGroups(c);
+	return 0;
+}
+
+// MetricFamily: 1 name, 2 help, 3 type, 4 metric
+// Metric: 1 label, 2 gauge, 3 counter, 4 summary, 5 untyped, 6 timestamp_ms,
+// 7 histogram
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+int
+expo_encode_protobuf(expo_buf_t *out, const expo_set_t *set, int64_t now,
+	const char *instance)
+{
+#pragma GCC diagnostic pop
+	pb_ctx_t c;
+	const expo_family_t *f;
+	const expo_sample_t *s;
+	uint32_t i, k;
+	int res = 1;
+
+	memset(&c, 0, sizeof(c));
+	if ((c.scratch = malloc(PB_SCRATCH_SZ)) == NULL) {
+		PROM_WARN("Unable to allocate protobuf buffer: %s", strerror(errno));
+		return 1;
+	}
+	for (i = 0; i < set->nfam; i++) {
+		f = &(set->fam[i]);
+		if (f->first == UINT32_MAX)
+			continue;
+		c.fam.len = 0;
+		pb_bytes(&(c.fam), 1, f->name, f->nlen);
+		if (f->help != NULL)
+			pb_bytes(&(c.fam), 2, c.scratch,
+				expo_unescape(c.scratch, f->help, f->hlen));
+		pb_uint64(&(c.fam), 3, f->type);
+		if (f->type == EXPO_SUMMARY || f->type == EXPO_HISTOGRAM) {
+			if (addGrouped(&c, set, f) != 0)
+				goto end;
+		} else {
+			for (k = f->first; k != UINT32_MAX; k = s->next) {
+				s = &(set->sample[k]);
+				c.metric.len = 0;
+				addLabels(&c, s, false);
+				c.tmp.len = 0;
+				pb_double(&(c.tmp), 1, s->value);
+				pb_msg(&(c.metric), f->type == EXPO_COUNTER ? 3
+					: (f->type == EXPO_GAUGE ? 2 : 5), &(c.tmp));
+				if (s->ts != 0)
+					pb_uint64(&(c.metric), 6, (uint64_t) s->ts);
+				pb_msg(&(c.fam), 4, &(c.metric));
+			}
+		}
+		pb_varint(out, c.fam.len);
+		expo_buf_add(out, c.fam.b, c.fam.len);
+	}
+	res = (out->err || c.fam.err || c.metric.err || c.tmp.err || c.lbl.err)
+		? 1 : 0;
+
+end:
+	resetGroups(&c);
+	free(c.grp);
+	free(c.scratch);
+	expo_buf_reset(&(c.fam));
+	expo_buf_reset(&(c.metric));
+	expo_buf_reset(&(c.tmp));
+	expo_buf_reset(&(c.lbl));
+	return res;
+}
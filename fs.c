@@ -17,6 +17,8 @@
 
 #include "fs.h"
 #include "ks_util.h"
+#include "zones.h"
+#include "expo.h"
 
 typedef uint16_t fsmode_t;
 
@@ -60,16 +62,19 @@ typedef uint32_t fs_mods_t;
 #define GET_FS_MOD(var, idx) 	(((var) >> (idx)) & 0x1)
 
 static zoneid_t MY_ZID = -1;
-static char MY_ZNAME[ZONENAME_MAX];
+static const char *MY_ZNAME = "";
 #define ANY_ZID INT32_MAX
 
 void
 check_zone_vars(void) {
+	const char *zname;
+
 	if (MY_ZID != -1)
 		return;
 
 	MY_ZID = getzoneid();
-	getzonenamebyid(MY_ZID, MY_ZNAME, ZONENAME_MAX);
+	if ((zname = zone_name(MY_ZID)) != NULL)
+		MY_ZNAME = zname;
 }
 
 typedef struct zinfo {
@@ -170,6 +175,7 @@ parse_fs_mods_list(const char *optarg, int *valid) {
 		return NULL;
 
 	char *cfg, *t, *c, *s;
+	const char *zn;
 	psb_t *b = psb_new();
 	size_t len = strlen(optarg);
 	int zcount = 0;
@@ -209,10 +215,9 @@ parse_fs_mods_list(const char *optarg, int *valid) {
 			// handle zonename
 			c[0] = '\0';
 			zchain = zchain_head;
-			if (strcmp(t, "this") == 0)
-				t = MY_ZNAME;
+			zn = strcmp(t, "this") == 0 ? MY_ZNAME : t;
 			while (zchain) {
-				if (strcmp(zchain->zname, t) == 0)
+				if (strcmp(zchain->zname, zn) == 0)
 					break;
 				zchain = zchain->next;
 			}
@@ -225,10 +230,10 @@ parse_fs_mods_list(const char *optarg, int *valid) {
 				}
 				zcount++;
 				zchain->mods = FS_MODS_NONE;
-				zchain->zname = strdup(t);
-				zchain->zid = strcmp(t, "any") == 0 ? ANY_ZID : getzoneidbyname(t);
+				zchain->zname = strdup(zn);
+				zchain->zid = strcmp(zn, "any") == 0 ? ANY_ZID : zone_id(zn);
 				if (zchain->zid == -1)
-					fprintf(stderr, "WARNING: Zone '%s' not found!\n", t);
+					fprintf(stderr, "WARNING: Zone '%s' not found!\n", zn);
 				zchain->next = zchain_head;
 				zchain_head = zchain;
 			}
@@ -291,13 +296,13 @@ parse_fs_mods_list(const char *optarg, int *valid) {
 #define DUMP_CFG(cfg, buf, sz)	\
 	dump_cfg((cfg), (buf), (sz)); \
 	fprintf(stderr, "CFG: %s\n", (buf));
-#define MAX_METRIC_PREFIX_SZ	ZONENAME_MAX+64	// SOLMEX_FS_NAME_PREFIX "autofs{" ATTR_NGZ  "='',op=''}""
+#define MAX_METRIC_PREFIX_SZ	ZONENAME_MAX+64	// "{" ATTR_NGZ  "='',op=''}""
 
 void
 collect_fs(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, void *cfg) {
 	kstat_t *ksp;
 	kstat_named_t *knp;
-	char buf[32], *s;
+	char *s;
 	ks_info_idx_t idx;
 
 	size_t psz = 0;
@@ -309,13 +314,14 @@ collect_fs(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, void *cfg) {
 
 	static fs_mods_t mods = FS_MODS_NONE;	// set of fs regarding all zones
 	static fs_mods_t *z_fs_mods = NULL;		// kstat instance related fs
-	static char **znames = NULL;			// kstat instance related zonenames
+	static const char **znames = NULL;		// kstat instance related zonenames
 	static int zlen = 0;					// capacity of z_fs_mods and znames
 	static int last_zones = 0;				// the number of kstat instances from the previous run
 	static kid_t last_kid = -1;				// the kstat id from the previous run
 	static zinfo_t *last_cfg = NULL;		// cfg from previous run
 
 	char metric_prefix[MAX_METRIC_PREFIX_SZ];
+	char labels[MAX_METRIC_PREFIX_SZ];
 
 	PROM_DEBUG("collect_vopstats ...", "");
 	if (cfg == NULL)
@@ -332,6 +338,7 @@ collect_fs(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, void *cfg) {
 	if (last_kid != kc->kc_chain_id || last_cfg != cfg) {
 		revalidate = true;
 		last_kid = kc->kc_chain_id;
+		zones_update(last_kid);
 	}
 	psz = psb_len(sb);
 	check_zone_vars();
@@ -341,7 +348,7 @@ collect_fs(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, void *cfg) {
 		mods = FS_MODS_NONE;
 		while (zi) {
 			if (zi->zid != ANY_ZID)
-				zi->zid = getzoneidbyname(zi->zname);
+				zi->zid = zone_id(zi->zname);
 			if (zi->zid != -1)
 				mods |= zi->mods;
 			zi = zi->next;
@@ -364,7 +371,7 @@ collect_fs(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, void *cfg) {
 			if (zones > zlen) {
 				// we only grow
 				fs_mods_t *p1 = realloc(z_fs_mods, zones * sizeof(zinfo_t *));
-				char **p2 = realloc(znames, zones * sizeof(char *));
+				const char **p2 = realloc(znames, zones * sizeof(char *));
 				if (p1 == NULL || p2 == NULL) {
 					PROM_WARN("Unable to allocate zone info tables: %s", strerror(errno));
 					break;
@@ -379,21 +386,16 @@ collect_fs(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, void *cfg) {
 			}
 			for (z = 0; z < zones; z++) {
 				zi = last_cfg;
-				free(znames[z]);
 				znames[z] = NULL;
 				z_fs_mods[z] = FS_MODS_NONE;
 				while (zi) {
 					if (zi->zid == kstat[idx].ksp[z]->ks_instance) {
 						z_fs_mods[z] = zi->mods;
-						znames[z] = strdup(zi->zname);
+						znames[z] = str_intern(zi->zname);
 						break;
 					} else if (zi->zid == ANY_ZID) {
-						char zname[ZONENAME_MAX];
 						z_fs_mods[z] = zi->mods;
-						znames[z] = getzonenamebyid(kstat[idx]
-							.ksp[z]->ks_instance, zname, ZONENAME_MAX) != -1
-							? strdup(zname)
-							: NULL;
+						znames[z] = zone_name(kstat[idx].ksp[z]->ks_instance);
 						break;
 					}
 					zi = zi->next;
@@ -412,19 +414,16 @@ collect_fs(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, void *cfg) {
 				continue;
 			if (ksp->ks_ndata == 0)
 				continue;
+			ks_emit_times(ksp);
 
-			if (!compact) {
+			// just a hint for humans, no HELP or TYPE
+			if (!compact && expo_target == NULL) {
 				psb_add_str(sb, "# ");
 				psb_add_str(sb, ksp->ks_name + strlen(VOPSTATS_STR));
 				psb_add_char(sb, '\n');
 			}
-			size_t tsz = psb_len(sb);
-			psb_add_str(sb, SOLMEX_FS_NAME_PREFIX);
-			psb_add_str(sb, ksp->ks_name + strlen(VOPSTATS_STR));
-			psb_add_str(sb, "{" ATTR_NGZ "=\"");
-			psb_add_str(sb, znames[z]);
-			psb_add_str(sb, "\",op=\"");
-			strcpy(metric_prefix, psb_str(sb) + tsz);
+			snprintf(metric_prefix, sizeof(metric_prefix),
+				SOLMEX_FS_NAME_PREFIX "%s", ksp->ks_name + strlen(VOPSTATS_STR));
 			knp = KSTAT_NAMED_PTR(ksp);
 			/*
 			Consistency checks:
@@ -452,11 +451,9 @@ collect_fs(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, void *cfg) {
 					// skip na{cancel,fsync,read,write}
 					continue;
 				}
-				if (e)
-					psb_add_str(sb, metric_prefix);
-				psb_add_str(sb, s);
-				sprintf(buf, "\"} %ld\n", knp->value.ui64);
-				psb_add_str(sb, buf);
+				snprintf(labels, sizeof(labels),
+					"{" ATTR_NGZ "=\"%s\",op=\"%s\"}", znames[z], s);
+				expo_emit_uint(sb, metric_prefix, labels, knp->value.ui64);
 			}
 		}
 	}
@@ -0,0 +1,487 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/mnttab.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libprom/prom.h>
+
+#include "fsusage.h"
+#include "expo.h"
+
+typedef enum fsu_idx {
+	FSU_IDX_SIZE,	FSU_IDX_FREE,	FSU_IDX_AVAIL,
+	FSU_IDX_FILES,	FSU_IDX_FILES_FREE,	FSU_IDX_MAX
+} fsu_idx_t;
+
+/* solmex metric names */
+static const char *snames[] = {
+#define STRINGIFY(x) #x
+#define _S(x) STRINGIFY(x)
+	_S(SOLMEX_FSU_SIZE_N),	_S(SOLMEX_FSU_FREE_N),	_S(SOLMEX_FSU_AVAIL_N),
+	_S(SOLMEX_FSU_FILES_N),	_S(SOLMEX_FSU_FILES_FREE_N),	NULL
+};
+
+/* metric HELP text */
+static const char *sdesc[] = {
+	SOLMEX_FSU_SIZE_D,	SOLMEX_FSU_FREE_D,	SOLMEX_FSU_AVAIL_D,
+	SOLMEX_FSU_FILES_D,	SOLMEX_FSU_FILES_FREE_D,	NULL
+};
+
+/* fstypes skipped when 'all' is given: no real capacity or just a view. */
+#define FSU_PSEUDO_FS \
+	",autofs,bootfs,ctfs,dev,devfs,fd,lofs,mntfs,objfs,proc,sharefs,"
+
+typedef struct fsu_cfg {
+	char *fstypes;		/**< ",type1,type2,...," or NULL for all */
+	uint32_t timeout;	/**< max. time in ms to wait for statvfs() results */
+} fsu_cfg_t;
+
+typedef struct fsu_mnt {
+	char *special;
+	char *mountp;
+	char *fstype;
+	char *labels;		/**< prepared '{mountpoint="",fstype="",device=""}' */
+	uint64_t vals[FSU_IDX_MAX];
+	uint32_t round;		/**< round of the last successful statvfs(), 0 .. never */
+	uint32_t qround;	/**< round when it got queued, 0 .. not pending */
+	bool busy;			/**< queued or statvfs() in progress */
+	bool orphan;		/**< gone from mnttab, release when not busy anymore */
+	struct fsu_mnt *qnext;
+	struct fsu_mnt *next;
+} fsu_mnt_t;
+
+typedef struct fsu_thread {
+	fsu_mnt_t *m;		/**< mount in progress, NULL if idle */
+	struct timespec deadline;	/**< when the statvfs() of m counts as hung */
+	bool alive;
+	bool hung;
+} fsu_thread_t;
+
+// All members are protected by the lock. Each statvfs() gets its own deadline
+// starting when a worker picks it up. A worker which misses it counts as hung
+// and gets replaced, as long as there are less than FSU_WORKERS_MAX threads.
+// Its mount stays busy, so it never gets queued again until the worker
+// returns (no worker pile-up), and gets released by the worker itself, if it
+// got removed from the mnttab meanwhile. Surplus workers exit when they
+// return from a hung call.
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work;	/**< signaled when jobs got queued */
+	pthread_cond_t done;	/**< signaled when a job got finished */
+	fsu_mnt_t *mounts;
+	fsu_mnt_t *qhead;
+	fsu_mnt_t *qtail;
+	uint32_t round;
+	uint32_t pending;		/**< jobs of the current round not yet finished */
+	uint32_t timeout;		/**< max. time in ms a statvfs() may take */
+	uint8_t workers;		/**< threads alive */
+	uint8_t hung;			/**< threads alive, but stuck in statvfs() */
+	fsu_thread_t worker[FSU_WORKERS_MAX];
+	struct timespec mtime;	/**< mtime of the mnttab when read last time */
+} fsu = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+	.mounts = NULL,
+	.qhead = NULL,
+	.qtail = NULL,
+	.round = 0,
+	.pending = 0,
+	.timeout = FSU_TIMEOUT_DEFAULT,
+	.workers = 0,
+	.hung = 0,
+	.mtime = { 0, 0 },
+};
+
+void *
+parse_fsusage_list(const char *s, int *valid) {
+	fsu_cfg_t *cfg;
+	char *buf, *c;
+	unsigned int ms = FSU_TIMEOUT_DEFAULT;
+	size_t len;
+
+	*valid = 0;
+	if (s == NULL)
+		return NULL;
+
+	if ((buf = strdup(s)) == NULL) {
+		perror("fsusage");
+		return NULL;
+	}
+	if ((c = strchr(buf, ':')) != NULL) {
+		c[0] = '\0';
+		if (sscanf(c + 1, "%u", &ms) != 1 || ms == 0) {
+			fprintf(stderr, "Invalid statvfs timeout '%s'.\n", c + 1);
+			free(buf);
+			return NULL;
+		}
+	}
+	len = strlen(buf);
+	if (len == 0 || strcmp(buf, "none") == 0) {
+		free(buf);
+		*valid = 1;
+		return NULL;
+	}
+	if ((cfg = malloc(sizeof(fsu_cfg_t))) == NULL) {
+		perror("fsusage");
+		free(buf);
+		return NULL;
+	}
+	cfg->timeout = ms;
+	cfg->fstypes = NULL;
+	if (strcmp(buf, "all") != 0) {
+		if ((cfg->fstypes = malloc(len + 3)) == NULL) {
+			perror("fsusage");
+			free(cfg);
+			free(buf);
+			return NULL;
+		}
+		sprintf(cfg->fstypes, ",%s,", buf);
+	}
+	free(buf);
+	*valid = 1;
+	return cfg;
+}
+
+static bool
+fsu_selected(fsu_cfg_t *cfg, const char *fstype) {
+	char buf[64];
+
+	if (strlen(fstype) > sizeof(buf) - 3)
+		return false;
+	sprintf(buf, ",%s,", fstype);
+	if (cfg->fstypes == NULL)
+		return strstr(FSU_PSEUDO_FS, buf) == NULL;
+	return strstr(cfg->fstypes, buf) != NULL;
+}
+
+static void
+fsu_release(fsu_mnt_t *m) {
+	free(m->special);
+	free(m->mountp);
+	free(m->fstype);
+	free(m->labels);
+	free(m);
+}
+
+static fsu_mnt_t *
+fsu_new(struct mnttab *mt) {
+	fsu_mnt_t *m = calloc(1, sizeof(fsu_mnt_t));
+	psb_t *b;
+
+	if (m == NULL)
+		return NULL;
+	m->special = strdup(mt->mnt_special);
+	m->mountp = strdup(mt->mnt_mountp);
+	m->fstype = strdup(mt->mnt_fstype);
+	b = psb_new();
+	if (b != NULL) {
+		psb_add_str(b, "{mountpoint=\"");
+		addLabelValue(b, mt->mnt_mountp);
+		psb_add_str(b, "\",fstype=\"");
+		addLabelValue(b, mt->mnt_fstype);
+		psb_add_str(b, "\",device=\"");
+		addLabelValue(b, mt->mnt_special);
+		psb_add_str(b, "\"}");
+		m->labels = psb_dump(b);
+		psb_destroy(b);
+	}
+	if (m->special == NULL || m->mountp == NULL || m->fstype == NULL
+		|| m->labels == NULL)
+	{
+		fsu_release(m);
+		return NULL;
+	}
+	return m;
+}
+
+// Re-read the mnttab if it has been changed since the last read. Mounts still
+// present keep their last values. Lock must be held.
+static void
+fsu_refresh(fsu_cfg_t *cfg) {
+	struct stat st;
+	struct mnttab mt;
+	FILE *f;
+	fsu_mnt_t *old, *head = NULL, **tail = &head, *m, **pm;
+
+	if (stat(MNTTAB, &st) != 0) {
+		PROM_WARN("Unable to stat '%s': %s", MNTTAB, strerror(errno));
+		return;
+	}
+	if (st.st_mtim.tv_sec == fsu.mtime.tv_sec
+		&& st.st_mtim.tv_nsec == fsu.mtime.tv_nsec)
+	{
+		return;
+	}
+	if ((f = fopen(MNTTAB, "r")) == NULL) {
+		PROM_WARN("Unable to open '%s': %s", MNTTAB, strerror(errno));
+		return;
+	}
+	PROM_DEBUG("Reading %s ...", MNTTAB);
+	old = fsu.mounts;
+	while (getmntent(f, &mt) == 0) {
+		if (!fsu_selected(cfg, mt.mnt_fstype))
+			continue;
+		for (pm = &old; *pm != NULL; pm = &((*pm)->next)) {
+			if (strcmp((*pm)->mountp, mt.mnt_mountp) == 0
+				&& strcmp((*pm)->special, mt.mnt_special) == 0
+				&& strcmp((*pm)->fstype, mt.mnt_fstype) == 0)
+			{
+				break;
+			}
+		}
+		if ((m = *pm) != NULL) {
+			*pm = m->next;
+		} else if ((m = fsu_new(&mt)) == NULL) {
+			PROM_WARN("Unable to allocate mount entry for '%s': %s",
+				mt.mnt_mountp, strerror(errno));
+			continue;
+		}
+		m->next = NULL;
+		*tail = m;
+		tail = &(m->next);
+	}
+	fclose(f);
+	// whatever is left over is gone
+	while (old != NULL) {
+		m = old;
+		old = old->next;
+		if (m->busy)
+			m->orphan = true;
+		else
+			fsu_release(m);
+	}
+	fsu.mounts = head;
+	fsu.mtime = st.st_mtim;
+}
+
+static void
+ts_add_ms(struct timespec *ts, uint32_t ms) {
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= NANOSEC) {
+		ts->tv_sec++;
+		ts->tv_nsec -= NANOSEC;
+	}
+}
+
+#define TS_BEFORE(a, b) ((a).tv_sec < (b).tv_sec \
+	|| ((a).tv_sec == (b).tv_sec && (a).tv_nsec < (b).tv_nsec))
+
+static void *
+fsu_worker(void *arg) {
+	fsu_thread_t *w = (fsu_thread_t *) arg;
+	fsu_mnt_t *m;
+	struct statvfs st;
+	int res;
+
+	pthread_mutex_lock(&fsu.lock);
+	while (1) {
+		// a replacement took over while we were hung
+		if (fsu.workers - fsu.hung > FSU_WORKERS)
+			break;
+		while (fsu.qhead == NULL)
+			pthread_cond_wait(&fsu.work, &fsu.lock);
+		m = fsu.qhead;
+		if ((fsu.qhead = m->qnext) == NULL)
+			fsu.qtail = NULL;
+		w->m = m;
+		clock_gettime(CLOCK_REALTIME, &(w->deadline));
+		ts_add_ms(&(w->deadline), fsu.timeout);
+		pthread_mutex_unlock(&fsu.lock);
+
+		// may block forever on a hung mount
+		res = statvfs(m->mountp, &st);
+
+		pthread_mutex_lock(&fsu.lock);
+		if (w->hung) {
+			PROM_INFO("statvfs(%s) returned after being hung", m->mountp);
+			w->hung = false;
+			fsu.hung--;
+		}
+		w->m = NULL;
+		if (res == 0) {
+			uint64_t frsz = st.f_frsize ? st.f_frsize : st.f_bsize;
+			m->vals[FSU_IDX_SIZE] = st.f_blocks * frsz;
+			m->vals[FSU_IDX_FREE] = st.f_bfree * frsz;
+			m->vals[FSU_IDX_AVAIL] = st.f_bavail * frsz;
+			m->vals[FSU_IDX_FILES] = st.f_files;
+			m->vals[FSU_IDX_FILES_FREE] = st.f_ffree;
+			m->round = fsu.round;	// fresh, even if it took several rounds
+		} else {
+			PROM_DEBUG("statvfs(%s): %s", m->mountp, strerror(errno));
+		}
+		m->busy = false;
+		if (m->qround == fsu.round && fsu.pending > 0)
+			fsu.pending--;
+		m->qround = 0;
+		if (m->orphan)
+			fsu_release(m);
+		pthread_cond_broadcast(&fsu.done);
+	}
+	w->alive = false;
+	fsu.workers--;
+	pthread_mutex_unlock(&fsu.lock);
+	return NULL;
+}
+
+// Mark all workers, which missed the deadline of their statvfs() call, as
+// hung and return the earliest deadline of all others in next (if before).
+// Lock must be held.
+static void
+fsu_check_hung(struct timespec *next) {
+	struct timespec now;
+	fsu_thread_t *w;
+	int i;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	for (i = 0; i < FSU_WORKERS_MAX; i++) {
+		w = &(fsu.worker[i]);
+		if (!w->alive || w->m == NULL || w->hung)
+			continue;
+		if (TS_BEFORE(now, w->deadline)) {
+			if (TS_BEFORE(w->deadline, *next))
+				*next = w->deadline;
+			continue;
+		}
+		PROM_WARN("statvfs(%s) hangs - marked as stale", w->m->mountp);
+		w->hung = true;
+		fsu.hung++;
+		// do not wait for it anymore
+		if (w->m->qround == fsu.round && fsu.pending > 0)
+			fsu.pending--;
+		w->m->qround = 0;
+	}
+}
+
+// Make sure, that there are FSU_WORKERS workers not hung in statvfs(), but
+// never more than FSU_WORKERS_MAX threads. Lock must be held.
+static bool
+fsu_start_workers(void) {
+	pthread_attr_t attr;
+	pthread_t tid;
+	int i, res;
+
+	if (fsu.workers - fsu.hung >= FSU_WORKERS)
+		return true;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (i = 0; i < FSU_WORKERS_MAX && fsu.workers - fsu.hung < FSU_WORKERS;
+		i++)
+	{
+		if (fsu.worker[i].alive)
+			continue;
+		fsu.worker[i].m = NULL;
+		fsu.worker[i].hung = false;
+		if ((res = pthread_create(&tid, &attr, fsu_worker, &(fsu.worker[i])))
+			!= 0)
+		{
+			PROM_WARN("Unable to create statvfs worker: %s", strerror(res));
+			break;
+		}
+		fsu.worker[i].alive = true;
+		fsu.workers++;
+	}
+	pthread_attr_destroy(&attr);
+	if (fsu.workers == fsu.hung)
+		PROM_WARN("All %d statvfs workers hung.", fsu.workers);
+	return fsu.workers > fsu.hung;
+}
+
+void
+collect_fsusage(psb_t *sb, bool compact, void *config) {
+	fsu_cfg_t *cfg = (fsu_cfg_t *) config;
+	fsu_mnt_t *m;
+	struct timespec ts;
+	fsu_idx_t k;
+
+	if (cfg == NULL)
+		return;
+
+	PROM_DEBUG("collect_fsusage ...", "");
+	pthread_mutex_lock(&fsu.lock);
+	fsu.timeout = cfg->timeout;
+	ts.tv_sec = LONG_MAX;
+	fsu_check_hung(&ts);
+	if (!fsu_start_workers() && fsu.workers == 0) {
+		pthread_mutex_unlock(&fsu.lock);
+		return;
+	}
+	fsu_refresh(cfg);
+
+	// queue all mounts, which are not still busy from a previous round
+	fsu.round++;
+	fsu.pending = 0;
+	for (m = fsu.mounts; m != NULL; m = m->next) {
+		if (m->busy)
+			continue;
+		m->busy = true;
+		m->qround = fsu.round;
+		m->qnext = NULL;
+		if (fsu.qtail == NULL)
+			fsu.qhead = m;
+		else
+			fsu.qtail->qnext = m;
+		fsu.qtail = m;
+		fsu.pending++;
+	}
+	if (fsu.pending > 0)
+		pthread_cond_broadcast(&fsu.work);
+	// Each job gets its own deadline when started. Wake up at the earliest
+	// one at the latest, to replace hung workers, so that queued jobs
+	// continue to be served.
+	while (fsu.pending > 0) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts_add_ms(&ts, cfg->timeout);
+		fsu_check_hung(&ts);
+		if (fsu.pending == 0 || (!fsu_start_workers() && fsu.qhead != NULL))
+			break;
+		(void) pthread_cond_timedwait(&fsu.done, &fsu.lock, &ts);
+	}
+	if (fsu.pending > 0)
+		PROM_DEBUG("%d statvfs() calls did not get started", fsu.pending);
+
+	bool free_sb = sb == NULL;
+	if (free_sb)
+		sb = psb_new();
+
+	for (k = 0; k < FSU_IDX_MAX; k++) {
+		expo_emit_info(sb, compact, snames[k], "gauge", sdesc[k]);
+		for (m = fsu.mounts; m != NULL; m = m->next) {
+			if (m->round == 0)
+				continue;	// no values, yet
+			expo_emit_uint(sb, snames[k], m->labels, m->vals[k]);
+		}
+	}
+	expo_emit_info(sb, compact, _S(SOLMEX_FSU_STALE_N), SOLMEX_FSU_STALE_T,
+		SOLMEX_FSU_STALE_D);
+	for (m = fsu.mounts; m != NULL; m = m->next)
+		expo_emit_uint(sb, _S(SOLMEX_FSU_STALE_N), m->labels,
+			m->round == fsu.round ? 0 : 1);
+	pthread_mutex_unlock(&fsu.lock);
+
+	if (free_sb) {
+		fprintf(stdout, "\n%s", psb_str(sb));
+		psb_destroy(sb);
+	}
+	PROM_DEBUG("collect_fsusage done", "");
+}
@@ -0,0 +1,63 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file fsusage.h
+ * Filesystem capacity (statvfs) related defintions/functions/etc.
+ */
+#ifndef SOLMEX_FSUSAGE_H
+#define SOLMEX_FSUSAGE_H
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default max. time in ms a statvfs() call may take. */
+#define FSU_TIMEOUT_DEFAULT 500
+/** Number of statvfs() worker threads, which are not hung. */
+#define FSU_WORKERS 4
+/** Max. number of statvfs() worker threads including hung ones. */
+#define FSU_WORKERS_MAX 32
+
+/**
+ * @brief Parse the given filesystem usage option string of the form
+ * 	`fstype[,...][:ms]`. The special fstype `all` selects all fstypes except
+ * 	the well known pseudo filesystems, `none` disables the collector.
+ * @param s	The string to parse.
+ * @param valid Gets set to @code 1 if the given string could be parsed
+ * 	successfully, to @code 0 otherwise.
+ * @return A reference to the config to be used in the collect_fsusage() call,
+ * 	`NULL` if disabled or on error.
+ */
+void *parse_fsusage_list(const char *s, int *valid);
+
+/**
+ * @brief Emit size, free and available space and inodes of all mounted
+ * 	filesystems of the selected types. The mount table gets re-read only if
+ * 	/etc/mnttab has been changed. statvfs() gets called on a small pool of
+ * 	worker threads, so a hung mount cannot block the scrape: mounts which do
+ * 	not answer within the configured time get reported with their last
+ * 	known values and `solmex_node_filesystem_stale 1`, and do not get queued
+ * 	again until their call returns. Hung workers get replaced up to
+ * 	FSU_WORKERS_MAX threads.
+ * @param sb    where to add the stats.
+ * @param compact   whether to add HELP and TYPE comments
+ * @param cfg	The reference returned by parse_fsusage_list().
+ */
+void collect_fsusage(psb_t *sb, bool compact, void *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_FSUSAGE_H
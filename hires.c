@@ -0,0 +1,410 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <kstat.h>
+#include <sys/sysinfo.h>
+#include <atomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libprom/prom.h>
+
+#include "hires.h"
+#include "expo.h"
+
+// sysinfo and vminfo are raw kstats, so kstat_data_lookup() does not work.
+typedef struct raw_field {
+	const char *name;
+	const char *stat;
+	size_t off;
+	uint8_t sz;
+} raw_field_t;
+
+#define RAW_SYS(x) { "sysinfo", #x, offsetof(sysinfo_t, x), sizeof(uint_t) }
+#define RAW_VM(x) { "vminfo", #x, offsetof(vminfo_t, x), sizeof(uint64_t) }
+static const raw_field_t raw_fields[] = {
+	RAW_SYS(updates), RAW_SYS(runque), RAW_SYS(runocc),
+	RAW_SYS(swpque), RAW_SYS(swpocc), RAW_SYS(waiting),
+	RAW_VM(freemem), RAW_VM(swap_resv), RAW_VM(swap_alloc),
+	RAW_VM(swap_avail), RAW_VM(swap_free), RAW_VM(updates),
+};
+#undef RAW_SYS
+#undef RAW_VM
+
+typedef struct hires_agg {
+	double min;
+	double max;
+	double sum;
+	double last;
+	uint32_t n;
+} hires_agg_t;
+
+typedef struct hires_field {
+	char *module;
+	int instance;
+	char *name;
+	char *stat;
+	bool delta;				/**< record the difference to the previous sample */
+	char *labels;			/**< {kstat="..."} */
+	// sampler thread only
+	kstat_t *ksp;
+	const raw_field_t *raw;	/**< NULL if a named kstat */
+	double prev;
+	bool have_prev;
+	// shared: the sampler updates slot[cur], the scraper switches cur
+	volatile uint32_t cur;
+	volatile uint32_t busy;	/**< cur + 1 while the sampler updates a slot */
+	hires_agg_t slot[2];
+} hires_field_t;
+
+typedef struct hires_cfg {
+	hires_field_t *field;
+	uint16_t n;
+	uint32_t interval;		/**< ms */
+	bool started;
+} hires_cfg_t;
+
+static bool
+parseField(hires_field_t *f, char *spec) {
+	char *t[4], *s = spec, *d;
+	int i;
+	psb_t *sb;
+
+	for (i = 0; i < 4; i++) {
+		t[i] = s;
+		if (i < 3) {
+			if ((s = strchr(s, ':')) == NULL)
+				return false;
+			*s++ = '\0';
+		}
+	}
+	if ((d = strchr(t[3], '/')) != NULL) {
+		if (strcmp(d, "/d") != 0)
+			return false;
+		*d = '\0';
+		f->delta = true;
+	}
+	if (*t[0] == '\0' || *t[2] == '\0' || *t[3] == '\0')
+		return false;
+	if (sscanf(t[1], "%d", &f->instance) != 1 || f->instance < 0)
+		return false;
+	if ((sb = psb_new()) == NULL)
+		return false;
+	f->module = strdup(t[0]);
+	f->name = strdup(t[2]);
+	f->stat = strdup(t[3]);
+	psb_add_str(sb, "{kstat=\"");
+	addLabelValue(sb, f->module);
+	psb_add_char(sb, ':');
+	psb_add_str(sb, t[1]);
+	psb_add_char(sb, ':');
+	addLabelValue(sb, f->name);
+	psb_add_char(sb, ':');
+	addLabelValue(sb, f->stat);
+	psb_add_str(sb, f->delta ? "/d\"}" : "\"}");
+	f->labels = psb_dump(sb);
+	psb_destroy(sb);
+	return f->module != NULL && f->name != NULL && f->stat != NULL
+		&& f->labels != NULL;
+}
+
+void *
+parse_hires_opts(const char *s, int *valid) {
+	hires_cfg_t *cfg;
+	char *buf, *t, *e;
+	unsigned int n;
+
+	*valid = 0;
+	if (s == NULL)
+		return NULL;
+	if (strcmp(s, "none") == 0 || strcmp(s, "n") == 0 || strcmp(s, "0") == 0) {
+		*valid = 1;
+		return NULL;
+	}
+	if ((cfg = calloc(1, sizeof(hires_cfg_t))) == NULL
+		|| (cfg->field = calloc(HIRES_FIELDS_MAX, sizeof(hires_field_t))) == NULL
+		|| (buf = strdup(s)) == NULL)
+	{
+		perror("hires");
+		if (cfg != NULL)
+			free(cfg->field);
+		free(cfg);
+		return NULL;
+	}
+	cfg->interval = HIRES_INTERVAL_DEFAULT;
+	if ((t = strrchr(buf, '@')) != NULL) {
+		*t = '\0';
+		if (sscanf(t + 1, "%u", &n) != 1 || n < HIRES_INTERVAL_MIN
+			|| n > 60000)
+		{
+			fprintf(stderr, "Invalid sampling interval in '%s' (%d..60000 ms).\n",
+				s, HIRES_INTERVAL_MIN);
+			goto fail;
+		}
+		cfg->interval = n;
+	}
+	for (t = buf; *t != '\0'; t = e) {
+		if ((e = strchr(t, ',')) != NULL)
+			*e++ = '\0';
+		else
+			e = t + strlen(t);
+		if (*t == '\0')
+			continue;
+		if (cfg->n == HIRES_FIELDS_MAX) {
+			fprintf(stderr, "Too many kstat fields to sample (max. %d).\n",
+				HIRES_FIELDS_MAX);
+			goto fail;
+		}
+		if (!parseField(&cfg->field[cfg->n], t)) {
+			fprintf(stderr, "Invalid kstat field '%s' - expected "
+				"module:instance:name:stat[/d].\n", t);
+			goto fail;
+		}
+		cfg->n++;
+	}
+	if (cfg->n == 0) {
+		fprintf(stderr, "No kstat fields found in '%s'.\n", s);
+		goto fail;
+	}
+	free(buf);
+	*valid = 1;
+	return cfg;
+
+fail:
+	free(buf);
+	for (n = 0; n < HIRES_FIELDS_MAX; n++) {
+		free(cfg->field[n].module);
+		free(cfg->field[n].name);
+		free(cfg->field[n].stat);
+		free(cfg->field[n].labels);
+	}
+	free(cfg->field);
+	free(cfg);
+	return NULL;
+}
+
+static void
+lookupFields(kstat_ctl_t *kc, hires_cfg_t *cfg) {
+	hires_field_t *f;
+	uint16_t i;
+	size_t k;
+
+	for (i = 0; i < cfg->n; i++) {
+		f = &cfg->field[i];
+		f->have_prev = false;
+		f->raw = NULL;
+		f->ksp = kstat_lookup(kc, f->module, f->instance, f->name);
+		if (f->ksp == NULL || f->ksp->ks_type != KSTAT_TYPE_RAW)
+			continue;
+		for (k = 0; k < ARRAY_SIZE(raw_fields); k++) {
+			if (strcmp(raw_fields[k].name, f->name) == 0
+				&& strcmp(raw_fields[k].stat, f->stat) == 0)
+			{
+				f->raw = &raw_fields[k];
+				break;
+			}
+		}
+		if (f->raw == NULL) {
+			PROM_WARN("Unsupported raw kstat field %s:%d:%s:%s - ignored",
+				f->module, f->instance, f->name, f->stat);
+			f->ksp = NULL;
+		}
+	}
+}
+
+static bool
+getValue(hires_field_t *f, double *v) {
+	kstat_named_t *knp;
+
+	if (f->raw != NULL) {
+		const char *p = (const char *) f->ksp->ks_data + f->raw->off;
+		if (f->raw->off + f->raw->sz > f->ksp->ks_data_size)
+			return false;
+		if (f->raw->sz == sizeof(uint64_t))
+			*v = *((const uint64_t *) p);
+		else
+			*v = *((const uint_t *) p);
+		return true;
+	}
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+	if ((knp = kstat_data_lookup(f->ksp, f->stat)) == NULL)
+		return false;
+#pragma GCC diagnostic pop
+	switch (knp->data_type) {
+		case KSTAT_DATA_INT32:	*v = knp->value.i32; break;
+		case KSTAT_DATA_UINT32:	*v = knp->value.ui32; break;
+		case KSTAT_DATA_INT64:	*v = knp->value.i64; break;
+		case KSTAT_DATA_UINT64:	*v = knp->value.ui64; break;
+		default:
+			return false;
+	}
+	return true;
+}
+
+// Writer side of the slot switch. If the scraper switched the slot after we
+// have read cur, we retry, so the scraper never sees a slot in use.
+static void
+addSample(hires_field_t *f, double v) {
+	hires_agg_t *a;
+	uint32_t i;
+
+	do {
+		i = f->cur;
+		f->busy = i + 1;
+		membar_enter();
+	} while (f->cur != i);
+	a = &f->slot[i];
+	if (a->n == 0 || v < a->min)
+		a->min = v;
+	if (a->n == 0 || v > a->max)
+		a->max = v;
+	a->sum += v;
+	a->last = v;
+	a->n++;
+	membar_producer();
+	f->busy = 0;
+}
+
+static void *
+hires_sampler(void *arg) {
+	hires_cfg_t *cfg = (hires_cfg_t *) arg;
+	hires_field_t *f;
+	kstat_ctl_t *kc;
+	hrtime_t next, now, ival = (hrtime_t) cfg->interval * (NANOSEC / MILLISEC);
+	struct timespec ts;
+	double v, d;
+	uint16_t i;
+
+	// kstat handles are not thread-safe, so the sampler uses its own
+	if ((kc = kstat_open()) == NULL) {
+		PROM_WARN("hires sampler: kstat_open failed: %s", strerror(errno));
+		return NULL;
+	}
+	lookupFields(kc, cfg);
+	next = gethrtime();
+	while (1) {
+		if (kstat_chain_update(kc) > 0)
+			lookupFields(kc, cfg);
+		for (i = 0; i < cfg->n; i++) {
+			f = &cfg->field[i];
+			if (f->ksp == NULL)
+				continue;
+			if (kstat_read(kc, f->ksp, NULL) == -1 || !getValue(f, &v))
+				continue;
+			if (f->delta) {
+				d = v - f->prev;
+				f->prev = v;
+				if (!f->have_prev) {
+					f->have_prev = true;
+					continue;
+				}
+				v = d;
+			}
+			addSample(f, v);
+		}
+		next += ival;
+		now = gethrtime();
+		if (next <= now)
+			next = now + ival;	// overrun: skip the missed ticks
+		ts.tv_sec = (next - now) / NANOSEC;
+		ts.tv_nsec = (next - now) % NANOSEC;
+		while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+			;
+	}
+	return NULL;
+}
+
+static bool
+startSampler(hires_cfg_t *cfg) {
+	pthread_attr_t attr;
+	pthread_t tid;
+	int res;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	res = pthread_create(&tid, &attr, hires_sampler, cfg);
+	pthread_attr_destroy(&attr);
+	if (res != 0) {
+		PROM_WARN("Unable to create hires sampler: %s", strerror(res));
+		return false;
+	}
+	return true;
+}
+
+#define EMIT(metric, expr) \
+	addExpoInfo(metric); \
+	for (i = 0; i < cfg->n; i++) { \
+		if (a[i].n == 0) \
+			continue; \
+		v = (double) (expr); \
+		sprintf(buf, "%.9g", v); \
+		expo_emit(sb, metric ## _N, cfg->field[i].labels, buf, v); \
+	}
+
+void
+collect_hires(psb_t *sb, bool compact, void *config) {
+	hires_cfg_t *cfg = (hires_cfg_t *) config;
+	hires_agg_t a[HIRES_FIELDS_MAX];
+	hires_field_t *f;
+	uint32_t old;
+	uint16_t i, n = 0;
+	char buf[64];
+	double v;
+
+	if (cfg == NULL)
+		return;
+
+	PROM_DEBUG("collect_hires ...", "");
+	if (!cfg->started) {
+		cfg->started = startSampler(cfg);
+		return;
+	}
+
+	// reader side of the slot switch
+	for (i = 0; i < cfg->n; i++) {
+		f = &cfg->field[i];
+		old = atomic_swap_32(&f->cur, f->cur ^ 1);
+		membar_enter();
+		while (f->busy == old + 1)
+			(void) sched_yield();
+		membar_consumer();
+		a[i] = f->slot[old];
+		memset(&f->slot[old], 0, sizeof(hires_agg_t));
+		if (a[i].n > 0)
+			n++;
+	}
+	if (n == 0)
+		return;
+
+	bool free_sb = sb == NULL;
+	if (free_sb)
+		sb = psb_new();
+
+	EMIT(SOLMEXM_HIRES_MIN, a[i].min)
+	EMIT(SOLMEXM_HIRES_MAX, a[i].max)
+	EMIT(SOLMEXM_HIRES_AVG, a[i].sum / a[i].n)
+	EMIT(SOLMEXM_HIRES_LAST, a[i].last)
+	EMIT(SOLMEXM_HIRES_SAMPLES, a[i].n)
+
+	if (free_sb) {
+		fprintf(stdout, "\n%s", psb_str(sb));
+		psb_destroy(sb);
+	}
+	PROM_DEBUG("collect_hires done", "");
+}
+
+#undef EMIT
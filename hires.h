@@ -0,0 +1,62 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file hires.h
+ * Background high resolution sampling of selected kstat fields with min, max,
+ * avg and last value summaries between two scrapes.
+ */
+#ifndef SOLMEX_HIRES_H
+#define SOLMEX_HIRES_H
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default sampling interval in ms. */
+#define HIRES_INTERVAL_DEFAULT 100
+/** Min. sampling interval in ms. */
+#define HIRES_INTERVAL_MIN 10
+/** Max. number of kstat fields to sample. */
+#define HIRES_FIELDS_MAX 64
+
+/**
+ * @brief Parse the given sampler option string of the form
+ * 	`module:instance:name:stat[/d][,...][@ms]`. With the `/d` suffix the
+ * 	difference to the previous sample gets recorded instead of the value
+ * 	itself (for kstats, which are running totals like `unix:0:sysinfo:runque`).
+ * @param s	The string to parse.
+ * @param valid Gets set to @code 1 if the given string could be parsed
+ * 	successfully, to @code 0 otherwise.
+ * @return A reference to the config to be used in the collect_hires() call,
+ * 	`NULL` if disabled or on error.
+ */
+void *parse_hires_opts(const char *s, int *valid);
+
+/**
+ * @brief Emit the min, max, avg and last value of each configured kstat field
+ * 	sampled since the previous call and start a new interval. The sampler
+ * 	thread gets started on the first call, so the first scrape emits nothing.
+ * 	The sampler never blocks on the scrape and vice versa: each field has
+ * 	two aggregate slots, which get switched atomically on each call.
+ * @param sb	where to add the stats.
+ * @param compact	whether to add HELP and TYPE comments
+ * @param cfg	The reference returned by parse_hires_opts().
+ */
+void collect_hires(psb_t *sb, bool compact, void *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_HIRES_H
@@ -16,11 +16,11 @@
 #include <stdio.h>
 
 #include "common.h"
+#include "expo.h"
 #include "init.h"
 
 static uint8_t started = 0;
 
-static char *versionProm = NULL;	// version string emitted via /metrics
 static char *versionHR = NULL;		// version string emitted to stdout/stderr
 
 #define MMATCH(_x)	(cfg->_x && (regexec(cfg->_x, buf, 0,NULL,0) == 0))
@@ -69,46 +69,27 @@ void
 stop() {
 	free(versionHR);
 	versionHR = NULL;
-	free(versionProm);
-	versionProm = NULL;
 	PROM_DEBUG("Node stack has been properly shutdown", "");
 	started = 0;
 }
 
 char *
-getVersions(psb_t *sbp, bool compact) {
-	psb_t *sbi = NULL, *sb = NULL;
-
-	if (versionProm != NULL) {
-		goto end;
-	}
-
-	sbi = psb_new();
-	sb = psb_new();
-	if (sbi == NULL || sb == NULL) {
+getVersions(psb_t *sb, bool compact) {
+	if (versionHR == NULL) {
+		psb_t *sbi = psb_new();
+		if (sbi == NULL)
+			return NULL;
+		psb_add_str(sbi, "solmex " SOLMEX_VERSION "\n(C) 2025 " SOLMEX_AUTHOR "\n");
+		versionHR = psb_dump(sbi);
 		psb_destroy(sbi);
-		psb_destroy(sb);
-		return NULL;
 	}
 
-	psb_add_str(sbi, "solmex " SOLMEX_VERSION "\n(C) 2025 " SOLMEX_AUTHOR "\n");
-	versionHR = psb_dump(sbi);
-	psb_destroy(sbi);
-
-	if (!compact)
-		addPromInfo(SOLMEXM_VERS);
-
-	psb_add_str(sb, SOLMEXM_VERS_N "{name=\"server\",value=\"" SOLMEX_VERSION
-		"\"} 1\n");
-
-	versionProm = psb_dump(sb);
-	psb_destroy(sb);
-
-end:
-	if (sbp == NULL) {
+	if (sb == NULL) {
 		fprintf(stdout, "%s", versionHR);
 	} else {
-		psb_add_str(sbp, versionProm);
+		addExpoInfo(SOLMEXM_VERS);
+		expo_emit(sb, SOLMEXM_VERS_N,
+			"{name=\"server\",value=\"" SOLMEX_VERSION "\"}", "1", 1);
 	}
 	return versionHR;
 }
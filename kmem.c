@@ -0,0 +1,293 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <kstat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libprom/prom.h>
+
+#include "kmem.h"
+#include "ks_util.h"
+#include "expo.h"
+
+// see also: usr/src/uts/common/os/kmem.c (kmem_cache_kstat_update())
+// and mdb's ::kmastat
+
+#define KMEM_CLASS "kmem_cache"
+
+typedef enum kmem_idx {
+	KMEM_IDX_BUF_SIZE,		KMEM_IDX_BUF_INUSE,		KMEM_IDX_BUF_TOTAL,
+	KMEM_IDX_SLAB_CREATE,	KMEM_IDX_SLAB_DESTROY,	KMEM_IDX_ALLOC_FAIL,
+	KMEM_IDX_MEM_INUSE,		// derived: buf_inuse * buf_size - no kstat
+	KMEM_IDX_MAX
+} kmem_idx_t;
+
+/* kstat names */
+static const char *knames[] = {
+	"buf_size",		"buf_inuse",	"buf_total",
+	"slab_create",	"slab_destroy",	"alloc_fail",
+	NULL
+};
+
+/* solmex metric names */
+static const char *snames[] = {
+#define STRINGIFY(x) #x
+#define _S(x) STRINGIFY(x)
+	_S(SOLMEX_KMEM_BUF_SIZE_N),		_S(SOLMEX_KMEM_BUF_INUSE_N),	_S(SOLMEX_KMEM_BUF_TOTAL_N),
+	_S(SOLMEX_KMEM_SLAB_CREATE_N),	_S(SOLMEX_KMEM_SLAB_DESTROY_N),	_S(SOLMEX_KMEM_ALLOC_FAIL_N),
+	_S(SOLMEX_KMEM_MEM_INUSE_N),	NULL
+};
+
+/* metric HELP text */
+static const char *sdesc[] = {
+	SOLMEX_KMEM_BUF_SIZE_D,		SOLMEX_KMEM_BUF_INUSE_D,	SOLMEX_KMEM_BUF_TOTAL_D,
+	SOLMEX_KMEM_SLAB_CREATE_D,	SOLMEX_KMEM_SLAB_DESTROY_D,	SOLMEX_KMEM_ALLOC_FAIL_D,
+	SOLMEX_KMEM_MEM_INUSE_D,	NULL
+};
+
+/* metric types */
+static const char *stypes[] = {
+	SOLMEX_KMEM_BUF_SIZE_T,		SOLMEX_KMEM_BUF_INUSE_T,	SOLMEX_KMEM_BUF_TOTAL_T,
+	SOLMEX_KMEM_SLAB_CREATE_T,	SOLMEX_KMEM_SLAB_DESTROY_T,	SOLMEX_KMEM_ALLOC_FAIL_T,
+	SOLMEX_KMEM_MEM_INUSE_T,	NULL
+};
+
+/** the order used to emit the metrics */
+static kmem_idx_t stats[] = {
+	KMEM_IDX_MEM_INUSE,		KMEM_IDX_BUF_SIZE,		KMEM_IDX_BUF_INUSE,
+	KMEM_IDX_BUF_TOTAL,		KMEM_IDX_SLAB_CREATE,	KMEM_IDX_SLAB_DESTROY,
+	KMEM_IDX_ALLOC_FAIL
+};
+static uint32_t stats_sz = ARRAY_SIZE(stats);
+
+typedef struct kmem_cache {
+	kstat_t *ksp;
+	uint64_t vals[KMEM_IDX_MAX];
+} kmem_cache_t;
+
+#define KMEM_EXTENT 256
+
+static kmem_cache_t *caches = NULL;	// all kmem_cache kstats of the chain
+static uint32_t caches_sz = 0;		// capacity of caches and rank
+static uint32_t caches_n = 0;		// number of entries in caches
+static uint32_t *rank = NULL;		// caches indexes, top N first
+static kid_t last_kid = -1;
+
+#define MEM(i)	(caches[(i)].vals[KMEM_IDX_MEM_INUSE])
+
+int
+parse_kmem_opts(const char *s, uint16_t *topn, uint16_t *interval) {
+	unsigned int n, i;
+	int res;
+
+	if (s == NULL)
+		return 1;
+	res = sscanf(s, "%u,%u", &n, &i);
+	if (res < 1 || n > UINT16_MAX) {
+		fprintf(stderr, "Invalid kmem top-N value in '%s'.\n", s);
+		return 1;
+	}
+	if (res == 1) {
+		i = KMEM_INTERVAL_DEFAULT;
+	} else if (i == 0 || i > UINT16_MAX) {
+		fprintf(stderr, "Invalid kmem scan interval in '%s'.\n", s);
+		return 2;
+	}
+	*topn = n;
+	*interval = i;
+	return 0;
+}
+
+// Walk the chain and remember all kstats of class kmem_cache. There are
+// usually 500..2000 of them, so update_instance() is not the right tool.
+static int
+update_caches(kstat_ctl_t *kc) {
+	kstat_t *ksp;
+	uint32_t n = 0;
+
+	if (kc->kc_chain_id == last_kid)
+		return caches_n;
+
+	for (ksp = kc->kc_chain; ksp != NULL; ksp = ksp->ks_next) {
+		if (ksp->ks_type != KSTAT_TYPE_NAMED
+			|| strcmp(ksp->ks_class, KMEM_CLASS) != 0)
+		{
+			continue;
+		}
+		if (n == caches_sz) {
+			kmem_cache_t *c = realloc(caches,
+				(caches_sz + KMEM_EXTENT) * sizeof(kmem_cache_t));
+			uint32_t *r = c == NULL
+				? NULL
+				: realloc(rank, (caches_sz + KMEM_EXTENT) * sizeof(uint32_t));
+			if (r == NULL) {
+				PROM_WARN("Unable to allocate kmem cache table: %s",
+					strerror(errno));
+				if (c != NULL)
+					caches = c;
+				caches_n = 0;
+				return -1;	// try again later
+			}
+			caches = c;
+			rank = r;
+			caches_sz += KMEM_EXTENT;
+		}
+		caches[n].ksp = ksp;
+		n++;
+	}
+	caches_n = n;
+	last_kid = kc->kc_chain_id;
+	return n;
+}
+
+static bool
+read_cache(kstat_ctl_t *kc, kmem_cache_t *c, hrtime_t now) {
+	kstat_t *ksp;
+	kstat_named_t *knp;
+	kmem_idx_t k;
+
+	if ((ksp = ks_read(kc, c->ksp, now, NULL)) == NULL) {
+		memset(c->vals, 0, sizeof(c->vals));
+		return false;
+	}
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+	for (k = 0; k < KMEM_IDX_MEM_INUSE; k++) {
+		c->vals[k] = ((knp = kstat_data_lookup(ksp, knames[k])) != NULL)
+			? knp->value.ui64
+			: 0;
+	}
+#pragma GCC diagnostic pop
+	c->vals[KMEM_IDX_MEM_INUSE] =
+		c->vals[KMEM_IDX_BUF_INUSE] * c->vals[KMEM_IDX_BUF_SIZE];
+	return true;
+}
+
+// Partial quickselect (Hoare): afterwards idx[0..k-1] contains the k caches
+// with the most memory in use, in no particular order. O(n) on average
+// instead of O(n log n) for a full sort.
+static void
+select_topn(uint32_t *idx, int n, int k) {
+	int lo = 0, hi = n - 1, i, j;
+	uint32_t t;
+	uint64_t pivot;
+
+	if (k <= 0 || k >= n)
+		return;
+
+	k--;	// position of the smallest element of the top-N
+	while (lo < hi) {
+		pivot = MEM(idx[lo + ((hi - lo) >> 1)]);
+		i = lo;
+		j = hi;
+		while (i <= j) {
+			while (MEM(idx[i]) > pivot)
+				i++;
+			while (MEM(idx[j]) < pivot)
+				j--;
+			if (i <= j) {
+				t = idx[i];
+				idx[i] = idx[j];
+				idx[j] = t;
+				i++;
+				j--;
+			}
+		}
+		if (k <= j)
+			hi = j;
+		else if (k >= i)
+			lo = i;
+		else
+			break;
+	}
+}
+
+// not thread-safe, but neither is the rest of the collector
+static int
+cmp_mem_desc(const void *a, const void *b) {
+	uint64_t ma = MEM(*((const uint32_t *) a));
+	uint64_t mb = MEM(*((const uint32_t *) b));
+	return ma < mb ? 1 : (ma > mb ? -1 : 0);
+}
+
+void
+collect_kmem(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
+	uint16_t topn, uint16_t interval)
+{
+	static hrtime_t last_scan = 0;
+	static uint32_t top = 0;				// number of caches to emit
+	static uint64_t other[KMEM_IDX_MAX];	// sum of all non-top caches
+	int n;
+	uint32_t i, m;
+	kmem_idx_t k;
+	char buf[64];
+
+	PROM_DEBUG("collect_kmem ...", "");
+	if (topn == 0)
+		return;
+
+	bool rescan = kc->kc_chain_id != last_kid;
+	if ((n = update_caches(kc)) < 1)
+		return;
+
+	if (rescan || last_scan == 0
+		|| (now - last_scan) >= ((hrtime_t) interval) * NANOSEC)
+	{
+		for (i = 0; i < (uint32_t) n; i++) {
+			read_cache(kc, &caches[i], now);
+			rank[i] = i;
+		}
+		top = topn < n ? topn : n;
+		select_topn(rank, n, top);
+		// just a few entries, so an order by size is cheap and stable output
+		qsort(rank, top, sizeof(uint32_t), cmp_mem_desc);
+		memset(other, 0, sizeof(other));
+		for (i = top; i < (uint32_t) n; i++) {
+			for (k = 0; k < KMEM_IDX_MAX; k++)
+				other[k] += caches[rank[i]].vals[k];
+		}
+		last_scan = now;
+	} else {
+		// the ranking is still valid - refresh the top-N, only
+		for (i = 0; i < top; i++)
+			read_cache(kc, &caches[rank[i]], now);
+	}
+
+	bool free_sb = sb == NULL;
+	if (free_sb)
+		sb = psb_new();
+
+	addExpoInfo(SOLMEXM_KMEM_CACHES);
+	expo_emit_uint(sb, SOLMEXM_KMEM_CACHES_N, NULL, n);
+
+	for (m = 0; m < stats_sz; m++) {
+		k = stats[m];
+		expo_emit_info(sb, compact, snames[k], stypes[k], sdesc[k]);
+		for (i = 0; i < top; i++) {
+			kmem_cache_t *c = &caches[rank[i]];
+			snprintf(buf, sizeof(buf), "{cache=\"%s\"}", c->ksp->ks_name);
+			ks_emit_times(c->ksp);
+			expo_emit_uint(sb, snames[k], buf, c->vals[k]);
+		}
+		ks_emit_times(NULL);
+		// a summarized buffer size makes no sense
+		if (top < (uint32_t) n && k != KMEM_IDX_BUF_SIZE)
+			expo_emit_uint(sb, snames[k], "{cache=\"other\"}", other[k]);
+	}
+
+	if (free_sb) {
+		fprintf(stdout, "\n%s", psb_str(sb));
+		psb_destroy(sb);
+	}
+	PROM_DEBUG("collect_kmem done", "");
+}
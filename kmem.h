@@ -0,0 +1,61 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file kmem.h
+ * Collect kmem_cache stats via kstats for the top-N caches wrt. memory in use.
+ */
+
+#ifndef SOLMEX_KMEM_H
+#define SOLMEX_KMEM_H
+
+#include <kstat.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default number of seconds between two full scans of all kmem caches. */
+#define KMEM_INTERVAL_DEFAULT 60
+
+/**
+ * @brief Parse the given kmem option string of the form `N[,interval]`.
+ * @param s	The string to parse.
+ * @param topn	Where to store the number of caches to emit. `0` disables the
+ * 	collector.
+ * @param interval	Where to store the number of seconds between two full
+ * 	scans. Set to `KMEM_INTERVAL_DEFAULT` if not given.
+ * @return 0 on success, a value != 0 otherwise.
+ */
+int parse_kmem_opts(const char *s, uint16_t *topn, uint16_t *interval);
+
+/**
+ * @brief Collect the `unix:0:` class `kmem_cache` stats. All caches get
+ * 	scanned and ranked by memory in use every `interval` seconds, only. In
+ * 	between just the kstats of the top `topn` caches get re-read. All other
+ * 	caches get summarized as cache="other" based on the last full scan.
+ * @param sb	where to add the stats.
+ * @param compact	whether to add HELP and TYPE comments
+ * @param kc	The kstat chain to use.
+ * @param now	The current time as delivered by gethrtime().
+ * @param topn	The max. number of caches to emit individually.
+ * @param interval	Number of seconds between two full scans.
+ */
+void collect_kmem(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
+	uint16_t topn, uint16_t interval);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_KMEM_H
@@ -16,6 +16,7 @@
 #include <poll.h>
 
 #include "ks_util.h"
+#include "expo.h"
 
 /*
 node_cpus_total{state="offline"} 0
@@ -73,21 +74,28 @@ ks_chain_open_or_update(kstat_ctl_t *kc) {
 	return kc;
 }
 
-#define LOAD_MAX_TMP_ENTRIES 128
+static inline bool
+ks_match(const ks_info_t *ks, const kstat_t *ksp) {
+	if (ks->module != NULL && (strcmp(ks->module, ksp->ks_module) != 0))
+		return false;
+	if (ks->instance >= 0 && ks->instance != ksp->ks_instance)
+		return false;
+	if (ks->name != NULL && (strcmp(ks->name, ksp->ks_name) != 0))
+		return false;
+	return true;
+}
 
 int
 update_instance(kstat_ctl_t *kc, ks_info_t *ks) {
-	kstat_t *ksp;
-
-	kstat_t *tmp_ksp[LOAD_MAX_TMP_ENTRIES];
-	uint8_t found = 0, i;//, k;
+	kstat_t *ksp, *first;
+	uint32_t found = 1, i;
 
 	// entries uptodate ?
 	if ((kc->kc_chain_id == ks->last_kid))
 		return ks->entries;
 
 	assert(ks->module != NULL || ks->name != NULL);
-	if ((ksp = kstat_lookup(kc, ks->module, ks->instance, ks->name)) == NULL) {
+	if ((first = kstat_lookup(kc, ks->module, ks->instance, ks->name)) == NULL) {
 		if (errno != ENOENT) {
 			PROM_WARN("'%s:%d:%s' is neither a named nor a timer kstat",
 				ks->module, ks->instance, (ks->name ? ks->name : "NULL"));
@@ -97,21 +105,12 @@ update_instance(kstat_ctl_t *kc, ks_info_t *ks) {
 		ks->entries = 0;
 		return 0;
 	}
-	tmp_ksp[found++] = ksp;
+	// wildcards - so try to find more. No temp array: on big boxes there
+	// are several hundred cpu_info:* or cpu:*:vm instances.
 	if (ks->instance < 0 || ks->name == NULL || ks->module == NULL) {
-		// wildcards - so try to find more
-		for (ksp = ksp->ks_next; ksp; ksp = ksp->ks_next) {
-			if (ks->module != NULL && (strcmp(ks->module, ksp->ks_module) != 0))
-				continue;
-			if (ks->instance >= 0 && ks->instance != ksp->ks_instance)
-				continue;
-			if (ks->name != NULL && (strcmp(ks->name, ksp->ks_name) != 0))
-				continue;
-			tmp_ksp[found++] = ksp;
-			if (found == LOAD_MAX_TMP_ENTRIES) {
-				PROM_WARN("Max instance found (%d) - skipping others", LOAD_MAX_TMP_ENTRIES);
-				break;
-			}
+		for (ksp = first->ks_next; ksp; ksp = ksp->ks_next) {
+			if (ks_match(ks, ksp))
+				found++;
 		}
 	}
 	// that's why we make all this: we wanna keep already populated instances
@@ -125,18 +124,12 @@ update_instance(kstat_ctl_t *kc, ks_info_t *ks) {
 		}
 		ks->ksp = ksp_new;
 	}
-	/*
-	for (i = 0; i < found; i++) {
-		kid_t kid_new =  tmp_ksp[i]->ks_kid;
-		for (k = 0; k < ks->entries; k++) {
-			if (ks->ksp[k]->ks_kid == kid_new)
-				tmp_ksp[i] = ks->ksp[k];
-		}
+	ks->ksp[0] = first;
+	for (i = 1, ksp = first->ks_next; i < found && ksp; ksp = ksp->ks_next) {
+		if (ks_match(ks, ksp))
+			ks->ksp[i++] = ksp;
 	}
-	*/
-	for (i = 0; i < found; i++)
-		ks->ksp[i] = tmp_ksp[i];
-	for (i = found; i < ks->entries; i++)
+	for (; i < ks->entries; i++)
 		ks->ksp[i] = NULL;
 	ks->entries = found;
 	ks->last_kid = kc->kc_chain_id;
@@ -145,14 +138,44 @@ update_instance(kstat_ctl_t *kc, ks_info_t *ks) {
 
 #define MAX_READ_ERRORS 5		// don't wanna block forever
 
+ks_mark_t ks_mark = { 0, 0, 0, NULL };
+
+void
+ks_mark_reset(void) {
+	ks_mark.snap = ks_mark.crtime = 0;
+	ks_mark.n = 0;
+	ks_mark.ksp = NULL;
+}
+
+void
+ks_emit_times(const kstat_t *ksp) {
+	if (ksp == NULL)
+		expo_emit_times(0, 0);
+	else
+		expo_emit_times(ksp->ks_snaptime, ksp->ks_crtime);
+}
+
+static void
+markRead(const kstat_t *ksp) {
+	if (ksp->ks_snaptime > ks_mark.snap)
+		ks_mark.snap = ksp->ks_snaptime;
+	if (ksp != ks_mark.ksp) {
+		ks_mark.n++;
+		ks_mark.ksp = ksp;
+		ks_mark.crtime = ksp->ks_crtime;
+	}
+}
+
 kstat_t *
 ks_read(kstat_ctl_t *kc, kstat_t *ksp, hrtime_t now, void *data) {
 	kid_t kid;
 	int count = 0;
 
 	hrtime_t delta = now - ksp->ks_snaptime;
-	if (ksp->ks_data && delta > 0 && delta < NANOSEC)
+	if (ksp->ks_data && delta > 0 && delta < NANOSEC) {
+		markRead(ksp);
 		return ksp;
+	}
 
 	while ((count < MAX_READ_ERRORS) && (kid = kstat_read(kc, ksp, data)) == -1) {
 		if (errno == EAGAIN) {
@@ -166,5 +189,8 @@ ks_read(kstat_ctl_t *kc, kstat_t *ksp, hrtime_t now, void *data) {
 			break;
 		}
 	}
-	return kid == -1 ? NULL : ksp;
+	if (kid == -1)
+		return NULL;
+	markRead(ksp);
+	return ksp;
 }
@@ -21,6 +21,7 @@
 #include <kstat.h>
 
 #include "common.h"
+#include "solmex_plugin.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,17 +42,7 @@ extern "C" {
  */
 kstat_ctl_t *ks_chain_open_or_update(kstat_ctl_t *kc);
 
-/**
- * At least modul or name are required to be != NULL.
- */
-typedef struct ks_info {
-	char *module;		/**< the module name to lookup. */
-	int instance;		/**< the instance to lookup, or -1 if all */
-	char *name;			/**< the statistic name to lookup, or NULL if all */
-	kid_t last_kid;		/**< Id of the kstat chain where ksp entries belong to */
-	uint8_t entries;	/**< number of instances found and stored in ksp below */
-	kstat_t **ksp;		/**< the kstat instance[s] holding the related data */
-} ks_info_t;
+// ks_info_t is part of the plugin ABI, so it lives in solmex_plugin.h
 
 /**
  * @brief Just set entries = 0 and free ksp member, if != NULL
@@ -108,6 +99,30 @@ int update_instance(kstat_ctl_t *kc, ks_info_t *ks);
  */
 kstat_t *ks_read(kstat_ctl_t *kc, kstat_t *ksp, hrtime_t now, void *data);
 
+/** The kstat times seen by ks_read() since the last ks_mark_reset(). */
+typedef struct ks_mark {
+	hrtime_t snap;		/**< the most recent ks_snaptime */
+	hrtime_t crtime;	/**< ks_crtime of the last kstat read */
+	uint32_t n;			/**< number of kstats read (consecutive reads count 1) */
+	const kstat_t *ksp;	/**< the last kstat read */
+} ks_mark_t;
+
+/** Not thread-safe: collectors run one at a time. */
+extern ks_mark_t ks_mark;
+
+/**
+ * @brief Reset the kstat times recorded by ks_read().
+ */
+void ks_mark_reset(void);
+
+/**
+ * @brief Stamp the samples emitted after this call with the kstat times of
+ * 	the given kstat (see expo_emit_times()).
+ * @param ksp	The kstat the following samples are made of, `NULL` if they
+ * 	are made of several kstats, e.g. sums.
+ */
+void ks_emit_times(const kstat_t *ksp);
+
 #ifdef __cplusplus
 }
 #endif
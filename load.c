@@ -15,13 +15,20 @@
 #include <sys/stat.h>
 #include <sys/swap.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <libprom/prom.h>
 
 #include "load.h"
 #include "ks_util.h"
+#include "expo.h"
 
 // usr/src/cmd/powertop/common/cpufreq.c
 // usr/src/cmd/cpc/common/cpustat.c
@@ -55,7 +62,6 @@ collect_load(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now) {
 	static double aven[3] = { 0, 0 , 0 };
 	static hrtime_t last_time = 0;
 	static uint64_t deficit	= UINT64_MAX;
-	char buf[32];
 
 	PROM_DEBUG("collect_load ...", "");
 
@@ -98,30 +104,18 @@ collect_load(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now) {
 	if (free_sb)
 		sb = psb_new();
 
-	if (!compact)
-		addPromInfo(SOLMEXM_LOAD1);
-	psb_add_str(sb, SOLMEXM_LOAD1_N " ");
-	sprintf(buf, "%.17g\n", aven[LOADAVG_1MIN]);
-	psb_add_str(sb, buf);
+	addExpoInfo(SOLMEXM_LOAD1);
+	expo_emit_double(sb, SOLMEXM_LOAD1_N, NULL, aven[LOADAVG_1MIN]);
 
-	if (!compact)
-		addPromInfo(SOLMEXM_LOAD5);
-	psb_add_str(sb, SOLMEXM_LOAD5_N " ");
-	sprintf(buf, "%.17g\n", aven[LOADAVG_5MIN]);
-	psb_add_str(sb, buf);
+	addExpoInfo(SOLMEXM_LOAD5);
+	expo_emit_double(sb, SOLMEXM_LOAD5_N, NULL, aven[LOADAVG_5MIN]);
 
-	if (!compact)
-		addPromInfo(SOLMEXM_LOAD15);
-	psb_add_str(sb, SOLMEXM_LOAD15_N " ");
-	sprintf(buf, "%.17g\n", aven[LOADAVG_15MIN]);
-	psb_add_str(sb, buf);
+	addExpoInfo(SOLMEXM_LOAD15);
+	expo_emit_double(sb, SOLMEXM_LOAD15_N, NULL, aven[LOADAVG_15MIN]);
 
 	if (deficit != UINT64_MAX) {
-		if (!compact)
-			addPromInfo(SOLMEXM_DEFICIT);
-		psb_add_str(sb, SOLMEXM_DEFICIT_N " ");
-		sprintf(buf, "%ld\n", deficit << page_shift);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_DEFICIT);
+		expo_emit_uint(sb, SOLMEXM_DEFICIT_N, NULL, deficit << page_shift);
 	}
 	if (free_sb) {
 		fprintf(stdout, "\n%s", psb_str(sb));
@@ -144,12 +138,177 @@ typedef enum {
 	UNKNOWN = -1
 } info_t;
 
-// not thread-safe !
+// The raw samples of the last two rounds and the difference between them.
+// Kept on file scope, so that the last sample can be persisted for the next
+// oneshot run. Swap metrics come from swapctl(2) and not from the vminfo
+// riemann sums (see collect() in main.c), so there is nothing to persist.
+static struct {
+	sysinfo_t info[3];
+	hrtime_t snap;		// snaptime of info[prev]
+	info_t prev;
+	bool restored;		// info[prev] got loaded from a state file
+} procq_smpl = { .prev = UNKNOWN };
+
+static struct {
+	vminfo_t info[3];
+	info_t prev;
+} swap_smpl = { .prev = UNKNOWN };
+
+typedef struct load_state_cfg {
+	char *path;
+	uint32_t maxage;	// in seconds
+} load_state_cfg_t;
+
+#define LOAD_STATE_MAGIC 0x534d5853		// SMXS
+#define LOAD_STATE_VERSION 2
+
+// on disk format of the state file
+typedef struct load_state {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t size;		// sizeof(load_state_t)
+	time_t boot;		// approximate boot time
+	hrtime_t snap;		// snaptime of the sample below
+	sysinfo_t sysinfo;
+} load_state_t;
+
+void *
+parse_state_opts(const char *s, int *valid) {
+	load_state_cfg_t *cfg;
+	char *t;
+	unsigned int age;
+
+	*valid = 0;
+	if (s == NULL)
+		return NULL;
+	if (strcmp(s, "none") == 0 || strcmp(s, "n") == 0 || strcmp(s, "0") == 0) {
+		*valid = 1;
+		return NULL;
+	}
+	if ((cfg = calloc(1, sizeof(load_state_cfg_t))) == NULL
+		|| (cfg->path = strdup(s)) == NULL)
+	{
+		perror("statefile");
+		free(cfg);
+		return NULL;
+	}
+	cfg->maxage = LOAD_STATE_MAXAGE;
+	if ((t = strrchr(cfg->path, ':')) != NULL
+		&& t[1 + strspn(t + 1, "0123456789")] == '\0')
+	{
+		if (sscanf(t + 1, "%u", &age) != 1 || age < 1) {
+			fprintf(stderr, "Invalid max. age of the state file in '%s'.\n", s);
+			goto fail;
+		}
+		*t = '\0';
+		cfg->maxage = age;
+	}
+	if (cfg->path[0] != '/') {
+		fprintf(stderr, "The state file '%s' needs to be an absolute path.\n",
+			cfg->path);
+		goto fail;
+	}
+	*valid = 1;
+	return cfg;
+
+fail:
+	free(cfg->path);
+	free(cfg);
+	return NULL;
+}
+
+// Boot time in seconds since the epoch, good enough to tell boots apart.
+static time_t
+bootTime(void) {
+	return time(NULL) - gethrtime() / NANOSEC;
+}
+
+bool
+load_state_restore(void *cfg, hrtime_t now) {
+	load_state_cfg_t *sc = (load_state_cfg_t *) cfg;
+	load_state_t st;
+	hrtime_t maxage;
+	ssize_t n;
+	int fd;
+
+	if (sc == NULL)
+		return false;
+	if ((fd = open(sc->path, O_RDONLY)) == -1) {
+		if (errno != ENOENT)
+			PROM_WARN("Unable to open state file '%s': %s", sc->path,
+				strerror(errno));
+		return false;
+	}
+	n = read(fd, &st, sizeof(st));
+	(void) close(fd);
+	if (n != sizeof(st) || st.magic != LOAD_STATE_MAGIC
+		|| st.version != LOAD_STATE_VERSION || st.size != sizeof(st))
+	{
+		PROM_WARN("Ignoring invalid state file '%s'.", sc->path);
+		return false;
+	}
+	// hrtime starts at 0 on each boot
+	if (labs(st.boot - bootTime()) > 2) {
+		PROM_DEBUG("State file '%s' is from a previous boot.", sc->path);
+		return false;
+	}
+	maxage = (hrtime_t) sc->maxage * NANOSEC;
+	if (st.snap > 0 && st.snap < now && now - st.snap <= maxage) {
+		procq_smpl.info[A] = st.sysinfo;
+		procq_smpl.snap = st.snap;
+		procq_smpl.prev = A;
+		procq_smpl.restored = true;
+	}
+	return procq_smpl.restored;
+}
+
 void
+load_state_save(void *cfg) {
+	load_state_cfg_t *sc = (load_state_cfg_t *) cfg;
+	load_state_t st;
+	char tmp[PATH_MAX];
+	int fd;
+
+	if (sc == NULL || procq_smpl.prev == UNKNOWN)
+		return;
+
+	memset(&st, 0, sizeof(st));
+	st.magic = LOAD_STATE_MAGIC;
+	st.version = LOAD_STATE_VERSION;
+	st.size = sizeof(st);
+	st.boot = bootTime();
+	st.sysinfo = procq_smpl.info[procq_smpl.prev];
+	st.snap = procq_smpl.snap;
+	// write and rename, so that concurrent runs never see a partial file
+	if (snprintf(tmp, sizeof(tmp), "%s.%d", sc->path, (int) getpid())
+		>= (int) sizeof(tmp))
+	{
+		PROM_WARN("State file path '%s' is too long.", sc->path);
+		return;
+	}
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+		PROM_WARN("Unable to create state file '%s': %s", tmp, strerror(errno));
+		return;
+	}
+	if (write(fd, &st, sizeof(st)) != sizeof(st)) {
+		PROM_WARN("Unable to write state file '%s': %s", tmp, strerror(errno));
+		(void) close(fd);
+		(void) unlink(tmp);
+		return;
+	}
+	(void) close(fd);
+	if (rename(tmp, sc->path) == -1) {
+		PROM_WARN("Unable to rename '%s' to '%s': %s", tmp, sc->path,
+			strerror(errno));
+		(void) unlink(tmp);
+	}
+}
+
+// not thread-safe !
+bool
 collect_procq(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now) {
-	char buf[32];
-	static sysinfo_t info[3];
-	static info_t prev = UNKNOWN;
+	sysinfo_t *info = procq_smpl.info;
+	info_t prev = procq_smpl.prev;
 	info_t next;
 
 	kstat_t *ksp;
@@ -157,17 +316,22 @@ collect_procq(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now) {
 
 	uint8_t n = update_instance(kc, &kstat[idx]);
 	if (n != 1)
-		return;
+		return false;
 
 	next = (prev + 1) & 0x1;
 	if ((ksp = ks_read(kc, kstat[idx].ksp[0], now, &(info[next]))) == NULL)
-		return;
+		return false;
 
-	if (prev == UNKNOWN)	{
+	if (prev == UNKNOWN
+		|| (procq_smpl.restored && info[next].updates <= info[prev].updates))
+	{
 		// does not make sense w/o a previous stat
-		prev = next;
-		return;
+		procq_smpl.prev = next;
+		procq_smpl.snap = ksp->ks_snaptime;
+		procq_smpl.restored = false;
+		return false;
 	}
+	procq_smpl.restored = false;
 	// If a system has 16 TiB and sys pages are 4 KiB = 8 TiB = 2^32 pages and
 	// thus room for 2^64 updates (it gets made every second) =~ 136 years.
 	info[D].updates = 1;
@@ -177,45 +341,37 @@ collect_procq(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now) {
 	INFO_DIFF(runque);
 	INFO_DIFF(swpque);
 	INFO_DIFF(waiting);
-	prev = next;
+	procq_smpl.prev = next;
+	procq_smpl.snap = ksp->ks_snaptime;
 
 	bool free_sb = sb == NULL;
 	if (free_sb)
 		sb = psb_new();
 
-	if (!compact)
-		addPromInfo(SOLMEXM_PROCQ_RUN);
-	psb_add_str(sb, SOLMEXM_PROCQ_RUN_N " ");
-	sprintf(buf, "%u\n", info[D].runque);
-	psb_add_str(sb, buf);
+	addExpoInfo(SOLMEXM_PROCQ_RUN);
+	expo_emit_uint(sb, SOLMEXM_PROCQ_RUN_N, NULL, info[D].runque);
 
-	if (!compact)
-		addPromInfo(SOLMEXM_PROCQ_SWAP);
-	psb_add_str(sb, SOLMEXM_PROCQ_SWAP_N " ");
-	sprintf(buf, "%u\n", info[D].swpque);
-	psb_add_str(sb, buf);
+	addExpoInfo(SOLMEXM_PROCQ_SWAP);
+	expo_emit_uint(sb, SOLMEXM_PROCQ_SWAP_N, NULL, info[D].swpque);
 
-	if (!compact)
-		addPromInfo(SOLMEXM_PROCQ_WAIT);
-	psb_add_str(sb, SOLMEXM_PROCQ_WAIT_N " ");
-	sprintf(buf, "%u\n", info[D].waiting);
-	psb_add_str(sb, buf);
+	addExpoInfo(SOLMEXM_PROCQ_WAIT);
+	expo_emit_uint(sb, SOLMEXM_PROCQ_WAIT_N, NULL, info[D].waiting);
 
 	if (free_sb) {
 		fprintf(stdout, "\n%s", psb_str(sb));
 		psb_destroy(sb);
 	}
 	PROM_DEBUG("collect_procq done", "");
+	return true;
 }
 
 #define PSHIFT page_shift
 
 // not thread-safe !
-void
+bool
 collect_swap(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now) {
-	char buf[32];
-	static vminfo_t info[3];
-	static info_t prev = UNKNOWN;
+	vminfo_t *info = swap_smpl.info;
+	info_t prev = swap_smpl.prev;
 	info_t next;
 	//uint64_t used;
 
@@ -226,7 +382,7 @@ collect_swap(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now) {
 		struct anoninfo ai;
 		if (swapctl(SC_AINFO, &ai) == -1) {
 			PROM_WARN("SWAP info n/a: ", strerror(errno));
-			return;
+			return false;
 		}
 		memset(&(info[D]), 0, sizeof(vminfo_t));
 		// ani.max = total amount of swap space including free physical memory
@@ -243,16 +399,16 @@ collect_swap(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now) {
 	} else {
 		int n = update_instance(kc, &kstat[idx]);
 		if (n != 1)
-			return;
+			return false;
 
 		next = (prev + 1) & 0x1;
 		if ((ksp = ks_read(kc, kstat[idx].ksp[0], now, &(info[next]))) == NULL)
-			return;
+			return false;
 
-		if (prev == UNKNOWN)	{
+		if (prev == UNKNOWN) {
 			// does not make sense w/o a previous stat
-			prev = next;
-			return;
+			swap_smpl.prev = next;
+			return false;
 		}
 		// If a system has 16 TiB and sys pages are 4 KiB = 8 TiB = 2^32 pages and
 		// thus room for 2^64 updates (it gets made every second) =~ 136 years.
@@ -265,42 +421,35 @@ collect_swap(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now) {
 		INFO_DIFF(swap_alloc);	// k_anoninfo.(ani_mem_resv + ani_max - ani_free);
 		INFO_DIFF(swap_avail);	// avail_rmem + k_anoninfo.(ani_max - ani_phys_resv);
 		INFO_DIFF(swap_free);	// avail_rmem + k_anoninfo.ani_free;
-		prev = next;
+		swap_smpl.prev = next;
 	}
 
 	bool free_sb = sb == NULL;
 	if (free_sb)
 		sb = psb_new();
 
-	if (!compact)
-		addPromInfo(SOLMEXM_SWAP_RESV);
-	psb_add_str(sb, SOLMEXM_SWAP_RESV_N " ");
-	sprintf(buf, "%ld\n", info[D].swap_resv << PSHIFT);
-	psb_add_str(sb, buf);
-
-	if (!compact)
-		addPromInfo(SOLMEXM_SWAP_ALLOC);
-	psb_add_str(sb, SOLMEXM_SWAP_ALLOC_N " ");
-	sprintf(buf, "%ld\n", info[D].swap_alloc << PSHIFT);
-	psb_add_str(sb, buf);
-
-	if (!compact)
-		addPromInfo(SOLMEXM_SWAP_AVAIL);
-	psb_add_str(sb, SOLMEXM_SWAP_AVAIL_N " ");
-	sprintf(buf, "%ld\n", info[D].swap_avail << PSHIFT);
-	psb_add_str(sb, buf);
-
-	if (!compact)
-		addPromInfo(SOLMEXM_SWAP_FREE);
-	psb_add_str(sb, SOLMEXM_SWAP_FREE_N" ");
-	sprintf(buf, "%ld\n", info[D].swap_free << PSHIFT);
-	psb_add_str(sb, buf);
+	addExpoInfo(SOLMEXM_SWAP_RESV);
+	expo_emit_uint(sb, SOLMEXM_SWAP_RESV_N, NULL,
+		info[D].swap_resv << PSHIFT);
+
+	addExpoInfo(SOLMEXM_SWAP_ALLOC);
+	expo_emit_uint(sb, SOLMEXM_SWAP_ALLOC_N, NULL,
+		info[D].swap_alloc << PSHIFT);
+
+	addExpoInfo(SOLMEXM_SWAP_AVAIL);
+	expo_emit_uint(sb, SOLMEXM_SWAP_AVAIL_N, NULL,
+		info[D].swap_avail << PSHIFT);
+
+	addExpoInfo(SOLMEXM_SWAP_FREE);
+	expo_emit_uint(sb, SOLMEXM_SWAP_FREE_N, NULL,
+		info[D].swap_free << PSHIFT);
 
 	if (free_sb) {
 		fprintf(stdout, "\n%s", psb_str(sb));
 		psb_destroy(sb);
 	}
 	PROM_DEBUG("collect_swap done", "");
+	return true;
 }
 
 /*
@@ -311,7 +460,6 @@ void
 collect_cpu_state(psb_t *sb, bool compact, hrtime_t now) {
 	static hrtime_t last_time = 0;
 	static uint64_t all, online;
-	char buf[32];
 
 	PROM_DEBUG("collect_cpu_state ...", "");
 
@@ -328,17 +476,9 @@ collect_cpu_state(psb_t *sb, bool compact, hrtime_t now) {
 	if (free_sb)
 		sb = psb_new();
 
-	if (!compact)
-		addPromInfo(SOLMEXM_CPUSTATE);
-
-	psb_add_str(sb, SOLMEXM_CPUSTATE_N "{state=\"online\"} ");
-	sprintf(buf, "%ld", online);
-	psb_add_str(sb, buf);
-	psb_add_char(sb, '\n');
-	psb_add_str(sb, SOLMEXM_CPUSTATE_N "{state=\"offline\"} ");
-	sprintf(buf, "%ld", all - online);
-	psb_add_str(sb, buf);
-	psb_add_char(sb, '\n');
+	addExpoInfo(SOLMEXM_CPUSTATE);
+	expo_emit_uint(sb, SOLMEXM_CPUSTATE_N, "{state=\"online\"}", online);
+	expo_emit_uint(sb, SOLMEXM_CPUSTATE_N, "{state=\"offline\"}", all - online);
 
 	if (free_sb) {
 		fprintf(stdout, "\n%s", psb_str(sb));
@@ -349,33 +489,16 @@ collect_cpu_state(psb_t *sb, bool compact, hrtime_t now) {
 
 void
 collect_units(psb_t *sb, bool compact) {
-	static char *metrics = NULL;
-
-	char buf[32];
-
-	PROM_DEBUG("collect_cpu_state ...", "");
+	PROM_DEBUG("collect_units ...", "");
 
 	bool free_sb = sb == NULL;
 	if (free_sb)
 		sb = psb_new();
 
-	if (metrics == NULL) {
-		size_t pos = psb_len(sb);
-
-		if (!compact)
-			addPromInfo(SOLMEXM_UNIT_PAGE);
-		psb_add_str(sb, SOLMEXM_UNIT_PAGE_N " ");
-		sprintf(buf, "%ld\n", 1L << page_shift);
-		psb_add_str(sb, buf);
-		if (!compact)
-			addPromInfo(SOLMEXM_UNIT_TICKS);
-		psb_add_str(sb, SOLMEXM_UNIT_TICKS_N " ");
-		sprintf(buf, "%ld\n", tps);
-		psb_add_str(sb, buf);
-		metrics = strdup(psb_str(sb) + pos);
-	} else {
-		psb_add_str(sb, metrics);
-	}
+	addExpoInfo(SOLMEXM_UNIT_PAGE);
+	expo_emit_uint(sb, SOLMEXM_UNIT_PAGE_N, NULL, 1UL << page_shift);
+	addExpoInfo(SOLMEXM_UNIT_TICKS);
+	expo_emit_uint(sb, SOLMEXM_UNIT_TICKS_N, NULL, tps);
 
 	if (free_sb) {
 		fprintf(stdout, "\n%s", psb_str(sb));
@@ -27,6 +27,37 @@ extern "C" {
 
 /** NOTE: The kernel updates these values usuallly once per second, only! */
 
+/** Default max. age of a state file sample in seconds. */
+#define LOAD_STATE_MAXAGE 300
+
+/**
+ * @brief Parse the given state file option string of the form
+ * 	`/path[:maxage]`.
+ * @param s	The string to parse.
+ * @param valid Gets set to @code 1 if the given string could be parsed
+ * 	successfully, to @code 0 otherwise.
+ * @return A reference to the config to be used in the load_state_*() calls,
+ * 	`NULL` if disabled or on error.
+ */
+void *parse_state_opts(const char *s, int *valid);
+
+/**
+ * @brief Load the raw unix::sysinfo sample persisted by a previous run, so
+ * 	that collect_procq() is able to emit its values on the first call. A
+ * 	sample from a previous boot or older than the configured max. age gets
+ * 	ignored.
+ * @param cfg	The reference returned by parse_state_opts().
+ * @param now	The current time as delivered by gethrtime().
+ * @return @code true if the sample got restored.
+ */
+bool load_state_restore(void *cfg, hrtime_t now);
+
+/**
+ * @brief Persist the last raw unix::sysinfo sample for the next run.
+ * @param cfg	The reference returned by parse_state_opts().
+ */
+void load_state_save(void *cfg);
+
 /**
  * @brief Get the average load statistics for the whole system for the last 1, 5,
  * and 15 minutes (via unix::system_misc).
@@ -56,8 +87,10 @@ void collect_cpu_state(psb_t *sb, bool compact, hrtime_t now);
  * 		from the kernel via syscall without making the indirection via the kstat
  *		machinery.
  * @param now	The current time as delivered by gethrtime().
+ * @return @code true if the values got emitted, @code false if there is no
+ *	previous sample (yet) to calculate them from.
  */
-void collect_procq(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now);
+bool collect_procq(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now);
 
 /**
  * @brief Get swap related kernel stats (via unix::vminfo).
@@ -67,8 +100,10 @@ void collect_procq(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now);
  * 		from the kernel via syscall without making the indirection via the kstat
  *		machinery.
  * @param now	The current time as delivered by gethrtime().
+ * @return @code true if the values got emitted, @code false if there is no
+ *	previous sample (yet) to calculate them from.
  */
-void collect_swap(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now);
+bool collect_swap(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now);
 
 /**
  * @brief Get the value of some static kernel vars like page size and ticks per
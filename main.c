@@ -13,9 +13,12 @@
 #include <errno.h>
 #include <arpa/inet.h>
 #include <signal.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <regex.h>
 #include <stdio.h>
 #include <kstat.h>
@@ -33,9 +36,23 @@
 #include "mem.h"
 #include "vmstat.h"
 #include "cpu_sys.h"
+#include "cpu_topo.h"
 #include "network.h"
 #include "mib.h"
 #include "fs.h"
+#include "fsusage.h"
+#include "kmem.h"
+#include "nfs.h"
+#include "procs.h"
+#include "rings.h"
+#include "tcpconn.h"
+#include "rates.h"
+#include "hires.h"
+#include "expo.h"
+#include "rwrite.h"
+#include "textfile.h"
+#include "exec.h"
+#include "plugin.h"
 
 typedef enum {
 	SMF_EXIT_OK	= 0,
@@ -55,41 +72,61 @@ static struct option options[] = {
 	{"no-boottime",			no_argument,		NULL, 'B'},
 	{"no-clock-freq-max",	no_argument,		NULL, 'C'},
 	{"no-dmi",				no_argument,		NULL, 'D'},
+	{"plugin",				required_argument,	NULL, 'E'},
 	{"no-clock-freq",		no_argument,		NULL, 'F'},
+	{"no-om-timestamps",	no_argument,		NULL, 'G'},
 	{"sysinfo-mp",			no_argument,		NULL, 'I'},
+	{"openmetrics",			no_argument,		NULL, 'J'},
 	{"no-kstats",			no_argument,		NULL, 'K'},
 	{"no-scrapetime",		no_argument,		NULL, 'L'},
 	{"vmstats-mp",			no_argument,		NULL, 'M'},
+	{"socket",				required_argument,	NULL, 'N'},
+	{"hires",				required_argument,	NULL, 'H'},
 	{"no-cpu-state",		no_argument,		NULL, 'O'},
 	{"no-cpu-info",			no_argument,		NULL, 'P'},
 	{"no-procq",			no_argument,		NULL, 'Q'},
+	{"nic-rollup",			required_argument,	NULL, 'R'},
 	{"no-scrapetime-all",	no_argument,		NULL, 'S'},
 	{"nic-filter",			required_argument,	NULL, 'T'},
 	{"no-units",			no_argument,		NULL, 'U'},
 	{"version",				no_argument,		NULL, 'V'},
 	{"no-swap",				no_argument,		NULL, 'W'},
+	{"exec",				required_argument,	NULL, 'X'},
 	{"no-mem",				no_argument,		NULL, 'Y'},
+	{"mib-all-stacks",		no_argument,		NULL, 'Z'},
+	{"cpu-agg",				required_argument,	NULL, 'a'},
 	{"netstats",			required_argument,	NULL, 'b'},
 	{"compact",				no_argument,		NULL, 'c'},
 	{"daemon",				no_argument,		NULL, 'd'},
+	{"rates",				required_argument,	NULL, 'e'},
 	{"foreground",			no_argument,		NULL, 'f'},
+	{"nicrings",			required_argument,	NULL, 'g'},
 	{"help",				no_argument,		NULL, 'h'},
 	{"sysinfo",				required_argument,	NULL, 'i'},
+	{"textfile-dir",		required_argument,	NULL, 'j'},
+	{"kmem",				required_argument,	NULL, 'k'},
 	{"logfile",				required_argument,	NULL, 'l'},
 	{"no-metrics",			required_argument,	NULL, 'n'},
 	{"vmstats",				required_argument,	NULL, 'm'},
+	{"procs",				required_argument,	NULL, 'o'},
 	{"port",				required_argument,	NULL, 'p'},
+	{"tcpconns",			required_argument,	NULL, 'q'},
+	{"nfsstats",			required_argument,	NULL, 'r'},
 	{"source",				required_argument,	NULL, 's'},
 	{"nicstats",			required_argument,	NULL, 't'},
+	{"fsusage",				required_argument,	NULL, 'u'},
 	{"verbosity",			required_argument,	NULL, 'v'},
+	{"statefile",			required_argument,	NULL, 'w'},
+	{"remote-write",		required_argument,	NULL, 'x'},
+	{"textfile",			required_argument,	NULL, 'y'},
 	{"fsops",				required_argument,	NULL, 'z'},
 	{0, 0, 0, 0}
 };
 
 static const char *shortUsage = {
-	"[-ABCDFIKLMOPQSUVWYcdfh] [-T list]  [-b {[i|c|u|t|s|n|r|x|a]}[,...]] "
-	"[-i {n|r|x}] [-l file] [-m {n|r|x|a}] [-n list] "
-	"[-p port] [-s ip] [-t {n|r|x|a}] [-z list] "
+	"[-ABCDFGIJKLMOPQSUVWYZcdfh] [-E file[:opts]] [-H fields[@ms]] [-N path[:mode]] [-R list] [-T list] [-X name[@secs[,timeout]]=cmd] [-a list] [-b {[i|c|u|t|s|n|r|x|a]}[,...]] "
+	"[-e names[:K]] [-g {n|r|s}] [-i {n|r|x}] [-j dir] [-k N[,secs]] [-l file] [-m {n|r|x|a}] [-n list] "
+	"[-o N[,zone:...]] [-p port] [-q ports[:secs]] [-r list] [-s ip] [-t {n|r|x|a}] [-u list[:ms]] [-w file[:secs]] [-x url[@secs[,N]]] [-y file[@secs[,fmt]]] [-z list] "
 	"[-v DEBUG|INFO|WARN|ERROR|FATAL]"
 };
 
@@ -110,38 +147,70 @@ typedef struct node_cfg {
 	cpu_sys_quantity_t cpusys_type;
 	nic_stat_quantity_t nicstat_type;
 	mib_mods_t mibstat_mode;
+	bool mib_all_stacks;
 	nic_filter_chain_t *nfc;
+	uint32_t nic_rollup;
+	ring_stat_mode_t ringstat_mode;
 	bool no_vmstat_mp;
 	bool no_cpusys_mp;
+	uint8_t cpu_agg;
 	void *fscfg;
+	uint16_t kmem_topn;
+	uint16_t kmem_interval;
+	nfs_mods_t nfs_mode;
+	void *fsucfg;
+	void *procscfg;
+	void *tcpconncfg;
+	void *ratecfg;
+	void *hirescfg;
 } node_cfg_t;
 
 static struct {
 	prom_counter_t *req_counter;
 	prom_counter_t *res_counter;
 	struct MHD_Daemon *daemon;
+	struct MHD_Daemon *udsdaemon;
 	struct in6_addr *addr;
+	char *sockpath;
+	mode_t sockmode;
 	char *logfile;
+	void *statecfg;
+	void *rwcfg;
+	void *tfoutcfg;
+	void *tfincfg;
+	void *execcfg;
+	void *plugincfg;
 	int MHD_error;
 	uint32_t promflags;
 	uint32_t verbose;
 	uint16_t port;
 	bool versionInfo;
 	bool ipv6;
+	bool openmetrics;
 	bool no_node;
 	node_cfg_t ncfg;
 } global = {
 	.req_counter = NULL,
 	.res_counter = NULL,
 	.daemon = NULL,
+	.udsdaemon = NULL,
 	.addr = NULL,
+	.sockpath = NULL,
+	.sockmode = 0660,
 	.logfile = NULL,
+	.statecfg = NULL,
+	.rwcfg = NULL,
+	.tfoutcfg = NULL,
+	.tfincfg = NULL,
+	.execcfg = NULL,
+	.plugincfg = NULL,
 	.MHD_error = -1,
 	.promflags = PROM_PROCESS | PROM_SCRAPETIME | PROM_SCRAPETIME_ALL,
 	.port = 9100,
 	.versionInfo = true,
 	.verbose = 0,
 	.ipv6 = false,
+	.openmetrics = false,
 	.no_node = false,
 	.ncfg = {
 		.no_boot = false,
@@ -160,10 +229,22 @@ static struct {
 		.cpusys_type = CPUSYS_NORMAL,
 		.nicstat_type = NICSTAT_NORMAL,
 		.mibstat_mode = MIB_MODE_FAIL,
+		.mib_all_stacks = false,
 		.nfc = NULL,
+		.nic_rollup = NICROLLUP_NONE,
+		.ringstat_mode = RINGSTAT_NONE,
 		.no_vmstat_mp = true,
 		.no_cpusys_mp = true,
+		.cpu_agg = CPUAGG_NONE,
 		.fscfg = NULL,
+		.kmem_topn = 0,
+		.kmem_interval = KMEM_INTERVAL_DEFAULT,
+		.nfs_mode = NFS_MODE_NONE,
+		.fsucfg = NULL,
+		.procscfg = NULL,
+		.tcpconncfg = NULL,
+		.ratecfg = NULL,
+		.hirescfg = NULL,
 	}
 };
 
@@ -210,9 +291,18 @@ disableMetrics(char *skipList) {
 				global.ncfg.no_sys_mem = true;
 				global.ncfg.vmstat_type = VMSTAT_NONE;
 				global.ncfg.cpusys_type = CPUSYS_NONE;
+				global.ncfg.cpu_agg = CPUAGG_NONE;
 				global.ncfg.nicstat_type = NICSTAT_NONE;
+				global.ncfg.ringstat_mode = RINGSTAT_NONE;
 				global.ncfg.mibstat_mode = MIB_MODE_NONE;
 				global.ncfg.fscfg = NULL;
+				global.ncfg.kmem_topn = 0;
+				global.ncfg.nfs_mode = NFS_MODE_NONE;
+				global.ncfg.fsucfg = NULL;
+				global.ncfg.procscfg = NULL;
+				global.ncfg.tcpconncfg = NULL;
+				global.ncfg.ratecfg = NULL;
+				global.ncfg.hirescfg = NULL;
 			} else {
 				PROM_WARN("Unknown metrics '%s'", s);
 				res++;
@@ -239,13 +329,30 @@ static _Thread_local psb_t *sb = NULL;
 static /* _Thread_local */ kstat_ctl_t *kc = NULL;
 static short kstat_err_count = 0;
 
+// Record the kstat times of the metrics the given collector call adds to sb
+// or expo_target. Metrics the collector stamped via ks_emit_times() keep the
+// times of their own kstat.
+#define KS_SPAN(call) {\
+	size_t off = sb == NULL ? 0 : psb_len(sb);\
+	uint32_t first = expo_target == NULL ? 0 : expo_target->nsample;\
+	ks_mark_reset();\
+	call;\
+	expo_emit_times(0, 0);\
+	if (sb != NULL)\
+		expo_span_add(off, psb_len(sb), first, ks_mark.snap,\
+			ks_mark.n == 1 ? ks_mark.crtime : 0);\
+}
+
 static prom_map_t *
 collect(prom_collector_t *self) {
 	bool compact = global.promflags & PROM_COMPACT;
-	kstat_ctl_t *kc_new;
+	kstat_ctl_t *kc_new, *kc_cur = NULL;
 	hrtime_t now = gethrtime();
+	size_t start = sb == NULL ? 0 : psb_len(sb);
 
 	PROM_DEBUG("collector: %p  sb: %p", self, sb);
+	if (sb != NULL)
+		expo_spans_reset();
 	if (global.versionInfo)
 		getVersions(sb, compact);
 	if (!global.ncfg.no_dmi)
@@ -263,12 +370,14 @@ collect(prom_collector_t *self) {
 		if ((kc_new = ks_chain_open_or_update(kc)) != NULL) {
 			uint8_t again = 0;
 			kc = kc_new;
+			kc_cur = kc;
 			kstat_err_count = 0;
 			if (!global.ncfg.no_load)
-				collect_load(sb, compact, kc, now);
+				KS_SPAN(collect_load(sb, compact, kc, now));
 			if (!global.ncfg.no_procq) {
-				collect_procq(sb, compact, kc, now);
-				if (sb == NULL)
+				bool ok;
+				KS_SPAN(ok = collect_procq(sb, compact, kc, now));
+				if (!ok && sb == NULL)
 					again |= 1 << 1;
 			}
 			// To avoid confusion we do not use the kstat riemann sums
@@ -283,22 +392,35 @@ collect(prom_collector_t *self) {
 					collect_swap(sb, compact, kc, now);
 			}
 			if (!global.ncfg.no_cpu_speed)
-				collect_cpu_speed(sb, compact, kc, now, !global.ncfg.no_cpu_speed_max);
+				KS_SPAN(collect_cpu_speed(sb, compact, kc, now,
+					!global.ncfg.no_cpu_speed_max));
 			if (!global.ncfg.no_sys_mem)
-				collect_sys_mem(sb, compact, kc, now);
+				KS_SPAN(collect_sys_mem(sb, compact, kc, now));
 			if (global.ncfg.vmstat_type != VMSTAT_NONE)
-				collect_vmstat(sb, compact, kc, now,
-					!global.ncfg.no_vmstat_mp, global.ncfg.vmstat_type);
+				KS_SPAN(collect_vmstat(sb, compact, kc, now,
+					!global.ncfg.no_vmstat_mp, global.ncfg.vmstat_type,
+					global.ncfg.cpu_agg));
 			if (global.ncfg.cpusys_type != CPUSYS_NONE)
-				collect_cpusys(sb, compact, kc, now,
-					!global.ncfg.no_cpusys_mp, global.ncfg.cpusys_type);
+				KS_SPAN(collect_cpusys(sb, compact, kc, now,
+					!global.ncfg.no_cpusys_mp, global.ncfg.cpusys_type,
+					global.ncfg.cpu_agg));
 			if (global.ncfg.nicstat_type != NICSTAT_NONE)
-				collect_nicstat(sb, compact, kc, now, global.ncfg.nicstat_type,
-					global.ncfg.nfc);
+				KS_SPAN(collect_nicstat(sb, compact, kc, now,
+					global.ncfg.nicstat_type, global.ncfg.nfc,
+					global.ncfg.nic_rollup));
+			if (global.ncfg.ringstat_mode != RINGSTAT_NONE)
+				KS_SPAN(collect_rings(sb, compact, kc, now,
+					global.ncfg.ringstat_mode, global.ncfg.nfc));
 			if (global.ncfg.mibstat_mode)
-				collect_mib(sb, compact, kc, now, global.ncfg.mibstat_mode);
+				KS_SPAN(collect_mib(sb, compact, kc, now,
+					global.ncfg.mibstat_mode, global.ncfg.mib_all_stacks));
 			if (global.ncfg.fscfg)
-				collect_fs(sb, compact, kc, now, global.ncfg.fscfg);
+				KS_SPAN(collect_fs(sb, compact, kc, now, global.ncfg.fscfg));
+			if (global.ncfg.kmem_topn)
+				KS_SPAN(collect_kmem(sb, compact, kc, now,
+					global.ncfg.kmem_topn, global.ncfg.kmem_interval));
+			if (global.ncfg.nfs_mode)
+				KS_SPAN(collect_nfs(sb, compact, kc, now, global.ncfg.nfs_mode));
 		} else {
 			kstat_err_count++;
 			if (kstat_err_count > 10) {
@@ -316,6 +438,27 @@ collect(prom_collector_t *self) {
 		if (!global.ncfg.no_swap)
 			collect_swap(sb, compact, NULL, now);
 	}
+	// statvfs() based, so no kstats needed
+	if (global.ncfg.fsucfg)
+		collect_fsusage(sb, compact, global.ncfg.fsucfg);
+	if (global.ncfg.procscfg)
+		collect_procs(sb, compact, now, global.ncfg.procscfg);
+	if (global.ncfg.tcpconncfg)
+		collect_tcpconn(sb, compact, now, global.ncfg.tcpconncfg);
+	// own kstat chain in a background thread
+	if (global.ncfg.hirescfg)
+		collect_hires(sb, compact, global.ncfg.hirescfg);
+	// site specific collectors sharing the updated kstat chain
+	if (global.plugincfg)
+		collect_plugins(sb, compact, kc_cur, now, global.plugincfg);
+	// metrics provided by other applications
+	if (global.tfincfg)
+		collect_textfiles(sb, compact, global.tfincfg);
+	if (global.execcfg)
+		collect_exec(sb, compact, global.execcfg);
+	// needs the output of all others, so must be the last one
+	if (global.ncfg.ratecfg)
+		derive_rates(sb, start, compact, now, global.ncfg.ratecfg);
 	if (sb != NULL && !compact)
 		psb_add_char(sb, '\n');
 	return NULL;
@@ -343,6 +486,137 @@ getShortOpts(const struct option *opts) {
 	return str;
 }
 
+// Set by SIGTERM and SIGINT to let the main thread shut down the exporter.
+static volatile sig_atomic_t stop_requested = 0;
+
+static void
+stopHandler(int sig) {
+	(void) sig;
+	stop_requested = 1;
+}
+
+// Block SIGTERM and SIGINT, so that all threads started later inherit the
+// mask and the main thread is the only one, which gets them (via
+// sigsuspend(2) in main()). oset gets the mask to wait with.
+static void
+blockStopSignals(sigset_t *oset) {
+	struct sigaction sa;
+	sigset_t sset;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stopHandler;
+	(void) sigemptyset(&sa.sa_mask);
+	(void) sigaction(SIGTERM, &sa, NULL);
+	(void) sigaction(SIGINT, &sa, NULL);
+	(void) sigemptyset(&sset);
+	(void) sigaddset(&sset, SIGTERM);
+	(void) sigaddset(&sset, SIGINT);
+	(void) pthread_sigmask(SIG_BLOCK, &sset, oset);
+	(void) sigdelset(oset, SIGTERM);
+	(void) sigdelset(oset, SIGINT);
+}
+
+// collect() is not thread-safe, but the HTTP server and the remote write
+// thread may scrape at the same time.
+static pthread_mutex_t scrape_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Lock must be held.
+static char *
+scrapeText(size_t *len) {
+	char *body, *s;
+
+	// trick 17: collect() adds stuff to sb directly, when it gets invoked
+	// indirectly by pcr_bridge(). Therefore: thread local
+	if (sb != NULL)
+		PROM_WARN("stringBuilder %p is already there =8-(", sb);
+	sb = psb_new();
+	s = pcr_bridge(PROM_COLLECTOR_REGISTRY);
+	expo_emit_text(sb, s);	// add libprom metrics
+	free(s);				// avoid mem leaks
+	body = psb_dump(sb);
+	*len = psb_len(sb);
+	psb_destroy(sb);		// avoid mem leaks on thread exit
+	sb = NULL;
+	return body;
+}
+
+// Lock must be held. All collectors add their values to the set directly via
+// the expo_emit_*() API, so the returned text contains no metrics.
+static char *
+scrapeValues(expo_set_t **set, size_t *len) {
+	char *body;
+
+	if ((*set = expo_new()) == NULL)
+		return scrapeText(len);
+	expo_target = *set;
+	body = scrapeText(len);
+	expo_target = NULL;
+	if (body == NULL) {
+		expo_free(*set);
+		*set = NULL;
+	}
+	return body;
+}
+
+// Lock must be held.
+static char *
+scrapeEncoded(expo_format_t fmt, size_t *len, const char **ctype) {
+	const expo_encoder_t *enc = expo_encoder(fmt);
+	expo_set_t *set = NULL;
+	char *body;
+
+	if (enc == NULL || enc->encode == NULL)
+		return scrapeText(len);
+	body = enc->values ? scrapeValues(&set, len) : scrapeText(len);
+	if (body != NULL)
+		(void) expo_convert(fmt, set, &body, len, ctype);
+	expo_free(set);
+	return body;
+}
+
+static char *
+scrapeSet(expo_set_t **set, size_t *len) {
+	char *body;
+
+	pthread_mutex_lock(&scrape_lock);
+	body = scrapeValues(set, len);
+	if (*set != NULL)
+		expo_apply_spans(*set, body, *len);
+	pthread_mutex_unlock(&scrape_lock);
+	return body;
+}
+
+static char *
+scrapeRender(expo_format_t fmt, size_t *len) {
+	const char *ctype;
+	char *body;
+
+	pthread_mutex_lock(&scrape_lock);
+	body = scrapeEncoded(fmt, len, &ctype);
+	pthread_mutex_unlock(&scrape_lock);
+	return body;
+}
+
+// Static responses shared by the TCP and the UDS daemon. Get initialized by
+// initResponses() before any of them starts.
+static char *RESP[] = { NULL, NULL, NULL };
+static int rlen[] = { 0, 0, 0 };
+
+static int
+initResponses(void) {
+	RESP[0] = strdup("Invalid HTTP Method\n");
+	RESP[1] = strdup("<html><body>See <a href='/metrics'>/metrics</a>.\r\n");
+	RESP[2] = strdup("Bad Request\n");
+	if (RESP[0] == NULL || RESP[1] == NULL || RESP[2] == NULL) {
+		PROM_FATAL("Unable to allocate HTTP responses.", "");
+		return 1;
+	}
+	rlen[0] = strlen(RESP[0]);
+	rlen[1] = strlen(RESP[1]);
+	rlen[2] = strlen(RESP[2]);
+	return 0;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 static int
@@ -351,26 +625,21 @@ http_handler(void *cls, struct MHD_Connection *connection, const char *url,
 	size_t *upload_data_size, void **con_cls)
 {
 #pragma GCC diagnostic pop
-	char *body, *s;
+	char *body;
+	const char *ctype = NULL, *fmtname;
+	char token[EXPO_DELTA_TOKEN_LEN] = "";
+	expo_format_t fmt;
+	bool full;
 	size_t len;
 	struct MHD_Response *response;
 	enum MHD_ResponseMemoryMode mode = MHD_RESPMEM_PERSISTENT;
 	unsigned int status = MHD_HTTP_BAD_REQUEST;
-	static const char *labels[] = { "" };
-	static char *RESP[] = { NULL, NULL, NULL };
-	static int rlen[] = { 0, 0, 0 };
+	const char *labels[] = { "" };
 
 	int ret;
 
-	if (RESP[0] == NULL) {
-		RESP[0]= strdup("Invalid HTTP Method\n");
-		rlen[0] = strlen(RESP[0]);
-		RESP[1]= strdup("<html><body>See <a href='/metrics'>/metrics</a>.\r\n");
-		rlen[1] = strlen(RESP[1]);
-		RESP[2]= strdup("Bad Request\n");
-		rlen[2] = strlen(RESP[2]);
-	}
-
+	fmtname = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND,
+		"format");
 	if (strcmp(method, "GET") != 0) {
 		body = RESP[0];
 		len = rlen[0];
@@ -380,22 +649,31 @@ http_handler(void *cls, struct MHD_Connection *connection, const char *url,
 		len = rlen[1];
 		status = MHD_HTTP_OK;
 		labels[0] = "/";
-	} else if (strcmp(url, "/metrics") == 0) {
-		// trick 17: collect() adds stuff to sb directly, when it gets invoked
-		// indirectly by pcr_bridge(). Therefore: thread local
-		if (sb != NULL)
-			PROM_WARN("stringBuilder %p is already there =8-(", sb);
-		sb = psb_new();
-		s = pcr_bridge(PROM_COLLECTOR_REGISTRY);
-		psb_add_str(sb, s);		// add libprom metrics
-		free(s);				// avoid mem leaks
-		body = psb_dump(sb);
-		len = psb_len(sb);
-		psb_destroy(sb);		// avoid mem leaks on thread exit
-		sb = NULL;
+	} else if (strcmp(url, "/metrics") == 0
+		&& (fmtname == NULL || expo_format_parse(fmtname, &fmt)))
+	{
+		// an explicit ?format=name wins over the Accept header
+		if (fmtname == NULL)
+			fmt = expo_negotiate(MHD_lookup_connection_value(connection,
+				MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT), global.openmetrics);
+		pthread_mutex_lock(&scrape_lock);
+		body = scrapeEncoded(fmt, &len, &ctype);
+		pthread_mutex_unlock(&scrape_lock);
 		labels[0] = "/metrics";
 		mode = MHD_RESPMEM_MUST_FREE;
 		status = MHD_HTTP_OK;
+	} else if (strcmp(url, "/metrics/delta") == 0) {
+		pthread_mutex_lock(&scrape_lock);
+		body = scrapeText(&len);
+		if (body != NULL && expo_delta(MHD_lookup_connection_value(connection,
+			MHD_GET_ARGUMENT_KIND, "since"), &body, &len, token, &full) != 0)
+		{
+			token[0] = '\0';
+		}
+		pthread_mutex_unlock(&scrape_lock);
+		labels[0] = "/metrics/delta";
+		mode = MHD_RESPMEM_MUST_FREE;
+		status = MHD_HTTP_OK;
 	} else {
 		body = RESP[2];
 		len = rlen[2];
@@ -409,6 +687,14 @@ http_handler(void *cls, struct MHD_Connection *connection, const char *url,
 			free(body);
 		ret = MHD_NO;
 	} else {
+		if (ctype != NULL)
+			MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE,
+				ctype);
+		if (token[0] != '\0') {
+			MHD_add_response_header(response, "X-Solmex-Delta-Token", token);
+			MHD_add_response_header(response, "X-Solmex-Delta",
+				full ? "full" : "delta");
+		}
 		labels[0] = "count";
 		prom_counter_inc(global.res_counter, labels);
 		labels[0] = "bytes";
@@ -494,10 +780,87 @@ cleanupProm(void) {
 	global.req_counter = global.res_counter = NULL;
 }
 
+// Parse the -N option value path[:mode].
+static int
+parseSocketOpts(const char *s) {
+	struct sockaddr_un sa;
+	char *p;
+	unsigned int mode;
+
+	free(global.sockpath);
+	if ((global.sockpath = strdup(s)) == NULL) {
+		perror("socket");
+		return 1;
+	}
+	if ((p = strrchr(global.sockpath, ':')) != NULL) {
+		*p++ = '\0';
+		if (sscanf(p, "%o", &mode) != 1 || mode > 0777) {
+			fprintf(stderr, "Invalid socket mode '%s'.\n", p);
+			return 1;
+		}
+		global.sockmode = mode;
+	}
+	if (global.sockpath[0] != '/'
+		|| strlen(global.sockpath) >= sizeof(sa.sun_path))
+	{
+		fprintf(stderr, "Socket path '%s' is not absolute or too long.\n",
+			global.sockpath);
+		return 1;
+	}
+	return 0;
+}
+
+// Bind a listening Unix domain socket to global.sockpath. A stale socket
+// gets replaced, any other file or a socket somebody listens on is left as is.
+static int
+udsListen(void) {
+	struct sockaddr_un sa;
+	struct stat st;
+	int fd;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, global.sockpath);
+	if (lstat(global.sockpath, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			PROM_FATAL("'%s' exists and is not a socket.", global.sockpath);
+			errno = EEXIST;
+			return -1;
+		}
+		// e.g. another solmex instance
+		if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) != -1
+			&& connect(fd, (struct sockaddr *) &sa, sizeof(sa)) == 0)
+		{
+			PROM_FATAL("'%s' is in use by another process.", global.sockpath);
+			(void) close(fd);
+			errno = EADDRINUSE;
+			return -1;
+		}
+		if (fd != -1)
+			(void) close(fd);
+		(void) unlink(global.sockpath);
+	}
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		PROM_FATAL("Unable to create socket: %s", strerror(errno));
+		return -1;
+	}
+	if (bind(fd, (struct sockaddr *) &sa, sizeof(sa)) == -1
+		|| chmod(global.sockpath, global.sockmode) == -1
+		|| listen(fd, SOMAXCONN) == -1)
+	{
+		PROM_FATAL("Unable to listen on '%s': %s", global.sockpath,
+			strerror(errno));
+		(void) close(fd);
+		return -1;
+	}
+	return fd;
+}
+
 static int
 startHttpServer(void) {
 	struct sockaddr *addr = NULL;
 	uint32_t flags = MHD_USE_DEBUG;	// same as MHD_USE_ERROR_LOG
+	int fd;
 	// since there is no way to use a blocking, i.e. one (this) thread only
 	// MHD_run(), or MHD_{e?poll|select}, or MHD_polling_thread.
 	// same as MHD_USE_INTERNAL_POLLING_THREAD but backward compatible
@@ -507,6 +870,27 @@ startHttpServer(void) {
 	else if (MHD_is_feature_supported(MHD_FEATURE_POLL) == MHD_YES)
 		flags |= MHD_USE_POLL;
 
+	if (global.sockpath != NULL) {
+		if ((fd = udsListen()) == -1)
+			return errno == EACCES ? SMF_EXIT_ERR_PERM : SMF_EXIT_ERR_OTHER;
+		// MHD takes over the socket, the port gets ignored
+		global.udsdaemon = MHD_start_daemon(flags, 0,
+			NULL, NULL, &http_handler, NULL,
+			MHD_OPTION_EXTERNAL_LOGGER, &MHD_logger, NULL,
+			MHD_OPTION_LISTEN_SOCKET, fd,
+			MHD_OPTION_END);
+		if (global.udsdaemon == NULL) {
+			PROM_FATAL("Unable to start http daemon on '%s'.",
+				global.sockpath);
+			(void) close(fd);
+			(void) unlink(global.sockpath);
+			return SMF_EXIT_ERR_OTHER;
+		}
+		PROM_INFO("Listening on %s (mode %03o)", global.sockpath,
+			(unsigned int) global.sockmode);
+	}
+	if (global.port == 0)
+		return SMF_EXIT_OK;
 	if (global.addr != NULL) {
 		struct sockaddr_in v4addr;
 		struct sockaddr_in6 v6addr;
@@ -553,6 +937,19 @@ startHttpServer(void) {
 	return SMF_EXIT_OK;
 }
 
+static void
+stopHttpServer(void) {
+	if (global.daemon != NULL) {
+		MHD_stop_daemon(global.daemon);
+		global.daemon = NULL;
+	}
+	if (global.udsdaemon != NULL) {
+		MHD_stop_daemon(global.udsdaemon);
+		global.udsdaemon = NULL;
+		(void) unlink(global.sockpath);
+	}
+}
+
 static int
 daemonize(void) {
 	int status;
@@ -657,6 +1054,7 @@ main(int argc, char **argv) {
 	struct in6_addr in6addr;
 	struct in6_addr *addr = malloc(sizeof(struct in6_addr));
 	psb_t *buf;
+	sigset_t waitset;
 	char *str = getShortOpts(options);
 
 	system_cpu_max = sysconf(_SC_CPUID_MAX);
@@ -681,12 +1079,29 @@ main(int argc, char **argv) {
 			case 'D':
 				global.ncfg.no_dmi = true;
 				break;
+			case 'E':
+				global.plugincfg = parse_plugin_opts(optarg, global.plugincfg,
+					&res);
+				if (res == 0)
+					err++;
+				break;
 			case 'F':
 				global.ncfg.no_cpu_speed = true;
 				break;
+			case 'G':
+				expo_om_timestamps = false;
+				break;
 			case 'I':
 				global.ncfg.no_cpusys_mp = false;
 				break;
+			case 'H':
+				global.ncfg.hirescfg = parse_hires_opts(optarg, &res);
+				if (res == 0)
+					err++;
+				break;
+			case 'J':
+				global.openmetrics = true;
+				break;
 			case 'K':
 				global.ncfg.no_kstats = true;
 				break;
@@ -696,6 +1111,10 @@ main(int argc, char **argv) {
 			case 'M':
 				global.ncfg.no_vmstat_mp = false;
 				break;
+			case 'N':
+				if (parseSocketOpts(optarg) != 0)
+					err++;
+				break;
 			case 'O':
 				global.ncfg.no_cpu_state = true;
 				break;
@@ -705,6 +1124,13 @@ main(int argc, char **argv) {
 			case 'Q':
 				global.ncfg.no_procq = true;
 				break;
+			case 'R':
+				global.ncfg.nic_rollup = parse_nic_rollup(optarg);
+				if (global.ncfg.nic_rollup == NICROLLUP_FAIL) {
+					global.ncfg.nic_rollup = NICROLLUP_NONE;
+					err++;
+				}
+				break;
 			case 'S':
 				global.promflags &= ~PROM_SCRAPETIME_ALL;
 				break;
@@ -721,9 +1147,27 @@ main(int argc, char **argv) {
 			case 'W':
 				global.ncfg.no_swap = true;
 				break;
+			case 'X':
+				global.execcfg = parse_exec_opts(optarg, global.execcfg, &res);
+				if (res == 0)
+					err++;
+				break;
 			case 'Y':
 				global.ncfg.no_sys_mem = true;
 				break;
+			case 'Z':
+				global.ncfg.mib_all_stacks = true;
+				break;
+			case 'a':
+				global.ncfg.cpu_agg = parse_cpu_agg(optarg);
+				if (global.ncfg.cpu_agg == CPUAGG_FAIL) {
+					global.ncfg.cpu_agg = CPUAGG_NONE;
+					err++;
+				} else if (global.ncfg.cpu_agg & CPUAGG_STRAND) {
+					global.ncfg.no_vmstat_mp = false;
+					global.ncfg.no_cpusys_mp = false;
+				}
+				break;
 			case 'b':
 				if ((global.ncfg.mibstat_mode = parse_mib_mode_list(optarg)) == MIB_MODE_FAIL) {
 					global.ncfg.mibstat_mode = 0;
@@ -736,9 +1180,21 @@ main(int argc, char **argv) {
 			case 'd':
 				mode = 2;
 				break;
+			case 'e':
+				global.ncfg.ratecfg = parse_rate_opts(optarg, &res);
+				if (res == 0)
+					err++;
+				break;
 			case 'f':
 				mode = 1;
 				break;
+			case 'g':
+				global.ncfg.ringstat_mode = parse_ring_mode(optarg);
+				if (global.ncfg.ringstat_mode == RINGSTAT_FAIL) {
+					fprintf(stderr, "Unsupported ring stat mode '%s'.\n", optarg);
+					err++;
+				}
+				break;
 			case 'h':
 				fprintf(stderr, "Usage: %s %s\n", argv[0], shortUsage);
 				return 0;
@@ -764,6 +1220,16 @@ main(int argc, char **argv) {
 					err++;
 				}
 				break;
+			case 'j':
+				global.tfincfg = parse_tf_in_opts(optarg, &res);
+				if (res == 0)
+					err++;
+				break;
+			case 'k':
+				if (parse_kmem_opts(optarg, &(global.ncfg.kmem_topn),
+					&(global.ncfg.kmem_interval)) != 0)
+					err++;
+				break;
 			case 'l':
 				if (global.logfile != NULL)
 					free(global.logfile);
@@ -799,14 +1265,31 @@ main(int argc, char **argv) {
 			case 'n':
 				err += disableMetrics(optarg);
 				break;
+			case 'o':
+				global.ncfg.procscfg = parse_procs_opts(optarg, &res);
+				if (res == 0)
+					err++;
+				break;
 			case 'p':
-				if ((sscanf(optarg, "%u", &n) != 1) || n == 0) {
+				// 0 .. UDS only
+				if ((sscanf(optarg, "%u", &n) != 1) || n > UINT16_MAX) {
 					fprintf(stderr, "Invalid port '%s'.\n", optarg);
 					err++;
 				} else {
 					global.port = n;
 				}
 				break;
+			case 'q':
+				global.ncfg.tcpconncfg = parse_tcpconn_opts(optarg, &res);
+				if (res == 0)
+					err++;
+				break;
+			case 'r':
+				if ((global.ncfg.nfs_mode = parse_nfs_mode_list(optarg)) == NFS_MODE_FAIL) {
+					global.ncfg.nfs_mode = NFS_MODE_NONE;
+					err++;
+				}
+				break;
 			case 's':
 				if (strstr(optarg, ":") == NULL) {
 					if ((res = inet_pton(AF_INET, optarg, &inaddr)) == 1)
@@ -855,6 +1338,11 @@ main(int argc, char **argv) {
 					err++;
 				}
 				break;
+			case 'u':
+				global.ncfg.fsucfg = parse_fsusage_list(optarg, &res);
+				if (res == 0)
+					err++;
+				break;
 			case 'v':
 				n = prom_log_level_parse(optarg);
 				if (n == 0) {
@@ -865,6 +1353,21 @@ main(int argc, char **argv) {
 					prom_log_level(n);
 				}
 				break;
+			case 'w':
+				global.statecfg = parse_state_opts(optarg, &res);
+				if (res == 0)
+					err++;
+				break;
+			case 'x':
+				global.rwcfg = parse_rw_opts(optarg, &res);
+				if (res == 0)
+					err++;
+				break;
+			case 'y':
+				global.tfoutcfg = parse_tf_out_opts(optarg, &res);
+				if (res == 0)
+					err++;
+				break;
 			case 'z':
 				global.ncfg.fscfg = parse_fs_mods_list(optarg, &fs_seen);
 				if (fs_seen == 0)
@@ -878,6 +1381,12 @@ main(int argc, char **argv) {
 	free(str);
 	free(addr);
 
+	if (global.port == 0 && global.sockpath == NULL
+		&& global.tfoutcfg == NULL)
+	{
+		fprintf(stderr, "Port 0 requires a socket (-N) or textfile (-y).\n");
+		err++;
+	}
 	if (err)
 		return SMF_EXIT_ERR_CONFIG;
 
@@ -911,8 +1420,12 @@ main(int argc, char **argv) {
 		page_shift--;
 	}
 
+	if (mode != 0)
+		blockStopSignals(&waitset);
 	if (mode == 2)
 		pfd = daemonize();
+	// plugins may start threads, which would not survive the fork
+	plugins_start(global.plugincfg);
 
 	err = start(!global.ncfg.no_dmi, !global.ncfg.no_kstats,
 		global.promflags & PROM_COMPACT, &n);
@@ -935,10 +1448,23 @@ main(int argc, char **argv) {
 		fprintf(stderr, "%s", str);
 	if (strlen(str)) {
 		if (mode == 0) {
+			// CLI: use the samples of the previous run if any to avoid
+			// waiting for the next kernel update
+			if (global.statecfg != NULL)
+				(void) load_state_restore(global.statecfg, gethrtime());
 			collect(NULL);
+			if (global.statecfg != NULL)
+				load_state_save(global.statecfg);
 			status = SMF_EXIT_OK;
-		} else if (setupProm() == 0) {
+		} else if (setupProm() == 0 && initResponses() == 0) {
 			fputs("\n", stderr);
+			if (global.rwcfg != NULL && rw_start(global.rwcfg, scrapeSet) != 0)
+				PROM_WARN("Remote write disabled.", "");
+			if (global.tfoutcfg != NULL
+				&& tf_out_start(global.tfoutcfg, scrapeRender) != 0)
+			{
+				PROM_WARN("Textfile output disabled.", "");
+			}
 			status = startHttpServer();
 			// let the parent exit
 			if (mode == 2) {
@@ -946,8 +1472,13 @@ main(int argc, char **argv) {
 				(void) close(pfd);
 			}
 			// because libmicrohttpd does not expose blocking calls =8-((((
-			if (status == SMF_EXIT_OK)
-				pause();
+			while (status == SMF_EXIT_OK && !stop_requested)
+				(void) sigsuspend(&waitset);
+			if (stop_requested)
+				PROM_INFO("Shutting down.", "");
+			stopHttpServer();
+			// other threads may still scrape: never let them start again
+			pthread_mutex_lock(&scrape_lock);
 		} else {
 			status = SMF_EXIT_ERR_OTHER;
 			if (mode == 2) {
@@ -967,6 +1498,8 @@ main(int argc, char **argv) {
 	psb_destroy(buf);
 	cleanupProm();
 	stop();
+	plugins_fini(global.plugincfg);
 	free(global.addr);
+	free(global.sockpath);
 	return status;
 }
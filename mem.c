@@ -15,6 +15,7 @@
 #include <libprom/prom.h>
 
 #include "ks_util.h"
+#include "expo.h"
 #include "mem.h"
 
 typedef enum ks_info_idx {
@@ -33,7 +34,6 @@ void
 collect_sys_mem(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now) {
 	kstat_t *ksp;
 	kstat_named_t *knp;
-	char buf[32];
 
 	bool free_sb = sb == NULL;
 	size_t physmem = 0, lockedmem = 0;
@@ -53,118 +53,80 @@ collect_sys_mem(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now) {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
 	if ((knp = kstat_data_lookup(ksp, "physmem")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_PHYSMEM);
-		psb_add_str(sb, SOLMEXM_PHYSMEM_N " ");		// same as pagestotal
+		addExpoInfo(SOLMEXM_PHYSMEM);		// same as pagestotal
 		physmem = knp->value.ui64 << page_shift;
-		sprintf(buf, "%ld\n", physmem);
-		psb_add_str(sb, buf);
+		expo_emit_uint(sb, SOLMEXM_PHYSMEM_N, NULL, physmem);
 	}
 	if ((knp = kstat_data_lookup(ksp, "availrmem")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_AVAILRMEM);
-		psb_add_str(sb, SOLMEXM_AVAILRMEM_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64 << page_shift);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_AVAILRMEM);
+		expo_emit_uint(sb, SOLMEXM_AVAILRMEM_N, NULL,
+			knp->value.ui64 << page_shift);
 	}
 	if ((knp = kstat_data_lookup(ksp, "pageslocked")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_LOCKEDMEM);
-		psb_add_str(sb, SOLMEXM_LOCKEDMEM_N " ");
+		addExpoInfo(SOLMEXM_LOCKEDMEM);
 		lockedmem = knp->value.ui64 << page_shift;
-		sprintf(buf, "%ld\n", lockedmem);
-		psb_add_str(sb, buf);
+		expo_emit_uint(sb, SOLMEXM_LOCKEDMEM_N, NULL, lockedmem);
 	}
 	if ((knp = kstat_data_lookup(ksp, "freemem")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_FREEMEM);
-		psb_add_str(sb, SOLMEXM_FREEMEM_N " ");		// same as pagesfree
-		sprintf(buf, "%ld\n", knp->value.ui64 << page_shift);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_FREEMEM);		// same as pagesfree
+		expo_emit_uint(sb, SOLMEXM_FREEMEM_N, NULL,
+			knp->value.ui64 << page_shift);
 	}
 	if ((knp = kstat_data_lookup(ksp, "lotsfree")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_LOTSFREE);
-		psb_add_str(sb, SOLMEXM_LOTSFREE_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64 << page_shift);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_LOTSFREE);
+		expo_emit_uint(sb, SOLMEXM_LOTSFREE_N, NULL,
+			knp->value.ui64 << page_shift);
 	}
 	if ((knp = kstat_data_lookup(ksp, "desfree")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_DESFREE);
-		psb_add_str(sb, SOLMEXM_DESFREE_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64 << page_shift);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_DESFREE);
+		expo_emit_uint(sb, SOLMEXM_DESFREE_N, NULL,
+			knp->value.ui64 << page_shift);
 	}
 	if ((knp = kstat_data_lookup(ksp, "minfree")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_MINFREE);
-		psb_add_str(sb, SOLMEXM_MINFREE_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64 << page_shift);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_MINFREE);
+		expo_emit_uint(sb, SOLMEXM_MINFREE_N, NULL,
+			knp->value.ui64 << page_shift);
 	}
 	if ((knp = kstat_data_lookup(ksp, "desscan")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_DESSCAN);
-		psb_add_str(sb, SOLMEXM_DESSCAN_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64 << page_shift);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_DESSCAN);
+		expo_emit_uint(sb, SOLMEXM_DESSCAN_N, NULL,
+			knp->value.ui64 << page_shift);
 	}
 	if ((knp = kstat_data_lookup(ksp, "slowscan")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_SLOWSCAN);
-		psb_add_str(sb, SOLMEXM_SLOWSCAN_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64 << page_shift);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_SLOWSCAN);
+		expo_emit_uint(sb, SOLMEXM_SLOWSCAN_N, NULL,
+			knp->value.ui64 << page_shift);
 	}
 	if ((knp = kstat_data_lookup(ksp, "fastscan")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_FASTSCAN);
-		psb_add_str(sb, SOLMEXM_FASTSCAN_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64 << page_shift);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_FASTSCAN);
+		expo_emit_uint(sb, SOLMEXM_FASTSCAN_N, NULL,
+			knp->value.ui64 << page_shift);
 	}
 	if ((knp = kstat_data_lookup(ksp, "nscan")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_NSCAN);
-		psb_add_str(sb, SOLMEXM_NSCAN_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64 << page_shift);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_NSCAN);
+		expo_emit_uint(sb, SOLMEXM_NSCAN_N, NULL,
+			knp->value.ui64 << page_shift);
 	}
 	if ((knp = kstat_data_lookup(ksp, "pp_kernel")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_PPKERNEL);
-		psb_add_str(sb, SOLMEXM_PPKERNEL_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64 << page_shift);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_PPKERNEL);
+		expo_emit_uint(sb, SOLMEXM_PPKERNEL_N, NULL,
+			knp->value.ui64 << page_shift);
 	}
 	if ((knp = kstat_data_lookup(ksp, "nalloc_calls")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_NALLOC);
-		psb_add_str(sb, SOLMEXM_NALLOC_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_NALLOC);
+		expo_emit_uint(sb, SOLMEXM_NALLOC_N, NULL, knp->value.ui64);
 	}
 	if ((knp = kstat_data_lookup(ksp, "nalloc")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_NALLOCSZ);
-		psb_add_str(sb, SOLMEXM_NALLOCSZ_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_NALLOCSZ);
+		expo_emit_uint(sb, SOLMEXM_NALLOCSZ_N, NULL, knp->value.ui64);
 	}
 	if ((knp = kstat_data_lookup(ksp, "nfree_calls")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_NFREE);
-		psb_add_str(sb, SOLMEXM_NFREE_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_NFREE);
+		expo_emit_uint(sb, SOLMEXM_NFREE_N, NULL, knp->value.ui64);
 	}
 	if ((knp = kstat_data_lookup(ksp, "nfree")) != NULL) {
-		if (!compact)
-			addPromInfo(SOLMEXM_NFREESZ);
-		psb_add_str(sb, SOLMEXM_NFREESZ_N " ");
-		sprintf(buf, "%ld\n", knp->value.ui64);
-		psb_add_str(sb, buf);
+		addExpoInfo(SOLMEXM_NFREESZ);
+		expo_emit_uint(sb, SOLMEXM_NFREESZ_N, NULL, knp->value.ui64);
 	}
 #pragma GCC diagnostic pop
 
@@ -9,15 +9,19 @@
  * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <limits.h>
+#include <zone.h>
 
 #include <libprom/prom.h>
 
 #include "mib.h"
 #include "mib_impl.h"
 #include "ks_util.h"
+#include "zones.h"
+#include "expo.h"
 
 typedef enum ks_info_idx {
 	KS_IDX_RAWIP,
@@ -77,6 +81,49 @@ static uint32_t astats_sz[] = {
 		ARRAY_SIZE(udpstats_a), ARRAY_SIZE(tcpstats_a), ARRAY_SIZE(sctpstats_a)
 };
 
+// The instance of the mib2 kstats is the netstack ID, which is equal to the ID
+// of the exclusive-IP zone owning the stack (0 for the global zone and all
+// shared-IP zones). In the global zone the kstats of all stacks are visible.
+typedef struct stack_labels {
+	kid_t kid;			/**< chain ID the labels belong to */
+	uint32_t entries;	/**< number of labels */
+	const char **label;	/**< interned {zone="name"} per kstat[idx].ksp[i] */
+} stack_labels_t;
+
+static stack_labels_t stack_labels[KS_IDX_MAX];
+
+static void
+update_stack_labels(ks_info_t *ks, stack_labels_t *sl, kid_t kid) {
+	char buf[ZONENAME_MAX + 16];
+	const char *zname;
+	uint32_t i;
+
+	if (sl->kid == kid && sl->entries == ks->entries)
+		return;
+	zones_update(kid);
+	sl->entries = 0;
+	if (ks->entries > 0) {
+		const char **l = realloc(sl->label, ks->entries * sizeof(char *));
+		if (l == NULL) {
+			PROM_WARN("Unable to allocate mib2 zone labels: %s", strerror(errno));
+			return;
+		}
+		sl->label = l;
+	}
+	for (i = 0; i < ks->entries; i++) {
+		int id = ks->ksp[i]->ks_instance;
+		if ((zname = zone_name(id)) != NULL)
+			snprintf(buf, sizeof(buf), "{zone=\"%s\"}", zname);
+		else
+			snprintf(buf, sizeof(buf), "{zone=\"stack%d\"}", id);
+		sl->label[i] = str_intern(buf);
+		if (sl->label[i] == NULL)
+			break;
+		sl->entries++;
+	}
+	sl->kid = kid;
+}
+
 #define SET_MIB_MODE(idx, val) \
 	mode &= ~(MIB_MODE_MASK << (MIB_MODE_SHIFT * (idx))); \
 	mode |= ((val) << (MIB_MODE_SHIFT * (idx)));
@@ -158,10 +205,12 @@ parse_mib_mode_list(const char *mode_str) {
 }
 
 void
-collect_mib(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, mib_mods_t mode) {
+collect_mib(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
+	mib_mods_t mode, bool all_stacks)
+{
 	kstat_t *ksp;
 	kstat_named_t *knp;
-	char buf[32];
+	const char *labels;
 	ks_info_idx_t kidx;
 
 	size_t psz = 0;
@@ -191,9 +240,20 @@ collect_mib(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, mib_mods_t m
 		if (type == MIB_NONE)
 			continue;
 
+		if (all_stacks && kstat[kidx].instance == 0) {
+			// switch to the wildcard lookup once
+			kstat[kidx].instance = -1;
+			kstat[kidx].last_kid = -1;
+		}
 		n = update_instance(kc, &kstat[kidx]);
 		if (n < 1)
 			continue;
+		if (all_stacks) {
+			update_stack_labels(&kstat[kidx], &stack_labels[kidx],
+				kc->kc_chain_id);
+			if ((uint32_t) n > stack_labels[kidx].entries)
+				n = stack_labels[kidx].entries;
+		}
 
 		type >>= 1;	// adjust for none
 		knames = aknames[kidx];
@@ -204,32 +264,30 @@ collect_mib(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, mib_mods_t m
 
 		for (m = 0; m < stats_sz; m++) {
 			uint32_t l = stats[m];
-			if (!compact)
-				addPromInfo4("", snames[l],
-					(kidx == KS_IDX_TCP && l == TCP_IDX_CURRESTAB) ||
-					(kidx == KS_IDX_SCTP && l == SCTP_IDX_SCTPCURRESTAB)
-						? "gauge" : "counter", sdescs[l]);
+			expo_emit_info(sb, compact, snames[l],
+				(kidx == KS_IDX_TCP && l == TCP_IDX_CURRESTAB) ||
+				(kidx == KS_IDX_SCTP && l == SCTP_IDX_SCTPCURRESTAB)
+					? "gauge" : "counter", sdescs[l]);
 			for (i = 0; i < n; i++) {
 				if ((ksp = ks_read(kc, kstat[kidx].ksp[i], now, NULL)) != NULL) {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
 				if ((knp = kstat_data_lookup(ksp, knames[l])) != NULL) {
+					labels = all_stacks ? stack_labels[kidx].label[i] : NULL;
+					ks_emit_times(ksp);
 					if (knp->data_type == KSTAT_DATA_UINT32) {
-						sprintf(buf, " %u\n", knp->value.ui32);
+						expo_emit_uint(sb, snames[l], labels, knp->value.ui32);
 					} else if (knp->data_type == KSTAT_DATA_UINT64) {
-						sprintf(buf, " %ld\n", knp->value.ui64);
+						expo_emit_uint(sb, snames[l], labels, knp->value.ui64);
 					} else if (knp->data_type == KSTAT_DATA_INT32) {
-						sprintf(buf, " %d\n", knp->value.i32);
+						expo_emit_int(sb, snames[l], labels, knp->value.i32);
 					} else if (knp->data_type == KSTAT_DATA_INT64) {
 						// only for sctp
-						sprintf(buf, " %ld\n", knp->value.i64);
+						expo_emit_int(sb, snames[l], labels, knp->value.i64);
 					} else {
 						PROM_WARN("Software bug: unsupported KSTAT type %d for %s",
 							knp->data_type, snames[l]);
-						continue;
 					}
-					psb_add_str(sb, snames[l]);
-					psb_add_str(sb, buf);
 				}
 #pragma GCC diagnostic pop
 				}
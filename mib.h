@@ -42,8 +42,12 @@ mib_mods_t parse_mib_mode_list(const char *s);
  * @param kc    The kstat chain to use.
  * @param now   The current time as delivered by gethrtime().
  * @param mode	A bit set of `mib_stat_mode_t` regarding the metrics to emit.
+ * @param all_stacks	If `true`, emit the metrics of all visible IP stacks
+ * 	(i.e. in the global zone those of all exclusive-IP zones, too) with a
+ * 	`zone` label. Zone names get resolved on kstat chain changes, only.
  */
-void collect_mib(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, mib_mods_t mode);
+void collect_mib(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
+	mib_mods_t mode, bool all_stacks);
 
 #ifdef __cplusplus
 }
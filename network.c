@@ -12,16 +12,21 @@
 #include <sys/loadavg.h>
 #include <rpcsvc/rstat.h>
 #include <libdllink.h>
+#include <libdlaggr.h>
+#include <ipmp_query.h>
 #include <zone.h>
 #include <sys/utsname.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
 
 #include <libprom/prom.h>
 
 #include "network.h"
 #include "network_impl.h"
 #include "ks_util.h"
+#include "zones.h"
+#include "expo.h"
 
 typedef enum ks_info_idx {
 	KS_IDX_NICMOD = 0,
@@ -42,114 +47,336 @@ static ks_info_t kstat[KS_IDX_MAX] = {
 #define VNIC "vnic"
 #define PHYS "phys"
 
+#define ATTR_NICNAME "nic"		// node-exporter uses: "device" instead
+#define ATTR_GZ "gz"
+#define ATTR_NGZ "ngz"
+#define ATTR_TYPE "type"
+
 typedef struct nic {
 	datalink_id_t lid;
 	char name[MAXLINKNAMELEN];
 	datalink_class_t class;
 	const char *tname;
 	zoneid_t zid;
+	uint32_t gen;		// walk generation when the link has been seen last
+	int8_t selected;	// cached filter decision, -1 .. not yet evaluated
+	int inst;			// kstat instance index, -1 .. none or filtered
+	char *attr;			// cached metric attributes "{...}"
+	int nnext;			// next entry in the name hash chain, -1 .. end
+	int lnext;			// next entry in the linkid hash chain, -1 .. end
 } nic_t;
 
+#define NIC_HASH_SZ 256		// must be a power of 2
+#define LID_HASH(lid)	((lid) & (NIC_HASH_SZ - 1))
+
+// Persistent NIC table. A walk over all datalinks is still needed to find out
+// which links appeared or vanished, however, the dladm info and derived
+// data get fetched for new links, only.
 typedef struct nic_bucket {
 	int len;
 	int sz;
 	nic_t *nic;
+	uint32_t gen;		// current walk generation
+	kid_t kid;			// kstat chain ID of the last walk
+	uint32_t zgen;		// zone registry generation of the last walk
+	bool refresh;		// re-fetch the info of all links on the next walk
+	bool changed;		// whether links appeared, vanished or got re-fetched
+	nic_filter_chain_t *nfc;	// the filter chain the cached decisions are for
+	int nhash[NIC_HASH_SZ];		// name -> index of the 1st nic
+	int lhash[NIC_HASH_SZ];		// linkid -> index of the 1st nic
 } nic_bucket_t;
 
+static nic_bucket_t bucket = { .kid = -1, .len = 0, .nic = NULL };
+
 #define EXTENT 8
-#define NEXT_NIC(bp)	((bp)->nic[(bp)->len])
 
-static int
-record_link(dladm_handle_t dh, datalink_id_t linkid, void *arg) {
-	nic_bucket_t *bucket = arg;
-	dladm_status_t status;
+static uint32_t
+nameHash(const char *s) {
+	uint32_t h = 2166136261U;	// FNV-1a
+
+	while (*s) {
+		h ^= (unsigned char) *s++;
+		h *= 16777619U;
+	}
+	return h & (NIC_HASH_SZ - 1);
+}
+
+static void
+rehash(nic_bucket_t *nb) {
+	uint32_t h;
+	int i;
+
+	memset(nb->nhash, 0xff, sizeof(nb->nhash));
+	memset(nb->lhash, 0xff, sizeof(nb->lhash));
+	for (i = 0; i < nb->len; i++) {
+		h = nameHash(nb->nic[i].name);
+		nb->nic[i].nnext = nb->nhash[h];
+		nb->nhash[h] = i;
+		h = LID_HASH(nb->nic[i].lid);
+		nb->nic[i].lnext = nb->lhash[h];
+		nb->lhash[h] = i;
+	}
+}
+
+static nic_t *
+nicByName(nic_bucket_t *nb, const char *name) {
+	int i;
+
+	for (i = nb->nhash[nameHash(name)]; i >= 0; i = nb->nic[i].nnext) {
+		if (strcmp(nb->nic[i].name, name) == 0)
+			return &(nb->nic[i]);
+	}
+	return NULL;
+}
+
+static nic_t *
+nicById(nic_bucket_t *nb, datalink_id_t lid) {
+	int i;
+
+	for (i = nb->lhash[LID_HASH(lid)]; i >= 0; i = nb->nic[i].lnext) {
+		if (nb->nic[i].lid == lid)
+			return &(nb->nic[i]);
+	}
+	return NULL;
+}
+
+static const char *
+gzName(void) {
+	static char *gz = NULL;
+
+	if (gz == NULL) {
+		struct utsname uts;
+		gz = (uname(&uts) != -1) ? strdup(uts.nodename) : strdup("");
+	}
+	return gz == NULL ? "" : gz;
+}
+
+static void
+updateNicAttr(nic_t *nic) {
+	char buf[32];
+	const char *zname;
+	psb_t *s = psb_new();
+
+	if (s == NULL)
+		return;
+	psb_add_str(s, "{" ATTR_NICNAME "=\"");
+	psb_add_str(s, nic->name);
+	psb_add_str(s, "\"," ATTR_TYPE "=\"");
+	psb_add_str(s, nic->tname);
+	psb_add_str(s, "\"," ATTR_GZ "=\"");
+	psb_add_str(s, gzName());
+	if (nic->zid != 0) {
+		if ((zname = zone_name(nic->zid)) == NULL) {
+			sprintf(buf, "link%u", nic->lid);
+			zname = buf;
+			PROM_WARN("Unable to get zonename for Id %d (using '%s' instead)",
+				nic->zid, zname);
+		}
+		psb_add_str(s, "\"," ATTR_NGZ "=\"");
+		psb_add_str(s, zname);
+	}
+	psb_add_str(s, "\"}");
+	free(nic->attr);
+	nic->attr = psb_dump(s);
+	psb_destroy(s);
+}
+
+static bool
+fetchLinkInfo(dladm_handle_t dh, datalink_id_t linkid, nic_t *nic) {
 	uint32_t flags;
 	uint32_t media;
 
-	if (bucket == NULL)
+	if (dladm_datalink_id2linkinfo(dh, linkid, &flags, &(nic->class), &media,
+		nic->name, MAXLINKNAMELEN, &(nic->zid)) != DLADM_STATUS_OK)
+	{
+		return false;
+	}
+	nic->lid = linkid;
+	if (nic->class == DATALINK_CLASS_PHYS) {
+		nic->tname = PHYS;
+	} else if (nic->class == DATALINK_CLASS_VNIC) {
+		nic->tname = VNIC;
+	} else {
+		// should not happen because we restrict the walker accordingly
+		char cbuf[DLADM_STRSIZE];
+		(void) dladm_class2str(nic->class, cbuf);
+		PROM_WARN("Interface type '%s' for '%s' is not supported - skipping.",
+			cbuf, nic->name);
+		return false;
+	}
+	nic->selected = -1;
+	updateNicAttr(nic);
+	return true;
+}
+
+static int
+record_link(dladm_handle_t dh, datalink_id_t linkid, void *arg) {
+	nic_bucket_t *nb = arg;
+	nic_t *nic;
+
+	if (nb == NULL)
 		return DLADM_STATUS_BADARG;
 
-	if (bucket->len == bucket->sz) {
-		nic_t *rnic = realloc(bucket->nic, (bucket->sz + EXTENT) * sizeof(nic_t));
+	if ((nic = nicById(nb, linkid)) != NULL) {
+		if (nb->refresh) {
+			if (!fetchLinkInfo(dh, linkid, nic))
+				return DLADM_WALK_CONTINUE;		// gets dropped
+			nb->changed = true;
+		}
+		nic->gen = nb->gen;
+		return DLADM_WALK_CONTINUE;
+	}
+
+	if (nb->len == nb->sz) {
+		nic_t *rnic = realloc(nb->nic, (nb->sz + EXTENT) * sizeof(nic_t));
 		if (rnic == NULL) {
 			PROM_WARN("Unable to allocate NIC buffer. Link %u ignored.", linkid);
 			return DLADM_STATUS_NOMEM;
 		}
-		bucket->nic = rnic;
-		bucket->sz += EXTENT;
+		nb->nic = rnic;
+		nb->sz += EXTENT;
 	}
 	// lets populate it here (instead of just recording the linkId) immediately
 	// so we do not clutter other places with dladm ...
-	status = dladm_datalink_id2linkinfo(dh, linkid, &flags,
-		&(NEXT_NIC(bucket).class),
-		&media, NEXT_NIC(bucket).name, MAXLINKNAMELEN, &(NEXT_NIC(bucket).zid));
-	if (status == DLADM_STATUS_OK) {
-		NEXT_NIC(bucket).lid = linkid;
-		if (NEXT_NIC(bucket).class == DATALINK_CLASS_PHYS) {
-			NEXT_NIC(bucket).tname = PHYS;
-			bucket->len++;
-		} else if (NEXT_NIC(bucket).class == DATALINK_CLASS_VNIC) {
-			NEXT_NIC(bucket).tname = VNIC;
-			bucket->len++;
-		} else {
-			// should not happen because we restrict the walker accordingly
-			char cbuf[DLADM_STRSIZE];
-			(void) dladm_class2str(NEXT_NIC(bucket).class, cbuf);
-			PROM_WARN("Interface type '%s' for '%s' is not supported - skipping.",
-				cbuf, NEXT_NIC(bucket).name);
-		}
+	nic = &(nb->nic[nb->len]);
+	memset(nic, 0, sizeof(nic_t));
+	if (fetchLinkInfo(dh, linkid, nic)) {
+		nic->gen = nb->gen;
+		nb->len++;
+		nb->changed = true;
+	} else {
+		free(nic->attr);
 	}
 	return DLADM_WALK_CONTINUE;
 }
 
-#define NIC_BUCKET_INIT_SZ 8
 #define LOOKUP_CLASS_TYPES	DATALINK_CLASS_PHYS | DATALINK_CLASS_VNIC	// DATALINK_CLASS_ALL
 #define LOOKUP_MEDIA_TYPES	DL_ETHER									// DATALINK_ANY_MEDIATYPE
 #define LOOKUP_FLAGS		DLADM_OPT_ACTIVE	// if not active, ignore it
 
+static dladm_handle_t dladm = NULL;
+
+// Update the NIC table if the given kstat chain ID differs from the one of the
+// last update.
 static nic_bucket_t *
-collectNicInfo(void) {
-	static dladm_handle_t dladm = NULL;
+collectNicInfo(kid_t kid) {
+	nic_bucket_t *nb = &bucket;
 	dladm_status_t status;
-	static nic_bucket_t *bucket = NULL;
+	uint32_t zgen;
+	int i, k;
 
 	if (dladm == NULL) {
 		if ((status = dladm_open(&dladm, NULL)) != DLADM_STATUS_OK) {
 			PROM_WARN("Could not open /dev/dld", "");
-			return bucket;
-		}
-	}
-	if (bucket == NULL) {
-		bucket = calloc(1, sizeof(nic_bucket_t));
-		if (bucket == NULL) {
-			PROM_WARN("Unable to allocate nic bucket: ", strerror(errno));
 			return NULL;
 		}
 	}
-	bucket->len = 0;
-	dladm_walk_datalink_id(record_link, dladm, bucket,
+	if (nb->nic == NULL) {
+		memset(nb->nhash, 0xff, sizeof(nb->nhash));
+		memset(nb->lhash, 0xff, sizeof(nb->lhash));
+	} else if (kid == nb->kid) {
+		return nb;
+	}
+	nb->gen++;
+	nb->changed = false;
+	// Zones booting or halting change the zone of their VNICs but not the
+	// linkid.
+	zgen = zones_update(kid);
+	if (zgen != nb->zgen) {
+		nb->refresh = true;
+		nb->zgen = zgen;
+	}
+	dladm_walk_datalink_id(record_link, dladm, nb,
 		LOOKUP_CLASS_TYPES, LOOKUP_MEDIA_TYPES, LOOKUP_FLAGS);
+	nb->refresh = false;
+
+	// drop vanished links
+	for (i = 0, k = 0; i < nb->len; i++) {
+		if (nb->nic[i].gen != nb->gen) {
+			free(nb->nic[i].attr);
+			nb->changed = true;
+			continue;
+		}
+		if (k != i)
+			nb->nic[k] = nb->nic[i];
+		k++;
+	}
+	nb->len = k;
+	if (nb->changed)
+		rehash(nb);
+	nb->kid = kid;
+	return nb;
+}
 
-	return bucket;
+// Apply the given filter chain to the given NIC. If the first filter is an
+// exclude filter, all NICs are included by default, excluded otherwise.
+static bool
+nicSelected(nic_filter_chain_t *nfc, nic_t *nic) {
+	uint32_t f;
+	bool selected;
+
+	if (nfc == NULL || nfc->pos == 0)
+		return true;
+
+	selected = (nfc->filter[0].flags & NICFILTER_EXCL) != 0;
+	for (f = 0; f < nfc->pos; f++) {
+		if ((nic->class & nfc->filter[f].flags) == 0)
+			continue;
+		if (regexec(nfc->filter[f].regex, nic->name, 0, NULL, 0))
+			continue;
+		selected = (nfc->filter[f].flags & NICFILTER_INCL) != 0;
+	}
+	return selected;
 }
 
-#define ATTR_NICNAME "nic"		// node-exporter uses: "device" instead
-#define ATTR_GZ "gz"
-#define ATTR_NGZ "ngz"
-#define ATTR_TYPE "type"
+// Same as nicSelected(), but the decision gets cached in the NIC table.
+static bool
+nicIsSelected(nic_bucket_t *nb, nic_filter_chain_t *nfc, nic_t *nic) {
+	int i;
+
+	if (nb->nfc != nfc) {
+		for (i = 0; i < nb->len; i++)
+			nb->nic[i].selected = -1;
+		nb->nfc = nfc;
+	}
+	if (nic->selected < 0)
+		nic->selected = nicSelected(nfc, nic) ? 1 : 0;
+	return nic->selected == 1;
+}
+
+void
+nic_filter_select(kid_t kid, nic_filter_chain_t *nfc, const char **names,
+	bool *selected, int n)
+{
+	nic_bucket_t *nb;
+	nic_t *nic, other;
+	int i;
+
+	if (nfc == NULL || nfc->pos == 0) {
+		for (i = 0; i < n; i++)
+			selected[i] = true;
+		return;
+	}
+	nb = collectNicInfo(kid);
+	memset(&other, 0, sizeof(other));
+	for (i = 0; i < n; i++) {
+		if (nb != NULL && (nic = nicByName(nb, names[i])) != NULL) {
+			selected[i] = nicIsSelected(nb, nfc, nic);
+		} else {
+			// neither phys nor vnic (e.g. aggr): no filter can match its class
+			strncpy(other.name, names[i], MAXLINKNAMELEN - 1);
+			selected[i] = nicSelected(nfc, &other);
+		}
+	}
+}
 
 static char **
 updateMetricAttrs(char **metric_attr, int *metric_attr_sz, int n,
-	ks_info_idx_t idx, nic_filter_chain_t *nfc)
+	ks_info_idx_t idx, nic_filter_chain_t *nfc, kid_t kid)
 {
-	int i, k, r;
-	char *gz = NULL;
-	char zname[ZONENAME_MAX];
-	psb_t *s = psb_new();
-	uint64_t *nicset = NULL, nicset_sz = 0, f;
-	char **nics = NULL;
-
-	nic_bucket_t *nb = collectNicInfo();
+	int i;
+	nic_t *nic;
+	nic_bucket_t *nb = collectNicInfo(kid);
 
 	if (nb == NULL)
 		return metric_attr;
@@ -171,111 +398,37 @@ updateMetricAttrs(char **metric_attr, int *metric_attr_sz, int n,
 		*metric_attr_sz = n;
 	}
 	memset(metric_attr, 0, n * sizeof(char *));	// cheap, so lets reset for now
-	nics = calloc(n, sizeof (char *));
-	if (nics == NULL) {
-		PROM_WARN("Unable to allocate nicstat metrics - skipping.", "");
-		goto end;
-	}
-	for (i = 0; i < n; i++) {
-		nics[i] = idx == KS_IDX_NICMOD
-			? kstat[idx].ksp[i]->ks_module
-			: kstat[idx].ksp[i]->ks_name;
-	}
 
-	if (nfc != NULL && nfc->pos > 0) {
-		uint64_t offset;
-		nicset_sz = (n >> 6) + 1;
-		nicset = calloc(nicset_sz, sizeof(uint64_t));
-		if (nicset == NULL) {
-			PROM_WARN("Unable to allocate nicstat metrics - skipping.", "");
-			goto end;
-		}
-		if (nfc->filter[0].flags & NICFILTER_EXCL) {
-			for (offset = 0; offset < nicset_sz; offset++)
-				nicset[offset] = 0xFFFFFFFFFFFFFFFF;
-		}
-		for (f = 0; f < nfc->pos; f++) {
-			for (i = 0, r = 0, offset = 0; i < nb->len; i++, r++) {
-				if (r == 64) {
-					offset++;
-					r = 0;
-				}
-				if ((nb->nic[i].class & nfc->filter[f].flags) == 0)
-					continue;
-				if (regexec(nfc->filter[f].regex, nb->nic[i].name, 0, NULL, 0))
-					continue;
-				if (nfc->filter[f].flags & NICFILTER_INCL) {
-					nicset[offset] |= (1UL << r);
-				} else {
-					nicset[offset] &= ~(1UL << r);
-				}
-			}
-		}
-		for (i = 0, r = 0, offset = 0; i < nb->len; i++, r++) {
-			if (r == 64) {
-				offset++;
-				r = 0;
-			}
-			if ((nicset[offset] & (1UL << r)) == 0) {
+	if (nfc != NULL && nfc->pos > 0 && (nb->changed || nb->nfc != nfc)) {
+		psb_t *s = psb_new();
+		size_t l;
+		for (i = 0; i < nb->len; i++) {
+			if (!nicIsSelected(nb, nfc, &(nb->nic[i]))) {
 				psb_add_str(s, nb->nic[i].name);
 				psb_add_str(s, ", ");
-				nb->nic[i].name[0] = '\0'; // so no match occurs below
 			}
 		}
-		f = psb_len(s);
-		if (f > 0) {
-			psb_truncate(s, f - 2);
+		l = psb_len(s);
+		if (l > 0) {
+			psb_truncate(s, l - 2);
 			psb_add_char(s, '.');
 			PROM_INFO("Excluding NIC metrics for: %s", psb_str(s));
 		}
+		psb_destroy(s);
 	}
 
+	for (i = 0; i < nb->len; i++)
+		nb->nic[i].inst = -1;
 	for (i = 0; i < n; i++) {
-		size_t l;
-
-		psb_truncate(s, 0);
-		for (k = 0; k < nb->len; k++) {
-			if (strcmp(nb->nic[k].name, nics[i]) != 0)
-				continue;
-			psb_add_str(s, "{" ATTR_NICNAME "=\"");
-			psb_add_str(s, nics[i]);
-			psb_add_str(s, "\"," ATTR_TYPE "=\"");
-			psb_add_str(s, nb->nic[k].tname);
-			psb_add_str(s, "\",");
-			if (gz == NULL) {
-				struct utsname uts;
-				gz = (uname(&uts) != -1) ? strdup(uts.nodename) : strdup("");
-			}
-			psb_add_str(s, ATTR_GZ "=\"");
-			psb_add_str(s, gz);
-			psb_add_str(s, "\",");
-			if (nb->nic[k].zid != 0) {
-				if (getzonenamebyid(nb->nic[k].zid, zname, ZONENAME_MAX) == -1) {
-					char *err = strerror(errno);
-					sprintf(zname, "link%u", nb->nic[k].lid);
-					PROM_WARN("Unbale to get zonename for Id %d: %s "
-						"(using '%s' instead)", nb->nic[k].zid, err, zname);
-				}
-				psb_add_str(s, ATTR_NGZ "=\"");
-				psb_add_str(s, zname);
-				psb_add_str(s, "\",");
-			}
-			break;
-		}
-		if ((l = psb_len(s)) != 0) {
-			psb_truncate(s, l - 1);
-			psb_add_str(s, "} ");
-			metric_attr[i] = psb_dump(s);
-		} else {
-			metric_attr[i] = NULL;
-		}
+		nic = nicByName(nb, idx == KS_IDX_NICMOD
+			? kstat[idx].ksp[i]->ks_module
+			: kstat[idx].ksp[i]->ks_name);
+		if (nic == NULL || nic->attr == NULL || !nicIsSelected(nb, nfc, nic))
+			continue;
+		metric_attr[i] = strdup(nic->attr);
+		if (metric_attr[i] != NULL)
+			nic->inst = i;
 	}
-
-end:
-	free(gz);
-	free(nicset);
-	free(nics);
-	psb_destroy(s);
 	return metric_attr;
 }
 
@@ -412,27 +565,236 @@ parse_nic_filter(char *s, nic_filter_chain_t **list) {
 	return 0;
 }
 
-static char *
+uint32_t
+parse_nic_rollup(const char *s) {
+	char buf[_POSIX_ARG_MAX], *t, *e;
+	uint32_t mode = NICROLLUP_NONE;
+
+	if (s == NULL)
+		return mode;
+	if (strlen(s) >= sizeof(buf)) {
+		fprintf(stderr, "nic rollup string to parse is too long.\n");
+		return NICROLLUP_FAIL;
+	}
+	strcpy(buf, s);
+	for (t = buf; *t != '\0'; t = e) {
+		if ((e = strchr(t, ',')) != NULL)
+			*e++ = '\0';
+		else
+			e = t + strlen(t);
+		if (strcmp(t, "none") == 0) {
+			mode = NICROLLUP_NONE;
+		} else if (strcmp(t, "zone") == 0) {
+			mode |= NICROLLUP_ZONE;
+		} else if (strcmp(t, "aggr") == 0) {
+			mode |= NICROLLUP_AGGR;
+		} else if (strcmp(t, "ipmp") == 0) {
+			mode |= NICROLLUP_IPMP;
+		} else if (strcmp(t, "only") == 0) {
+			mode |= NICROLLUP_ONLY;
+		} else if (*t != '\0') {
+			fprintf(stderr, "Unknown nic rollup mode '%s'.\n", t);
+			return NICROLLUP_FAIL;
+		}
+	}
+	return mode;
+}
+
+typedef struct nic_rollup_grp {
+	char *attr;			// metric attributes incl. the braces
+	int n;				// number of members
+	int sz;
+	int *member;		// kstat instance indexes of the members
+} nic_rollup_grp_t;
+
+static nic_rollup_grp_t *rgrp = NULL;
+static int rgrp_n = 0;
+static int rgrp_sz = 0;
+static bool *rmember = NULL;	// per kstat instance: member of any rollup
+
+static void
+resetRollups(void) {
+	int i;
+
+	for (i = 0; i < rgrp_n; i++) {
+		free(rgrp[i].attr);
+		free(rgrp[i].member);
+	}
+	rgrp_n = 0;
+	free(rmember);
+	rmember = NULL;
+}
+
+static void
+addRollupMember(const char *type, const char *nic, const char *gz,
+	const char *ngz, int idx)
+{
+	nic_rollup_grp_t *g = NULL;
+	char attr[256];
+	int i;
+
+	if (nic != NULL)
+		snprintf(attr, sizeof(attr), "{" ATTR_NICNAME "=\"%s\"," ATTR_TYPE
+			"=\"%s\"," ATTR_GZ "=\"%s\"}", nic, type, gz);
+	else
+		snprintf(attr, sizeof(attr), "{" ATTR_TYPE "=\"%s\"," ATTR_GZ "=\"%s\","
+			ATTR_NGZ "=\"%s\"}", type, gz, ngz);
+	for (i = 0; i < rgrp_n; i++) {
+		if (strcmp(rgrp[i].attr, attr) == 0) {
+			g = &rgrp[i];
+			break;
+		}
+	}
+	if (g == NULL) {
+		if (rgrp_n == rgrp_sz) {
+			nic_rollup_grp_t *t =
+				realloc(rgrp, (rgrp_sz + EXTENT) * sizeof(nic_rollup_grp_t));
+			if (t == NULL)
+				goto nomem;
+			rgrp = t;
+			rgrp_sz += EXTENT;
+		}
+		g = &rgrp[rgrp_n];
+		memset(g, 0, sizeof(nic_rollup_grp_t));
+		if ((g->attr = strdup(attr)) == NULL)
+			goto nomem;
+		rgrp_n++;
+	}
+	if (g->n == g->sz) {
+		int *m = realloc(g->member, (g->sz + EXTENT) * sizeof(int));
+		if (m == NULL)
+			goto nomem;
+		g->member = m;
+		g->sz += EXTENT;
+	}
+	g->member[g->n++] = idx;
+	rmember[idx] = true;
+	return;
+
+nomem:
+	PROM_WARN("Unable to allocate nic rollup group - member %s ignored.",
+		nic == NULL ? ngz : nic);
+}
+
+// Get the kstat instance index of the given link, -1 if not found/filtered.
+static int
+getInstance(nic_t *nic) {
+	return nic == NULL ? -1 : nic->inst;
+}
+
+static int
+record_aggr(dladm_handle_t dh, datalink_id_t linkid, void *arg) {
+	nic_bucket_t *nb = arg;
+	dladm_aggr_grp_attr_t ginfo;
+	char aname[MAXLINKNAMELEN];
+	uint32_t p;
+	int i;
+
+	if (dladm_datalink_id2info(dh, linkid, NULL, NULL, NULL, aname,
+		sizeof(aname)) != DLADM_STATUS_OK)
+	{
+		return DLADM_WALK_CONTINUE;
+	}
+	if (dladm_aggr_info(dh, linkid, &ginfo, DLADM_OPT_ACTIVE) != DLADM_STATUS_OK)
+		return DLADM_WALK_CONTINUE;
+	for (p = 0; p < ginfo.lg_nports; p++) {
+		i = getInstance(nicById(nb, ginfo.lg_ports[p].lp_linkid));
+		if (i >= 0)
+			addRollupMember("aggr", aname, gzName(), NULL, i);
+	}
+	free(ginfo.lg_ports);
+	return DLADM_WALK_CONTINUE;
+}
+
+// Must be called after updateMetricAttrs(), which sets the instance indexes.
+static void
+updateRollups(uint32_t rollup, int n, kid_t kid) {
+	char buf[32];
+	const char *zname;
+	const char *gz = gzName();
+	nic_bucket_t *nb;
+	int i, k;
+
+	resetRollups();
+	if ((rollup & (NICROLLUP_ZONE | NICROLLUP_AGGR | NICROLLUP_IPMP)) == 0)
+		return;
+	if ((nb = collectNicInfo(kid)) == NULL)
+		return;
+	if ((rmember = calloc(n, sizeof(bool))) == NULL) {
+		PROM_WARN("Unable to allocate nic rollups - skipping.", "");
+		return;
+	}
+
+	if (rollup & NICROLLUP_ZONE) {
+		for (k = 0; k < nb->len; k++) {
+			if (nb->nic[k].class != DATALINK_CLASS_VNIC)
+				continue;
+			if ((i = getInstance(&(nb->nic[k]))) < 0)
+				continue;
+			if (nb->nic[k].zid == 0) {
+				zname = "global";
+			} else if ((zname = zone_name(nb->nic[k].zid)) == NULL) {
+				sprintf(buf, "zone%d", nb->nic[k].zid);
+				zname = buf;
+			}
+			addRollupMember("vnic", NULL, gz, zname, i);
+		}
+	}
+	if ((rollup & NICROLLUP_AGGR) && dladm != NULL) {
+		dladm_walk_datalink_id(record_aggr, dladm, nb,
+			DATALINK_CLASS_AGGR, DATALINK_ANY_MEDIATYPE, LOOKUP_FLAGS);
+	}
+	if (rollup & NICROLLUP_IPMP) {
+		ipmp_handle_t ih;
+		ipmp_grouplist_t *gl;
+		ipmp_groupinfo_t *gi;
+		uint32_t g, f;
+
+		if (ipmp_open(&ih) != IPMP_SUCCESS) {
+			PROM_WARN("Unable to open IPMP handle - no IPMP rollups.", "");
+		} else {
+			if (ipmp_getgrouplist(ih, &gl) == IPMP_SUCCESS) {
+				for (g = 0; g < gl->gl_ngroup; g++) {
+					if (ipmp_getgroupinfo(ih, gl->gl_groups[g], &gi) != IPMP_SUCCESS)
+						continue;
+					// IP interface names are the names of the underlying links
+					for (f = 0; f < gi->gr_iflistp->il_nif; f++) {
+						i = getInstance(nicByName(nb, gi->gr_iflistp->il_ifs[f]));
+						if (i >= 0)
+							addRollupMember("ipmp", gi->gr_name, gz, NULL, i);
+					}
+					ipmp_freegroupinfo(gi);
+				}
+				ipmp_freegrouplist(gl);
+			}
+			ipmp_close(ih);
+		}
+	}
+	PROM_INFO("%d nic rollup groups found.", rgrp_n);
+}
+
+// Get the speed of each selected link, -1 if n/a.
+static int64_t *
 updateSpeed(kstat_ctl_t *kc, ks_info_idx_t ks_idx, int n, char **metric_attr,
-	bool compact, hrtime_t now)
+	bool *skip, hrtime_t now)
 {
 	kstat_t *ksp;
 	kstat_named_t *knp;
-	psb_t *sb = psb_new();
-	char *res = NULL;
-	char buf[32];
+	int64_t *res;
 
 	PROM_INFO("Checking speed for %d links.", n);
-	if (!compact)
-		addPromInfo4("", snames[NET_IDX_IFSPEED_BPS],
-			"gauge", sdesc[NET_IDX_IFSPEED_BPS]);
+	if (n < 1)
+		return NULL;
+	if ((res = malloc(n * sizeof(int64_t))) == NULL) {
+		PROM_WARN("Unable to allocate link speeds - skipping.", "");
+		return NULL;
+	}
+	for (int i = 0; i < n; i++)
+		res[i] = -1;
 
 	if (ks_idx == KS_IDX_LNKMOD) {
-		if (n < 1)
-			goto noSpeed;
-
 		for (int i = 0; i < n; i++) {
-			if (metric_attr[i] == NULL)
+			if (metric_attr[i] == NULL || (skip != NULL && skip[i]))
 				continue;
 
 			if ((ksp = ks_read(kc, kstat[KS_IDX_LNKMOD].ksp[i], now, NULL)) != NULL) {
@@ -441,68 +803,57 @@ updateSpeed(kstat_ctl_t *kc, ks_info_idx_t ks_idx, int n, char **metric_attr,
 				knp = kstat_data_lookup(kstat[KS_IDX_LNKMOD].ksp[i],
 					knames[NET_IDX_IFSPEED_BPS]);
 #pragma GCC diagnostic pop
-				if (knp != NULL) {
-					psb_add_str(sb, snames[NET_IDX_IFSPEED_BPS]);
-					psb_add_str(sb, metric_attr[i]);
-					sprintf(buf, " %ld\n", knp->value.ui64);
-					psb_add_str(sb, buf);
-				}
+				if (knp != NULL)
+					res[i] = knp->value.ui64;
 			}
 		}
 	} else {
 		// need to lookup ::${nicname}:ifspeed - unfortunately we cant rely on
-		// the order wrt. nicname
-		kstat[KS_IDX_LNKMOD].last_kid = 0;	// force an update
+		// the order wrt. nicname. update_instance() is a no-op if the chain
+		// did not change since its last call.
 		int n2 = update_instance(kc, &kstat[KS_IDX_LNKMOD]);
-		if (n2 < 1)
-			goto noSpeed;
+		if (n2 < 1) {
+			free(res);
+			return NULL;
+		}
 
-		for (int i = 0; i < n; i++) {
-			if (metric_attr[i] == NULL)
+		for (int k = 0; k < n2; k++) {
+			nic_t *nic = nicByName(&bucket, kstat[KS_IDX_LNKMOD].ksp[k]->ks_name);
+			int i = nic == NULL ? -1 : nic->inst;
+			if (i < 0 || i >= n || metric_attr[i] == NULL
+				|| (skip != NULL && skip[i]))
+			{
 				continue;
-
-			for (int k = 0; k < n2; k++) {
-				if (strcmp(kstat[KS_IDX_NICMOD].ksp[i]->ks_module,
-					kstat[KS_IDX_LNKMOD].ksp[k]->ks_name) != 0)
-					continue;
-
-				if ((ksp = ks_read(kc, kstat[KS_IDX_LNKMOD].ksp[k], now, NULL)) != NULL) {
+			}
+			if ((ksp = ks_read(kc, kstat[KS_IDX_LNKMOD].ksp[k], now, NULL)) != NULL) {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
-					knp = kstat_data_lookup(kstat[KS_IDX_LNKMOD].ksp[k],
-						knames[NET_IDX_IFSPEED_BPS]);
+				knp = kstat_data_lookup(kstat[KS_IDX_LNKMOD].ksp[k],
+					knames[NET_IDX_IFSPEED_BPS]);
 #pragma GCC diagnostic pop
-					if (knp != NULL) {
-						psb_add_str(sb, snames[NET_IDX_IFSPEED_BPS]);
-						psb_add_str(sb, metric_attr[i]);
-						sprintf(buf, " %ld\n", knp->value.ui64);
-						psb_add_str(sb, buf);
-						break;
-					}
-				}
+				if (knp != NULL)
+					res[i] = knp->value.ui64;
 			}
 		}
 	}
-	res = psb_dump(sb);
-noSpeed:
-	psb_destroy(sb);
 	return res;
 }
 
 void
 collect_nicstat(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
-	nic_stat_quantity_t ntype, nic_filter_chain_t *nfc)
+	nic_stat_quantity_t ntype, nic_filter_chain_t *nfc, uint32_t rollup)
 {
 	kstat_t *ksp;
 	kstat_named_t *knp;
-	char buf[32];
+	bool *skip;
 
 	static int metric_attr_sz = 0;
 	static char **metric_attr = NULL;
 	static ks_info_idx_t ks_idx = KS_IDX_NICMOD;
-	int i, n, m, stats_sz;
+	int i, k, g, n, m, stats_sz;
 	net_idx_t *stats;
-	static char *speed = NULL;
+	static int64_t *speed = NULL;
+	static int speed_n = 0;
 
 	bool nicmode;
 
@@ -527,20 +878,37 @@ collect_nicstat(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
 
 	if (check || n > metric_attr_sz) {
 		metric_attr =
-			updateMetricAttrs(metric_attr, &metric_attr_sz, n, ks_idx, nfc);
+			updateMetricAttrs(metric_attr, &metric_attr_sz, n, ks_idx, nfc,
+				kc->kc_chain_id);
 		if (n > metric_attr_sz) {
 			PROM_WARN("Skipping nicstat metrics", "");
 			return;
 		}
+		updateRollups(rollup, n, kc->kc_chain_id);
 		free(speed);
-		speed = updateSpeed(kc, ks_idx, n, metric_attr, compact, now);
+		speed = updateSpeed(kc, ks_idx, n, metric_attr,
+			(rollup & NICROLLUP_ONLY) ? rmember : NULL, now);
+		speed_n = speed == NULL ? 0 : n;
 	}
+	skip = (rollup & NICROLLUP_ONLY) ? rmember : NULL;
 
 	bool free_sb = sb == NULL;
 	if (free_sb)
 		sb = psb_new();
 
-	psb_add_str(sb, speed);
+	if (speed != NULL) {
+		expo_emit_info(sb, compact, snames[NET_IDX_IFSPEED_BPS], "gauge",
+			sdesc[NET_IDX_IFSPEED_BPS]);
+		for (i = 0; i < speed_n && i < n; i++) {
+			if (speed[i] < 0 || metric_attr[i] == NULL
+				|| (skip != NULL && skip[i]))
+			{
+				continue;
+			}
+			expo_emit_uint(sb, snames[NET_IDX_IFSPEED_BPS], metric_attr[i],
+				speed[i]);
+		}
+	}
 
 	nicmode = ks_idx == KS_IDX_NICMOD;
 	if (nicmode) {
@@ -569,27 +937,46 @@ collect_nicstat(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
 
 	for (m = 0; m < stats_sz; m++) {
 		net_idx_t l = stats[m];
-		if (!compact) {
-			addPromInfo4("", snames[l],
-				(l == NET_IDX_LINK_STATE || l == NET_IDX_PHYS_STATE)
-					? "gauge"
-					: "counter",
-				sdesc[l]);
-		}
+		expo_emit_info(sb, compact, snames[l],
+			(l == NET_IDX_LINK_STATE || l == NET_IDX_PHYS_STATE)
+				? "gauge"
+				: "counter",
+			sdesc[l]);
 		for (i = 0; i < n; i++) {
-			if (metric_attr[i] == NULL)
+			if (metric_attr[i] == NULL || (skip != NULL && skip[i]))
 				continue;
 			if ((ksp = ks_read(kc, kstat[ks_idx].ksp[i], now, NULL)) != NULL) {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
 				if ((knp = kstat_data_lookup(ksp, knames[l])) != NULL) {
-					psb_add_str(sb, snames[l]);
-					psb_add_str(sb, metric_attr[i]);
-					sprintf(buf, "%ld\n", knp->value.ui64);
-					psb_add_str(sb, buf);
+					ks_emit_times(ksp);
+					expo_emit_uint(sb, snames[l], metric_attr[i], knp->value.ui64);
+				}
+#pragma GCC diagnostic pop
+			}
+		}
+		ks_emit_times(NULL);	// rollups: several links
+		// summing up states makes no sense
+		if (l == NET_IDX_LINK_STATE || l == NET_IDX_PHYS_STATE)
+			continue;
+		for (g = 0; g < rgrp_n; g++) {
+			uint64_t sum = 0;
+			bool seen = false;
+			for (k = 0; k < rgrp[g].n; k++) {
+				i = rgrp[g].member[k];
+				if ((ksp = ks_read(kc, kstat[ks_idx].ksp[i], now, NULL)) == NULL)
+					continue;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+				if ((knp = kstat_data_lookup(ksp, knames[l])) != NULL) {
+					sum += knp->value.ui64;
+					seen = true;
 				}
 #pragma GCC diagnostic pop
 			}
+			if (!seen)
+				continue;
+			expo_emit_uint(sb, snames[l], rgrp[g].attr, sum);
 		}
 	}
 	if (free_sb) {
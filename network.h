@@ -40,6 +40,15 @@ typedef enum nic_filter_flag {
 	NICFILTER_EXCL = 1 << 25,
 } nic_filter_flag_t;
 
+typedef enum nic_rollup {
+	NICROLLUP_NONE = 0,
+	NICROLLUP_ZONE = 1,			/**< Sum up VNIC stats per zone */
+	NICROLLUP_AGGR = 1 << 1,	/**< Sum up member stats per link aggregation */
+	NICROLLUP_IPMP = 1 << 2,	/**< Sum up member stats per IPMP group */
+	NICROLLUP_ONLY = 1 << 3,	/**< Do not emit the stats of rollup members */
+} nic_rollup_t;
+#define NICROLLUP_FAIL 0xFFFFFFFF
+
 #define NICFILTER_OP_MASK   0x00F00000
 #define NICFILTER_TYPE_MASK 0x0000FFFF
 
@@ -64,6 +73,26 @@ typedef struct nic_filter_chain {
  */
 int parse_nic_filter(char *s, nic_filter_chain_t **list);
 
+/**
+ * @brief Parse the given comma separated list of NIC rollup modes.
+ * @param s	The string to parse: `zone`, `aggr`, `ipmp`, `only`, or `none`.
+ * @return A bit set of `nic_rollup_t`, `NICROLLUP_FAIL` on error.
+ */
+uint32_t parse_nic_rollup(const char *s);
+
+/**
+ * @brief Apply the given NIC filter chain to the given link names the same
+ * 	way collect_nicstat() does.
+ * @param kid	The ID of the current kstat chain. The cached NIC table gets
+ * 	updated only, if it differs from the ID of its last update.
+ * @param nfc	NIC filter chain. If `NULL` or empty, all links get selected.
+ * @param names	The names of the links to check.
+ * @param selected	Where to store the result for each link.
+ * @param n	The number of names to check.
+ */
+void nic_filter_select(kid_t kid, nic_filter_chain_t *nfc, const char **names,
+	bool *selected, int n);
+
 /**
  * @brief Get data for various network interfaces.
  * @param sb	where to add the stats.
@@ -72,9 +101,14 @@ int parse_nic_filter(char *s, nic_filter_chain_t **list);
  * @param now	The current time as delivered by gethrtime().
  * @param ntype Quantity of metrics to emit.
  * @param nfc	NIC filter chain.
+ * @param rollup	A bit set of `nic_rollup_t`. Rollups get emitted using the
+ * 	same metric names as the NICs, but with `type="vnic"` and the zone as
+ * 	`ngz` label, or the aggregation resp. IPMP group name as `nic` label and
+ * 	`type="aggr"` resp. `type="ipmp"`. Group membership gets re-evaluated on
+ * 	kstat chain changes, only.
  */
 void collect_nicstat(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
-	nic_stat_quantity_t ntype, nic_filter_chain_t *nfc);
+	nic_stat_quantity_t ntype, nic_filter_chain_t *nfc, uint32_t rollup);
 
 #ifdef __cplusplus
 }
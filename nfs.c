@@ -0,0 +1,290 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+
+#include <libprom/prom.h>
+
+#include "nfs.h"
+#include "nfs_impl.h"
+#include "ks_util.h"
+#include "expo.h"
+
+typedef enum ks_info_idx {
+	KS_IDX_SRV_V2,
+	KS_IDX_SRV_V3,
+	KS_IDX_SRV_V4,
+	KS_IDX_CLNT_V2,
+	KS_IDX_CLNT_V3,
+	KS_IDX_CLNT_V4,
+	KS_IDX_NFS_SRV,
+	KS_IDX_NFS_CLNT,
+	KS_IDX_RPC_COTS_SRV,
+	KS_IDX_RPC_CLTS_SRV,
+	KS_IDX_RPC_COTS_CLNT,
+	KS_IDX_RPC_CLTS_CLNT,
+	KS_IDX_MAX,			// last entry by cotract
+} ks_info_idx_t;
+
+typedef enum nfs_stat_mode {
+	NFS_SERVER = 1,			/**< Server side stats. */
+	NFS_CLIENT = 1 << 1,	/**< Client side stats. */
+	NFS_RPC = 1 << 2,		/**< Kernel RPC stats of the enabled side[s]. */
+	NFS_V2 = 1 << 3,		/**< NFS v2 op counters. */
+	NFS_V3 = 1 << 4,		/**< NFS v3 op counters. */
+	NFS_V4 = 1 << 5,		/**< NFS v4 op counters. */
+} nfs_stat_mode_t;
+#define NFS_SIDES (NFS_SERVER | NFS_CLIENT)
+#define NFS_VERSIONS (NFS_V2 | NFS_V3 | NFS_V4)
+#define NFS_MODE_ANY (NFS_SIDES | NFS_RPC | NFS_VERSIONS)
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+static ks_info_t kstat[KS_IDX_MAX] = {
+	{ "nfs", 0, "rfsproccnt_v2", -1, 0, NULL },
+	{ "nfs", 0, "rfsproccnt_v3", -1, 0, NULL },
+	{ "nfs", 0, "rfsproccnt_v4", -1, 0, NULL },
+	{ "nfs", 0, "rfsreqcnt_v2", -1, 0, NULL },
+	{ "nfs", 0, "rfsreqcnt_v3", -1, 0, NULL },
+	{ "nfs", 0, "rfsreqcnt_v4", -1, 0, NULL },
+	{ "nfs", 0, "nfs_server", -1, 0, NULL },
+	{ "nfs", 0, "nfs_client", -1, 0, NULL },
+	{ "unix", 0, "rpc_cots_server", -1, 0, NULL },
+	{ "unix", 0, "rpc_clts_server", -1, 0, NULL },
+	{ "unix", 0, "rpc_cots_client", -1, 0, NULL },
+	{ "unix", 0, "rpc_clts_client", -1, 0, NULL },
+};
+#pragma GCC diagnostic pop
+
+static const char **aops[] = { ops_v2, ops_v3, ops_v4 };
+static const char *versions[] = { "2", "3", "4" };
+static const char *transports[] = { "cots", "clts" };
+
+nfs_mods_t
+parse_nfs_mode_list(const char *mode_str) {
+	char buf[_POSIX_ARG_MAX], *t;
+	size_t len;
+	nfs_mods_t mode = 0;
+
+	if (mode_str == NULL)
+		return mode;
+
+	if ((len = strlen(mode_str)) > (_POSIX_ARG_MAX - 2)) {
+		fprintf(stderr, "nfs mode string to parse is too long (%ld).\n", len);
+		return NFS_MODE_FAIL;
+	}
+	if (len == 0)
+		return NFS_MODE_NONE;
+
+	strcpy(buf, mode_str);
+	buf[len] = ',';
+	buf[len + 1] = '\0';
+	t = buf;
+
+	while (*t) {
+		char *s = strchr(t, ',');
+		if (s == NULL)
+			break;
+		s[0] = '\0';
+		if ((strcmp(t, "none") == 0) || (strcmp(t, "n") == 0)
+			|| (strcmp(t, "0") == 0))
+		{
+			mode = NFS_MODE_NONE;
+		} else if (strcmp(t, "all") == 0) {
+			mode = NFS_MODE_ANY;
+		} else if (strcmp(t, "server") == 0) {
+			mode |= NFS_SERVER;
+		} else if (strcmp(t, "client") == 0) {
+			mode |= NFS_CLIENT;
+		} else if (strcmp(t, "rpc") == 0) {
+			mode |= NFS_RPC;
+		} else if ((strcmp(t, "v2") == 0) || (strcmp(t, "2") == 0)) {
+			mode |= NFS_V2;
+		} else if ((strcmp(t, "v3") == 0) || (strcmp(t, "3") == 0)) {
+			mode |= NFS_V3;
+		} else if ((strcmp(t, "v4") == 0) || (strcmp(t, "4") == 0)) {
+			mode |= NFS_V4;
+		} else {
+			fprintf(stderr, "Unknown nfs mode '%s'.\n", t);
+			return NFS_MODE_FAIL;
+		}
+		t = s + 1;
+	}
+	if (mode == NFS_MODE_NONE)
+		return mode;
+	if ((mode & NFS_SIDES) == 0)
+		mode |= NFS_SIDES;
+	if ((mode & NFS_VERSIONS) == 0)
+		mode |= NFS_V3 | NFS_V4;
+	return mode;
+}
+
+static uint64_t
+knp_value(kstat_named_t *knp) {
+	switch (knp->data_type) {
+		case KSTAT_DATA_INT32:
+			return knp->value.i32;
+		case KSTAT_DATA_UINT32:
+			return knp->value.ui32;
+		case KSTAT_DATA_INT64:
+			return knp->value.i64;
+		default:
+			return knp->value.ui64;
+	}
+}
+
+// The kernel creates the op entries in the same order as our ops tables, so
+// usually the entry at the op's index is the one we want and no
+// kstat_data_lookup() (which is a linear search) is needed.
+static void
+add_ops(psb_t *sb, kstat_t *ksp, const char *metric, const char *version,
+	const char **ops)
+{
+	kstat_named_t *knp = KSTAT_NAMED_PTR(ksp), *k;
+	uint32_t i;
+	char buf[64];
+
+	ks_emit_times(ksp);
+	for (i = 0; ops[i] != NULL; i++) {
+		if (i < ksp->ks_ndata && strcmp(knp[i].name, ops[i]) == 0) {
+			k = &knp[i];
+		} else {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+			if ((k = kstat_data_lookup(ksp, ops[i])) == NULL)
+				continue;
+#pragma GCC diagnostic pop
+		}
+		snprintf(buf, sizeof(buf), "{version=\"%s\",op=\"%s\"}", version,
+			ops[i]);
+		expo_emit_int(sb, metric, buf, (int64_t) knp_value(k));
+	}
+}
+
+// Emit all entries of the given kstat named tables found in the kstats
+// `kidx` .. `kidx + count - 1`. If `labels` is not NULL, a
+// transport="labels[i]" gets attached to the value of kstat `kidx + i`.
+static void
+add_stats(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
+	ks_info_idx_t kidx, int count, const char **labels,
+	const char **knames, const char **snames, const char **sdesc,
+	const char **stypes)
+{
+	kstat_t *ksp[2];
+	kstat_named_t *knp;
+	uint32_t l;
+	int i;
+	char buf[64];
+
+	for (i = 0; i < count; i++) {
+		ksp[i] = NULL;
+		if (update_instance(kc, &kstat[kidx + i]) > 0)
+			ksp[i] = ks_read(kc, kstat[kidx + i].ksp[0], now, NULL);
+	}
+	for (l = 0; knames[l] != NULL; l++) {
+		bool seen = false;
+		for (i = 0; i < count; i++) {
+			if (ksp[i] == NULL)
+				continue;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+			if ((knp = kstat_data_lookup(ksp[i], knames[l])) == NULL)
+				continue;
+#pragma GCC diagnostic pop
+			if (!seen)
+				expo_emit_info(sb, compact, snames[l], stypes[l], sdesc[l]);
+			seen = true;
+			if (labels != NULL)
+				snprintf(buf, sizeof(buf), "{transport=\"%s\"}", labels[i]);
+			ks_emit_times(ksp[i]);
+			expo_emit_int(sb, snames[l], labels == NULL ? NULL : buf,
+				(int64_t) knp_value(knp));
+		}
+	}
+}
+
+void
+collect_nfs(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, nfs_mods_t mode) {
+	kstat_t *ksp;
+	int v;
+	size_t psz = 0;
+
+	bool free_sb = sb == NULL;
+
+	if (mode == NFS_MODE_FAIL || (mode & NFS_MODE_ANY) == 0)
+		return;
+	mode &= NFS_MODE_ANY;
+
+	PROM_DEBUG("collect_nfs (0x%x)...", mode);
+	if (free_sb) {
+		sb = psb_new();
+		if (sb == NULL) {
+			PROM_WARN("collect_nfs: %s", strerror(errno));
+			return;
+		}
+	}
+	psz = psb_len(sb);
+
+	if (mode & NFS_SERVER) {
+		bool seen = false;
+		for (v = 0; v < 3; v++) {
+			if ((mode & (NFS_V2 << v)) == 0)
+				continue;
+			if (update_instance(kc, &kstat[KS_IDX_SRV_V2 + v]) < 1)
+				continue;
+			ksp = ks_read(kc, kstat[KS_IDX_SRV_V2 + v].ksp[0], now, NULL);
+			if (ksp == NULL)
+				continue;
+			if (!seen)
+				expo_emit_info(sb, compact, _S(SOLMEX_NFS_SERVER_OPS_N),
+					SOLMEX_NFS_SERVER_OPS_T, SOLMEX_NFS_SERVER_OPS_D);
+			seen = true;
+			add_ops(sb, ksp, _S(SOLMEX_NFS_SERVER_OPS_N), versions[v], aops[v]);
+		}
+		add_stats(sb, compact, kc, now, KS_IDX_NFS_SRV, 1, NULL,
+			knames_nfs_srv, snames_nfs_srv, sdesc_nfs_srv, stypes_nfs_srv);
+		if (mode & NFS_RPC)
+			add_stats(sb, compact, kc, now, KS_IDX_RPC_COTS_SRV, 2, transports,
+				knames_rpc_srv, snames_rpc_srv, sdesc_rpc_srv, stypes_rpc_srv);
+	}
+	if (mode & NFS_CLIENT) {
+		bool seen = false;
+		for (v = 0; v < 3; v++) {
+			if ((mode & (NFS_V2 << v)) == 0)
+				continue;
+			if (update_instance(kc, &kstat[KS_IDX_CLNT_V2 + v]) < 1)
+				continue;
+			ksp = ks_read(kc, kstat[KS_IDX_CLNT_V2 + v].ksp[0], now, NULL);
+			if (ksp == NULL)
+				continue;
+			if (!seen)
+				expo_emit_info(sb, compact, _S(SOLMEX_NFS_CLIENT_OPS_N),
+					SOLMEX_NFS_CLIENT_OPS_T, SOLMEX_NFS_CLIENT_OPS_D);
+			seen = true;
+			add_ops(sb, ksp, _S(SOLMEX_NFS_CLIENT_OPS_N), versions[v], aops[v]);
+		}
+		add_stats(sb, compact, kc, now, KS_IDX_NFS_CLNT, 1, NULL,
+			knames_nfs_clnt, snames_nfs_clnt, sdesc_nfs_clnt, stypes_nfs_clnt);
+		if (mode & NFS_RPC)
+			add_stats(sb, compact, kc, now, KS_IDX_RPC_COTS_CLNT, 2, transports,
+				knames_rpc_clnt, snames_rpc_clnt, sdesc_rpc_clnt,
+				stypes_rpc_clnt);
+	}
+
+	if (free_sb) {
+		if (psb_len(sb) != psz)
+			fprintf(stdout, "\n%s", psb_str(sb));
+		psb_destroy(sb);
+	}
+	PROM_DEBUG("collect_nfs done", "");
+}
@@ -0,0 +1,58 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file nfs.h
+ * NFS server/client RPC operation related defintions/functions/etc.
+ */
+#ifndef SOLMEX_NFS_H
+#define SOLMEX_NFS_H
+
+#include <kstat.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t nfs_mods_t;
+#define NFS_MODE_FAIL 0xffffffff
+#define NFS_MODE_NONE 0
+
+/**
+ * @brief Parse the given NFS mode list string and return the corresponding
+ * 	mode mask. Supported list entries are `server`, `client`, `rpc`, `v2`,
+ * 	`v3`, `v4`, `all` and `none`. If versions but neither `server` nor
+ * 	`client` are given, both get enabled. If `server` or `client` but no
+ * 	version is given, `v3` and `v4` get enabled.
+ * @param s	The string to parse. An empty string is equal to `none`.
+ * @return The resulting mode mask, `NFS_MODE_FAIL` on error.
+ */
+nfs_mods_t parse_nfs_mode_list(const char *s);
+
+/**
+ * @brief Get the NFS server/client per-operation counters of the selected
+ * 	NFS versions, the nfs_server/nfs_client summaries and optionally the
+ * 	kernel RPC stats of the running zone.
+ * @param sb    where to add the stats.
+ * @param compact   whether to add HELP and TYPE comments
+ * @param kc    The kstat chain to use.
+ * @param now   The current time as delivered by gethrtime().
+ * @param mode	The mode mask returned by parse_nfs_mode_list().
+ */
+void collect_nfs(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now, nfs_mods_t mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_NFS_H
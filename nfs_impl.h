@@ -0,0 +1,213 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/*
+NOTE: Keep {nfs_srv,nfs_clnt,rpc_srv,rpc_clnt}_idx_t and
+      {sname,sdesc,kname,stype}_{nfs_srv,nfs_clnt,rpc_srv,rpc_clnt} always in
+      sync! They are generated via
+      'etc/kstat2solmex.sh -t nfs etc/s11.4-nfs.kstat'.
+      The op tables ops_v{2,3,4} are maintained by hand: they list the kstat
+      names in the order the kernel creates them (see
+      usr/src/uts/common/fs/nfs/nfs_stats.c), i.e. the position is the index
+      of the related kstat_named_t entry. kstat(1M) sorts its output, so
+      this order can not be derived from it.
+*/
+
+#ifndef SOLMEX_NFS_IMPL_H
+#define SOLMEX_NFS_IMPL_H
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STRINGIFY(x) #x
+#define _S(x) STRINGIFY(x)
+
+/* rfsproccnt_v2, rfsreqcnt_v2 */
+static const char *ops_v2[] = {
+	"null",		"getattr",	"setattr",	"root",		"lookup",	"readlink",
+	"read",		"wrcache",	"write",	"create",	"remove",	"rename",
+	"link",		"symlink",	"mkdir",	"rmdir",	"readdir",	"statfs",
+	NULL
+};
+
+/* rfsproccnt_v3, rfsreqcnt_v3 */
+static const char *ops_v3[] = {
+	"null",		"getattr",	"setattr",	"lookup",	"access",	"readlink",
+	"read",		"write",	"create",	"mkdir",	"symlink",	"mknod",
+	"remove",	"rmdir",	"rename",	"link",		"readdir",	"readdirplus",
+	"fsstat",	"fsinfo",	"pathconf",	"commit",
+	NULL
+};
+
+/* rfsproccnt_v4, rfsreqcnt_v4 */
+static const char *ops_v4[] = {
+	"null",				"compound",			"reserved",			"access",
+	"close",			"commit",			"create",			"delegpurge",
+	"delegreturn",		"getattr",			"getfh",			"link",
+	"lock",				"lockt",			"locku",			"lookup",
+	"lookupp",			"nverify",			"open",				"openattr",
+	"open_confirm",		"open_downgrade",	"putfh",			"putpubfh",
+	"putrootfh",		"read",				"readdir",			"readlink",
+	"remove",			"rename",			"renew",			"restorefh",
+	"savefh",			"secinfo",			"setattr",			"setclientid",
+	"setclientid_confirm",	"verify",		"write",			"release_lockowner",
+	"illegal",
+	NULL
+};
+
+/* index into snames/knames/sdesc */
+typedef enum nfs_srv_idx {
+	NFS_SRV_IDX_BADCALLS,	NFS_SRV_IDX_CALLS,	NFS_SRV_IDX_REFERLINKS,
+	NFS_SRV_IDX_REFERRALS,	NFS_SRV_IDX_MAX
+} nfs_srv_idx_t;
+
+/* kstat names */
+static const char *knames_nfs_srv[] = {
+	"badcalls",	"calls",	"referlinks",
+	"referrals",	NULL
+};
+
+/* solmex metric names */
+static const char *snames_nfs_srv[] = {
+	_S(SOLMEX_NFS_SRV_BADCALLS_N),	_S(SOLMEX_NFS_SRV_CALLS_N),	_S(SOLMEX_NFS_SRV_REFERLINKS_N),
+	_S(SOLMEX_NFS_SRV_REFERRALS_N),	NULL
+};
+
+/* metric HELP text */
+static const char *sdesc_nfs_srv[] = {
+	SOLMEX_NFS_SRV_BADCALLS_D,	SOLMEX_NFS_SRV_CALLS_D,	SOLMEX_NFS_SRV_REFERLINKS_D,
+	SOLMEX_NFS_SRV_REFERRALS_D,	NULL
+};
+
+/* metric TYPE */
+static const char *stypes_nfs_srv[] = {
+	SOLMEX_NFS_SRV_BADCALLS_T,	SOLMEX_NFS_SRV_CALLS_T,	SOLMEX_NFS_SRV_REFERLINKS_T,
+	SOLMEX_NFS_SRV_REFERRALS_T,	NULL
+};
+
+/* index into snames/knames/sdesc */
+typedef enum nfs_clnt_idx {
+	NFS_CLNT_IDX_BADCALLS,	NFS_CLNT_IDX_CALLS,	NFS_CLNT_IDX_CLGETS,
+	NFS_CLNT_IDX_CLTOOMANY,	NFS_CLNT_IDX_MAX
+} nfs_clnt_idx_t;
+
+/* kstat names */
+static const char *knames_nfs_clnt[] = {
+	"badcalls",	"calls",	"clgets",
+	"cltoomany",	NULL
+};
+
+/* solmex metric names */
+static const char *snames_nfs_clnt[] = {
+	_S(SOLMEX_NFS_CLNT_BADCALLS_N),	_S(SOLMEX_NFS_CLNT_CALLS_N),	_S(SOLMEX_NFS_CLNT_CLGETS_N),
+	_S(SOLMEX_NFS_CLNT_CLTOOMANY_N),	NULL
+};
+
+/* metric HELP text */
+static const char *sdesc_nfs_clnt[] = {
+	SOLMEX_NFS_CLNT_BADCALLS_D,	SOLMEX_NFS_CLNT_CALLS_D,	SOLMEX_NFS_CLNT_CLGETS_D,
+	SOLMEX_NFS_CLNT_CLTOOMANY_D,	NULL
+};
+
+/* metric TYPE */
+static const char *stypes_nfs_clnt[] = {
+	SOLMEX_NFS_CLNT_BADCALLS_T,	SOLMEX_NFS_CLNT_CALLS_T,	SOLMEX_NFS_CLNT_CLGETS_T,
+	SOLMEX_NFS_CLNT_CLTOOMANY_T,	NULL
+};
+
+/* index into snames/knames/sdesc */
+typedef enum rpc_srv_idx {
+	RPC_SRV_IDX_BADCALLS,	RPC_SRV_IDX_BADLEN,	RPC_SRV_IDX_CALLS,
+	RPC_SRV_IDX_DUPCHECKS,	RPC_SRV_IDX_DUPREQS,	RPC_SRV_IDX_NULLRECV,
+	RPC_SRV_IDX_XDRCALL,	RPC_SRV_IDX_MAX
+} rpc_srv_idx_t;
+
+/* kstat names */
+static const char *knames_rpc_srv[] = {
+	"badcalls",	"badlen",	"calls",
+	"dupchecks",	"dupreqs",	"nullrecv",
+	"xdrcall",	NULL
+};
+
+/* solmex metric names */
+static const char *snames_rpc_srv[] = {
+	_S(SOLMEX_RPC_SRV_BADCALLS_N),	_S(SOLMEX_RPC_SRV_BADLEN_N),	_S(SOLMEX_RPC_SRV_CALLS_N),
+	_S(SOLMEX_RPC_SRV_DUPCHECKS_N),	_S(SOLMEX_RPC_SRV_DUPREQS_N),	_S(SOLMEX_RPC_SRV_NULLRECV_N),
+	_S(SOLMEX_RPC_SRV_XDRCALL_N),	NULL
+};
+
+/* metric HELP text */
+static const char *sdesc_rpc_srv[] = {
+	SOLMEX_RPC_SRV_BADCALLS_D,	SOLMEX_RPC_SRV_BADLEN_D,	SOLMEX_RPC_SRV_CALLS_D,
+	SOLMEX_RPC_SRV_DUPCHECKS_D,	SOLMEX_RPC_SRV_DUPREQS_D,	SOLMEX_RPC_SRV_NULLRECV_D,
+	SOLMEX_RPC_SRV_XDRCALL_D,	NULL
+};
+
+/* metric TYPE */
+static const char *stypes_rpc_srv[] = {
+	SOLMEX_RPC_SRV_BADCALLS_T,	SOLMEX_RPC_SRV_BADLEN_T,	SOLMEX_RPC_SRV_CALLS_T,
+	SOLMEX_RPC_SRV_DUPCHECKS_T,	SOLMEX_RPC_SRV_DUPREQS_T,	SOLMEX_RPC_SRV_NULLRECV_T,
+	SOLMEX_RPC_SRV_XDRCALL_T,	NULL
+};
+
+/* index into snames/knames/sdesc */
+typedef enum rpc_clnt_idx {
+	RPC_CLNT_IDX_BADCALLS,	RPC_CLNT_IDX_BADVERFS,	RPC_CLNT_IDX_BADXIDS,
+	RPC_CLNT_IDX_CALLS,	RPC_CLNT_IDX_CANTCONN,	RPC_CLNT_IDX_CANTSEND,
+	RPC_CLNT_IDX_INTERRUPTS,	RPC_CLNT_IDX_NEWCREDS,	RPC_CLNT_IDX_NOMEM,
+	RPC_CLNT_IDX_RETRANS,	RPC_CLNT_IDX_TIMEOUTS,	RPC_CLNT_IDX_TIMERS,
+	RPC_CLNT_IDX_MAX
+} rpc_clnt_idx_t;
+
+/* kstat names */
+static const char *knames_rpc_clnt[] = {
+	"badcalls",	"badverfs",	"badxids",
+	"calls",	"cantconn",	"cantsend",
+	"interrupts",	"newcreds",	"nomem",
+	"retrans",	"timeouts",	"timers",
+	NULL
+};
+
+/* solmex metric names */
+static const char *snames_rpc_clnt[] = {
+	_S(SOLMEX_RPC_CLNT_BADCALLS_N),	_S(SOLMEX_RPC_CLNT_BADVERFS_N),	_S(SOLMEX_RPC_CLNT_BADXIDS_N),
+	_S(SOLMEX_RPC_CLNT_CALLS_N),	_S(SOLMEX_RPC_CLNT_CANTCONN_N),	_S(SOLMEX_RPC_CLNT_CANTSEND_N),
+	_S(SOLMEX_RPC_CLNT_INTERRUPTS_N),	_S(SOLMEX_RPC_CLNT_NEWCREDS_N),	_S(SOLMEX_RPC_CLNT_NOMEM_N),
+	_S(SOLMEX_RPC_CLNT_RETRANS_N),	_S(SOLMEX_RPC_CLNT_TIMEOUTS_N),	_S(SOLMEX_RPC_CLNT_TIMERS_N),
+	NULL
+};
+
+/* metric HELP text */
+static const char *sdesc_rpc_clnt[] = {
+	SOLMEX_RPC_CLNT_BADCALLS_D,	SOLMEX_RPC_CLNT_BADVERFS_D,	SOLMEX_RPC_CLNT_BADXIDS_D,
+	SOLMEX_RPC_CLNT_CALLS_D,	SOLMEX_RPC_CLNT_CANTCONN_D,	SOLMEX_RPC_CLNT_CANTSEND_D,
+	SOLMEX_RPC_CLNT_INTERRUPTS_D,	SOLMEX_RPC_CLNT_NEWCREDS_D,	SOLMEX_RPC_CLNT_NOMEM_D,
+	SOLMEX_RPC_CLNT_RETRANS_D,	SOLMEX_RPC_CLNT_TIMEOUTS_D,	SOLMEX_RPC_CLNT_TIMERS_D,
+	NULL
+};
+
+/* metric TYPE */
+static const char *stypes_rpc_clnt[] = {
+	SOLMEX_RPC_CLNT_BADCALLS_T,	SOLMEX_RPC_CLNT_BADVERFS_T,	SOLMEX_RPC_CLNT_BADXIDS_T,
+	SOLMEX_RPC_CLNT_CALLS_T,	SOLMEX_RPC_CLNT_CANTCONN_T,	SOLMEX_RPC_CLNT_CANTSEND_T,
+	SOLMEX_RPC_CLNT_INTERRUPTS_T,	SOLMEX_RPC_CLNT_NEWCREDS_T,	SOLMEX_RPC_CLNT_NOMEM_T,
+	SOLMEX_RPC_CLNT_RETRANS_T,	SOLMEX_RPC_CLNT_TIMEOUTS_T,	SOLMEX_RPC_CLNT_TIMERS_T,
+	NULL
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_NFS_IMPL_H
@@ -0,0 +1,236 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libprom/prom.h>
+
+#include "ks_util.h"
+#include "expo.h"
+#include "plugin.h"
+#include "solmex_plugin.h"
+
+typedef struct plugin {
+	const solmex_plugin_t *p;
+	void *cfg;				// returned by p->init()
+	void *handle;
+	double duration;		// of the last collect() call in seconds
+} plugin_t;
+
+typedef struct plugin_cfg {
+	plugin_t *p;
+	uint32_t n;
+} plugin_cfg_t;
+
+#define NANOSEC_D 1000000000.0
+
+// the chain of the running collect_plugins() call
+static kstat_ctl_t *kc_cur = NULL;
+
+static kstat_ctl_t *
+kstat_chain(void) {
+	return kc_cur;
+}
+
+static const solmex_api_t api = {
+	.update_instance = update_instance,
+	.ks_read = ks_read,
+	.kstat_chain = kstat_chain,
+	.emit_info = expo_emit_info,
+	.emit_uint = expo_emit_uint,
+	.emit_int = expo_emit_int,
+	.emit_double = expo_emit_double,
+};
+
+void *
+parse_plugin_opts(const char *s, void *config, int *valid) {
+	plugin_cfg_t *cfg = (plugin_cfg_t *) config;
+	const solmex_plugin_t *p = NULL;
+	plugin_t *x;
+	uint32_t i;
+	char *file = NULL, *opts;
+	void *handle = NULL, *pcfg = NULL;
+	int res;
+
+	*valid = 0;
+	if (s == NULL)
+		return cfg;
+	if (strcmp(s, "none") == 0 || strcmp(s, "n") == 0 || strcmp(s, "0") == 0) {
+		*valid = 1;
+		return NULL;
+	}
+	if ((file = strdup(s)) == NULL) {
+		perror("plugin");
+		return cfg;
+	}
+	if ((opts = strchr(file, ':')) != NULL)
+		*opts++ = '\0';
+	if (*file == '\0') {
+		fprintf(stderr, "Missing plugin file in '%s'.\n", s);
+		goto fail;
+	}
+	// never unloaded: a plugin may have started threads
+	if ((handle = dlopen(file, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+		fprintf(stderr, "Unable to load plugin '%s': %s\n", file, dlerror());
+		goto fail;
+	}
+	if ((p = dlsym(handle, SOLMEX_PLUGIN_SYM)) == NULL) {
+		fprintf(stderr, "'%s' is not a solmex plugin (no '%s' symbol).\n",
+			file, SOLMEX_PLUGIN_SYM);
+		goto fail;
+	}
+	if (p->abi != SOLMEX_PLUGIN_ABI) {
+		fprintf(stderr, "Plugin '%s' has been built for ABI %u, but this "
+			"solmex supports ABI %u, only.\n", file, p->abi, SOLMEX_PLUGIN_ABI);
+		goto fail;
+	}
+	if (p->name == NULL || p->name[0] == '\0' || p->collect == NULL) {
+		fprintf(stderr, "Plugin '%s' has no name or collector.\n", file);
+		goto fail;
+	}
+	for (i = 0; cfg != NULL && i < cfg->n; i++) {
+		if (strcmp(cfg->p[i].p->name, p->name) == 0) {
+			fprintf(stderr, "Plugin '%s' already loaded.\n", p->name);
+			goto fail;
+		}
+	}
+	if (p->init != NULL) {
+		res = 1;
+		pcfg = p->init(&api, opts, &res);
+		if (res == 0) {
+			fprintf(stderr, "Invalid options for plugin '%s'.\n", p->name);
+			if (p->usage != NULL)
+				fprintf(stderr, "Usage: -E %s:%s\n", file, p->usage);
+			goto fail;
+		}
+	} else if (opts != NULL) {
+		fprintf(stderr, "Plugin '%s' does not accept options.\n", p->name);
+		goto fail;
+	}
+	if (cfg == NULL && (cfg = calloc(1, sizeof(plugin_cfg_t))) == NULL) {
+		perror("plugin");
+		goto fail;
+	}
+	if ((x = realloc(cfg->p, (cfg->n + 1) * sizeof(plugin_t))) == NULL) {
+		perror("plugin");
+		goto fail;
+	}
+	cfg->p = x;
+	x = &(cfg->p[cfg->n++]);
+	x->p = p;
+	x->cfg = pcfg;
+	x->handle = handle;
+	x->duration = 0;
+	free(file);
+	*valid = 1;
+	return cfg;
+
+fail:
+	if (pcfg != NULL && p->fini != NULL)
+		p->fini(pcfg);
+	if (handle != NULL)
+		dlclose(handle);
+	free(file);
+	return cfg;
+}
+
+void
+plugins_start(void *config) {
+	plugin_cfg_t *cfg = (plugin_cfg_t *) config;
+	plugin_t *x;
+	uint32_t i = 0;
+
+	if (cfg == NULL)
+		return;
+	while (i < cfg->n) {
+		x = &(cfg->p[i]);
+		if (x->p->start == NULL || x->p->start(x->cfg) == 0) {
+			i++;
+			continue;
+		}
+		PROM_WARN("Plugin '%s' failed to start - disabled.", x->p->name);
+		if (x->p->fini != NULL)
+			x->p->fini(x->cfg);
+		cfg->n--;
+		memmove(x, x + 1, (cfg->n - i) * sizeof(plugin_t));
+	}
+}
+
+void
+collect_plugins(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
+	void *config)
+{
+	plugin_cfg_t *cfg = (plugin_cfg_t *) config;
+	plugin_t *x;
+	hrtime_t t;
+	uint32_t i;
+	char buf[64];
+	psb_t *tmp;
+
+	if (cfg == NULL || cfg->n == 0)
+		return;
+
+	PROM_DEBUG("collect_plugins ...", "");
+	if ((tmp = psb_new()) == NULL)
+		return;
+
+	bool free_sb = sb == NULL;
+	if (free_sb)
+		sb = psb_new();
+
+	kc_cur = kc;
+	for (i = 0; i < cfg->n; i++) {
+		x = &(cfg->p[i]);
+		t = gethrtime();
+		// values emitted via the api go to expo_target directly, text needs
+		// to be parsed
+		x->p->collect(expo_target == NULL ? sb : tmp, compact, kc, now,
+			x->cfg);
+		x->duration = (gethrtime() - t) / NANOSEC_D;
+		if (expo_target != NULL && psb_len(tmp) > 0) {
+			expo_emit_text(sb, psb_str(tmp));
+			psb_truncate(tmp, 0);
+		}
+	}
+	kc_cur = NULL;
+	addExpoInfo(SOLMEXM_PLUGIN_DURATION);
+	for (i = 0; i < cfg->n; i++) {
+		x = &(cfg->p[i]);
+		psb_truncate(tmp, 0);
+		psb_add_str(tmp, "{plugin=\"");
+		addLabelValue(tmp, x->p->name);
+		psb_add_str(tmp, "\"}");
+		sprintf(buf, "%.6f", x->duration);
+		expo_emit(sb, SOLMEXM_PLUGIN_DURATION_N, psb_str(tmp), buf, x->duration);
+	}
+	psb_destroy(tmp);
+
+	if (free_sb) {
+		fprintf(stdout, "\n%s", psb_str(sb));
+		psb_destroy(sb);
+	}
+	PROM_DEBUG("collect_plugins done", "");
+}
+
+void
+plugins_fini(void *config) {
+	plugin_cfg_t *cfg = (plugin_cfg_t *) config;
+	uint32_t i;
+
+	if (cfg == NULL)
+		return;
+	for (i = 0; i < cfg->n; i++) {
+		if (cfg->p[i].p->fini != NULL)
+			cfg->p[i].p->fini(cfg->p[i].cfg);
+	}
+}
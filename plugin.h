@@ -0,0 +1,70 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file plugin.h
+ * Load collector plugins via dlopen(3C) and call them on each scrape.
+ */
+#ifndef SOLMEX_PLUGIN_LOADER_H
+#define SOLMEX_PLUGIN_LOADER_H
+
+#include <kstat.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Parse the given plugin option string of the form `file[:opts]`,
+ * 	load the shared object `file`, check its ABI version and pass `opts` to
+ * 	its init() function. See solmex_plugin.h for details.
+ * @param s	The string to parse.
+ * @param cfg	The config returned by a previous call, `NULL` on the 1st.
+ * @param valid Gets set to @code 1 if the given string could be parsed
+ * 	and the plugin loaded successfully, to @code 0 otherwise.
+ * @return A reference to the config to be used in the collect_plugins() call.
+ * 	`NULL` if disabled, or the given config on error.
+ */
+void *parse_plugin_opts(const char *s, void *cfg, int *valid);
+
+/**
+ * @brief Call the start() function of each loaded plugin. Plugins failing to
+ * 	start get finalized and removed. Must be called once after solmex has
+ * 	daemonized (if at all) and before the first scrape.
+ * @param cfg	The reference returned by parse_plugin_opts().
+ */
+void plugins_start(void *cfg);
+
+/**
+ * @brief Call the collector of each loaded plugin in the order they have
+ * 	been given on the command line.
+ * @param sb	where to add the stats.
+ * @param compact	whether to add HELP and TYPE comments
+ * @param kc	The kstat chain to pass, `NULL` if not available.
+ * @param now	The current time as delivered by gethrtime().
+ * @param cfg	The reference returned by parse_plugin_opts().
+ */
+void collect_plugins(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
+	void *cfg);
+
+/**
+ * @brief Call the fini() function of each loaded plugin.
+ * @param cfg	The reference returned by parse_plugin_opts().
+ */
+void plugins_fini(void *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_PLUGIN_LOADER_H
@@ -0,0 +1,556 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <procfs.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zone.h>
+
+#include <libprom/prom.h>
+
+#include "procs.h"
+#include "zones.h"
+#include "expo.h"
+
+#define PROC_HASH_SZ 4096		// must be a power of 2
+#define PROC_HASH(pid)	((pid) & (PROC_HASH_SZ - 1))
+#define TS2NS(ts)	((uint64_t) (ts).tv_sec * NANOSEC + (ts).tv_nsec)
+
+/* pr_sname values. The last slot counts everything else. */
+static const char states[] = "ORSTWZI";
+#define STATE_MAX (sizeof(states) - 1)
+
+typedef struct procs_cfg {
+	uint16_t topn;
+	uint16_t zcount;		/**< number of entries in zids */
+	zoneid_t *zids;			/**< zones to consider, NULL .. any */
+	struct proc_entry **topcpu;
+	struct proc_entry **toprss;
+} procs_cfg_t;
+
+typedef struct proc_entry {
+	pid_t pid;
+	int fd_psinfo;			/**< -1 if not kept open */
+	int fd_usage;			/**< -1 if not kept open */
+	zoneid_t zid;
+	bool selected;			/**< whether zid is a zone to consider */
+	timestruc_t start;		/**< process start time to detect PID reuse */
+	uint32_t round;			/**< round when seen last time */
+	bool cpu_valid;			/**< whether cpu is from the previous round */
+	uint64_t cpu;			/**< usr + sys time in ns */
+	uint64_t cpu_delta;		/**< CPU time in ns used since the previous round */
+	uint64_t rss;			/**< resident set size in bytes */
+	char fname[PRFNSZ];
+	struct proc_entry *next;
+} proc_entry_t;
+
+typedef struct zone_acc {
+	zoneid_t zid;
+	uint32_t states[STATE_MAX + 1];
+	const char *name;		/**< interned, see zones.h */
+} zone_acc_t;
+
+typedef struct proj_acc {
+	zoneid_t zid;
+	projid_t projid;
+	uint32_t count;
+} proj_acc_t;
+
+#define PROCS_EXTENT 16
+#define PROCS_FD_RESERVE 64		// fds left for HTTP connections, kstat, etc.
+
+static struct {
+	DIR *dir;				/**< /proc - kept open, just rewound */
+	proc_entry_t *hash[PROC_HASH_SZ];
+	uint32_t round;
+	hrtime_t last;			/**< time of the previous round */
+	uint32_t cached;		/**< number of fds currently kept open */
+	uint32_t max_cached;	/**< RLIMIT_NOFILE - PROCS_FD_RESERVE */
+	zone_acc_t *zones;		/**< kept to avoid zone name lookups */
+	uint32_t zones_n;
+	uint32_t zones_sz;
+	uint32_t zones_gen;		/**< zone registry generation of the names */
+	proj_acc_t *projs;		/**< reset each round */
+	uint32_t projs_n;
+	uint32_t projs_sz;
+} procs;
+
+void *
+parse_procs_opts(const char *s, int *valid) {
+	procs_cfg_t *cfg;
+	char *buf, *t, *e;
+	unsigned int n;
+	size_t len;
+
+	*valid = 0;
+	if (s == NULL)
+		return NULL;
+	if (sscanf(s, "%u", &n) != 1 || n > UINT16_MAX) {
+		fprintf(stderr, "Invalid process top-N value in '%s'.\n", s);
+		return NULL;
+	}
+	if ((cfg = calloc(1, sizeof(procs_cfg_t))) == NULL) {
+		perror("procs");
+		return NULL;
+	}
+	cfg->topn = n;
+	if (n > 0) {
+		cfg->topcpu = malloc(n * sizeof(proc_entry_t *));
+		cfg->toprss = malloc(n * sizeof(proc_entry_t *));
+		if (cfg->topcpu == NULL || cfg->toprss == NULL) {
+			perror("procs");
+			goto fail;
+		}
+	}
+	if ((t = strchr(s, ',')) == NULL) {
+		*valid = 1;
+		return cfg;
+	}
+
+	len = strlen(t);
+	if ((buf = malloc(len + 1)) == NULL
+		|| (cfg->zids = malloc(len * sizeof(zoneid_t))) == NULL)
+	{
+		perror("procs");
+		free(buf);
+		goto fail;
+	}
+	strcpy(buf, t + 1);
+	buf[len - 1] = ',';
+	buf[len] = '\0';
+	t = buf;
+	while (*t) {
+		if ((e = strchr(t, ',')) == NULL)
+			break;
+		e[0] = '\0';
+		if (e != t && e[-1] == ':')
+			e[-1] = '\0';		// same as -z but no fstypes
+		if (*t == '\0') {
+			;
+		} else if (strcmp(t, "any") == 0) {
+			free(cfg->zids);
+			cfg->zids = NULL;
+			cfg->zcount = 0;
+			break;
+		} else {
+			zoneid_t zid = strcmp(t, "this") == 0
+				? getzoneid()
+				: zone_id(t);
+			if (zid == -1)
+				fprintf(stderr, "WARNING: Zone '%s' not found!\n", t);
+			else
+				cfg->zids[cfg->zcount++] = zid;
+		}
+		t = e + 1;
+	}
+	free(buf);
+	*valid = 1;
+	return cfg;
+
+fail:
+	free(cfg->topcpu);
+	free(cfg->toprss);
+	free(cfg);
+	return NULL;
+}
+
+static bool
+zone_selected(procs_cfg_t *cfg, zoneid_t zid) {
+	uint16_t i;
+
+	if (cfg->zids == NULL)
+		return true;
+	for (i = 0; i < cfg->zcount; i++)
+		if (cfg->zids[i] == zid)
+			return true;
+	return false;
+}
+
+static const char *
+zone_acc_name(zoneid_t zid) {
+	const char *name = zone_name(zid);
+	char buf[16];
+
+	if (name != NULL)
+		return name;
+	sprintf(buf, "%d", zid);
+	return (name = str_intern(buf)) == NULL ? "" : name;
+}
+
+static zone_acc_t *
+zone_acc_get(zoneid_t zid) {
+	uint32_t i;
+	zone_acc_t *z;
+
+	for (i = 0; i < procs.zones_n; i++)
+		if (procs.zones[i].zid == zid)
+			return &procs.zones[i];
+
+	if (procs.zones_n == procs.zones_sz) {
+		z = realloc(procs.zones,
+			(procs.zones_sz + PROCS_EXTENT) * sizeof(zone_acc_t));
+		if (z == NULL)
+			return NULL;
+		procs.zones = z;
+		procs.zones_sz += PROCS_EXTENT;
+	}
+	z = &procs.zones[procs.zones_n++];
+	memset(z, 0, sizeof(zone_acc_t));
+	z->zid = zid;
+	z->name = zone_acc_name(zid);
+	return z;
+}
+
+static void
+proj_acc_add(zoneid_t zid, projid_t projid) {
+	uint32_t i;
+	proj_acc_t *p;
+
+	for (i = 0; i < procs.projs_n; i++) {
+		if (procs.projs[i].projid == projid && procs.projs[i].zid == zid) {
+			procs.projs[i].count++;
+			return;
+		}
+	}
+	if (procs.projs_n == procs.projs_sz) {
+		p = realloc(procs.projs,
+			(procs.projs_sz + PROCS_EXTENT) * sizeof(proj_acc_t));
+		if (p == NULL)
+			return;
+		procs.projs = p;
+		procs.projs_sz += PROCS_EXTENT;
+	}
+	p = &procs.projs[procs.projs_n++];
+	p->zid = zid;
+	p->projid = projid;
+	p->count = 1;
+}
+
+// Close all cached fds. Used when the process runs out of fds anyway.
+static void
+proc_flush_fds(void) {
+	proc_entry_t *e;
+	uint32_t i;
+
+	for (i = 0; i < PROC_HASH_SZ; i++) {
+		for (e = procs.hash[i]; e != NULL; e = e->next) {
+			if (e->fd_psinfo != -1) {
+				close(e->fd_psinfo);
+				e->fd_psinfo = -1;
+			}
+			if (e->fd_usage != -1) {
+				close(e->fd_usage);
+				e->fd_usage = -1;
+			}
+		}
+	}
+	procs.cached = 0;
+}
+
+static int
+proc_open(pid_t pid, const char *file) {
+	char path[64];
+	int fd;
+
+	sprintf(path, "/proc/%d/%s", (int) pid, file);
+	if ((fd = open(path, O_RDONLY)) == -1 && errno == EMFILE
+		&& procs.cached > 0)
+	{
+		// others need fds as well: use at most half of what we had
+		PROM_WARN("Too many open files - closing %u cached /proc "
+			"descriptors.", procs.cached);
+		procs.max_cached = procs.cached / 2;
+		proc_flush_fds();
+		fd = open(path, O_RDONLY);
+	}
+	return fd;
+}
+
+// Read the given /proc file of the given process into buf. If the cached fd
+// does not work anymore, the process has exited. However, the PID might have
+// been re-used already, so try a fresh open once. The fd gets cached if keep
+// is set and procs.max_cached is not reached, otherwise it gets closed
+// immediately.
+static bool
+proc_pread(proc_entry_t *e, int *fdp, const char *file, void *buf, size_t sz,
+	bool keep)
+{
+	int fd = *fdp;
+	ssize_t n;
+
+	if (fd != -1) {
+		if (pread(fd, buf, sz, 0) == (ssize_t) sz)
+			return true;
+		close(fd);
+		*fdp = -1;
+		procs.cached--;
+		e->cpu_valid = false;
+	}
+	if ((fd = proc_open(e->pid, file)) == -1)
+		return false;
+	n = pread(fd, buf, sz, 0);
+	if (n == (ssize_t) sz && keep && procs.cached < procs.max_cached) {
+		*fdp = fd;
+		procs.cached++;
+	} else {
+		close(fd);
+	}
+	return n == (ssize_t) sz;
+}
+
+static void
+proc_release(proc_entry_t *e) {
+	if (e->fd_psinfo != -1) {
+		close(e->fd_psinfo);
+		procs.cached--;
+	}
+	if (e->fd_usage != -1) {
+		close(e->fd_usage);
+		procs.cached--;
+	}
+	free(e);
+}
+
+// Keep top[0..cnt-1] sorted in descending order.
+static void
+topn_add(proc_entry_t **top, uint16_t *cnt, uint16_t max, proc_entry_t *e,
+	bool by_cpu)
+{
+#define TOP_VAL(x)	(by_cpu ? (x)->cpu_delta : (x)->rss)
+	uint64_t v = TOP_VAL(e);
+	int i = *cnt;
+
+	if (v == 0 || max == 0)
+		return;
+	if (i == max) {
+		if (TOP_VAL(top[i - 1]) >= v)
+			return;
+		i--;
+	} else {
+		(*cnt)++;
+	}
+	while (i > 0 && TOP_VAL(top[i - 1]) < v) {
+		top[i] = top[i - 1];
+		i--;
+	}
+	top[i] = e;
+#undef TOP_VAL
+}
+
+// Set lb to the labels of the given top-N process.
+static const char *
+add_top_labels(psb_t *lb, proc_entry_t *e) {
+	zone_acc_t *z = zone_acc_get(e->zid);
+	char buf[32];
+
+	psb_truncate(lb, 0);
+	psb_add_str(lb, "{zone=\"");
+	if (z != NULL)
+		psb_add_str(lb, z->name);
+	sprintf(buf, "\",pid=\"%d\",comm=\"", (int) e->pid);
+	psb_add_str(lb, buf);
+	addLabelValue(lb, e->fname);
+	psb_add_str(lb, "\"}");
+	return psb_str(lb);
+}
+
+void
+collect_procs(psb_t *sb, bool compact, hrtime_t now, void *config) {
+	procs_cfg_t *cfg = (procs_cfg_t *) config;
+	struct dirent *de;
+	proc_entry_t *e, **pe;
+	psinfo_t psi;
+	prusage_t pru;
+	zone_acc_t *z;
+	uint16_t ncpu = 0, nrss = 0;
+	uint32_t i, k;
+	char buf[128], *s;
+	psb_t *lb;
+
+	if (cfg == NULL)
+		return;
+
+	PROM_DEBUG("collect_procs ...", "");
+	if (procs.dir == NULL) {
+		struct rlimit rl;
+		// we wanna keep 2 fds per process open, but not all of them
+		if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+			if (rl.rlim_cur < rl.rlim_max) {
+				rl.rlim_cur = rl.rlim_max;
+				if (setrlimit(RLIMIT_NOFILE, &rl) != 0)
+					(void) getrlimit(RLIMIT_NOFILE, &rl);
+			}
+			if (rl.rlim_cur > UINT32_MAX)
+				rl.rlim_cur = UINT32_MAX;
+			procs.max_cached = rl.rlim_cur > PROCS_FD_RESERVE
+				? rl.rlim_cur - PROCS_FD_RESERVE
+				: 0;
+		}
+		if ((procs.dir = opendir("/proc")) == NULL) {
+			PROM_WARN("Unable to open /proc: %s", strerror(errno));
+			return;
+		}
+	} else {
+		rewinddir(procs.dir);
+	}
+	procs.round++;
+	procs.projs_n = 0;
+	for (i = 0; i < procs.zones_n; i++)
+		memset(procs.zones[i].states, 0, sizeof(procs.zones[i].states));
+	if ((k = zones_update(-1)) != procs.zones_gen) {
+		// a zone ID might have been reused by another zone
+		for (i = 0; i < procs.zones_n; i++)
+			procs.zones[i].name = zone_acc_name(procs.zones[i].zid);
+		procs.zones_gen = k;
+	}
+
+	while ((de = readdir(procs.dir)) != NULL) {
+		pid_t pid;
+		if (de->d_name[0] < '0' || de->d_name[0] > '9')
+			continue;
+		pid = atoi(de->d_name);
+		for (e = procs.hash[PROC_HASH(pid)]; e != NULL; e = e->next)
+			if (e->pid == pid)
+				break;
+		if (e == NULL) {
+			if ((e = calloc(1, sizeof(proc_entry_t))) == NULL)
+				continue;
+			e->pid = pid;
+			e->fd_psinfo = e->fd_usage = -1;
+			e->selected = cfg->zids == NULL;
+			e->next = procs.hash[PROC_HASH(pid)];
+			procs.hash[PROC_HASH(pid)] = e;
+		}
+		// cache fds of processes in the zones to consider, only
+		if (!proc_pread(e, &(e->fd_psinfo), "psinfo", &psi, sizeof(psi),
+			e->selected))
+		{
+			continue;	// gone - gets dropped below
+		}
+		if (e->start.tv_sec != psi.pr_start.tv_sec
+			|| e->start.tv_nsec != psi.pr_start.tv_nsec)
+		{
+			// new process behind the same PID
+			e->start = psi.pr_start;
+			e->cpu_valid = false;
+		}
+		if (!e->cpu_valid && e->fd_usage != -1) {
+			close(e->fd_usage);
+			e->fd_usage = -1;
+			procs.cached--;
+		}
+		e->round = procs.round;
+		e->zid = psi.pr_zoneid;
+		e->selected = zone_selected(cfg, e->zid);
+		if (!e->selected) {
+			if (e->fd_psinfo != -1) {
+				close(e->fd_psinfo);
+				e->fd_psinfo = -1;
+				procs.cached--;
+			}
+			continue;
+		}
+
+		if ((z = zone_acc_get(e->zid)) != NULL) {
+			s = strchr(states, psi.pr_lwp.pr_sname);
+			z->states[(s == NULL || *s == '\0') ? STATE_MAX : (size_t) (s - states)]++;
+		}
+		proj_acc_add(e->zid, psi.pr_projid);
+		if (cfg->topn == 0)
+			continue;
+
+		uint64_t cpu = proc_pread(e, &(e->fd_usage), "usage", &pru, sizeof(pru),
+			true)
+			? TS2NS(pru.pr_utime) + TS2NS(pru.pr_stime)
+			: TS2NS(psi.pr_time);
+		e->cpu_delta = (e->cpu_valid && cpu >= e->cpu) ? cpu - e->cpu : 0;
+		e->cpu = cpu;
+		e->cpu_valid = true;
+		e->rss = (uint64_t) psi.pr_rssize << 10;
+		memcpy(e->fname, psi.pr_fname, PRFNSZ);
+		e->fname[PRFNSZ - 1] = '\0';
+		if (procs.last != 0)
+			topn_add(cfg->topcpu, &ncpu, cfg->topn, e, true);
+		topn_add(cfg->toprss, &nrss, cfg->topn, e, false);
+	}
+
+	// drop exited processes
+	for (i = 0; i < PROC_HASH_SZ; i++) {
+		pe = &(procs.hash[i]);
+		while ((e = *pe) != NULL) {
+			if (e->round == procs.round) {
+				pe = &(e->next);
+			} else {
+				*pe = e->next;
+				proc_release(e);
+			}
+		}
+	}
+
+	bool free_sb = sb == NULL;
+	if (free_sb)
+		sb = psb_new();
+
+	addExpoInfo(SOLMEXM_PROCS);
+	for (i = 0; i < procs.zones_n; i++) {
+		uint32_t total = 0;
+		z = &procs.zones[i];
+		for (k = 0; k <= STATE_MAX; k++)
+			total += z->states[k];
+		if (total == 0)
+			continue;
+		for (k = 0; k <= STATE_MAX; k++) {
+			snprintf(buf, sizeof(buf), "{zone=\"%s\",state=\"%c\"}", z->name,
+				k == STATE_MAX ? '?' : states[k]);
+			expo_emit_uint(sb, SOLMEXM_PROCS_N, buf, z->states[k]);
+		}
+	}
+	addExpoInfo(SOLMEXM_PROCS_PROJECT);
+	for (i = 0; i < procs.projs_n; i++) {
+		if ((z = zone_acc_get(procs.projs[i].zid)) == NULL)
+			continue;
+		snprintf(buf, sizeof(buf), "{zone=\"%s\",projid=\"%d\"}", z->name,
+			(int) procs.projs[i].projid);
+		expo_emit_uint(sb, SOLMEXM_PROCS_PROJECT_N, buf, procs.projs[i].count);
+	}
+	if ((ncpu > 0 || nrss > 0) && (lb = psb_new()) != NULL) {
+		if (ncpu > 0) {
+			double dt = now - procs.last;
+			addExpoInfo(SOLMEXM_PROC_TOP_CPU);
+			for (i = 0; i < ncpu; i++) {
+				double v = cfg->topcpu[i]->cpu_delta / dt;
+				sprintf(buf, "%.4f", v);
+				expo_emit(sb, SOLMEXM_PROC_TOP_CPU_N,
+					add_top_labels(lb, cfg->topcpu[i]), buf, v);
+			}
+		}
+		if (nrss > 0) {
+			addExpoInfo(SOLMEXM_PROC_TOP_RSS);
+			for (i = 0; i < nrss; i++)
+				expo_emit_uint(sb, SOLMEXM_PROC_TOP_RSS_N,
+					add_top_labels(lb, cfg->toprss[i]), cfg->toprss[i]->rss);
+		}
+		psb_destroy(lb);
+	}
+	procs.last = now;
+
+	if (free_sb) {
+		fprintf(stdout, "\n%s", psb_str(sb));
+		psb_destroy(sb);
+	}
+	PROM_DEBUG("collect_procs done", "");
+}
@@ -0,0 +1,57 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file procs.h
+ * Process table summary and top-N processes via /proc.
+ */
+#ifndef SOLMEX_PROCS_H
+#define SOLMEX_PROCS_H
+
+#include <sys/time.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Parse the given process option string of the form
+ * 	`N[,zonename:[,...]]`. Zone names get handled like the ones of the `-z`
+ * 	option, i.e. `this` denotes the current zone and `any` all zones. If no
+ * 	zone is given, processes of all visible zones get considered.
+ * @param s	The string to parse.
+ * @param valid Gets set to @code 1 if the given string could be parsed
+ * 	successfully, to @code 0 otherwise.
+ * @return A reference to the config to be used in the collect_procs() call,
+ * 	`NULL` if disabled or on error.
+ */
+void *parse_procs_opts(const char *s, int *valid);
+
+/**
+ * @brief Emit the number of processes by zone and state and by zone and
+ * 	project as well as the top-N processes wrt. CPU utilization and RSS.
+ * 	The descriptors of /proc and the psinfo/usage files of the processes
+ * 	are kept open across scrapes, so each scrape costs a readdir() and
+ * 	a few pread()s per process, only.
+ * @param sb    where to add the stats.
+ * @param compact   whether to add HELP and TYPE comments
+ * @param now   The current time as delivered by gethrtime().
+ * @param cfg	The reference returned by parse_procs_opts().
+ */
+void collect_procs(psb_t *sb, bool compact, hrtime_t now, void *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_PROCS_H
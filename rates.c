@@ -0,0 +1,331 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libprom/prom.h>
+
+#include "rates.h"
+#include "expo.h"
+
+#define RATE_HASH_SZ 1024		// must be a power of 2
+
+typedef struct rate_series {
+	struct rate_series *next;
+	char *key;					/**< metric name incl. labels */
+	uint32_t round;				/**< round the series has been seen last */
+	uint8_t head;				/**< index of the newest sample */
+	uint8_t count;				/**< number of valid samples */
+	double v[RATE_SAMPLES_MAX];
+	hrtime_t t[RATE_SAMPLES_MAX];
+} rate_series_t;
+
+typedef struct rate_cfg {
+	char **name;				/**< selected metric names or prefixes */
+	size_t *len;
+	bool *prefix;
+	uint16_t n;
+	uint8_t samples;			/**< samples to keep per series */
+	uint32_t round;
+	rate_series_t *hash[RATE_HASH_SZ];
+	char *key;					/**< name{labels} of a value-level sample */
+	char *buf;					/**< name_rate, labels and HELP to emit */
+	size_t keysz;
+	size_t bufsz;
+	const char *last;			/**< name of the last family emitted */
+	size_t last_len;
+} rate_cfg_t;
+
+void *
+parse_rate_opts(const char *s, int *valid) {
+	rate_cfg_t *cfg;
+	char *buf, *t, *e;
+	unsigned int n;
+
+	*valid = 0;
+	if (s == NULL)
+		return NULL;
+	if (strcmp(s, "none") == 0 || strcmp(s, "n") == 0 || strcmp(s, "0") == 0) {
+		*valid = 1;
+		return NULL;
+	}
+	if ((cfg = calloc(1, sizeof(rate_cfg_t))) == NULL
+		|| (buf = strdup(s)) == NULL)
+	{
+		perror("rates");
+		free(cfg);
+		return NULL;
+	}
+	cfg->samples = RATE_SAMPLES_DEFAULT;
+	if ((t = strrchr(buf, ':')) != NULL) {
+		*t = '\0';
+		if (sscanf(t + 1, "%u", &n) != 1 || n < 2 || n > RATE_SAMPLES_MAX) {
+			fprintf(stderr, "Invalid number of rate samples in '%s' "
+				"(2..%d).\n", s, RATE_SAMPLES_MAX);
+			goto fail;
+		}
+		cfg->samples = n;
+	}
+	for (n = 1, t = buf; *t != '\0'; t++)
+		if (*t == ',')
+			n++;
+	cfg->name = calloc(n, sizeof(char *));
+	cfg->len = calloc(n, sizeof(size_t));
+	cfg->prefix = calloc(n, sizeof(bool));
+	if (cfg->name == NULL || cfg->len == NULL || cfg->prefix == NULL) {
+		perror("rates");
+		goto fail;
+	}
+	for (t = buf; *t != '\0'; t = e) {
+		size_t len;
+		if ((e = strchr(t, ',')) != NULL)
+			*e++ = '\0';
+		else
+			e = t + strlen(t);
+		if ((len = strlen(t)) == 0)
+			continue;
+		if (t[len - 1] == '*') {
+			t[--len] = '\0';
+			cfg->prefix[cfg->n] = true;
+		}
+		if ((cfg->name[cfg->n] = strdup(t)) == NULL) {
+			perror("rates");
+			goto fail;
+		}
+		cfg->len[cfg->n++] = len;
+	}
+	if (cfg->n == 0) {
+		fprintf(stderr, "No metric names found in '%s'.\n", s);
+		goto fail;
+	}
+	free(buf);
+	*valid = 1;
+	return cfg;
+
+fail:
+	free(buf);
+	if (cfg->name != NULL)
+		for (n = 0; n < cfg->n; n++)
+			free(cfg->name[n]);
+	free(cfg->name);
+	free(cfg->len);
+	free(cfg->prefix);
+	free(cfg);
+	return NULL;
+}
+
+static bool
+selected(rate_cfg_t *cfg, const char *name, size_t len) {
+	uint16_t i;
+
+	for (i = 0; i < cfg->n; i++) {
+		if (cfg->prefix[i]) {
+			if (len >= cfg->len[i] && strncmp(name, cfg->name[i], cfg->len[i]) == 0)
+				return true;
+		} else if (len == cfg->len[i] && strncmp(name, cfg->name[i], len) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static rate_series_t *
+getSeries(rate_cfg_t *cfg, const char *key, size_t len) {
+	uint32_t h = 2166136261U;
+	rate_series_t *r;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ (unsigned char) key[i]) * 16777619U;
+	h &= RATE_HASH_SZ - 1;
+	for (r = cfg->hash[h]; r != NULL; r = r->next)
+		if (strncmp(r->key, key, len) == 0 && r->key[len] == '\0')
+			return r;
+
+	if ((r = calloc(1, sizeof(rate_series_t))) == NULL
+		|| (r->key = strndup(key, len)) == NULL)
+	{
+		PROM_WARN("Unable to allocate rate series: %s", strerror(errno));
+		free(r);
+		return NULL;
+	}
+	r->next = cfg->hash[h];
+	cfg->hash[h] = r;
+	return r;
+}
+
+// Drop the samples of series not seen for a while.
+static void
+expire(rate_cfg_t *cfg) {
+	rate_series_t *r, **pr;
+	uint32_t h;
+
+	for (h = 0; h < RATE_HASH_SZ; h++) {
+		for (pr = &cfg->hash[h]; (r = *pr) != NULL; ) {
+			if (cfg->round - r->round > RATE_KEEP_ROUNDS) {
+				*pr = r->next;
+				free(r->key);
+				free(r);
+			} else {
+				pr = &r->next;
+			}
+		}
+	}
+}
+
+// Make sure, *b has room for at least len bytes.
+static char *
+grow(char **b, size_t *sz, size_t len) {
+	char *x;
+
+	if (len > *sz) {
+		if ((x = realloc(*b, len)) == NULL) {
+			PROM_WARN("Unable to allocate rate buffer: %s", strerror(errno));
+			return NULL;
+		}
+		*b = x;
+		*sz = len;
+	}
+	return *b;
+}
+
+// Add a sample to the series with the given key (name incl. labels) at the
+// given time. Returns the series, if its rate is available.
+static rate_series_t *
+addSample(rate_cfg_t *rc, const char *key, size_t len, double v, hrtime_t t) {
+	rate_series_t *r;
+
+	if ((r = getSeries(rc, key, len)) == NULL)
+		return NULL;
+	r->round = rc->round;
+	if (r->count > 0 && (v < r->v[r->head] || t < r->t[r->head])) {
+		r->count = 0;	// counter reset or restart
+	} else if (r->count > 0 && t == r->t[r->head]) {
+		// same kstat snapshot as on the previous scrape (e.g. by another
+		// consumer within the same second): nothing new to record
+		return r->count < 2 ? NULL : r;
+	}
+	r->head = (r->count == 0) ? 0 : (r->head + 1) % rc->samples;
+	r->v[r->head] = v;
+	r->t[r->head] = t;
+	if (r->count < rc->samples)
+		r->count++;
+	return r->count < 2 ? NULL : r;
+}
+
+// Emit name_rate{labels} for the given series. key is name{labels}, fam
+// its name in a buffer, which does not change during this round and nlen the
+// length of the name.
+static void
+emitRate(rate_cfg_t *rc, psb_t *out, bool compact, const char *key,
+	const char *fam, size_t nlen, size_t len, const rate_series_t *r)
+{
+	uint8_t oldest = (r->head + rc->samples + 1 - r->count) % rc->samples;
+	double dt = (double) (r->t[r->head] - r->t[oldest]) / NANOSEC;
+	char *name, *lbl, *help;
+
+	// name_rate\0 labels\0 "Per-second rate of " name " over up to N samples."
+	if (grow(&(rc->buf), &(rc->bufsz), 2 * nlen + len + 64) == NULL)
+		return;
+	name = rc->buf;
+	memcpy(name, key, nlen);
+	strcpy(name + nlen, "_rate");
+	lbl = name + nlen + 6;
+	memcpy(lbl, key + nlen, len - nlen);
+	lbl[len - nlen] = '\0';
+	if (rc->last == NULL || nlen != rc->last_len
+		|| strncmp(fam, rc->last, nlen) != 0)
+	{
+		help = lbl + len - nlen + 1;
+		sprintf(help, "Per-second rate of %.*s over up to %u samples.",
+			(int) nlen, key, rc->samples);
+		expo_emit_info(out, compact, name, "gauge", help);
+	}
+	rc->last = fam;
+	rc->last_len = nlen;
+	expo_emit_double(out, name, len > nlen ? lbl : NULL,
+		(r->v[r->head] - r->v[oldest]) / dt);
+}
+
+void
+derive_rates(psb_t *sb, size_t start, bool compact, hrtime_t now, void *cfg) {
+	rate_cfg_t *rc = (rate_cfg_t *) cfg;
+	const char *s, *eol, *sp, *lbl;
+	size_t nlen, end, len;
+	rate_series_t *r;
+	expo_set_t *set = expo_target;
+	expo_sample_t *x;
+	psb_t *out;
+	uint32_t i, n;
+	hrtime_t t;
+
+	if (sb == NULL || rc == NULL)
+		return;
+	if ((out = psb_new()) == NULL)
+		return;
+
+	PROM_DEBUG("derive_rates ...", "");
+	rc->round++;
+	rc->last = NULL;
+	// values added by collectors directly
+	for (i = 0, n = set == NULL ? 0 : set->nsample; i < n; i++) {
+		x = &(set->sample[i]);
+		if (!selected(rc, x->name, x->nlen))
+			continue;
+		len = x->nlen + (x->llen > 0 ? x->llen + 2 : 0);
+		if (grow(&(rc->key), &(rc->keysz), len) == NULL)
+			break;
+		memcpy(rc->key, x->name, x->nlen);
+		if (x->llen > 0) {
+			rc->key[x->nlen] = '{';
+			memcpy(rc->key + x->nlen + 1, x->labels, x->llen);
+			rc->key[len - 1] = '}';
+		}
+		r = addSample(rc, rc->key, len, x->value,
+			x->snap != 0 ? x->snap : now);
+		// emitRate() adds to the set and might move its samples, but not the
+		// names they point to
+		if (r != NULL)
+			emitRate(rc, out, compact, rc->key, x->name, x->nlen, len, r);
+	}
+	rc->last = NULL;
+	// text output of all other collectors
+	end = psb_len(sb);
+	for (s = psb_str(sb) + start; s < psb_str(sb) + end; s = eol + 1) {
+		if ((eol = memchr(s, '\n', psb_str(sb) + end - s)) == NULL)
+			break;
+		if (*s == '#' || eol == s)
+			continue;
+		for (lbl = s; lbl < eol && *lbl != '{' && *lbl != ' '; lbl++)
+			;
+		nlen = lbl - s;
+		if (nlen == 0 || !selected(rc, s, nlen))
+			continue;
+		// the value is the last field
+		for (sp = eol - 1; sp > lbl && *sp != ' '; sp--)
+			;
+		if (*sp != ' ')
+			continue;
+		// kstat based metrics get the snaptime of their kstat, all others
+		// the time of the scrape
+		if ((t = expo_span_snap(s - psb_str(sb))) == 0)
+			t = now;
+		if ((r = addSample(rc, s, sp - s, strtod(sp + 1, NULL), t)) != NULL)
+			emitRate(rc, out, compact, s, s, nlen, sp - s, r);
+	}
+	psb_add_str(sb, psb_str(out));
+	psb_destroy(out);
+	expire(rc);
+
+	PROM_DEBUG("derive_rates done", "");
+}
@@ -0,0 +1,71 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file rates.h
+ * Derive per-second rates of selected counters on the exporter side.
+ */
+#ifndef SOLMEX_RATES_H
+#define SOLMEX_RATES_H
+
+#include <sys/time.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default number of samples to keep per series. */
+#define RATE_SAMPLES_DEFAULT 2
+/** Max. number of samples to keep per series. */
+#define RATE_SAMPLES_MAX 16
+/** Number of rounds a series may be absent before its samples get dropped. */
+#define RATE_KEEP_ROUNDS 10
+
+/**
+ * @brief Parse the given rate option string of the form `name[,...][:K]`.
+ * 	`name` is the name of a counter metric to derive the rate from. If it
+ * 	ends with a `*`, it gets used as prefix. `K` is the number of samples to
+ * 	keep per series (2..RATE_SAMPLES_MAX), the rate gets calculated over the
+ * 	oldest and the newest one.
+ * @param s	The string to parse.
+ * @param valid Gets set to @code 1 if the given string could be parsed
+ * 	successfully, to @code 0 otherwise.
+ * @return A reference to the config to be used in the derive_rates() call,
+ * 	`NULL` if disabled or on error.
+ */
+void *parse_rate_opts(const char *s, int *valid);
+
+/**
+ * @brief Scan the metrics added to the given buffer since the given offset
+ * 	and to expo_target (if set) and append a `*_rate` gauge for each series
+ * 	of a selected metric, for which at least 2 samples are available. The
+ * 	gauges get emitted via expo_emit_double(). A counter decrease drops all
+ * 	samples of the related series. The time of a sample is the snaptime of
+ * 	its kstat as stamped via expo_emit_times(), for sums over several kstats
+ * 	the most recent one recorded via expo_span_add(), `now` otherwise. A
+ * 	sample with the same time as the newest one does not advance the ring,
+ * 	so concurrent consumers do not narrow the window of each other.
+ * @param sb	The buffer containing the metrics of the current scrape.
+ * @param start	Offset of the 1st metric of the current scrape within `sb`.
+ * @param compact	whether to add HELP and TYPE comments
+ * @param now	The time of the scrape as delivered by gethrtime().
+ * @param cfg	The reference returned by parse_rate_opts().
+ */
+void derive_rates(psb_t *sb, size_t start, bool compact, hrtime_t now,
+	void *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_RATES_H
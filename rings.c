@@ -0,0 +1,433 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <kstat.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libprom/prom.h>
+
+#include "rings.h"
+#include "ks_util.h"
+#include "expo.h"
+
+// see also: usr/src/uts/common/io/mac/mac_stat.c (mac_ring_stat_create(),
+// mac_{rx,tx}_{hw,sw}lane_stat_create()). The module of these kstats is the
+// name of the link the ring belongs to.
+
+#define MAC_CLASS "net"
+
+typedef struct ring_kind {
+	const char *prefix;
+	size_t len;
+	const char *dir;
+	const char *type;
+	uint8_t tx;
+} ring_kind_t;
+
+static ring_kind_t kinds[] = {
+	{ "mac_rx_ring",	11, "rx", "ring",	0 },
+	{ "mac_rx_hwlane",	13, "rx", "hwlane",	0 },
+	{ "mac_rx_swlane",	13, "rx", "swlane",	0 },
+	{ "mac_tx_ring",	11, "tx", "ring",	1 },
+	{ "mac_tx_hwlane",	13, "tx", "hwlane",	1 },
+	{ "mac_tx_swlane",	13, "tx", "swlane",	1 },
+};
+static uint32_t kinds_sz = ARRAY_SIZE(kinds);
+
+typedef enum ring_idx {
+	RING_IDX_BYTES,
+	RING_IDX_PKTS,
+	RING_IDX_DROPS,		// lanes only
+	RING_IDX_MAX
+} ring_idx_t;
+
+/* kstat names by direction */
+static const char *knames[2][RING_IDX_MAX] = {
+	{ "rbytes", "ipackets", "rxsdrops" },
+	{ "obytes", "opackets", "txsdrops" },
+};
+
+/* solmex metric names */
+static const char *snames[] = {
+#define STRINGIFY(x) #x
+#define _S(x) STRINGIFY(x)
+	_S(SOLMEX_RING_BYTES_N), _S(SOLMEX_RING_PKTS_N), _S(SOLMEX_RING_DROPS_N),
+	NULL
+};
+
+/* metric HELP text */
+static const char *sdesc[] = {
+	SOLMEX_RING_BYTES_D, SOLMEX_RING_PKTS_D, SOLMEX_RING_DROPS_D, NULL
+};
+
+static const char *summary_suffix[] = { "_min", "_max", "_stddev" };
+static const char *summary_desc[] = {
+	" - min. over all rings of the NIC",
+	" - max. over all rings of the NIC",
+	" - population standard deviation over all rings of the NIC",
+};
+
+typedef struct ring {
+	kstat_t *ksp;
+	uint32_t kind;
+	uint32_t num;
+	uint32_t valid;		// bit i set if vals[i] is valid
+	uint64_t vals[RING_IDX_MAX];
+} ring_t;
+
+typedef struct ring_summary {
+	uint32_t n;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	double stddev;
+} ring_summary_t;
+
+typedef struct ring_group {
+	uint32_t first;		// index of the 1st ring in rings
+	uint32_t n;			// number of rings
+	ring_summary_t st[RING_IDX_MAX];
+} ring_group_t;
+
+#define RING_EXTENT 64
+
+static ring_t *rings = NULL;		// selected ring kstats, sorted by NIC,kind,num
+static uint32_t rings_sz = 0;
+static uint32_t rings_n = 0;
+static ring_group_t *groups = NULL;	// rings of the same NIC and kind
+static uint32_t groups_n = 0;
+static kid_t last_kid = -1;
+
+ring_stat_mode_t
+parse_ring_mode(const char *s) {
+	if (s == NULL)
+		return RINGSTAT_NONE;
+	if ((strcmp("n", s) == 0) || (strcmp("none", s) == 0)
+		|| (strcmp("0", s) == 0))
+	{
+		return RINGSTAT_NONE;
+	}
+	if ((strcmp("r", s) == 0) || (strcmp("ring", s) == 0)
+		|| (strcmp("1", s) == 0))
+	{
+		return RINGSTAT_RING;
+	}
+	if ((strcmp("s", s) == 0) || (strcmp("summary", s) == 0)
+		|| (strcmp("2", s) == 0))
+	{
+		return RINGSTAT_SUMMARY;
+	}
+	return RINGSTAT_FAIL;
+}
+
+static int
+cmp_ring(const void *a, const void *b) {
+	const ring_t *ra = a, *rb = b;
+	int res = strcmp(ra->ksp->ks_module, rb->ksp->ks_module);
+
+	if (res != 0)
+		return res;
+	if (ra->kind != rb->kind)
+		return ra->kind < rb->kind ? -1 : 1;
+	return ra->num < rb->num ? -1 : (ra->num > rb->num ? 1 : 0);
+}
+
+// Returns the kind index, if the given name is <prefix><number>, -1 otherwise.
+static int
+ring_kind(const char *name, uint32_t *num) {
+	uint32_t k;
+	char *e;
+
+	if (strncmp(name, "mac_", 4) != 0)
+		return -1;
+	for (k = 0; k < kinds_sz; k++) {
+		if (strncmp(name, kinds[k].prefix, kinds[k].len) != 0)
+			continue;
+		name += kinds[k].len;
+		if (*name < '0' || *name > '9')
+			return -1;
+		*num = strtoul(name, &e, 10);
+		return *e == '\0' ? (int) k : -1;
+	}
+	return -1;
+}
+
+// Walk the chain and remember the ring kstats of all selected NICs. Depending
+// on the number of NICs there may be several hundreds of them, so
+// update_instance() is not the right tool.
+static int
+update_rings(kstat_ctl_t *kc, nic_filter_chain_t *nfc) {
+	kstat_t *ksp;
+	uint32_t i, k, n = 0, nics_n = 0;
+	const char **nics = NULL;
+	bool *selected = NULL;
+	ring_group_t *g;
+	int kind;
+
+	if (kc->kc_chain_id == last_kid)
+		return rings_n;
+
+	rings_n = groups_n = 0;
+	for (ksp = kc->kc_chain; ksp != NULL; ksp = ksp->ks_next) {
+		uint32_t num;
+
+		if (ksp->ks_type != KSTAT_TYPE_NAMED
+			|| strcmp(ksp->ks_class, MAC_CLASS) != 0
+			|| (kind = ring_kind(ksp->ks_name, &num)) < 0)
+		{
+			continue;
+		}
+		if (n == rings_sz) {
+			ring_t *r = realloc(rings, (rings_sz + RING_EXTENT) * sizeof(ring_t));
+			if (r == NULL) {
+				PROM_WARN("Unable to allocate ring table: %s", strerror(errno));
+				return -1;	// try again later
+			}
+			rings = r;
+			rings_sz += RING_EXTENT;
+		}
+		rings[n].ksp = ksp;
+		rings[n].kind = kind;
+		rings[n].num = num;
+		n++;
+	}
+	if (n == 0) {
+		last_kid = kc->kc_chain_id;
+		return 0;
+	}
+	qsort(rings, n, sizeof(ring_t), cmp_ring);
+
+	// apply the NIC filter once per NIC
+	nics = malloc(n * sizeof(char *));
+	selected = malloc(n * sizeof(bool));
+	g = (nics == NULL || selected == NULL)
+		? NULL
+		: realloc(groups, n * sizeof(ring_group_t));
+	if (g == NULL) {
+		PROM_WARN("Unable to allocate ring table: %s", strerror(errno));
+		free(nics);
+		free(selected);
+		return -1;
+	}
+	groups = g;
+	for (i = 0; i < n; i++) {
+		if (nics_n == 0 || strcmp(nics[nics_n - 1], rings[i].ksp->ks_module))
+			nics[nics_n++] = rings[i].ksp->ks_module;
+	}
+	nic_filter_select(kc->kc_chain_id, nfc, nics, selected, nics_n);
+
+	for (i = 0, k = 0; i < n; i++) {
+		if (strcmp(nics[k], rings[i].ksp->ks_module) != 0)
+			k++;
+		if (!selected[k])
+			continue;
+		if (rings_n == 0 || rings[i].kind != rings[rings_n - 1].kind
+			|| strcmp(rings[i].ksp->ks_module,
+				rings[rings_n - 1].ksp->ks_module) != 0)
+		{
+			groups[groups_n].first = rings_n;
+			groups[groups_n].n = 0;
+			groups_n++;
+		}
+		groups[groups_n - 1].n++;
+		rings[rings_n++] = rings[i];
+	}
+	free(nics);
+	free(selected);
+	last_kid = kc->kc_chain_id;
+	return rings_n;
+}
+
+static void
+read_ring(kstat_ctl_t *kc, ring_t *r, hrtime_t now) {
+	kstat_t *ksp;
+	kstat_named_t *knp;
+	uint32_t i;
+	const char **names = knames[kinds[r->kind].tx];
+
+	r->valid = 0;
+	if ((ksp = ks_read(kc, r->ksp, now, NULL)) == NULL)
+		return;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+	for (i = 0; i < RING_IDX_MAX; i++) {
+		if ((knp = kstat_data_lookup(ksp, names[i])) == NULL)
+			continue;
+		r->vals[i] = knp->value.ui64;
+		r->valid |= 1 << i;
+	}
+#pragma GCC diagnostic pop
+}
+
+static void
+summarize(ring_group_t *g) {
+	uint32_t i, k;
+	ring_summary_t *s;
+
+	for (k = 0; k < RING_IDX_MAX; k++) {
+		double mean, sq = 0;
+
+		s = &(g->st[k]);
+		memset(s, 0, sizeof(ring_summary_t));
+		s->min = UINT64_MAX;
+		for (i = g->first; i < g->first + g->n; i++) {
+			if ((rings[i].valid & (1 << k)) == 0)
+				continue;
+			s->n++;
+			s->sum += rings[i].vals[k];
+			if (rings[i].vals[k] < s->min)
+				s->min = rings[i].vals[k];
+			if (rings[i].vals[k] > s->max)
+				s->max = rings[i].vals[k];
+		}
+		if (s->n == 0)
+			continue;
+		mean = (double) s->sum / s->n;
+		for (i = g->first; i < g->first + g->n; i++) {
+			if ((rings[i].valid & (1 << k)) == 0)
+				continue;
+			sq += (rings[i].vals[k] - mean) * (rings[i].vals[k] - mean);
+		}
+		s->stddev = sqrt(sq / s->n);
+	}
+}
+
+// Set lb to the labels of the given ring incl. its number if ring is set.
+static const char *
+add_labels(psb_t *lb, ring_t *r, bool ring) {
+	char buf[32];
+
+	psb_truncate(lb, 0);
+	psb_add_str(lb, "{nic=\"");
+	psb_add_str(lb, r->ksp->ks_module);
+	psb_add_str(lb, "\",dir=\"");
+	psb_add_str(lb, kinds[r->kind].dir);
+	psb_add_str(lb, "\",type=\"");
+	psb_add_str(lb, kinds[r->kind].type);
+	psb_add_char(lb, '"');
+	if (ring) {
+		sprintf(buf, ",ring=\"%u\"", r->num);
+		psb_add_str(lb, buf);
+	}
+	psb_add_char(lb, '}');
+	return psb_str(lb);
+}
+
+static void
+add_per_ring(psb_t *sb, psb_t *lb, bool compact) {
+	uint32_t i, k;
+
+	for (k = 0; k < RING_IDX_MAX; k++) {
+		bool seen = false;
+		for (i = 0; i < rings_n; i++) {
+			if ((rings[i].valid & (1 << k)) == 0)
+				continue;
+			if (!seen)
+				expo_emit_info(sb, compact, snames[k], "counter", sdesc[k]);
+			seen = true;
+			ks_emit_times(rings[i].ksp);
+			expo_emit_uint(sb, snames[k], add_labels(lb, &rings[i], true),
+				rings[i].vals[k]);
+		}
+	}
+	ks_emit_times(NULL);
+}
+
+static void
+add_summary(psb_t *sb, psb_t *lb, bool compact) {
+	uint32_t g, k, m;
+	char buf[64], name[128], desc[256];
+	const char *labels;
+	ring_summary_t *s;
+
+	expo_emit_info(sb, compact, _S(SOLMEX_RING_COUNT_N), SOLMEX_RING_COUNT_T,
+		SOLMEX_RING_COUNT_D);
+	for (g = 0; g < groups_n; g++)
+		expo_emit_uint(sb, _S(SOLMEX_RING_COUNT_N),
+			add_labels(lb, &rings[groups[g].first], false), groups[g].n);
+	for (k = 0; k < RING_IDX_MAX; k++) {
+		bool seen = false;
+		for (g = 0; g < groups_n; g++) {
+			s = &(groups[g].st[k]);
+			if (s->n == 0)
+				continue;
+			if (!seen)
+				expo_emit_info(sb, compact, snames[k], "counter", sdesc[k]);
+			seen = true;
+			expo_emit_uint(sb, snames[k],
+				add_labels(lb, &rings[groups[g].first], false), s->sum);
+		}
+		if (!seen)
+			continue;
+		for (m = 0; m < ARRAY_SIZE(summary_suffix); m++) {
+			snprintf(name, sizeof(name), "%s%s", snames[k], summary_suffix[m]);
+			snprintf(desc, sizeof(desc), "%s%s", sdesc[k], summary_desc[m]);
+			expo_emit_info(sb, compact, name, "gauge", desc);
+			for (g = 0; g < groups_n; g++) {
+				s = &(groups[g].st[k]);
+				if (s->n == 0)
+					continue;
+				labels = add_labels(lb, &rings[groups[g].first], false);
+				if (m == 0) {
+					expo_emit_uint(sb, name, labels, s->min);
+				} else if (m == 1) {
+					expo_emit_uint(sb, name, labels, s->max);
+				} else {
+					sprintf(buf, "%.4f", s->stddev);
+					expo_emit(sb, name, labels, buf, s->stddev);
+				}
+			}
+		}
+	}
+}
+
+void
+collect_rings(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
+	ring_stat_mode_t mode, nic_filter_chain_t *nfc)
+{
+	uint32_t i;
+
+	if (mode == RINGSTAT_NONE || mode == RINGSTAT_FAIL)
+		return;
+
+	PROM_DEBUG("collect_rings ...", "");
+	if (update_rings(kc, nfc) < 1)
+		return;
+
+	for (i = 0; i < rings_n; i++)
+		read_ring(kc, &rings[i], now);
+
+	psb_t *lb = psb_new();
+	if (lb == NULL)
+		return;
+
+	bool free_sb = sb == NULL;
+	if (free_sb)
+		sb = psb_new();
+
+	if (mode == RINGSTAT_RING) {
+		add_per_ring(sb, lb, compact);
+	} else {
+		for (i = 0; i < groups_n; i++)
+			summarize(&groups[i]);
+		add_summary(sb, lb, compact);
+	}
+	psb_destroy(lb);
+
+	if (free_sb) {
+		fprintf(stdout, "\n%s", psb_str(sb));
+		psb_destroy(sb);
+	}
+	PROM_DEBUG("collect_rings done", "");
+}
@@ -0,0 +1,62 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file rings.h
+ * Collect MAC layer ring and lane statistics of network interfaces.
+ */
+
+#ifndef SOLMEX_RINGS_H
+#define SOLMEX_RINGS_H
+
+#include <kstat.h>
+
+#include "common.h"
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum ring_stat_mode {
+	RINGSTAT_NONE = 0,
+	RINGSTAT_RING,		/**< One series per ring resp. lane */
+	RINGSTAT_SUMMARY,	/**< Sum, min, max and stddev over all rings of a NIC */
+	RINGSTAT_FAIL
+} ring_stat_mode_t;
+
+/**
+ * @brief Parse the given ring stat mode string.
+ * @param s	The string to parse.
+ * @return The related mode, `RINGSTAT_FAIL` if unknown.
+ */
+ring_stat_mode_t parse_ring_mode(const char *s);
+
+/**
+ * @brief Collect the `mac_{rx,tx}_ring*` and `mac_{rx,tx}_{hw,sw}lane*` stats
+ * 	of all NICs selected by the given NIC filter chain. The kstat chain gets
+ * 	scanned for ring kstats and the filter gets applied only if the chain has
+ * 	been changed.
+ * @param sb	where to add the stats.
+ * @param compact	whether to add HELP and TYPE comments
+ * @param kc	The kstat chain to use.
+ * @param now	The current time as delivered by gethrtime().
+ * @param mode	Whether to emit per-ring series or a per-NIC summary.
+ * @param nfc	NIC filter chain.
+ */
+void collect_rings(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
+	ring_stat_mode_t mode, nic_filter_chain_t *nfc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_RINGS_H
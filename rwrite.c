@@ -0,0 +1,591 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <netdb.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libprom/prom.h>
+
+#include "rwrite.h"
+
+// https://prometheus.io/docs/specs/prw/remote_write_spec/
+// https://github.com/prometheus/prometheus/blob/main/prompb/types.proto
+// https://github.com/google/snappy/blob/main/format_description.txt
+// https://docs.influxdata.com/influxdb/v2/api/#operation/PostWrite
+
+// push targets by URL scheme
+static const struct {
+	const char *scheme;
+	const char *port;		// default port
+	expo_format_t fmt;		// EXPO_FMT_TEXT: remote_write protobuf
+} targets[] = {
+	{ "http://", "80", EXPO_FMT_TEXT },
+	{ "influx://", "8086", EXPO_FMT_INFLUX },
+	{ "graphite://", "2003", EXPO_FMT_GRAPHITE },
+};
+
+typedef struct rw_cfg {
+	char *url;
+	char *host;
+	char *port;
+	char *path;
+	char *instance;
+	expo_format_t fmt;
+	uint32_t interval;		// in seconds
+	uint32_t batch;			// collection intervals per request
+	expo_scrape_fn scrape;
+	char *scratch;
+	expo_buf_t series;		// encoded TimeSeries of the current batch
+	uint32_t collected;		// collection intervals in series
+	expo_buf_t queue[RW_QUEUE_MAX];	// compressed WriteRequests or plain text
+	uint32_t head;
+	uint32_t count;
+	uint32_t backoff;		// current delay in seconds
+	time_t retry;			// do not send before
+	uint64_t dropped;
+} rw_cfg_t;
+
+typedef struct rw_label {
+	const char *name;
+	const char *value;
+	uint16_t nlen;
+	uint16_t vlen;
+	bool escaped;
+} rw_label_t;
+
+void *
+parse_rw_opts(const char *s, int *valid) {
+	rw_cfg_t *cfg;
+	char *t, *p;
+	unsigned int n, i;
+	struct utsname uts;
+
+	*valid = 0;
+	if (s == NULL)
+		return NULL;
+	if (strcmp(s, "none") == 0 || strcmp(s, "n") == 0 || strcmp(s, "0") == 0) {
+		*valid = 1;
+		return NULL;
+	}
+	if ((cfg = calloc(1, sizeof(rw_cfg_t))) == NULL
+		|| (cfg->url = strdup(s)) == NULL)
+	{
+		perror("remote-write");
+		free(cfg);
+		return NULL;
+	}
+	cfg->interval = RW_INTERVAL_DEFAULT;
+	cfg->batch = RW_BATCH_DEFAULT;
+	if ((t = strrchr(cfg->url, '@')) != NULL) {
+		*t++ = '\0';
+		if ((p = strchr(t, ',')) != NULL) {
+			*p++ = '\0';
+			if (sscanf(p, "%u", &n) != 1 || n < 1 || n > 100) {
+				fprintf(stderr, "Invalid batch size in '%s' (1..100).\n", s);
+				goto fail;
+			}
+			cfg->batch = n;
+		}
+		if (sscanf(t, "%u", &n) != 1 || n < 1 || n > 3600) {
+			fprintf(stderr, "Invalid push interval in '%s' (1..3600).\n", s);
+			goto fail;
+		}
+		cfg->interval = n;
+	}
+	for (i = 0; i < sizeof(targets)/sizeof(targets[0]); i++) {
+		n = strlen(targets[i].scheme);
+		if (strncmp(cfg->url, targets[i].scheme, n) == 0)
+			break;
+	}
+	if (i == sizeof(targets)/sizeof(targets[0]) || cfg->url[n] == '\0') {
+		fprintf(stderr, "Only http://, influx:// and graphite://host[:port]"
+			"[/path] URLs are supported, use a local proxy for https.\n");
+		goto fail;
+	}
+	cfg->fmt = targets[i].fmt;
+	t = cfg->url + n;
+	p = strchr(t, '/');
+	if ((cfg->path = strdup(p == NULL ? "/" : p)) == NULL
+		|| (cfg->host = p == NULL ? strdup(t) : strndup(t, p - t)) == NULL)
+	{
+		perror("remote-write");
+		goto fail;
+	}
+	if (cfg->host[0] == '[') {
+		// [IPv6 address][:port]
+		if ((p = strchr(cfg->host, ']')) == NULL) {
+			fprintf(stderr, "Invalid IPv6 address in '%s'.\n", s);
+			goto fail;
+		}
+		*p++ = '\0';
+		memmove(cfg->host, cfg->host + 1, strlen(cfg->host));
+		p = (*p == ':') ? p + 1 : NULL;
+	} else if ((p = strchr(cfg->host, ':')) != NULL) {
+		*p++ = '\0';
+	}
+	if ((cfg->port = strdup(p == NULL || *p == '\0' ? targets[i].port : p))
+			== NULL
+		|| (cfg->instance = strdup(uname(&uts) != -1 ? uts.nodename : ""))
+			== NULL)
+	{
+		perror("remote-write");
+		goto fail;
+	}
+	*valid = 1;
+	return cfg;
+
+fail:
+	free(cfg->url);
+	free(cfg->host);
+	free(cfg->port);
+	free(cfg->path);
+	free(cfg);
+	return NULL;
+}
+
+#define SNAPPY_BLOCK	65536
+#define SNAPPY_HBITS	14
+
+static void
+addLiteral(expo_buf_t *out, const uint8_t *s, size_t len) {
+	uint8_t tag[5];
+	size_t n = len - 1;
+
+	if (len == 0)
+		return;
+	if (n < 60) {
+		tag[0] = n << 2;
+		expo_buf_add(out, tag, 1);
+	} else if (n < 256) {
+		tag[0] = 60 << 2;
+		tag[1] = n;
+		expo_buf_add(out, tag, 2);
+	} else if (n < 65536) {
+		tag[0] = 61 << 2;
+		tag[1] = n & 0xFF;
+		tag[2] = n >> 8;
+		expo_buf_add(out, tag, 3);
+	} else {
+		tag[0] = 63 << 2;
+		tag[1] = n & 0xFF;
+		tag[2] = (n >> 8) & 0xFF;
+		tag[3] = (n >> 16) & 0xFF;
+		tag[4] = (n >> 24) & 0xFF;
+		expo_buf_add(out, tag, 5);
+	}
+	expo_buf_add(out, s, len);
+}
+
+// copy with a 2-byte offset, 4..64 bytes each
+static void
+addCopy(expo_buf_t *out, size_t offset, size_t len) {
+	uint8_t tag[3];
+	size_t n;
+
+	while (len > 0) {
+		// never leave less than 4 bytes for the last copy
+		n = len > 64 ? (len - 64 < 4 ? 60 : 64) : len;
+		tag[0] = ((n - 1) << 2) | 2;
+		tag[1] = offset & 0xFF;
+		tag[2] = offset >> 8;
+		expo_buf_add(out, tag, 3);
+		len -= n;
+	}
+}
+
+static uint32_t
+load32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+void
+snappy_compress(expo_buf_t *out, const uint8_t *in, size_t len) {
+	uint16_t table[1 << SNAPPY_HBITS];
+	size_t blen, ip, lit, cand, m;
+	const uint8_t *b;
+	uint32_t h;
+
+	pb_varint(out, len);
+	for (; len > 0; in += blen, len -= blen) {
+		blen = len > SNAPPY_BLOCK ? SNAPPY_BLOCK : len;
+		b = in;
+		memset(table, 0, sizeof(table));
+		for (ip = lit = 0; ip + 4 <= blen; ) {
+			h = (load32(b + ip) * 0x1E35A7BD) >> (32 - SNAPPY_HBITS);
+			cand = table[h];
+			table[h] = ip;
+			if (cand >= ip || load32(b + cand) != load32(b + ip)) {
+				ip++;
+				continue;
+			}
+			for (m = 4; ip + m < blen && b[cand + m] == b[ip + m]; m++)
+				;
+			addLiteral(out, b + lit, ip - lit);
+			addCopy(out, ip - cand, m);
+			ip += m;
+			lit = ip;
+		}
+		addLiteral(out, b + lit, blen - lit);
+	}
+}
+
+#undef SNAPPY_BLOCK
+#undef SNAPPY_HBITS
+
+static int
+cmpLabel(const rw_label_t *a, const rw_label_t *b) {
+	size_t n = a->nlen < b->nlen ? a->nlen : b->nlen;
+	int r = memcmp(a->name, b->name, n);
+
+	return r != 0 ? r : (int) a->nlen - (int) b->nlen;
+}
+
+// WriteRequest: 1 timeseries
+// TimeSeries: 1 labels {1 name, 2 value}, 2 samples {1 value, 2 timestamp}
+static void
+addSeries(rw_cfg_t *cfg, const expo_set_t *set, int64_t now) {
+	expo_label_t l[EXPO_LABELS_MAX];
+	rw_label_t x[EXPO_LABELS_MAX + 3], tmp;
+	expo_buf_t ts = { NULL, 0, 0, false }, sub = { NULL, 0, 0, false };
+	const expo_sample_t *s;
+	uint32_t i;
+	int j, k, n;
+	bool job, instance;
+
+	for (i = 0; i < set->nsample; i++) {
+		s = &(set->sample[i]);
+		n = expo_labels(s, l);
+		x[0].name = "__name__";
+		x[0].nlen = 8;
+		x[0].value = s->name;
+		x[0].vlen = s->nlen;
+		x[0].escaped = false;
+		job = instance = false;
+		for (j = 0, k = 1; j < n; j++, k++) {
+			x[k].name = l[j].name;
+			x[k].nlen = l[j].nlen;
+			x[k].value = l[j].value;
+			x[k].vlen = l[j].vlen;
+			x[k].escaped = true;
+			job |= l[j].nlen == 3 && strncmp(l[j].name, "job", 3) == 0;
+			instance |= l[j].nlen == 8 && strncmp(l[j].name, "instance", 8) == 0;
+		}
+		if (!job) {
+			x[k].name = "job";
+			x[k].nlen = 3;
+			x[k].value = "solmex";
+			x[k].vlen = 6;
+			x[k++].escaped = false;
+		}
+		if (!instance) {
+			x[k].name = "instance";
+			x[k].nlen = 8;
+			x[k].value = cfg->instance;
+			x[k].vlen = strlen(cfg->instance);
+			x[k++].escaped = false;
+		}
+		// receivers require the labels to be sorted by name
+		for (j = 1; j < k; j++) {
+			tmp = x[j];
+			for (n = j - 1; n >= 0 && cmpLabel(&(x[n]), &tmp) > 0; n--)
+				x[n + 1] = x[n];
+			x[n + 1] = tmp;
+		}
+		ts.len = 0;
+		for (j = 0; j < k; j++) {
+			sub.len = 0;
+			pb_bytes(&sub, 1, x[j].name, x[j].nlen);
+			if (x[j].escaped)
+				pb_bytes(&sub, 2, cfg->scratch,
+					expo_unescape(cfg->scratch, x[j].value, x[j].vlen));
+			else
+				pb_bytes(&sub, 2, x[j].value, x[j].vlen);
+			pb_msg(&ts, 1, &sub);
+		}
+		sub.len = 0;
+		pb_double(&sub, 1, s->value);
+		pb_uint64(&sub, 2, (uint64_t) (s->ts != 0 ? s->ts : now));
+		pb_msg(&ts, 2, &sub);
+		pb_msg(&(cfg->series), 1, &ts);
+	}
+	expo_buf_reset(&ts);
+	expo_buf_reset(&sub);
+}
+
+static bool
+writeAll(int fd, const void *data, size_t len) {
+	const char *p = data;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, p, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static int
+connectTo(rw_cfg_t *cfg) {
+	struct addrinfo hints, *res, *ai;
+	struct timeval tv = { RW_TIMEOUT, 0 };
+	struct pollfd pfd;
+	int fd = -1, err, flags;
+	socklen_t len;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if ((err = getaddrinfo(cfg->host, cfg->port, &hints, &res)) != 0) {
+		PROM_WARN("Unable to resolve '%s': %s", cfg->host, gai_strerror(err));
+		return -1;
+	}
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+			continue;
+		flags = fcntl(fd, F_GETFL);
+		(void) fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+		err = 0;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == -1) {
+			err = errno;
+			if (err == EINPROGRESS) {
+				pfd.fd = fd;
+				pfd.events = POLLOUT;
+				len = sizeof(err);
+				if (poll(&pfd, 1, RW_TIMEOUT * 1000) != 1
+					|| getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+				{
+					err = ETIMEDOUT;
+				}
+			}
+		}
+		if (err == 0) {
+			(void) fcntl(fd, F_SETFL, flags);
+			(void) setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+			(void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+			break;
+		}
+		(void) close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	if (fd == -1)
+		PROM_WARN("Unable to connect to %s:%s", cfg->host, cfg->port);
+	return fd;
+}
+
+// Return the HTTP status code of the response, -1 on network errors.
+static int
+post(rw_cfg_t *cfg, const expo_buf_t *body) {
+	char buf[512];
+	int fd, n, len = 0, status = -1;
+	bool v6;
+
+	if ((fd = connectTo(cfg)) == -1)
+		return -1;
+	if (cfg->fmt == EXPO_FMT_GRAPHITE) {
+		// plain TCP without any response
+		status = writeAll(fd, body->b, body->len) ? 200 : -1;
+		if (status == -1)
+			PROM_WARN("Unable to send metrics: %s", strerror(errno));
+		(void) close(fd);
+		return status;
+	}
+	// IPv6 literals need brackets (RFC 7230, 5.4)
+	v6 = strchr(cfg->host, ':') != NULL;
+	n = snprintf(buf, sizeof(buf), "POST %s HTTP/1.1\r\n"
+		"Host: %s%s%s:%s\r\n"
+		"User-Agent: solmex/" VERSION "\r\n"
+		"%s"
+		"Content-Length: %lu\r\n"
+		"Connection: close\r\n\r\n",
+		cfg->path, v6 ? "[" : "", cfg->host, v6 ? "]" : "", cfg->port,
+		cfg->fmt == EXPO_FMT_INFLUX
+			? "Content-Type: text/plain; charset=utf-8\r\n"
+			: "Content-Type: application/x-protobuf\r\n"
+			"Content-Encoding: snappy\r\n"
+			"X-Prometheus-Remote-Write-Version: 0.1.0\r\n",
+		(unsigned long) body->len);
+	if (n >= (int) sizeof(buf) || !writeAll(fd, buf, n)
+		|| !writeAll(fd, body->b, body->len))
+	{
+		PROM_WARN("Unable to send remote write request: %s", strerror(errno));
+		(void) close(fd);
+		return -1;
+	}
+	// the status line is all we need
+	while (len < (int) sizeof(buf) - 1
+		&& (n = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0)
+	{
+		len += n;
+		buf[len] = '\0';
+		if (strstr(buf, "\r\n") != NULL)
+			break;
+	}
+	buf[len] = '\0';
+	if (sscanf(buf, "HTTP/%*d.%*d %d", &status) != 1) {
+		PROM_WARN("No valid response from %s:%s", cfg->host, cfg->port);
+		status = -1;
+	}
+	(void) close(fd);
+	return status;
+}
+
+// Compress the current batch into a new request (remote_write only). Drops the
+// oldest request if the queue is full.
+static void
+enqueue(rw_cfg_t *cfg) {
+	expo_buf_t *q;
+
+	if (cfg->series.len == 0)
+		return;
+	if (cfg->count == RW_QUEUE_MAX) {
+		expo_buf_reset(&(cfg->queue[cfg->head]));
+		cfg->head = (cfg->head + 1) % RW_QUEUE_MAX;
+		cfg->count--;
+		cfg->dropped++;
+		PROM_WARN("Remote write queue full - %lu requests dropped so far.",
+			(unsigned long) cfg->dropped);
+	}
+	q = &(cfg->queue[(cfg->head + cfg->count) % RW_QUEUE_MAX]);
+	q->len = 0;
+	if (cfg->fmt == EXPO_FMT_TEXT)
+		snappy_compress(q, cfg->series.b, cfg->series.len);
+	else
+		expo_buf_add(q, cfg->series.b, cfg->series.len);
+	if (q->err) {
+		expo_buf_reset(q);
+	} else {
+		cfg->count++;
+	}
+	cfg->series.len = 0;
+	cfg->collected = 0;
+}
+
+static void
+flush(rw_cfg_t *cfg) {
+	expo_buf_t *q;
+	int status;
+
+	while (cfg->count > 0 && time(NULL) >= cfg->retry) {
+		q = &(cfg->queue[cfg->head]);
+		status = post(cfg, q);
+		if (status >= 200 && status < 300) {
+			cfg->backoff = 0;
+		} else if (status >= 400 && status < 500 && status != 429) {
+			// retrying would not help
+			PROM_WARN("Remote write request rejected (%d) - dropped.", status);
+		} else {
+			cfg->backoff = cfg->backoff == 0 ? 1 : cfg->backoff * 2;
+			if (cfg->backoff > RW_BACKOFF_MAX)
+				cfg->backoff = RW_BACKOFF_MAX;
+			cfg->retry = time(NULL) + cfg->backoff;
+			PROM_DEBUG("Remote write failed (%d), retry in %us", status,
+				cfg->backoff);
+			return;
+		}
+		expo_buf_reset(q);
+		cfg->head = (cfg->head + 1) % RW_QUEUE_MAX;
+		cfg->count--;
+	}
+}
+
+static void *
+rw_pusher(void *arg) {
+	rw_cfg_t *cfg = (rw_cfg_t *) arg;
+	const expo_encoder_t *enc = expo_encoder(cfg->fmt);
+	struct timespec next, ts;
+	expo_set_t *set;
+	int64_t now;
+	char *text;
+	size_t len;
+
+	(void) clock_gettime(CLOCK_REALTIME, &next);
+	while (1) {
+		text = cfg->scrape(&set, &len);
+		if (set != NULL) {
+			(void) clock_gettime(CLOCK_REALTIME, &ts);
+			now = (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+			if (cfg->fmt == EXPO_FMT_TEXT)
+				addSeries(cfg, set, now);
+			else
+				(void) enc->encode(&(cfg->series), set, now, cfg->instance);
+			expo_free(set);
+			cfg->collected++;
+		}
+		free(text);
+		if (cfg->collected >= cfg->batch || cfg->series.err) {
+			if (cfg->series.err)
+				expo_buf_reset(&(cfg->series));
+			else
+				enqueue(cfg);
+			cfg->collected = 0;
+		}
+		flush(cfg);
+
+		next.tv_sec += cfg->interval;
+		(void) clock_gettime(CLOCK_REALTIME, &ts);
+		if (ts.tv_sec > next.tv_sec) {
+			// fell behind, e.g. because the receiver did not answer in time
+			next = ts;
+			continue;
+		}
+		ts.tv_sec = next.tv_sec - ts.tv_sec;
+		ts.tv_nsec = 0;
+		while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+			;
+	}
+	return NULL;
+}
+
+int
+rw_start(void *config, expo_scrape_fn fn) {
+	rw_cfg_t *cfg = (rw_cfg_t *) config;
+	pthread_attr_t attr;
+	pthread_t tid;
+	int res;
+
+	if (cfg == NULL || fn == NULL)
+		return 1;
+	if ((cfg->scratch = malloc(UINT16_MAX + 1)) == NULL) {
+		PROM_WARN("Unable to allocate remote write buffer: %s",
+			strerror(errno));
+		return 1;
+	}
+	cfg->scrape = fn;
+	// a receiver closing the connection early must not kill the exporter
+	(void) signal(SIGPIPE, SIG_IGN);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	res = pthread_create(&tid, &attr, rw_pusher, cfg);
+	pthread_attr_destroy(&attr);
+	if (res != 0) {
+		PROM_WARN("Unable to create remote write thread: %s", strerror(res));
+		return 1;
+	}
+	PROM_INFO("Pushing metrics every %us to %s", cfg->interval, cfg->url);
+	return 0;
+}
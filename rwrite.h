@@ -0,0 +1,74 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file rwrite.h
+ * Push the collected metrics via the Prometheus remote_write protocol, the
+ * InfluxDB line protocol or the Graphite plaintext protocol.
+ */
+#ifndef SOLMEX_RWRITE_H
+#define SOLMEX_RWRITE_H
+
+#include "expo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default collection interval in seconds. */
+#define RW_INTERVAL_DEFAULT 15
+/** Default number of collection intervals to send per request. */
+#define RW_BATCH_DEFAULT 4
+/** Max. number of requests to keep while the receiver is unavailable. */
+#define RW_QUEUE_MAX 64
+/** Max. delay in seconds between two attempts to send a request. */
+#define RW_BACKOFF_MAX 120
+/** Timeout in seconds for connecting and talking to the receiver. */
+#define RW_TIMEOUT 10
+
+/**
+ * @brief Parse the given remote write option string of the form
+ * 	`scheme://host[:port][/path][@secs[,N]]`. `secs` is the collection
+ * 	interval, `N` the number of collection intervals to send per request.
+ * 	The scheme selects the protocol: `http` (Prometheus remote_write, port 80),
+ * 	`influx` (line protocol via HTTP POST, port 8086) or `graphite` (plain
+ * 	TCP, port 2003).
+ * @param s	The string to parse.
+ * @param valid Gets set to @code 1 if the given string could be parsed
+ * 	successfully, to @code 0 otherwise.
+ * @return A reference to the config to be used in the rw_start() call,
+ * 	`NULL` if disabled or on error.
+ */
+void *parse_rw_opts(const char *s, int *valid);
+
+/**
+ * @brief Start the background thread, which collects all metrics every
+ * 	interval via the given function and pushes them in batches to the
+ * 	configured receiver. Requests, which could not be sent, get queued and
+ * 	retried with exponential backoff. If the queue is full, the oldest request
+ * 	gets dropped.
+ * @param cfg	The reference returned by parse_rw_opts().
+ * @param fn	The function to use to collect the metrics.
+ * @return `0` on success, `1` otherwise.
+ */
+int rw_start(void *cfg, expo_scrape_fn fn);
+
+/**
+ * @brief Append the Snappy (block format) compressed `len` bytes of `in` to
+ * 	the given buffer.
+ */
+void snappy_compress(expo_buf_t *out, const uint8_t *in, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_RWRITE_H
@@ -0,0 +1,189 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file solmex_plugin.h
+ * The ABI of collector plugins, which solmex loads via dlopen(3C).
+ *
+ * A plugin is a shared object, which exports a `solmex_plugin_t` named
+ * `solmex_plugin` (see SOLMEX_PLUGIN_SYM). It gets linked against libprom
+ * and - if it uses kstats - libkstat, e.g.:
+ * @code
+ *	#include <solmex/solmex_plugin.h>
+ *
+ *	static const solmex_api_t *solmex;
+ *
+ *	static void *
+ *	init(const solmex_api_t *api, const char *opts, int *valid)
+ *	{
+ *		solmex = api;
+ *		return NULL;
+ *	}
+ *
+ *	static void
+ *	collect(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
+ *		void *cfg)
+ *	{
+ *		solmex->emit_info(sb, compact, "site_foo", "gauge", "Foo.");
+ *		solmex->emit_uint(sb, "site_foo", NULL, 1);
+ *	}
+ *
+ *	const solmex_plugin_t solmex_plugin = {
+ *		.abi = SOLMEX_PLUGIN_ABI,
+ *		.name = "foo",
+ *		.init = init,
+ *		.collect = collect,
+ *	};
+ * @endcode
+ * and gets compiled with `gcc -shared -fPIC -o foo.so foo.c -lprom`.
+ *
+ * Plugins using kstats should look them up and read them via the
+ * `solmex_api_t` functions passed to init(), so that they share the lookup
+ * cache and EAGAIN handling of the builtin collectors.
+ */
+#ifndef SOLMEX_PLUGIN_H
+#define SOLMEX_PLUGIN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <kstat.h>
+
+#include <libprom/prom_string_builder.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The version of the plugin ABI. It gets incremented on any incompatible
+ * change of this file. solmex refuses to load plugins built for another one.
+ */
+#define SOLMEX_PLUGIN_ABI 2
+
+/** The name of the symbol solmex looks up in a plugin. */
+#define SOLMEX_PLUGIN_SYM "solmex_plugin"
+
+/**
+ * At least modul or name are required to be != NULL.
+ */
+typedef struct ks_info {
+	char *module;		/**< the module name to lookup. */
+	int instance;		/**< the instance to lookup, or -1 if all */
+	char *name;			/**< the statistic name to lookup, or NULL if all */
+	kid_t last_kid;		/**< Id of the kstat chain where ksp entries belong to */
+	uint32_t entries;	/**< number of instances found and stored in ksp below */
+	kstat_t **ksp;		/**< the kstat instance[s] holding the related data */
+} ks_info_t;
+
+/** The functions solmex provides to plugins. */
+typedef struct solmex_api {
+	/**
+	 * @brief Update the instances described by the given ks_info_t, see
+	 * 	update_instance() in ks_util.h. Initialize `last_kid` with `-1`,
+	 * 	release `ksp` via free(3C) in fini().
+	 * @return The number of instances found, `-1` on error.
+	 */
+	int (*update_instance)(kstat_ctl_t *kc, ks_info_t *ks);
+	/**
+	 * @brief Read the given kstat retrying on EAGAIN, see ks_read() in
+	 * 	ks_util.h. Skips the read, if the data are less than 1s old.
+	 * @return `NULL` on error, ksp otherwise.
+	 */
+	kstat_t *(*ks_read)(kstat_ctl_t *kc, kstat_t *ksp, hrtime_t now,
+		void *data);
+	/**
+	 * @brief Get the kstat chain solmex uses for the current scrape, i.e. the
+	 * 	one passed to collect(). It may be closed and re-opened between two
+	 * 	scrapes, so a plugin must not keep it.
+	 * @return `NULL` if called outside of collect(), or if kstats are
+	 * 	disabled or not available.
+	 */
+	kstat_ctl_t *(*kstat_chain)(void);
+	/**
+	 * @brief Emit the HELP and TYPE of a metric family, see expo_emit_info()
+	 * 	in expo.h. The emit functions write to `sb` in the Prometheus text
+	 * 	format or - if another format got requested - pass the values to its
+	 * 	encoder directly, so that solmex does not need to parse them.
+	 * @param type	`counter`, `gauge`, `summary`, `histogram` or `untyped`.
+	 * @param help	The HELP text escaped as in the text format.
+	 */
+	void (*emit_info)(psb_t *sb, bool compact, const char *name,
+		const char *type, const char *help);
+	/**
+	 * @brief Emit a sample, see expo_emit_uint() in expo.h.
+	 * @param labels	The labels incl. the braces (values escaped as in the
+	 * 	text format), `NULL` if none.
+	 */
+	void (*emit_uint)(psb_t *sb, const char *name, const char *labels,
+		uint64_t v);
+	/** @brief Same as emit_uint(), but for a signed value. */
+	void (*emit_int)(psb_t *sb, const char *name, const char *labels,
+		int64_t v);
+	/** @brief Same as emit_uint(), but for a floating point value. */
+	void (*emit_double)(psb_t *sb, const char *name, const char *labels,
+		double v);
+} solmex_api_t;
+
+/** The description of a plugin. */
+typedef struct solmex_plugin {
+	/** Set to SOLMEX_PLUGIN_ABI. */
+	uint32_t abi;
+	/** The name of the plugin used in messages. */
+	const char *name;
+	/** A short description of the options accepted, might be `NULL`. */
+	const char *usage;
+	/**
+	 * @brief Parse the options of the plugin. Gets called once while solmex
+	 * 	parses its command line, i.e. before it daemonizes. So it must not
+	 * 	start any threads - use start() instead. Might be `NULL`.
+	 * @param api	The functions solmex provides. Valid until fini().
+	 * @param opts	The options given on the command line, `NULL` if none.
+	 * @param valid	Set it to `0` if the options are not acceptable.
+	 * @return The config to pass to start(), collect() and fini().
+	 */
+	void *(*init)(const solmex_api_t *api, const char *opts, int *valid);
+	/**
+	 * @brief Start background work like threads. Gets called once after
+	 * 	solmex has daemonized (if at all) and before the first scrape.
+	 * 	Might be `NULL`.
+	 * @param cfg	The config returned by init().
+	 * @return `0` on success, any other value disables the plugin.
+	 */
+	int (*start)(void *cfg);
+	/**
+	 * @brief Emit the metrics of the plugin via the solmex_api_t emit
+	 * 	functions or append them to `sb` in the Prometheus text format. The
+	 * 	latter needs to be parsed, if another format got requested. Gets
+	 * 	called on each scrape by the scraping thread. Must not block.
+	 * @param sb	Where to add the metrics.
+	 * @param compact	If `true`, HELP and TYPE comments should be omitted.
+	 * @param kc	The kstat chain solmex uses, already updated for this
+	 * 	scrape. `NULL` if kstats are disabled or not available. The plugin
+	 * 	must neither update nor close it.
+	 * @param now	The time of this scrape as delivered by gethrtime().
+	 * @param cfg	The config returned by init().
+	 */
+	void (*collect)(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
+		void *cfg);
+	/**
+	 * @brief Release all resources of the plugin. Gets called when solmex
+	 * 	exits. Might be `NULL`.
+	 * @param cfg	The config returned by init().
+	 */
+	void (*fini)(void *cfg);
+} solmex_plugin_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_PLUGIN_H
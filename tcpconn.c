@@ -0,0 +1,338 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stropts.h>
+#include <sys/tihdr.h>
+#include <netinet/in.h>
+#include <inet/mib2.h>
+#include <stropts.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libprom/prom.h>
+
+#include "tcpconn.h"
+#include "expo.h"
+
+// see also: usr/src/cmd/cmd-inet/usr.bin/netstat/netstat.c (mibget())
+
+#define MIB_DEV "/dev/arp"
+#define CHUNK_SZ (64 * 1024)
+
+/* tcpConnState values 1..12, everything else goes to slot 0 */
+static const char *states[] = {
+	"other", "closed", "listen", "syn_sent", "syn_received", "established",
+	"fin_wait_1", "fin_wait_2", "close_wait", "last_ack", "closing",
+	"time_wait", "delete_tcb"
+};
+#define STATE_MAX ARRAY_SIZE(states)
+
+typedef struct tcpconn_cfg {
+	uint16_t interval;
+	uint16_t nports;
+	uint16_t ports[TCPCONN_PORTS_MAX];
+	uint8_t *slot;			/**< port -> index into counts, 0 .. other */
+	uint32_t *counts;		/**< [state][slot] of the last scan */
+	hrtime_t last;			/**< time of the last scan */
+	bool valid;				/**< whether counts are from a successful scan */
+	int fd;					/**< /dev/arp with tcp pushed, -1 if not open */
+	char *buf;				/**< CHUNK_SZ stream buffer */
+} tcpconn_cfg_t;
+
+#define COUNT(cfg, state, slot)	\
+	((cfg)->counts[(state) * ((cfg)->nports + 1) + (slot)])
+
+void *
+parse_tcpconn_opts(const char *s, int *valid) {
+	tcpconn_cfg_t *cfg;
+	char *buf, *t, *e;
+	unsigned int n;
+
+	*valid = 0;
+	if (s == NULL)
+		return NULL;
+	if (strcmp(s, "none") == 0 || strcmp(s, "n") == 0 || strcmp(s, "0") == 0) {
+		*valid = 1;
+		return NULL;
+	}
+	if ((cfg = calloc(1, sizeof(tcpconn_cfg_t))) == NULL
+		|| (buf = strdup(s)) == NULL)
+	{
+		perror("tcpconn");
+		free(cfg);
+		return NULL;
+	}
+	cfg->interval = TCPCONN_INTERVAL_DEFAULT;
+	cfg->fd = -1;
+	if ((t = strrchr(buf, ':')) != NULL) {
+		*t = '\0';
+		if (sscanf(t + 1, "%u", &n) != 1 || n == 0 || n > UINT16_MAX) {
+			fprintf(stderr, "Invalid tcp connection scan interval in '%s'.\n", s);
+			goto fail;
+		}
+		cfg->interval = n;
+	}
+	for (t = buf; *t != '\0'; t = e) {
+		if ((e = strchr(t, ',')) != NULL)
+			*e++ = '\0';
+		else
+			e = t + strlen(t);
+		if (*t == '\0' || strcmp(t, "all") == 0)
+			continue;
+		if (sscanf(t, "%u", &n) != 1 || n == 0 || n > UINT16_MAX) {
+			fprintf(stderr, "Invalid tcp port '%s'.\n", t);
+			goto fail;
+		}
+		if (cfg->nports == TCPCONN_PORTS_MAX) {
+			fprintf(stderr, "Too many tcp ports (max. %d).\n", TCPCONN_PORTS_MAX);
+			goto fail;
+		}
+		cfg->ports[cfg->nports++] = n;
+	}
+	cfg->slot = calloc(UINT16_MAX + 1, sizeof(uint8_t));
+	cfg->counts = calloc(STATE_MAX * (cfg->nports + 1), sizeof(uint32_t));
+	cfg->buf = malloc(CHUNK_SZ);
+	if (cfg->slot == NULL || cfg->counts == NULL || cfg->buf == NULL) {
+		perror("tcpconn");
+		goto fail;
+	}
+	for (n = 0; n < cfg->nports; n++) {
+		if (cfg->slot[cfg->ports[n]] == 0)
+			cfg->slot[cfg->ports[n]] = n + 1;
+	}
+	free(buf);
+	*valid = 1;
+	return cfg;
+
+fail:
+	free(buf);
+	free(cfg->slot);
+	free(cfg->counts);
+	free(cfg->buf);
+	free(cfg);
+	return NULL;
+}
+
+static int
+mib_open(void) {
+	int fd = open(MIB_DEV, O_RDWR);
+
+	if (fd == -1) {
+		PROM_WARN("Unable to open %s: %s", MIB_DEV, strerror(errno));
+		return -1;
+	}
+	if (ioctl(fd, I_PUSH, "tcp") == -1) {
+		PROM_WARN("Unable to push tcp module onto %s: %s", MIB_DEV,
+			strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int
+mib_request(int fd) {
+	char buf[sizeof(struct T_optmgmt_req) + sizeof(struct opthdr)];
+	struct T_optmgmt_req *req = (struct T_optmgmt_req *) buf;
+	struct opthdr *opt = (struct opthdr *) &req[1];
+	struct strbuf ctl;
+
+	req->PRIM_type = T_SVR4_OPTMGMT_REQ;
+	req->OPT_offset = sizeof(struct T_optmgmt_req);
+	req->OPT_length = sizeof(struct opthdr);
+	req->MGMT_flags = T_CURRENT;
+	opt->level = MIB2_IP;
+	opt->name = 0;
+	opt->len = 0;
+
+	ctl.buf = buf;
+	ctl.len = req->OPT_offset + req->OPT_length;
+	return putmsg(fd, &ctl, NULL, 0);
+}
+
+static inline void
+account(tcpconn_cfg_t *cfg, int state, uint32_t port) {
+	if (state < 0 || state >= (int) STATE_MAX)
+		state = 0;
+	COUNT(cfg, state, cfg->slot[port & 0xFFFF])++;
+}
+
+// Process all complete entries in buf and return the number of bytes consumed.
+static size_t
+parse_entries(tcpconn_cfg_t *cfg, char *buf, size_t len, size_t esz, bool v6) {
+	size_t off;
+
+	for (off = 0; off + esz <= len; off += esz) {
+		if (v6) {
+			mib2_tcp6ConnEntry_t *e = (mib2_tcp6ConnEntry_t *) (buf + off);
+			account(cfg, e->tcp6ConnState, e->tcp6ConnLocalPort);
+		} else {
+			mib2_tcpConnEntry_t *e = (mib2_tcpConnEntry_t *) (buf + off);
+			account(cfg, e->tcpConnState, e->tcpConnLocalPort);
+		}
+	}
+	return off;
+}
+
+// Read the data part of the current item through the fixed size stream buffer.
+// Items other than the TCP connection tables get just drained.
+static int
+read_item(tcpconn_cfg_t *cfg, struct opthdr *opt, size_t *esz4, size_t *esz6) {
+	struct strbuf data;
+	size_t rest = 0, esz = 0;
+	int flags, rc;
+	bool v6 = false, conn = false, tcp = false;
+
+	if (opt->level == MIB2_TCP && opt->name == 0) {
+		tcp = true;
+	} else if (opt->level == MIB2_TCP && opt->name == MIB2_TCP_CONN) {
+		conn = true;
+		esz = *esz4;
+	} else if (opt->level == MIB2_TCP6 && opt->name == MIB2_TCP6_CONN) {
+		conn = v6 = true;
+		esz = *esz6;
+	}
+	// should never happen, but be paranoid wrt. a broken table size
+	if (conn && (esz == 0 || esz > CHUNK_SZ))
+		esz = v6 ? sizeof(mib2_tcp6ConnEntry_t) : sizeof(mib2_tcpConnEntry_t);
+
+	do {
+		data.buf = cfg->buf + rest;
+		data.maxlen = CHUNK_SZ - rest;
+		data.len = 0;
+		flags = 0;
+		if ((rc = getmsg(cfg->fd, NULL, &data, &flags)) < 0)
+			return -1;
+		if (data.len <= 0)
+			continue;
+		if (tcp && rest == 0 && (size_t) data.len >= sizeof(mib2_tcp_t)) {
+			mib2_tcp_t *t = (mib2_tcp_t *) cfg->buf;
+			*esz4 = t->tcpConnTableSize;
+			*esz6 = t->tcp6ConnTableSize;
+			tcp = false;
+		}
+		if (!conn)
+			continue;
+		rest += data.len;
+		size_t used = parse_entries(cfg, cfg->buf, rest, esz, v6);
+		rest -= used;
+		if (rest > 0)
+			memmove(cfg->buf, cfg->buf + used, rest);
+	} while (rc == MOREDATA);
+	return 0;
+}
+
+static int
+scan(tcpconn_cfg_t *cfg) {
+	char cbuf[512];
+	struct T_optmgmt_ack *ack = (struct T_optmgmt_ack *) cbuf;
+	struct T_error_ack *err = (struct T_error_ack *) cbuf;
+	struct opthdr *opt;
+	struct strbuf ctl;
+	size_t esz4 = 0, esz6 = 0;
+	int flags, rc;
+
+	if (cfg->fd == -1 && (cfg->fd = mib_open()) == -1)
+		return -1;
+	if (mib_request(cfg->fd) == -1) {
+		PROM_WARN("mib2 request failed: %s", strerror(errno));
+		goto fail;
+	}
+	memset(cfg->counts, 0, STATE_MAX * (cfg->nports + 1) * sizeof(uint32_t));
+	for (;;) {
+		ctl.buf = cbuf;
+		ctl.maxlen = sizeof(cbuf);
+		flags = 0;
+		if ((rc = getmsg(cfg->fd, &ctl, NULL, &flags)) == -1) {
+			PROM_WARN("mib2 getmsg failed: %s", strerror(errno));
+			goto fail;
+		}
+		opt = (struct opthdr *) &cbuf[ack->OPT_offset];
+		if (rc == 0 && ctl.len >= (int) sizeof(struct T_optmgmt_ack)
+			&& ack->PRIM_type == T_OPTMGMT_ACK
+			&& ack->MGMT_flags == T_SUCCESS && opt->len == 0)
+		{
+			return 0;	// end of the reply
+		}
+		if (ctl.len >= (int) sizeof(struct T_error_ack)
+			&& err->PRIM_type == T_ERROR_ACK)
+		{
+			PROM_WARN("mib2 T_ERROR_ACK: TLI_error = 0x%lx, UNIX_error = 0x%lx",
+				(unsigned long) err->TLI_error, (unsigned long) err->UNIX_error);
+			goto fail;
+		}
+		if (rc != MOREDATA || ctl.len < (int) sizeof(struct T_optmgmt_ack)
+			|| ack->PRIM_type != T_OPTMGMT_ACK || ack->MGMT_flags != T_SUCCESS)
+		{
+			PROM_WARN("mib2 reply is invalid (rc = %d)", rc);
+			goto fail;
+		}
+		if (read_item(cfg, opt, &esz4, &esz6) == -1) {
+			PROM_WARN("mib2 getmsg failed: %s", strerror(errno));
+			goto fail;
+		}
+	}
+
+fail:
+	// the stream is in an unknown state now - start from scratch next time
+	close(cfg->fd);
+	cfg->fd = -1;
+	return -1;
+}
+
+void
+collect_tcpconn(psb_t *sb, bool compact, hrtime_t now, void *config) {
+	tcpconn_cfg_t *cfg = config;
+	uint32_t s, p;
+	char buf[64];
+
+	if (cfg == NULL)
+		return;
+
+	PROM_DEBUG("collect_tcpconn ...", "");
+	if (cfg->last == 0 || (now - cfg->last) >= ((hrtime_t) cfg->interval) * NANOSEC) {
+		cfg->valid = scan(cfg) == 0;
+		cfg->last = now;
+	}
+	if (!cfg->valid)
+		return;
+
+	bool free_sb = sb == NULL;
+	if (free_sb)
+		sb = psb_new();
+
+	addExpoInfo(SOLMEXM_TCP_CONNS);
+	for (s = 0; s < STATE_MAX; s++) {
+		for (p = 0; p <= cfg->nports; p++) {
+			if (COUNT(cfg, s, p) == 0)
+				continue;
+			if (cfg->nports == 0)
+				sprintf(buf, "{state=\"%s\"}", states[s]);
+			else if (p == 0)
+				sprintf(buf, "{state=\"%s\",port=\"other\"}", states[s]);
+			else
+				sprintf(buf, "{state=\"%s\",port=\"%u\"}", states[s],
+					cfg->ports[p - 1]);
+			expo_emit_uint(sb, SOLMEXM_TCP_CONNS_N, buf, COUNT(cfg, s, p));
+		}
+	}
+
+	if (free_sb) {
+		fprintf(stdout, "\n%s", psb_str(sb));
+		psb_destroy(sb);
+	}
+	PROM_DEBUG("collect_tcpconn done", "");
+}
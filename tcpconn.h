@@ -0,0 +1,61 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file tcpconn.h
+ * TCP connection state summary via the mib2 tables of /dev/arp.
+ */
+#ifndef SOLMEX_TCPCONN_H
+#define SOLMEX_TCPCONN_H
+
+#include <sys/time.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default number of seconds between two scans of the connection tables. */
+#define TCPCONN_INTERVAL_DEFAULT 60
+/** Max. number of ports to account separately. */
+#define TCPCONN_PORTS_MAX 254
+
+/**
+ * @brief Parse the given TCP connection option string of the form
+ * 	`port[,...][:secs]`. The special port `all` just summarizes by state,
+ * 	`none` disables the collector.
+ * @param s	The string to parse.
+ * @param valid Gets set to @code 1 if the given string could be parsed
+ * 	successfully, to @code 0 otherwise.
+ * @return A reference to the config to be used in the collect_tcpconn() call,
+ * 	`NULL` if disabled or on error.
+ */
+void *parse_tcpconn_opts(const char *s, int *valid);
+
+/**
+ * @brief Emit the number of IPv4 and IPv6 TCP endpoints by state and local
+ * 	port. The connection tables get read every `secs` seconds, only, in
+ * 	between the result of the last scan gets emitted. The tables are
+ * 	streamed through a small fixed size buffer, so memory usage does not
+ * 	depend on the number of connections.
+ * @param sb    where to add the stats.
+ * @param compact   whether to add HELP and TYPE comments
+ * @param now   The current time as delivered by gethrtime().
+ * @param cfg	The reference returned by parse_tcpconn_opts().
+ */
+void collect_tcpconn(psb_t *sb, bool compact, hrtime_t now, void *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_TCPCONN_H
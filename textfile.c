@@ -0,0 +1,706 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libprom/prom.h>
+
+#include "textfile.h"
+
+typedef struct tf_out_cfg {
+	char *path;
+	char *tmp;				// path.tmp
+	uint32_t interval;		// in seconds
+	expo_format_t fmt;
+	expo_render_fn render;
+} tf_out_cfg_t;
+
+void *
+parse_tf_out_opts(const char *s, int *valid) {
+	tf_out_cfg_t *cfg;
+	char *t, *p;
+	unsigned int n;
+
+	*valid = 0;
+	if (s == NULL)
+		return NULL;
+	if (strcmp(s, "none") == 0 || strcmp(s, "n") == 0 || strcmp(s, "0") == 0) {
+		*valid = 1;
+		return NULL;
+	}
+	if ((cfg = calloc(1, sizeof(tf_out_cfg_t))) == NULL
+		|| (cfg->path = strdup(s)) == NULL)
+	{
+		perror("textfile");
+		free(cfg);
+		return NULL;
+	}
+	cfg->interval = TF_INTERVAL_DEFAULT;
+	cfg->fmt = EXPO_FMT_TEXT;
+	if ((t = strrchr(cfg->path, '@')) != NULL) {
+		*t++ = '\0';
+		if ((p = strchr(t, ',')) != NULL) {
+			*p++ = '\0';
+			if (!expo_format_parse(p, &(cfg->fmt))) {
+				fprintf(stderr, "Invalid output format in '%s'.\n", s);
+				goto fail;
+			}
+		}
+		if (sscanf(t, "%u", &n) != 1 || n < 1 || n > 86400) {
+			fprintf(stderr, "Invalid write interval in '%s' (1..86400).\n", s);
+			goto fail;
+		}
+		cfg->interval = n;
+	}
+	if (cfg->path[0] != '/') {
+		fprintf(stderr, "Textfile '%s' is not an absolute path.\n", cfg->path);
+		goto fail;
+	}
+	if ((cfg->tmp = malloc(strlen(cfg->path) + 5)) == NULL) {
+		perror("textfile");
+		goto fail;
+	}
+	sprintf(cfg->tmp, "%s.tmp", cfg->path);
+	*valid = 1;
+	return cfg;
+
+fail:
+	free(cfg->path);
+	free(cfg);
+	return NULL;
+}
+
+static int
+writeFile(tf_out_cfg_t *cfg, const char *data, size_t len) {
+	ssize_t n;
+	int fd;
+
+	if ((fd = open(cfg->tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+		PROM_WARN("Unable to create '%s': %s", cfg->tmp, strerror(errno));
+		return 1;
+	}
+	while (len > 0) {
+		if ((n = write(fd, data, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			PROM_WARN("Unable to write '%s': %s", cfg->tmp, strerror(errno));
+			(void) close(fd);
+			(void) unlink(cfg->tmp);
+			return 1;
+		}
+		data += n;
+		len -= n;
+	}
+	// umask may have removed read permissions for other agents
+	(void) fchmod(fd, 0644);
+	if (close(fd) == -1 || rename(cfg->tmp, cfg->path) == -1) {
+		PROM_WARN("Unable to replace '%s': %s", cfg->path, strerror(errno));
+		(void) unlink(cfg->tmp);
+		return 1;
+	}
+	return 0;
+}
+
+static void *
+tf_writer(void *arg) {
+	tf_out_cfg_t *cfg = (tf_out_cfg_t *) arg;
+	struct timespec next, ts;
+	char *data;
+	size_t len;
+
+	(void) clock_gettime(CLOCK_REALTIME, &next);
+	while (1) {
+		if ((data = cfg->render(cfg->fmt, &len)) != NULL) {
+			(void) writeFile(cfg, data, len);
+			free(data);
+		}
+
+		next.tv_sec += cfg->interval;
+		(void) clock_gettime(CLOCK_REALTIME, &ts);
+		if (ts.tv_sec > next.tv_sec) {
+			next = ts;
+			continue;
+		}
+		ts.tv_sec = next.tv_sec - ts.tv_sec;
+		ts.tv_nsec = 0;
+		while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+			;
+	}
+	return NULL;
+}
+
+int
+tf_out_start(void *config, expo_render_fn fn) {
+	tf_out_cfg_t *cfg = (tf_out_cfg_t *) config;
+	pthread_attr_t attr;
+	pthread_t tid;
+	int res;
+
+	if (cfg == NULL || fn == NULL)
+		return 1;
+	cfg->render = fn;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	res = pthread_create(&tid, &attr, tf_writer, cfg);
+	pthread_attr_destroy(&attr);
+	if (res != 0) {
+		PROM_WARN("Unable to create textfile thread: %s", strerror(res));
+		return 1;
+	}
+	PROM_INFO("Writing metrics every %us to %s", cfg->interval, cfg->path);
+	return 0;
+}
+
+typedef struct tf_file {
+	char *name;				// file name relative to the directory
+	struct timespec mtime;
+	off_t size;
+	ino_t ino;
+	uint32_t gen;			// walk generation the file has been seen last
+	bool error;				// unreadable, invalid or conflicting
+	char *data;				// validated content, NULL if invalid
+	tf_names_t names;		// metric names of data
+} tf_file_t;
+
+typedef struct tf_in_cfg {
+	char *dir;
+	tf_file_t *file;		// sorted by name
+	uint32_t len;
+	uint32_t sz;
+	uint32_t gen;
+} tf_in_cfg_t;
+
+// for tf_conflict()
+static tf_in_cfg_t *tf_in = NULL;
+
+void *
+parse_tf_in_opts(const char *s, int *valid) {
+	tf_in_cfg_t *cfg;
+
+	*valid = 0;
+	if (s == NULL)
+		return NULL;
+	if (strcmp(s, "none") == 0 || strcmp(s, "n") == 0 || strcmp(s, "0") == 0) {
+		*valid = 1;
+		return NULL;
+	}
+	if (s[0] != '/') {
+		fprintf(stderr, "Textfile directory '%s' is not an absolute path.\n",
+			s);
+		return NULL;
+	}
+	if ((cfg = calloc(1, sizeof(tf_in_cfg_t))) == NULL
+		|| (cfg->dir = strdup(s)) == NULL)
+	{
+		perror("textfile");
+		free(cfg);
+		return NULL;
+	}
+	tf_in = cfg;
+	*valid = 1;
+	return cfg;
+}
+
+static bool
+isNameChar(char c, bool first, bool colon) {
+	return isalpha((unsigned char) c) || c == '_' || (colon && c == ':')
+		|| (!first && isdigit((unsigned char) c));
+}
+
+// Skip the metric or label name at s, return NULL if there is none.
+static const char *
+skipName(const char *s, const char *end, bool colon) {
+	const char *p = s;
+
+	while (p < end && isNameChar(*p, p == s, colon))
+		p++;
+	return p == s ? NULL : p;
+}
+
+// Append the given name with the given suffix unless it is the last one
+// added.
+static bool
+addName(tf_names_t *nl, const char *name, size_t n, const char *suffix) {
+	size_t k = strlen(suffix), len = n + k;
+	char *x;
+
+	if (nl->n > 0 && nl->len >= len + 1
+		&& strncmp(nl->b + nl->len - len - 1, name, n) == 0
+		&& strcmp(nl->b + nl->len - k - 1, suffix) == 0
+		&& (nl->len == len + 1 || nl->b[nl->len - len - 2] == '\0'))
+	{
+		return true;
+	}
+	if (nl->len + len + 1 > nl->sz) {
+		size_t sz = nl->sz == 0 ? 256 : nl->sz;
+		while (sz < nl->len + len + 1)
+			sz <<= 1;
+		if ((x = realloc(nl->b, sz)) == NULL)
+			return false;
+		nl->b = x;
+		nl->sz = sz;
+	}
+	memcpy(nl->b + nl->len, name, n);
+	memcpy(nl->b + nl->len + n, suffix, k + 1);
+	nl->len += len + 1;
+	nl->n++;
+	return true;
+}
+
+// The family the following samples belong to.
+typedef struct tf_family {
+	const char *name;
+	size_t len;
+	bool grouped;			// summary or histogram
+} tf_family_t;
+
+// Whether the given sample name is name, name_sum, name_count or name_bucket
+// of the given family.
+static bool
+inFamily(const tf_family_t *fam, const char *name, size_t n) {
+	const char *x = name + fam->len;
+
+	if (n < fam->len || strncmp(name, fam->name, fam->len) != 0)
+		return false;
+	n -= fam->len;
+	return n == 0 || (n == 4 && strncmp(x, "_sum", 4) == 0)
+		|| (n == 6 && strncmp(x, "_count", 6) == 0)
+		|| (n == 7 && strncmp(x, "_bucket", 7) == 0);
+}
+
+// Record the family name of a validated line. A summary or histogram claims
+// the names of its _sum, _count and _bucket series as well, so that they
+// collide with the same names provided as gauge or counter elsewhere.
+static const char *
+recordName(tf_names_t *nl, tf_family_t *fam, bool comment, int type,
+	const char *name, size_t n)
+{
+	bool ok = true;
+
+	if (comment) {
+		if (fam->name == NULL || fam->len != n
+			|| strncmp(fam->name, name, n) != 0)
+		{
+			fam->name = name;
+			fam->len = n;
+			fam->grouped = false;
+			ok = addName(nl, name, n, "");
+		}
+		if (ok && !fam->grouped && (type == 2 || type == 3)) {
+			fam->grouped = true;
+			ok = addName(nl, name, n, "_sum") && addName(nl, name, n, "_count")
+				&& (type == 2 || addName(nl, name, n, "_bucket"));
+		}
+	} else if (!fam->grouped || !inFamily(fam, name, n)) {
+		ok = addName(nl, name, n, "");
+	}
+	return ok ? NULL : strerror(errno);
+}
+
+// Validate a single line and record its metric family name. Returns an error
+// message, NULL if ok.
+static const char *
+checkLine(tf_names_t *nl, tf_family_t *fam, const char *s, const char *end) {
+	static const char *types[] = {
+		"counter", "gauge", "summary", "histogram", "untyped", NULL
+	};
+	const char *p, *name;
+	char buf[64];
+	char *ep;
+	size_t n;
+	int i = -1;
+
+	if (s == end)
+		return NULL;
+	if (*s == '#') {
+		bool help = end - s > 7 && strncmp(s, "# HELP ", 7) == 0;
+		if (!help && !(end - s > 7 && strncmp(s, "# TYPE ", 7) == 0))
+			return NULL;	// just a comment
+		name = s + 7;
+		if ((p = skipName(name, end, true)) == NULL
+			|| (p < end && *p != ' '))
+		{
+			return "invalid metric name";
+		}
+		if (!help) {
+			n = end - p - 1;
+			for (i = 0; types[i] != NULL; i++)
+				if (p < end && strlen(types[i]) == n
+					&& strncmp(p + 1, types[i], n) == 0)
+				{
+					break;
+				}
+			if (types[i] == NULL)
+				return "invalid metric type";
+		}
+	} else {
+		name = s;
+		if ((p = skipName(name, end, true)) == NULL)
+			return "invalid metric name";
+		if (p < end && *p == '{') {
+			for (p++; p < end && *p != '}'; ) {
+				if ((p = skipName(p, end, false)) == NULL || p + 1 >= end
+					|| p[0] != '=' || p[1] != '"')
+				{
+					return "invalid label";
+				}
+				for (p += 2; p < end && *p != '"'; p++) {
+					if (*p == '\\' && ++p == end)
+						break;
+				}
+				if (p == end)
+					return "unterminated label value";
+				if (++p < end && *p == ',')
+					p++;
+			}
+			if (p == end)
+				return "unterminated label set";
+			p++;
+		}
+		if (p == end || *p != ' ')
+			return "missing value";
+		while (p < end && *p == ' ')
+			p++;
+		n = end - p;
+		while (n > 0 && p[n - 1] == ' ')
+			n--;
+		if (n == 0 || n >= sizeof(buf))
+			return "invalid value";
+		if (memchr(p, ' ', n) != NULL)
+			return "timestamps are not supported";
+		memcpy(buf, p, n);
+		buf[n] = '\0';
+		if (strcmp(buf, "NaN") != 0 && strcmp(buf, "+Inf") != 0
+			&& strcmp(buf, "-Inf") != 0)
+		{
+			errno = 0;
+			(void) strtod(buf, &ep);
+			if (*ep != '\0' || ep == buf || errno == ERANGE)
+				return "invalid value";
+		}
+		p = skipName(name, end, true);
+	}
+	n = p - name;
+	if (n >= 7 && strncmp(name, "solmex_", 7) == 0)
+		return "solmex_* metrics are reserved";
+	return nl == NULL ? NULL : recordName(nl, fam, *s == '#', i, name, n);
+}
+
+const char *
+tf_validate(const char *s, size_t len, tf_names_t *names, size_t *line) {
+	const char *end = s + len, *eol, *msg = NULL;
+	tf_family_t fam = { NULL, 0, false };
+
+	*line = 0;
+	if (len > 0 && memchr(s, '\0', len) != NULL)
+		return "contains NUL bytes";
+	for (; msg == NULL && s < end; s = eol + 1) {
+		(*line)++;
+		if ((eol = memchr(s, '\n', end - s)) == NULL)
+			eol = end;
+		msg = checkLine(names, &fam, s, eol);
+	}
+	return msg;
+}
+
+static void
+dropData(tf_file_t *f) {
+	free(f->data);
+	free(f->names.b);
+	f->data = NULL;
+	memset(&(f->names), 0, sizeof(tf_names_t));
+}
+
+// mmap() the given file, validate it and keep a copy of its content.
+static void
+loadFile(tf_file_t *f, const char *path) {
+	const char *msg;
+	struct stat st;
+	void *m = MAP_FAILED;
+	size_t len, line;
+	int fd;
+
+	dropData(f);
+	f->error = true;
+	if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+		PROM_WARN("Unable to open '%s': %s", path, strerror(errno));
+		goto end;
+	}
+	// the file might have been replaced since stat()
+	f->mtime = st.st_mtim;
+	f->size = st.st_size;
+	f->ino = st.st_ino;
+	if (st.st_size > TF_FILE_MAX) {
+		PROM_WARN("'%s' exceeds %d bytes - ignored.", path, TF_FILE_MAX);
+		goto end;
+	}
+	if (st.st_size > 0 && (m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+		fd, 0)) == MAP_FAILED)
+	{
+		PROM_WARN("Unable to mmap '%s': %s", path, strerror(errno));
+		goto end;
+	}
+	msg = tf_validate(st.st_size > 0 ? m : "", st.st_size, &(f->names),
+		&line);
+	if (msg != NULL) {
+		PROM_WARN("%s:%lu: %s - file ignored.", path, (unsigned long) line,
+			msg);
+		goto end;
+	}
+	if ((f->data = malloc(st.st_size + 2)) == NULL) {
+		PROM_WARN("Unable to allocate textfile buffer: %s", strerror(errno));
+		goto end;
+	}
+	len = st.st_size;
+	if (len > 0)
+		memcpy(f->data, m, len);
+	if (len > 0 && f->data[len - 1] != '\n')
+		f->data[len++] = '\n';
+	f->data[len] = '\0';
+	f->error = false;
+
+end:
+	if (m != MAP_FAILED)
+		(void) munmap(m, st.st_size);
+	if (fd != -1)
+		(void) close(fd);
+	if (f->error)
+		dropData(f);
+}
+
+const char *
+tf_names_common(const tf_names_t *x, const tf_names_t *y) {
+	const char *a, *b;
+	size_t i, j;
+
+	for (i = 0, a = x->b; i < x->n; i++, a += strlen(a) + 1)
+		for (j = 0, b = y->b; j < y->n; j++, b += strlen(b) + 1)
+			if (strcmp(a, b) == 0)
+				return a;
+	return NULL;
+}
+
+// Whether one of the names of f has already been provided by a valid file
+// sorted before.
+static bool
+conflicts(tf_in_cfg_t *cfg, uint32_t k) {
+	const tf_file_t *f = &(cfg->file[k]), *o;
+	const char *a;
+	uint32_t n;
+
+	for (n = 0; n < k; n++) {
+		o = &(cfg->file[n]);
+		if (o->error || o->data == NULL)
+			continue;
+		if ((a = tf_names_common(&(f->names), &(o->names))) != NULL) {
+			PROM_WARN("%s/%s: metric '%s' already provided by '%s' - "
+				"file ignored.", cfg->dir, f->name, a, o->name);
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *
+tf_conflict(const tf_names_t *names, const char **owner) {
+	const tf_file_t *f;
+	const char *a;
+	uint32_t i;
+
+	for (i = 0; tf_in != NULL && i < tf_in->len; i++) {
+		f = &(tf_in->file[i]);
+		if (f->error || f->data == NULL)
+			continue;
+		if ((a = tf_names_common(names, &(f->names))) != NULL) {
+			*owner = f->name;
+			return a;
+		}
+	}
+	return NULL;
+}
+
+static tf_file_t *
+getFile(tf_in_cfg_t *cfg, const char *name) {
+	tf_file_t *f;
+	uint32_t i;
+	int c = 1;
+
+	for (i = 0; i < cfg->len && (c = strcmp(cfg->file[i].name, name)) < 0; i++)
+		;
+	if (i < cfg->len && c == 0)
+		return &(cfg->file[i]);
+	if (cfg->len == cfg->sz) {
+		uint32_t sz = cfg->sz + 16;
+		if ((f = realloc(cfg->file, sz * sizeof(tf_file_t))) == NULL)
+			return NULL;
+		cfg->file = f;
+		cfg->sz = sz;
+	}
+	memmove(&(cfg->file[i + 1]), &(cfg->file[i]),
+		(cfg->len - i) * sizeof(tf_file_t));
+	f = &(cfg->file[i]);
+	memset(f, 0, sizeof(tf_file_t));
+	if ((f->name = strdup(name)) == NULL)
+		return NULL;
+	f->size = -1;
+	cfg->len++;
+	return f;
+}
+
+// Re-scan the directory. Returns true if a file appeared, vanished or changed.
+static bool
+scanDir(tf_in_cfg_t *cfg) {
+	char path[PATH_MAX];
+	struct dirent *de;
+	struct stat st;
+	tf_file_t *f;
+	DIR *d;
+	size_t n;
+	uint32_t i, k;
+	bool changed = false;
+
+	if ((d = opendir(cfg->dir)) == NULL) {
+		PROM_WARN("Unable to open '%s': %s", cfg->dir, strerror(errno));
+		return false;
+	}
+	cfg->gen++;
+	while ((de = readdir(d)) != NULL) {
+		n = strlen(de->d_name);
+		if (n < 6 || de->d_name[0] == '.'
+			|| strcmp(de->d_name + n - 5, ".prom") != 0)
+		{
+			continue;
+		}
+		if (snprintf(path, sizeof(path), "%s/%s", cfg->dir, de->d_name)
+				>= (int) sizeof(path)
+			|| stat(path, &st) == -1 || !S_ISREG(st.st_mode))
+		{
+			continue;
+		}
+		if ((f = getFile(cfg, de->d_name)) == NULL) {
+			PROM_WARN("Unable to allocate textfile entry: %s", strerror(errno));
+			break;
+		}
+		f->gen = cfg->gen;
+		if (f->size == st.st_size && f->ino == st.st_ino
+			&& f->mtime.tv_sec == st.st_mtim.tv_sec
+			&& f->mtime.tv_nsec == st.st_mtim.tv_nsec)
+		{
+			continue;
+		}
+		// even if it cannot be loaded, try again on changes, only
+		f->mtime = st.st_mtim;
+		f->size = st.st_size;
+		f->ino = st.st_ino;
+		loadFile(f, path);
+		changed = true;
+	}
+	(void) closedir(d);
+	// drop vanished files
+	for (i = k = 0; i < cfg->len; i++) {
+		if (cfg->file[i].gen != cfg->gen) {
+			dropData(&(cfg->file[i]));
+			free(cfg->file[i].name);
+			changed = true;
+			continue;
+		}
+		if (i != k)
+			cfg->file[k] = cfg->file[i];
+		k++;
+	}
+	cfg->len = k;
+	return changed;
+}
+
+// Set lb to the labels of the given file.
+static const char *
+fileLabel(psb_t *lb, const char *name) {
+	psb_truncate(lb, 0);
+	psb_add_str(lb, "{file=\"");
+	addLabelValue(lb, name);
+	psb_add_str(lb, "\"}");
+	return psb_str(lb);
+}
+
+void
+collect_textfiles(psb_t *sb, bool compact, void *config) {
+	tf_in_cfg_t *cfg = (tf_in_cfg_t *) config;
+	struct timespec now;
+	tf_file_t *f;
+	uint32_t i;
+	char buf[64];
+	psb_t *lb;
+	double age;
+
+	if (cfg == NULL)
+		return;
+
+	PROM_DEBUG("collect_textfiles ...", "");
+	if (scanDir(cfg)) {
+		// conflicts depend on the set of files, so re-check all on changes
+		for (i = 0; i < cfg->len; i++) {
+			f = &(cfg->file[i]);
+			if (f->data != NULL)
+				f->error = conflicts(cfg, i);
+		}
+	}
+	if (cfg->len == 0)
+		return;
+
+	bool free_sb = sb == NULL;
+	if (free_sb)
+		sb = psb_new();
+
+	for (i = 0; i < cfg->len; i++) {
+		f = &(cfg->file[i]);
+		if (f->error || f->data == NULL || f->data[0] == '\0')
+			continue;
+		if (expo_target == NULL)
+			psb_add_char(sb, '\n');
+		expo_emit_text(sb, f->data);
+	}
+	if ((lb = psb_new()) != NULL) {
+		addExpoInfo(SOLMEXM_TEXTFILE_ERROR);
+		for (i = 0; i < cfg->len; i++) {
+			f = &(cfg->file[i]);
+			expo_emit_uint(sb, SOLMEXM_TEXTFILE_ERROR_N, fileLabel(lb, f->name),
+				f->error ? 1 : 0);
+		}
+		(void) clock_gettime(CLOCK_REALTIME, &now);
+		addExpoInfo(SOLMEXM_TEXTFILE_AGE);
+		for (i = 0; i < cfg->len; i++) {
+			f = &(cfg->file[i]);
+			age = (now.tv_sec - f->mtime.tv_sec)
+				+ (now.tv_nsec - f->mtime.tv_nsec) / 1e9;
+			sprintf(buf, "%.3f", age);
+			expo_emit(sb, SOLMEXM_TEXTFILE_AGE_N, fileLabel(lb, f->name), buf,
+				age);
+		}
+		psb_destroy(lb);
+	}
+
+	if (free_sb) {
+		fprintf(stdout, "\n%s", psb_str(sb));
+		psb_destroy(sb);
+	}
+	PROM_DEBUG("collect_textfiles done", "");
+}
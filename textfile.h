@@ -0,0 +1,120 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file textfile.h
+ * Write the collected metrics periodically to a file, and merge the metrics
+ * of *.prom files of a directory into the own ones.
+ */
+#ifndef SOLMEX_TEXTFILE_H
+#define SOLMEX_TEXTFILE_H
+
+#include "expo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default interval in seconds for writing the metrics file. */
+#define TF_INTERVAL_DEFAULT 15
+
+/**
+ * @brief Parse the given textfile output option string of the form
+ * 	`/path[@secs[,format]]`. `secs` is the write interval, `format` the name
+ * 	of the output format as accepted by expo_format_parse().
+ * @param s	The string to parse.
+ * @param valid Gets set to @code 1 if the given string could be parsed
+ * 	successfully, to @code 0 otherwise.
+ * @return A reference to the config to be used in the tf_out_start() call,
+ * 	`NULL` if disabled or on error.
+ */
+void *parse_tf_out_opts(const char *s, int *valid);
+
+/**
+ * @brief Start the background thread, which collects all metrics every
+ * 	interval via the given function and replaces the configured file with the
+ * 	result. The data get written to a temporary file in the same directory
+ * 	first and renamed afterwards, so readers never see a partial file.
+ * @param cfg	The reference returned by parse_tf_out_opts().
+ * @param fn	The function to use to collect and render the metrics.
+ * @return `0` on success, `1` otherwise.
+ */
+int tf_out_start(void *cfg, expo_render_fn fn);
+
+/** A list of metric names. */
+typedef struct tf_names {
+	char *b;				/**< `\0` separated names */
+	size_t len;
+	size_t sz;
+	size_t n;				/**< number of names in b */
+} tf_names_t;
+
+/**
+ * @brief Check whether the given text is in the Prometheus text format and
+ * 	has neither timestamps nor `solmex_*` metrics.
+ * @param s	The text to check.
+ * @param len	The length of the text in bytes.
+ * @param names	Where to add the metric family names found, might be `NULL`.
+ * 	A summary or histogram `x` adds `x_sum`, `x_count` and `x_bucket`
+ * 	(histogram only) as well, its samples add no further names.
+ * @param line	Where to store the number of the last line checked.
+ * @return `NULL` if valid, a message describing the problem otherwise.
+ */
+const char *tf_validate(const char *s, size_t len, tf_names_t *names,
+	size_t *line);
+
+/**
+ * @brief Find a name contained in both of the given lists.
+ * @return The first common name, `NULL` if there is none.
+ */
+const char *tf_names_common(const tf_names_t *a, const tf_names_t *b);
+
+/**
+ * @brief Check whether one of the given metric family names is provided by a
+ * 	textfile merged by collect_textfiles(). Must be called by the scraping
+ * 	thread after collect_textfiles().
+ * @param names	The names to check as recorded by tf_validate().
+ * @param owner	Where to store the name of the providing file.
+ * @return The first conflicting name, `NULL` if there is none.
+ */
+const char *tf_conflict(const tf_names_t *names, const char **owner);
+
+/** Max. size of a textfile to merge. */
+#define TF_FILE_MAX (16 * 1024 * 1024)
+
+/**
+ * @brief Parse the given textfile directory option string.
+ * @param s	The absolute path of the directory to read `*.prom` files from.
+ * @param valid Gets set to @code 1 if the given string could be parsed
+ * 	successfully, to @code 0 otherwise.
+ * @return A reference to the config to be used in the collect_textfiles()
+ * 	call, `NULL` if disabled or on error.
+ */
+void *parse_tf_in_opts(const char *s, int *valid);
+
+/**
+ * @brief Add the metrics of all valid `*.prom` files of the configured
+ * 	directory in the order of their names, and an error and age metric for
+ * 	each file. A file gets mmap()ed and validated only if its mtime, size or
+ * 	inode changed since the last call, otherwise its cached content gets
+ * 	used. Files with timestamps, `solmex_*` metrics or metric families
+ * 	already provided by a preceding file get rejected.
+ * @param sb	where to add the stats.
+ * @param compact	whether to add HELP and TYPE comments
+ * @param cfg	The reference returned by parse_tf_in_opts().
+ */
+void collect_textfiles(psb_t *sb, bool compact, void *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_TEXTFILE_H
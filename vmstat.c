@@ -18,6 +18,8 @@
 #include <libprom/prom.h>
 
 #include "ks_util.h"
+#include "cpu_topo.h"
+#include "expo.h"
 #include "vmstat.h"
 
 typedef enum ks_info_idx {
@@ -111,22 +113,30 @@ static uint32_t xstats_sz = ARRAY_SIZE(xstats);
 static vm_idx_t astats[VM_IDX_MAX];
 static uint32_t astats_sz = VM_IDX_MAX;
 
-static uint16_t strand_count_last = 0;
-
 void
 collect_vmstat(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
-	bool mp, vm_stat_quantity_t stype)
+	bool mp, vm_stat_quantity_t stype, uint8_t agg)
 {
+	// Values are stored column-major: vals[k * rows + row], with rows 0..n-1
+	// for the strands, row n for the sum and the topology groups thereafter.
+	// So sums and rollups are contiguous loops over a single column.
+	static uint32_t rows_last = 0;
+	static uint16_t n_last = 0;
 	static uint64_t *vals = NULL;
 	static int *seen = NULL;
+	static kstat_t **ksps = NULL;	// per strand, NULL if n/a
+	static int32_t *gmap = NULL;	// [level * n + strand] -> row or -1
 	vm_idx_t *what;
 
-	kstat_t *ksp;
 	kstat_named_t *knp;
 	char buf[64];
 	int i, k;
-	uint64_t idx,sidx;
-	uint32_t what_sz, l;
+	uint32_t rows, what_sz, l;
+	uint64_t *col, sum;
+	int32_t *m;
+	uint16_t g;
+	uint8_t gl;
+	const cpu_topo_t *topo;
 	vm_stat_quantity_t tmp_type;
 
 	bool free_sb = sb == NULL;
@@ -135,36 +145,48 @@ collect_vmstat(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
 	if (stype == VMSTAT_NONE)
 		return;
 
-	uint16_t n = update_instance(kc, &kstat[KS_IDX_CPU_VM]);
-	if (n == 0)
+	// -1 on error: must not wrap around and look like a huge box
+	int n = update_instance(kc, &kstat[KS_IDX_CPU_VM]);
+	if (n < 1)
 		return;
 
-	if (n > system_cpu_max) {
+	if (n > system_cpu_max + 1) {
 		PROM_WARN("Possibly tinkered system (%d strands) - ignored", n);
 		return;
 	}
 
 	if (mp && n == 1)
 		mp = false;
-	if (n > strand_count_last) {
-		uint64_t *v = realloc(vals, (n + 1) * sizeof(uint64_t) * VM_IDX_MAX);
-		int *s = realloc(seen, (n + 1) * sizeof(int));
+	topo = cpu_topo_get(kc, now, agg);
+	rows = n + 1 + (topo == NULL ? 0 : topo->ngrp);
+	if (rows > rows_last) {
+		uint64_t *v = realloc(vals, rows * sizeof(uint64_t) * VM_IDX_MAX);
+		int *s = realloc(seen, rows * sizeof(int));
+		if (v != NULL)
+			vals = v;
+		if (s != NULL)
+			seen = s;
 		if (v == NULL || s == NULL) {
 			PROM_WARN("Memory problem in vmstats: %s", strerror(errno));
-			free(v);
-			free(s);
 			return;
 		}
-		vals = v;
-		seen = s;
-		memset(vals + strand_count_last * VM_IDX_MAX, 0,
-			(n + 1 - strand_count_last) * sizeof(uint64_t) * VM_IDX_MAX);
-	} else {
-		memset(vals + n * VM_IDX_MAX, 0, VM_IDX_MAX * sizeof(uint64_t)); // reset sum
-		memset(seen, 0, n * sizeof(int));
+		rows_last = rows;
 	}
-	strand_count_last = n;
-	seen[n] = n;
+	if (n > n_last) {
+		kstat_t **p = realloc(ksps, n * sizeof(kstat_t *));
+		int32_t *gm = realloc(gmap, n * CPUAGG_LVL_MAX * sizeof(int32_t));
+		if (p != NULL)
+			ksps = p;
+		if (gm != NULL)
+			gmap = gm;
+		if (p == NULL || gm == NULL) {
+			PROM_WARN("Memory problem in vmstats: %s", strerror(errno));
+			return;
+		}
+		n_last = n;
+	}
+	memset(seen, 0, rows * sizeof(int));
+	seen[n] = n;	// the sum row is always valid
 	// too lazy to init it manually ;-)
 	if (stype == VMSTAT_ALL && astats[1] == 0) {
 		for (k = 0; k < VM_IDX_MAX; k++)
@@ -174,39 +196,65 @@ collect_vmstat(psb_t *sb, bool compact, kstat_ctl_t *kc, hrtime_t now,
 	if (free_sb)
 		sb = psb_new();
 
-	// get stats for each strand
-	sidx = n * VM_IDX_MAX;
-	for (i = idx = 0; i < n; i++, idx += VM_IDX_MAX) {
-		if ((ksp = ks_read(kc, kstat[KS_IDX_CPU_VM].ksp[i], now, NULL)) == NULL)
+	// read each strand and map it to its topology groups
+	for (i = 0; i < n; i++) {
+		ksps[i] = ks_read(kc, kstat[KS_IDX_CPU_VM].ksp[i], now, NULL);
+		for (gl = 0; gl < CPUAGG_LVL_MAX; gl++)
+			gmap[gl * n + i] = -1;
+		if (ksps[i] == NULL)
+			continue;
+		seen[i] = ksps[i]->ks_instance + 1;	// instance start with 0 ;-)
+		if (topo == NULL || ksps[i]->ks_instance >= topo->ncpu)
 			continue;
-		seen[i] = ksp->ks_instance + 1;	// instance start with 0 ;-)
-		tmp_type = stype;
-		if (stype == VMSTAT_ALL) {
-			what = astats;
-			what_sz = astats_sz;
-		} else {
-			what = nstats;
-			what_sz = nstats_sz;
+		for (gl = 0; gl < CPUAGG_LVL_MAX; gl++) {
+			int16_t gi = topo->grp[ksps[i]->ks_instance * CPUAGG_LVL_MAX + gl];
+			if (gi < 0)
+				continue;
+			seen[n + 1 + gi] = 1;
+			gmap[gl * n + i] = n + 1 + gi;
 		}
+	}
+
+	// fill one column per stat and derive sum and groups from it
+	tmp_type = stype;
+	if (stype == VMSTAT_ALL) {
+		what = astats;
+		what_sz = astats_sz;
+	} else {
+		what = nstats;
+		what_sz = nstats_sz;
+	}
 getx:
+	for (l = 0; l < what_sz; l++) {
+		k = what[l];
+		col = vals + k * rows;
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
-		for (l = 0; l < what_sz; l++) {
-			k = what[l];
-			if ((knp = kstat_data_lookup(ksp, knames[k])) != NULL) {
-				vals[sidx + k] += knp->value.ui64;
-				if (mp)
-					vals[idx + k] = knp->value.ui64;
-			}
+		for (i = 0; i < n; i++) {
+			col[i] = (ksps[i] != NULL
+				&& (knp = kstat_data_lookup(ksps[i], knames[k])) != NULL)
+				? knp->value.ui64
+				: 0;
 		}
 #pragma GCC diagnostic pop
-		if (tmp_type == VMSTAT_EXTENDED) {
-			what = xstats;
-			what_sz = xstats_sz;
-			tmp_type = VMSTAT_NONE;
-			goto getx;
+		for (i = 0, sum = 0; i < n; i++)
+			sum += col[i];
+		col[n] = sum;
+		if (topo == NULL)
+			continue;
+		memset(col + n + 1, 0, topo->ngrp * sizeof(uint64_t));
+		for (gl = 0, m = gmap; gl < CPUAGG_LVL_MAX; gl++, m += n) {
+			for (i = 0; i < n; i++)
+				if (m[i] >= 0)
+					col[m[i]] += col[i];
 		}
 	}
+	if (tmp_type == VMSTAT_EXTENDED) {
+		what = xstats;
+		what_sz = xstats_sz;
+		tmp_type = VMSTAT_NONE;
+		goto getx;
+	}
 
 	//print stats for each strand or just the summary
 	tmp_type = stype;
@@ -220,21 +268,24 @@ getx:
 valx:
 	for (l = 0; l < what_sz; l++) {
 		k = what[l];
-		if (!compact)
-			addPromInfo4("", snames[k], "counter", sdesc[k]);
-		idx = 0;
-		for (i = mp ? 0 : n; i <= n; i++, idx += VM_IDX_MAX) {
+		col = vals + k * rows;
+		expo_emit_info(sb, compact, snames[k], "counter", sdesc[k]);
+		for (i = mp ? 0 : n; i <= n; i++) {
 			if (!seen[i])
 				continue;
-			psb_add_str(sb, snames[k]);
 			if (i == n) {
-				sprintf(buf, "{cpu=\"sum\"} %ld\n", vals[sidx + k]);
-				psb_add_str(sb, buf);
+				ks_emit_times(NULL);	// sums and groups: all strands
+				expo_emit_uint(sb, snames[k], "{cpu=\"sum\"}", col[n]);
 			} else if (mp) {
-				sprintf(buf, "{cpu=\"%d\"} %ld\n", seen[i] - 1, vals[idx + k]);
-				psb_add_str(sb, buf);
+				ks_emit_times(ksps[i]);
+				sprintf(buf, "{cpu=\"%d\"}", seen[i] - 1);
+				expo_emit_uint(sb, snames[k], buf, col[i]);
 			}
 		}
+		for (g = 0; topo != NULL && g < topo->ngrp; g++) {
+			if (seen[n + 1 + g])
+				expo_emit_uint(sb, snames[k], topo->label[g], col[n + 1 + g]);
+		}
 	}
 	if (tmp_type == VMSTAT_EXTENDED) {
 		what = xstats;
@@ -0,0 +1,176 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zone.h>
+
+#include "zones.h"
+
+// Interned strings: never freed, so references may be kept forever. The number
+// of distinct zone names and labels is small, so a fixed hash table is fine.
+#define INTERN_HASH_SZ 64
+
+typedef struct istr {
+	struct istr *next;
+	char s[];
+} istr_t;
+
+static istr_t *ihash[INTERN_HASH_SZ];
+
+typedef struct zone_entry {
+	zoneid_t zid;
+	const char *name;
+} zone_entry_t;
+
+static struct {
+	uint32_t gen;			/**< registry generation, incremented on change */
+	kid_t kid;				/**< kstat chain ID of the last check */
+	zoneid_t *zids;			/**< zone IDs as returned by zone_list(2) */
+	uint_t len;				/**< number of zone IDs and entries */
+	zone_entry_t *entry;	/**< sorted by zone ID */
+} reg = { 0, -1, NULL, 0, NULL };
+
+const char *
+str_intern(const char *s) {
+	uint32_t h = 2166136261U;
+	const unsigned char *c;
+	istr_t *e;
+	size_t len;
+
+	if (s == NULL)
+		return NULL;
+	for (c = (const unsigned char *) s; *c; c++)
+		h = (h ^ *c) * 16777619U;
+	h %= INTERN_HASH_SZ;
+	for (e = ihash[h]; e != NULL; e = e->next)
+		if (strcmp(e->s, s) == 0)
+			return e->s;
+
+	len = strlen(s) + 1;
+	if ((e = malloc(sizeof(istr_t) + len)) == NULL) {
+		PROM_WARN("Unable to intern '%s': %s", s, strerror(errno));
+		return NULL;
+	}
+	memcpy(e->s, s, len);
+	e->next = ihash[h];
+	ihash[h] = e;
+	return e->s;
+}
+
+static int
+cmpZid(const void *a, const void *b) {
+	zoneid_t x = ((const zone_entry_t *) a)->zid;
+	zoneid_t y = ((const zone_entry_t *) b)->zid;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static zone_entry_t *
+findEntry(zoneid_t zid) {
+	zone_entry_t key = { zid, NULL };
+
+	if (reg.len == 0)
+		return NULL;
+	return bsearch(&key, reg.entry, reg.len, sizeof(zone_entry_t), cmpZid);
+}
+
+static const char *
+lookupName(zoneid_t zid) {
+	char zname[ZONENAME_MAX];
+
+	if (getzonenamebyid(zid, zname, ZONENAME_MAX) < 0)
+		return NULL;
+	return str_intern(zname);
+}
+
+// Rebuild the entry table. Zone IDs do not get reused until they wrap around,
+// so names of already known IDs get taken over without asking the kernel.
+static void
+rebuild(zoneid_t *z, uint_t n) {
+	zone_entry_t *e, *old;
+	uint_t i;
+
+	if ((e = malloc((n + 1) * sizeof(zone_entry_t))) == NULL) {
+		PROM_WARN("Unable to allocate zone registry: %s", strerror(errno));
+		free(z);
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		e[i].zid = z[i];
+		old = findEntry(z[i]);
+		e[i].name = old != NULL ? old->name : lookupName(z[i]);
+	}
+	qsort(e, n, sizeof(zone_entry_t), cmpZid);
+	free(reg.entry);
+	free(reg.zids);
+	reg.entry = e;
+	reg.zids = z;
+	reg.len = n;
+	reg.gen++;
+	if (reg.gen == 0)
+		reg.gen++;
+}
+
+uint32_t
+zones_update(kid_t kid) {
+	zoneid_t *z;
+	uint_t n = 0, k;
+
+	if (reg.gen != 0 && kid != -1 && kid == reg.kid)
+		return reg.gen;
+	reg.kid = kid;
+
+	if (zone_list(NULL, &n) != 0)
+		return reg.gen == 0 ? ++reg.gen : reg.gen;
+	// zones may boot in between, so allow one more
+	if ((z = malloc((n + 1) * sizeof(zoneid_t))) == NULL)
+		return reg.gen == 0 ? ++reg.gen : reg.gen;
+	k = n + 1;
+	if (zone_list(z, &k) != 0 || k > n + 1) {
+		free(z);
+		return reg.gen == 0 ? ++reg.gen : reg.gen;
+	}
+	if (reg.gen != 0 && k == reg.len
+		&& memcmp(z, reg.zids, k * sizeof(zoneid_t)) == 0)
+	{
+		free(z);
+		return reg.gen;
+	}
+	rebuild(z, k);
+	return reg.gen;
+}
+
+const char *
+zone_name(zoneid_t zid) {
+	zone_entry_t *e;
+
+	if (reg.gen == 0)
+		zones_update(-1);
+	if ((e = findEntry(zid)) != NULL && e->name != NULL)
+		return e->name;
+	// not running (anymore) or not visible from this zone
+	return lookupName(zid);
+}
+
+zoneid_t
+zone_id(const char *name) {
+	uint_t i;
+
+	if (name == NULL)
+		return -1;
+	if (reg.gen == 0)
+		zones_update(-1);
+	for (i = 0; i < reg.len; i++)
+		if (reg.entry[i].name != NULL && strcmp(reg.entry[i].name, name) == 0)
+			return reg.entry[i].zid;
+	return getzoneidbyname(name);
+}
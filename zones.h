@@ -0,0 +1,69 @@
+/*
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License") 1.1!
+ * You may not use this file except in compliance with the License.
+ *
+ * See  https://spdx.org/licenses/CDDL-1.1.html  for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * Copyright 2025 Jens Elkner (jel+solmex-src@cs.ovgu.de)
+ */
+
+/**
+ * @file zones.h
+ * Process wide zone ID <-> zone name registry and string interning.
+ */
+
+#ifndef SOLMEX_ZONES_H
+#define SOLMEX_ZONES_H
+
+#include <kstat.h>
+#include <zone.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Refresh the registry if the list of running zones has changed.
+ * 	Booting or halting a zone changes the kstat chain as well, so if the
+ * 	given chain ID is the same as on the previous call, zone_list(2) does not
+ * 	get consulted at all. Collectors without a kstat chain pass `-1`, which
+ * 	always checks the zone list (one system call).
+ * @param kid	The current kstat chain ID or `-1`.
+ * @return The generation of the registry. It gets incremented on each change
+ * 	and is never `0`, so consumers may use `0` as "not yet seen".
+ */
+uint32_t zones_update(kid_t kid);
+
+/**
+ * @brief Get the name of the zone with the given ID.
+ * @param zid	The zone ID to lookup.
+ * @return `NULL` if unknown, the interned zone name otherwise. The returned
+ * 	string stays valid until the process exits and may be compared by address.
+ */
+const char *zone_name(zoneid_t zid);
+
+/**
+ * @brief Get the ID of the running zone with the given name.
+ * @param name	The zone name to lookup.
+ * @return `-1` if not found, the zone ID otherwise.
+ */
+zoneid_t zone_id(const char *name);
+
+/**
+ * @brief Get a shared, immutable copy of the given string. Equal strings
+ * 	always yield the same address.
+ * @param s	The string to intern.
+ * @return `NULL` on allocation error, the interned string otherwise. It gets
+ * 	never freed.
+ */
+const char *str_intern(const char *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOLMEX_ZONES_H